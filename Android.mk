@@ -24,14 +24,20 @@ LOCAL_SRC_FILES := \
 	CallbacksThread.cpp \
 	CameraHAL.cpp \
 	ColorConverter.cpp \
+	ColorConverterKernels.cpp \
+	ColorConverterPool.cpp \
+	ColorConvertPlanner.cpp \
         VAConvertor.cpp \
         EXIFFields.cpp \
 	JpegCompressor.cpp \
+	JpegRemuxer.cpp \
+	MjpegDecoder.cpp \
 	CameraBuffer.cpp \
 	CameraBufferAllocator.cpp \
         GraphicBufferAllocator.cpp \
 	JpegEncoder.cpp \
-        SWJpegEncoder.cpp
+        SWJpegEncoder.cpp \
+        SWJpegDecoder.cpp
 
 LOCAL_C_INCLUDES += \
 	$(call include-path-for, frameworks-base) \
@@ -140,6 +140,15 @@ void Callbacks::compressedFrameDone(CameraBuffer *buff)
     }
 }
 
+void Callbacks::compressedChunkDone(camera_memory_t *chunks, int index)
+{
+    LOG2("@%s", __FUNCTION__);
+    if ((mMessageFlags & CAMERA_MSG_COMPRESSED_IMAGE) && mDataCB != NULL) {
+        LOG2("Sending message: CAMERA_MSG_COMPRESSED_IMAGE_CHUNK, index = %d", index);
+        mDataCB(CAMERA_MSG_COMPRESSED_IMAGE_CHUNK, chunks, index, NULL, mUserToken);
+    }
+}
+
 void Callbacks::cameraError(int err)
 {
     LOG1("@%s", __FUNCTION__);
@@ -173,6 +182,18 @@ camera_memory_t* Callbacks::allocateMemory(int size)
     return mGetMemoryCB(-1, size, 1, mUserToken);
 }
 
+camera_memory_t* Callbacks::allocateMemory(int size, int count)
+{
+    LOG1("@%s: size = %d, count = %d", __FUNCTION__, size, count);
+    return mGetMemoryCB(-1, size, count, mUserToken);
+}
+
+camera_memory_t* Callbacks::shareMemory(int fd, int size)
+{
+    LOG1("@%s: fd = %d, size = %d", __FUNCTION__, fd, size);
+    return mGetMemoryCB(fd, size, 1, mUserToken);
+}
+
 void Callbacks::autofocusDone(bool status)
 {
     LOG1("@%s", __FUNCTION__);
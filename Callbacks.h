@@ -24,6 +24,28 @@
 #include "IFaceDetectionListener.h"
 namespace android {
 
+/**
+ * Vendor message streaming a JPEG to the client while it is encoded, when
+ * the intel-jpeg-chunk-size parameter is set. Every message is one buffer
+ * of the memory given with it: a CompressedChunkHeader, then 'size' bytes
+ * of the JPEG file at 'offset'. The main picture comes first, in order, the
+ * headers in front of it last, in a chunk with COMPRESSED_CHUNK_LAST. A
+ * picture that fails ends with a COMPRESSED_CHUNK_ABORTED chunk instead.
+ * CAMERA_MSG_COMPRESSED_IMAGE still brings the whole file afterwards.
+ */
+#define CAMERA_MSG_COMPRESSED_IMAGE_CHUNK 0x10000
+
+struct CompressedChunkHeader {
+    int32_t offset;
+    int32_t size;
+    int32_t flags;
+};
+
+enum {
+    COMPRESSED_CHUNK_LAST = 0x1,
+    COMPRESSED_CHUNK_ABORTED = 0x2,
+};
+
 class Callbacks : public RefBase, public IFaceDetectionListener {
 
 public:
@@ -46,11 +68,17 @@ public:
     void videoFrameDone(CameraBuffer *buff, nsecs_t timstamp);
     void compressedFrameDone(CameraBuffer *buff);
     void compressedRawFrameDone(CameraBuffer *buff);
+    // sends buffer 'index' of 'chunks', see CAMERA_MSG_COMPRESSED_IMAGE_CHUNK
+    void compressedChunkDone(camera_memory_t *chunks, int index);
     void cameraError(int err);
     void autofocusDone(bool status);
     void shutterSound();
 
     camera_memory_t* allocateMemory(int size);
+    // 'count' buffers of 'size' bytes, one after the other
+    camera_memory_t* allocateMemory(int size, int count);
+    // maps the first 'size' bytes of the shared memory 'fd' for the client
+    camera_memory_t* shareMemory(int fd, int size);
     virtual void facesDetected(camera_frame_metadata_t &face_metadata, CameraBuffer* buffer);
 
     void storeMetaDataInBuffers(bool enabled);
@@ -32,7 +32,8 @@ CameraBuffer::CameraBuffer() :
         mHeight(-1),
         mData(0),
         mAlloc(0),
-        mAllocPrivate(0)
+        mAllocPrivate(0),
+        mLockLayout(SURFACE_LINEAR)
 {
 }
 
@@ -80,6 +81,10 @@ int CameraBuffer::GetGraStride()
 {
      return mStride;
 }
+SurfaceLayout CameraBuffer::GetLockLayout()
+{
+     return mLockLayout;
+}
 RenderTarget* CameraBuffer::GetRenderTargetHandle()
 {
      return mDecTargetBuf;
@@ -19,6 +19,7 @@
 #include <hardware/camera.h>
 #include <VideoVPPBase.h>
 #include "CameraCommon.h"
+#include "ColorConverter.h"
 
 namespace android
 {
@@ -115,6 +116,8 @@ public:
 
     RenderTarget* GetRenderTargetHandle();
     int GetGraStride();
+    // layout of the surface as LockGrallocData() maps it
+    SurfaceLayout GetLockLayout();
     int GetType();
 
 private:
@@ -150,6 +153,7 @@ private:
     struct gralloc_module_t *mGralloc_module;
     int mGraBuffSize;
     int mStride;
+    SurfaceLayout mLockLayout;
     RenderTarget *mDecTargetBuf;
 
     // Theses are special friends that need and are
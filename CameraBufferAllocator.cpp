@@ -70,6 +70,23 @@ int CameraMemoryAllocator::allocateMemory(CameraBuffer* buf, unsigned int size,
     return size;
 }
 
+int CameraMemoryAllocator::shareMemory(CameraBuffer* buf, int fd, unsigned int size,
+        Callbacks* callbacks)
+{
+    buf->mCamMem = callbacks->shareMemory(fd, size);
+    if (buf->mCamMem == 0 || buf->mCamMem->data == 0) {
+        return -1;
+    }
+    buf->mAllocPrivate = 0; //nothing else other than mCamMem
+    buf->mAlloc = instance();
+    buf->mSize = size;
+    buf->mData = buf->mCamMem->data;
+    buf->mFormat = 0;
+    buf->mWidth = 0;
+    buf->mHeight = 0;
+    return size;
+}
+
 int CameraMemoryAllocator::releaseMemory(CameraBuffer* buf)
 {
      if (buf->mCamMem != 0)
@@ -104,6 +104,18 @@ public:
 
     virtual int allocateMemory(CameraBuffer* buf,
             unsigned int size, Callbacks* callbacks, int w = 0, int h =0, int format = 0);
+    /**
+     * Hand the first bytes of a shared memory region to the client.
+     *
+     * Unlike allocateMemory() nothing is allocated or copied: the client
+     * maps the region the caller already filled.
+     *
+     * @param buf Buffer to attach the client memory to
+     * @param fd ashmem region, it is duplicated
+     * @param size number of bytes the client gets
+     * @return size, -1 for any error
+     */
+    static int shareMemory(CameraBuffer* buf, int fd, unsigned int size, Callbacks* callbacks);
     virtual ~CameraMemoryAllocator();
 
 private:
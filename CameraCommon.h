@@ -18,10 +18,15 @@
 #define ANDROID_LIBCAMERA_COMMON_H
 #include <linux/videodev2.h>
 #include <stdio.h>
+#ifndef CAMERA_HOST_BUILD
 #include <VideoVPPBase.h>
 #include "CameraBuffer.h"
 #include "IntelMetadataBuffer.h"
 #include "GraphicBufferAllocator.h"
+#else
+// host builds (test/host) only use the helpers below
+#include <string.h>
+#endif
 
 //This file define the general configuration for the camera driver
 
@@ -524,20 +524,13 @@ int CameraDriver::configureDevice(Mode deviceMode, int w, int h, int fps, int nu
 
     String8 mode = String8::format("%dx%d", w, h);
     if(mJpegModes.find(mode) != mJpegModes.end()) {
-        mJpegDecoder = new JpegDecoder();
+        mJpegDecoder = createMjpegDecoder(w,h,all_targets,targetBufNum);
         if(mJpegDecoder == NULL)
         {
-            ALOGE("create JpegDecoder failed");
+            ALOGE("create MJPEG decoder failed");
             return -1;
         }
-        status = mJpegDecoder->init(w,h,all_targets,targetBufNum);
-        if(status != JD_SUCCESS) {
-            LOGE("init JpegDecoder failed");
-            delete mJpegDecoder;
-            mJpegDecoder = NULL;
-            return -1;
-        }
-        ALOGI("Camera configured in MJPEG mode, %dx%d\n", w, h);
+        ALOGI("Camera configured in MJPEG mode, %dx%d, %s decoder\n", w, h, mJpegDecoder->getName());
     }
 
     //Set the format
@@ -578,10 +571,18 @@ int CameraDriver::deconfigureDevice()
         return -1;
     }
 
-    mJpegDecoder->deinit();
+    if (mJpegDecoder != NULL) {
+        MjpegParseStats stats;
+        mJpegDecoder->getParseStats(&stats);
+        const int parses = stats.frames - stats.headerHits;
+        LOG1("%s MJPEG decoder: headers of %d of %d frames cached, %.3fms per parse", mJpegDecoder->getName(),
+             stats.headerHits, stats.frames, parses ? stats.parseTime / 1000000.0 / parses : 0.0);
+
+        mJpegDecoder->deinit();
 
-    delete mJpegDecoder;
-    mJpegDecoder = NULL;
+        delete mJpegDecoder;
+        mJpegDecoder = NULL;
+    }
 
     return 0;
 }
@@ -854,32 +855,14 @@ status_t CameraDriver::dequeueBuffer(CameraBuffer **driverbuff, CameraBuffer *yu
     mBufferPool.numBuffersQueued--;
 
     if(mJpegDecoder) {
-        RenderTarget *cur_target = yuvbuff->mDecTargetBuf;
         void * pSrc = camBuff->getData();
         camBuff->mSize = vbuff.bytesused;
         int len = vbuff.bytesused;
 
         //write_image(pSrc, len, mConfig.preview.width, mConfig.preview.height, ".jpeg",0);
-        JpegInfo *jpginfo = new JpegInfo();
-        int status = 0;
-
-        jpginfo->buf = (uint8_t *)pSrc;
-        jpginfo->bufsize = len;
-        status = mJpegDecoder->parse(*jpginfo);
-        if(status != 0)
-        {
-             ALOGE("parse fail for jpegdec,status=%d",status);
-             delete jpginfo;
-             return status;
-        }
-        status = mJpegDecoder->decode(*jpginfo, *cur_target);
-        if(status != 0)
-        {
-            ALOGE("decoder fail,status=%d",status);
-            delete jpginfo;
+        status_t status = mJpegDecoder->decode((const unsigned char *) pSrc, len, yuvbuff);
+        if(status != NO_ERROR)
             return status;
-        }
-        delete jpginfo;
         LOG1("jpegdecoder over");
         /*
         //the following code is used for dump image after jpegdec with mapfunction in libjpegdec
@@ -921,6 +904,14 @@ status_t CameraDriver::dequeueBuffer(CameraBuffer **driverbuff, CameraBuffer *yu
     return NO_ERROR;
 }
 
+void CameraDriver::getMjpegParseStats(MjpegParseStats *stats) const
+{
+    if (mJpegDecoder != NULL)
+        mJpegDecoder->getParseStats(stats);
+    else
+        memset(stats, 0, sizeof(*stats));
+}
+
 status_t CameraDriver::querySupportedControls()
 {
     LOG1("@%s", __FUNCTION__);
@@ -24,7 +24,7 @@
 #include <utils/Errors.h>
 #include <utils/threads.h>
 #include <camera/CameraParameters.h>
-#include <JPEGDecoder.h>
+#include "MjpegDecoder.h"
 #include "CameraCommon.h"
 
 namespace android {
@@ -201,6 +201,9 @@ public:
 
     status_t getStatus();
 
+    // how the MJPEG frames of the current configuration were parsed
+    void getMjpegParseStats(MjpegParseStats *stats) const;
+
 // private types
 private:
 
@@ -363,7 +366,7 @@ private:
     String8 mVidSizes;
     String8 mBestVidSize;
 
-    JpegDecoder *mJpegDecoder;
+    IMjpegDecoder *mJpegDecoder;
     std::set<String8> mJpegModes;
 
     WhiteBalanceMode mWBMode;
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_ColorConvertPlanner"
+
+#include <linux/videodev2.h>
+#include <utils/Timers.h>
+#include "ColorConvertPlanner.h"
+#include "ColorConverter.h"
+#include "ColorConverterKernels.h"
+#include "CameraBuffer.h"
+#include "LogHelper.h"
+#include "VAConvertor.h"
+
+namespace android {
+
+// where the source and destination of an edge may live
+enum {
+    SRC_MEMORY = 1,
+    SRC_SURFACE = 2,
+    DST_MEMORY = 4,
+    DST_SURFACE = 8,
+};
+
+struct ConvertEdge {
+    int srcFormat;
+    int dstFormat;
+    ConvertEngine engine;
+    int where;
+    int computeUsPerMP;     // arithmetic on top of the memory traffic, microseconds per megapixel
+};
+
+/*
+The conversions the HAL can do in one step. The CPU converters write packed
+frames, which is not the layout of a gralloc surface, so only the NV12 surface
+fills of colorConvertToNV12Surface() may write one.
+*/
+static const ConvertEdge sEdges[] = {
+    // ColorConverter.cpp, plain memory sources (colorConvert)
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB565, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 1200 },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB32, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 1200 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 200 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 1200 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_RGB565, CONVERT_ENGINE_CPU, SRC_MEMORY | DST_MEMORY, 1200 },
+
+    // ColorConverter.cpp, gralloc sources (colorConvertwithStride)
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, CONVERT_ENGINE_CPU, SRC_SURFACE | DST_MEMORY, 1200 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_CPU, SRC_SURFACE | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU, SRC_SURFACE | DST_MEMORY, 300 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_CPU, SRC_SURFACE | DST_MEMORY, 100 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU, SRC_SURFACE | DST_MEMORY, 300 },
+
+    // colorConvertToNV12Surface, the VPP-free route into the video encoder surfaces
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_CPU_SURFACE, SRC_MEMORY | DST_SURFACE, 300 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_CPU_SURFACE, SRC_SURFACE | DST_SURFACE, 300 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_CPU_SURFACE, SRC_SURFACE | DST_SURFACE, 0 },
+
+    // colorConvertScaled
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU_SCALED, SRC_MEMORY | DST_MEMORY, 600 },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_CPU_SCALED, SRC_MEMORY | DST_MEMORY, 600 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU_SCALED, SRC_SURFACE | DST_MEMORY, 600 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_CPU_SCALED, SRC_SURFACE | DST_MEMORY, 600 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_CPU_SCALED, SRC_SURFACE | DST_MEMORY, 600 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_CPU_SCALED, SRC_SURFACE | DST_MEMORY, 600 },
+
+    // copies (colorConvert, copyBufWithStride)
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUYV, CONVERT_ENGINE_COPY, SRC_MEMORY | DST_MEMORY, 0 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_COPY, SRC_MEMORY | DST_MEMORY, 0 },
+    { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_NV21, CONVERT_ENGINE_COPY, SRC_MEMORY | DST_MEMORY, 0 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_COPY, SRC_MEMORY | DST_MEMORY, 0 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_COPY, SRC_SURFACE | DST_MEMORY, 0 },
+
+    // VPP blits
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUYV, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUYV, CONVERT_ENGINE_VPP, SRC_SURFACE | DST_SURFACE, 0 },
+};
+
+static const int NUM_EDGES = sizeof(sEdges) / sizeof(sEdges[0]);
+
+// memory traffic model, nanoseconds per byte
+static const int READ_MEMORY_NS_X10 = 4;        // cached memory, about 2.5 GB/s
+static const int READ_SURFACE_NS_X10 = 30;      // uncached gralloc mapping, plain loads
+static const int READ_STREAMING_NS_X10 = 8;     // uncached gralloc mapping, ColorReadback
+static const int WRITE_NS_X10 = 4;
+
+// VPP blits cost the CPU a submission and a wait rather than bandwidth
+static const int VPP_FIXED_US = 1500;
+static const int VPP_US_PER_MP = 200;
+
+// bytes per pixel, times 2
+static int bytesPerPixelX2(int format)
+{
+    switch (format) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+        return 3;
+    case V4L2_PIX_FMT_RGB32:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+static int modelCostPerMP(const ConvertEdge &edge)
+{
+    if (edge.engine == CONVERT_ENGINE_VPP)
+        return VPP_US_PER_MP;
+
+    int readNs = READ_MEMORY_NS_X10;
+    if (edge.where & SRC_SURFACE) {
+        const ColorKernels &kernels = getColorKernels();
+        readNs = (kernels.streamingLoads && colorReadbackEnabled()) ? READ_STREAMING_NS_X10 : READ_SURFACE_NS_X10;
+    }
+    // a megapixel of 1 byte per pixel at 1 ns per byte takes 1000 us
+    return (bytesPerPixelX2(edge.srcFormat) * readNs + bytesPerPixelX2(edge.dstFormat) * WRITE_NS_X10) * 1000 / 20
+           + edge.computeUsPerMP;
+}
+
+static bool sameRequest(const ConvertRequest &a, const ConvertRequest &b)
+{
+    return a.srcFormat == b.srcFormat && a.srcWidth == b.srcWidth && a.srcHeight == b.srcHeight &&
+           a.srcStride == b.srcStride && a.srcSurface == b.srcSurface &&
+           a.dstFormat == b.dstFormat && a.dstWidth == b.dstWidth && a.dstHeight == b.dstHeight &&
+           a.dstSurface == b.dstSurface && a.midFormat == b.midFormat;
+}
+
+ColorConvertPlanner *ColorConvertPlanner::instance()
+{
+    static ColorConvertPlanner theInstance;
+    return &theInstance;
+}
+
+ColorConvertPlanner::ColorConvertPlanner()
+    : mRetryAt(0)
+{
+    for (int i = 0; i < NUM_EDGES; i++) {
+        mCostPerMP.push(modelCostPerMP(sEdges[i]));
+        mDownUntil.push(0);
+    }
+    mPlannedCostPerMP = mCostPerMP;
+}
+
+ColorConvertPlanner::~ColorConvertPlanner()
+{
+}
+
+int ColorConvertPlanner::surfaceFormat(int format)
+{
+    if (format == V4L2_PIX_FMT_NV21 || format == V4L2_PIX_FMT_YVU420)
+        return V4L2_PIX_FMT_YUV420;
+    return format;
+}
+
+// called with mLock held. Steps from the source run at the source size,
+// all the others at the destination size (the intermediate surface's).
+int ColorConvertPlanner::stepCostUs(int edge, const ConvertRequest &request, bool fromSrc, bool toDst) const
+{
+    long long srcPixels = fromSrc ? (long long) request.srcWidth * request.srcHeight
+                                  : (long long) request.dstWidth * request.dstHeight;
+    long long dstPixels = (long long) request.dstWidth * request.dstHeight;
+    long long pixels = srcPixels > dstPixels ? srcPixels : dstPixels;
+    int cost = (int) (mCostPerMP[edge] * pixels / 1000000);
+    if (sEdges[edge].engine == CONVERT_ENGINE_VPP)
+        cost += VPP_FIXED_US;
+    return cost;
+}
+
+// whether a chain of 'steps' steps costing 'cost' beats the plan found so far,
+// fewer steps win a tie
+static inline bool betterChain(int cost, int steps, const ConvertPlan &plan, bool found)
+{
+    return !found || cost < plan.costUs || (cost == plan.costUs && steps < plan.numSteps);
+}
+
+// called with mLock held
+bool ColorConvertPlanner::findPlan(const ConvertRequest &request, ConvertPlan *plan, nsecs_t now) const
+{
+    const bool resize = request.srcWidth != request.dstWidth || request.srcHeight != request.dstHeight;
+    const int srcWhere = request.srcSurface ? SRC_SURFACE : SRC_MEMORY;
+    const int dstWhere = request.dstSurface ? DST_SURFACE : DST_MEMORY;
+    bool found = false;
+
+    plan->numSteps = 0;
+    plan->costUs = 0;
+
+    for (int i = 0; i < NUM_EDGES; i++) {
+        const ConvertEdge &first = sEdges[i];
+        const bool scales = first.engine == CONVERT_ENGINE_CPU_SCALED || first.engine == CONVERT_ENGINE_VPP;
+        if (first.srcFormat != request.srcFormat || !(first.where & srcWhere) || (resize && !scales) ||
+            mDownUntil[i] > now)
+            continue;
+
+        // straight into the destination
+        if (first.dstFormat == request.dstFormat && (first.where & dstWhere)) {
+            int cost = stepCostUs(i, request, true, true);
+            if (betterChain(cost, 1, *plan, found)) {
+                plan->numSteps = 1;
+                plan->steps[0].edge = i;
+                plan->costUs = cost;
+                found = true;
+            }
+        }
+
+        // through the intermediate surface
+        if (request.midFormat == 0 || first.dstFormat != request.midFormat || !(first.where & DST_SURFACE))
+            continue;
+        for (int j = 0; j < NUM_EDGES; j++) {
+            const ConvertEdge &second = sEdges[j];
+            if (second.srcFormat != request.midFormat || !(second.where & SRC_SURFACE) ||
+                second.dstFormat != request.dstFormat || !(second.where & dstWhere) || mDownUntil[j] > now)
+                continue;
+            int cost = stepCostUs(i, request, true, false) + stepCostUs(j, request, false, true);
+            if (betterChain(cost, 2, *plan, found)) {
+                plan->numSteps = 2;
+                plan->steps[0].edge = i;
+                plan->steps[1].edge = j;
+                plan->costUs = cost;
+                found = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < plan->numSteps; i++) {
+        const ConvertEdge &edge = sEdges[plan->steps[i].edge];
+        plan->steps[i].engine = edge.engine;
+        plan->steps[i].srcFormat = edge.srcFormat;
+        plan->steps[i].dstFormat = edge.dstFormat;
+    }
+    return found;
+}
+
+status_t ColorConvertPlanner::plan(const ConvertRequest &request, ConvertPlan *plan)
+{
+    Mutex::Autolock lock(mLock);
+    const nsecs_t now = systemTime();
+
+    // edges that were down may be back, plan again with them
+    if (mRetryAt != 0 && now >= mRetryAt) {
+        mRetryAt = 0;
+        for (int i = 0; i < NUM_EDGES; i++) {
+            if (mDownUntil[i] > now && (mRetryAt == 0 || mDownUntil[i] < mRetryAt))
+                mRetryAt = mDownUntil[i];
+        }
+        mPlans.clear();
+    }
+
+    for (size_t i = 0; i < mPlans.size(); i++) {
+        if (sameRequest(mPlans[i].request, request)) {
+            *plan = mPlans[i].plan;
+            return NO_ERROR;
+        }
+    }
+
+    if (!findPlan(request, plan, now)) {
+        ALOGE("no conversion from format 0x%x (%dx%d%s) to 0x%x (%dx%d%s)",
+              request.srcFormat, request.srcWidth, request.srcHeight, request.srcSurface ? ", surface" : "",
+              request.dstFormat, request.dstWidth, request.dstHeight, request.dstSurface ? ", surface" : "");
+        return BAD_VALUE;
+    }
+    LOG1("@%s: 0x%x %dx%d -> 0x%x %dx%d in %d step(s), engines %d/%d, ~%d us", __FUNCTION__,
+         request.srcFormat, request.srcWidth, request.srcHeight,
+         request.dstFormat, request.dstWidth, request.dstHeight, plan->numSteps,
+         plan->steps[0].engine, plan->numSteps > 1 ? plan->steps[1].engine : -1, plan->costUs);
+
+    if (mPlans.size() >= (size_t) MAX_CACHED_PLANS)
+        mPlans.removeAt(0);
+    CachedPlan cached;
+    cached.request = request;
+    cached.plan = *plan;
+    mPlans.push(cached);
+    return NO_ERROR;
+}
+
+// measured cost of an edge, folded into its running average
+void ColorConvertPlanner::recordCost(int edge, int usPerMegapixel)
+{
+    Mutex::Autolock lock(mLock);
+    int cost = mCostPerMP[edge] + (usPerMegapixel - mCostPerMP[edge]) / 8;
+    mCostPerMP.editItemAt(edge) = cost;
+
+    int planned = mPlannedCostPerMP[edge];
+    int drift = cost > planned ? cost - planned : planned - cost;
+    if (drift * 100 > REPLAN_DRIFT * planned) {
+        LOG1("@%s: edge %d now costs %d us/MP instead of %d, replanning", __FUNCTION__, edge, cost, planned);
+        mPlans.clear();
+        mPlannedCostPerMP = mCostPerMP;
+    }
+}
+
+// leaves a failed edge out of the plans for EDGE_RETRY_NS
+void ColorConvertPlanner::setEdgeDown(int edge)
+{
+    Mutex::Autolock lock(mLock);
+    const nsecs_t until = systemTime() + EDGE_RETRY_NS;
+    ALOGW("conversion 0x%x -> 0x%x (engine %d) failed, leaving it out for %lld ms",
+          sEdges[edge].srcFormat, sEdges[edge].dstFormat, sEdges[edge].engine, EDGE_RETRY_NS / 1000000);
+    mDownUntil.editItemAt(edge) = until;
+    if (mRetryAt == 0 || until < mRetryAt)
+        mRetryAt = until;
+    mPlans.clear();
+}
+
+status_t ColorConvertPlanner::runStep(const ConvertStep &step, const ConvertRequest &request,
+                                      const ConvertBuffers &buffers, bool fromSrc, bool toDst)
+{
+    CameraBuffer *in = fromSrc ? buffers.src : buffers.mid;
+    CameraBuffer *out = toDst ? buffers.dst : buffers.mid;
+    const bool inSurface = fromSrc ? request.srcSurface : true;
+    const bool outSurface = toDst ? request.dstSurface : true;
+    const int srcWidth = fromSrc ? request.srcWidth : request.dstWidth;
+    const int srcHeight = fromSrc ? request.srcHeight : request.dstHeight;
+    const int dstWidth = request.dstWidth;
+    const int dstHeight = request.dstHeight;
+    status_t status = NO_ERROR;
+
+    if (in == NULL || out == NULL) {
+        ALOGE("missing %s buffer", in == NULL ? "source" : "destination");
+        return BAD_VALUE;
+    }
+
+    nsecs_t start = systemTime();
+
+    if (step.engine == CONVERT_ENGINE_VPP) {
+        if (buffers.vpp != NULL)
+            status = buffers.vpp->VPPBitBlit(in->GetRenderTargetHandle(), out->GetRenderTargetHandle());
+        else
+            status = NO_INIT;
+        if (status != NO_ERROR) {
+            setEdgeDown(step.edge);
+            return status;
+        }
+    } else {
+        void *inAddr[3];
+        void *outAddr[3];
+        int size = 0;
+        unsigned char *src;
+        unsigned char *dst;
+        int stride;
+        int alignHeight;
+
+        if (inSurface) {
+            status = in->LockGrallocData((void**)&inAddr, &size);
+            if (status != NO_ERROR) {
+                ALOGE("lock data failed,ret=%d, in line %d", status, __LINE__);
+                return status;
+            }
+            src = (unsigned char *) inAddr[0];
+            stride = in->GetGraStride();
+            alignHeight = in->GetRenderTargetHandle()->height;
+        } else {
+            src = (unsigned char *) in->getData();
+            stride = fromSrc ? request.srcStride : srcWidth;
+            alignHeight = srcHeight;
+        }
+        if (outSurface) {
+            status = out->LockGrallocData((void**)&outAddr, &size);
+            if (status != NO_ERROR) {
+                ALOGE("lock data failed,ret=%d, in line %d", status, __LINE__);
+                if (inSurface)
+                    in->UnLockGrallocData();
+                return status;
+            }
+            dst = (unsigned char *) outAddr[0];
+        } else {
+            dst = (unsigned char *) out->getData();
+        }
+
+        switch (step.engine) {
+        case CONVERT_ENGINE_CPU:
+            if (inSurface)
+                status = colorConvertwithStride(step.srcFormat, step.dstFormat, stride, srcWidth, alignHeight,
+                                                srcHeight, src, dst);
+            else
+                status = colorConvert(step.srcFormat, step.dstFormat, srcWidth, srcHeight, src, dst);
+            break;
+        case CONVERT_ENGINE_CPU_SCALED: {
+            ColorScaleFilter filter = COLOR_SCALE_BILINEAR;
+            if (srcWidth >= 2 * dstWidth && srcHeight >= 2 * dstHeight)
+                filter = COLOR_SCALE_BOX;
+            status = colorConvertScaled(step.srcFormat, step.dstFormat, stride, srcWidth, alignHeight, srcHeight,
+                                        src, dstWidth, dstHeight, dst, filter);
+            break;
+        }
+        case CONVERT_ENGINE_CPU_SURFACE:
+            status = colorConvertToNV12Surface(step.srcFormat, stride, alignHeight, srcWidth, srcHeight, src,
+                                               out->GetLockLayout(), out->GetGraStride(),
+                                               out->GetRenderTargetHandle()->height, dst);
+            break;
+        case CONVERT_ENGINE_COPY:
+            if (inSurface)
+                status = copyBufWithStride(dst, src, srcWidth, srcHeight, stride, srcWidth, alignHeight,
+                                           step.srcFormat) == 0 ? NO_ERROR : BAD_VALUE;
+            else
+                status = colorConvert(step.srcFormat, step.dstFormat, srcWidth, srcHeight, src, dst);
+            break;
+        default:
+            status = BAD_VALUE;
+            break;
+        }
+
+        if (outSurface)
+            out->UnLockGrallocData();
+        if (inSurface)
+            in->UnLockGrallocData();
+    }
+
+    nsecs_t elapsedUs = (systemTime() - start) / 1000;
+    if (step.engine == CONVERT_ENGINE_VPP)
+        elapsedUs = elapsedUs > VPP_FIXED_US ? elapsedUs - VPP_FIXED_US : 0;
+    long long pixels = (long long) srcWidth * srcHeight;
+    if (pixels < (long long) dstWidth * dstHeight)
+        pixels = (long long) dstWidth * dstHeight;
+    if (status == NO_ERROR && pixels > 0)
+        recordCost(step.edge, (int) (elapsedUs * 1000000 / pixels));
+    return status;
+}
+
+status_t ColorConvertPlanner::run(const ConvertRequest &request, const ConvertBuffers &buffers)
+{
+    LOG2("@%s", __FUNCTION__);
+    ConvertPlan plan;
+    status_t status = this->plan(request, &plan);
+    if (status != NO_ERROR)
+        return status;
+
+    bool vppFailed = false;
+    for (int i = 0; i < plan.numSteps && status == NO_ERROR; i++) {
+        status = runStep(plan.steps[i], request, buffers, i == 0, i == plan.numSteps - 1);
+        vppFailed = status != NO_ERROR && plan.steps[i].engine == CONVERT_ENGINE_VPP;
+    }
+
+    // the failed blit is out of the graph now, redo the frame without it
+    if (vppFailed && this->plan(request, &plan) == NO_ERROR) {
+        status = NO_ERROR;
+        for (int i = 0; i < plan.numSteps && status == NO_ERROR; i++)
+            status = runStep(plan.steps[i], request, buffers, i == 0, i == plan.numSteps - 1);
+    }
+    return status;
+}
+
+}; // namespace android
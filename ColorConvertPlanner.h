@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_COLOR_CONVERT_PLANNER_H
+#define ANDROID_LIBCAMERA_COLOR_CONVERT_PLANNER_H
+
+#include <utils/Errors.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class CameraBuffer;
+class VAConvertor;
+
+// what carries out one step of a conversion
+enum ConvertEngine {
+    CONVERT_ENGINE_CPU = 0,     // a ColorConverter.cpp converter
+    CONVERT_ENGINE_CPU_SCALED,  // colorConvertScaled(), may resize
+    CONVERT_ENGINE_CPU_SURFACE, // colorConvertToNV12Surface(), fills an NV12 surface in its own layout
+    CONVERT_ENGINE_COPY,        // same format copy, plain or restrided
+    CONVERT_ENGINE_VPP,         // VPP blit between gralloc surfaces, may resize
+};
+
+/**
+ * One conversion, as the threads ask for it. Formats are V4L2 fourccs,
+ * with V4L2_PIX_FMT_YUV420 standing for YV12 like in ColorConverter.cpp.
+ * A "surface" is a gralloc buffer with a VPP render target; anything else
+ * is plain memory (driver buffers, callback heaps).
+ */
+struct ConvertRequest {
+    int srcFormat;
+    int srcWidth;
+    int srcHeight;
+    int srcStride;      // bytes for surfaces, pixels for plain memory
+    bool srcSurface;
+    int dstFormat;
+    int dstWidth;
+    int dstHeight;
+    bool dstSurface;
+    int midFormat;      // format of the intermediate surface (dst size), 0 if there is none
+};
+
+struct ConvertStep {
+    int edge;           // index in the planner's edge table
+    ConvertEngine engine;
+    int srcFormat;
+    int dstFormat;
+};
+
+/**
+ * The cheapest chain found for a request: one step straight into the
+ * destination, or two steps through the intermediate surface.
+ */
+struct ConvertPlan {
+    static const int MAX_STEPS = 2;
+    int numSteps;
+    ConvertStep steps[MAX_STEPS];
+    int costUs;         // estimated cost of the chain, in microseconds
+};
+
+// buffers a plan runs on, 'mid' may be NULL when the request has no midFormat
+struct ConvertBuffers {
+    CameraBuffer *src;
+    CameraBuffer *mid;
+    CameraBuffer *dst;
+    VAConvertor *vpp;
+};
+
+/**
+ * Picks and runs the cheapest chain of conversions between two formats.
+ *
+ * The planner knows a graph of formats whose edges are the CPU converters,
+ * the VPP blits and the copies, each with a cost per megapixel. The cost is
+ * modelled from the bytes an edge reads and writes at first, and replaced
+ * by the time measured whenever a step runs. Plans are cached per request
+ * and dropped when a measured cost moves away from the one they were made
+ * with. A VPP blit that fails takes its edge out of the graph for a while, so
+ * that the CPU converters take over when the VPP is unavailable.
+ */
+class ColorConvertPlanner {
+public:
+    static ColorConvertPlanner *instance();
+
+    // NO_ERROR and the cheapest plan, or BAD_VALUE when nothing connects the formats
+    status_t plan(const ConvertRequest &request, ConvertPlan *plan);
+
+    // plans the request if needed and runs it
+    status_t run(const ConvertRequest &request, const ConvertBuffers &buffers);
+
+    // gralloc surfaces can't hold NV21, GraphicBufferAllocator makes them YV12
+    static int surfaceFormat(int format);
+
+private:
+    ColorConvertPlanner();
+    ~ColorConvertPlanner();
+
+    struct CachedPlan {
+        ConvertRequest request;
+        ConvertPlan plan;
+    };
+
+    int stepCostUs(int edge, const ConvertRequest &request, bool fromSrc, bool toDst) const;
+    bool findPlan(const ConvertRequest &request, ConvertPlan *plan, nsecs_t now) const;
+    status_t runStep(const ConvertStep &step, const ConvertRequest &request, const ConvertBuffers &buffers,
+                     bool fromSrc, bool toDst);
+    void recordCost(int edge, int usPerMegapixel);
+    void setEdgeDown(int edge);
+
+    // how far a measured cost may drift before the cached plans are redone, in percent
+    static const int REPLAN_DRIFT = 25;
+    // cached plans kept, the oldest goes first
+    static const int MAX_CACHED_PLANS = 16;
+    // how long an edge that failed is left out of the plans, in nanoseconds
+    static const nsecs_t EDGE_RETRY_NS = 2000000000LL;
+
+    Mutex mLock;                    // protects everything below
+    Vector<int> mCostPerMP;         // current cost of each edge, microseconds per megapixel
+    Vector<int> mPlannedCostPerMP;  // the costs the cached plans were made with
+    Vector<CachedPlan> mPlans;
+    Vector<nsecs_t> mDownUntil;     // when each edge may be planned again after a failure
+    nsecs_t mRetryAt;               // the earliest of those still ahead, 0 if every edge is up
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_COLOR_CONVERT_PLANNER_H
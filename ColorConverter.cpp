@@ -17,488 +17,317 @@
 
 #include <camera/CameraParameters.h>
 #include <linux/videodev2.h>
+#include <system/graphics.h>
+#include <ufo/graphics.h>
 #include "ColorConverter.h"
+#include "ColorConverterKernels.h"
+#include "ColorConverterPool.h"
+#include "CameraCommon.h"
 #include "LogHelper.h"
-#include "VAConvertor.h"
 namespace android {
 
-inline unsigned char clamp(int x){
-    if (x < 0 )
-        x = 0;
-    else if (x > 255)
-        x = 255;
-    return (x & 0xFF);
+/*
+Every converter below is written as a rows function that converts the image
+rows [rowBegin, rowEnd), plus the public whole-image entry point that runs it
+through runColorConvertJob(), which may split the rows into bands converted in
+parallel. Bands always start on an even row, so a rows function only has to
+make sure that the bands of an image with even dimensions add up to exactly
+the bytes of the whole-image conversion, and that the single band [0, height)
+keeps the historical output for any size. The planar conversions of
+convertPlanesRows() are the exception, their chroma only covers whole 2x2
+blocks.
+
+colorConvert() and colorConvertwithStride() find the rows function of a pair
+of formats in sConvertTable, through getColorConvertRows().
+*/
+static void initConvertJob(ColorConvertJob *job, ColorConvertRowsFunc convertRows,
+                           int width, int height, int stride, int alignHeight,
+                           void *src, void *dst)
+{
+    job->convertRows = convertRows;
+    job->width = width;
+    job->height = height;
+    job->stride = stride;
+    job->alignHeight = alignHeight;
+    job->dstStride = 0;
+    job->option = 0;
+    job->srcWidth = width;
+    job->srcHeight = height;
+    job->srcFormat = 0;
+    job->srcUncached = false;
+    job->scaleColumns = NULL;
+    job->src = (unsigned char *) src;
+    job->dst = (unsigned char *) dst;
 }
 
-void YUYVToNV21(int width, int height, void *src, void *dst)
+static void runConvertRows(ColorConvertRowsFunc convertRows, int width, int height, void *src, void *dst)
+{
+    ColorConvertJob job;
+    initConvertJob(&job, convertRows, width, height, width, height, src, dst);
+    runColorConvertJob(job);
+}
+
+static void runConvertRowsWithStride(ColorConvertRowsFunc convertRows, int width, int height,
+                                     int stride, int alignheight, void *src, void *dst)
+{
+    ColorConvertJob job;
+    initConvertJob(&job, convertRows, width, height, stride, alignheight, src, dst);
+    runColorConvertJob(job);
+}
+
+// same as runConvertRowsWithStride(), for sources in (uncached) gralloc surfaces
+static void runGrallocConvertRows(ColorConvertRowsFunc convertRows, int width, int height,
+                                  int stride, int alignheight, void *src, void *dst)
+{
+    ColorConvertJob job;
+    initConvertJob(&job, convertRows, width, height, stride, alignheight, src, dst);
+    job.srcUncached = true;
+    runColorConvertJob(job);
+}
+
+// byte offset of the chroma data of 'row' in a plane of 'planeSize' bytes whose
+// rows pair up into chroma rows of 'chromaPitch' bytes
+static inline int chromaOffset(const ColorConvertJob &job, int row, int chromaPitch, int planeSize)
 {
-    unsigned char *pSrcY = (unsigned char *) src;
-    unsigned char *pSrcU = pSrcY + 1;
-    unsigned char *pSrcV = pSrcY + 3;
+    return (row == job.height) ? planeSize : (row / 2) * chromaPitch;
+}
 
-    unsigned char *pDstY = (unsigned char *) dst;
-    unsigned char *pDstUV = pDstY + width * height;
+// copy of a packed frame; job.option holds the frame size in bytes
+static void copyFrameRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const long long size = job.option;
+    const int begin = (int) (size * rowBegin / job.height);
+    const int end = (int) (size * rowEnd / job.height);
+    memcpy(job.dst + begin, job.src + begin, end - begin);
+}
+
+static void YUYVToNV21Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const ColorKernels &kernels = getColorKernels();
+    const int width = job.width;
+    const int rowBytes = (width / 2) * 2; // 2 y-pixels at a time
+    unsigned char *pSrc = job.src + rowBegin * rowBytes * 2;
+    unsigned char *pDstY = job.dst + rowBegin * rowBytes;
+    unsigned char *pDstUV = job.dst + width * job.height + (rowBegin + 1) / 2 * rowBytes;
 
     // YUYV format is: yuyvyuyvyuyv...yuyv
-    // NV12 format is: yyyy...yyyyuvuv...uvuvuv
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width / 2; j++) { // 2 y-pixels at a time
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-
-            // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
-            // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
-            // so skip odd numbered rows
-            if ((i % 2) == 0) {
-                *pDstUV++ = *pSrcV;
-                *pDstUV++ = *pSrcU;
-            }
-            pSrcU += 4;
-            pSrcV += 4;
+    // NV21 format is: yyyy...yyyyvuvu...vuvuvu
+    for (int i = rowBegin; i < rowEnd; i++) {
+        // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
+        // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
+        // so skip odd numbered rows
+        if ((i % 2) == 0) {
+            kernels.yuyvToNV21Row(pSrc, pDstY, pDstUV, width);
+            pDstUV += rowBytes;
+        } else {
+            kernels.yuyvToLumaRow(pSrc, pDstY, width);
         }
+        pSrc += rowBytes * 2;
+        pDstY += rowBytes;
     }
 }
 
-void YUYVToNV12(int width, int height, void *src, void *dst)
+void YUYVToNV21(int width, int height, void *src, void *dst)
 {
-    unsigned char *pSrcY = (unsigned char *) src;
-    unsigned char *pSrcU = pSrcY + 1;
-    unsigned char *pSrcV = pSrcY + 3;
+    runConvertRows(YUYVToNV21Rows, width, height, src, dst);
+}
 
-    unsigned char *pDstY = (unsigned char *) dst;
-    unsigned char *pDstUV = pDstY + width * height;
+static void YUYVToNV12Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const ColorKernels &kernels = getColorKernels();
+    const int width = job.width;
+    const int rowBytes = (width / 2) * 2; // 2 y-pixels at a time
+    unsigned char *pSrc = job.src + rowBegin * rowBytes * 2;
+    unsigned char *pDstY = job.dst + rowBegin * rowBytes;
+    unsigned char *pDstUV = job.dst + width * job.height + (rowBegin + 1) / 2 * rowBytes;
 
     // YUYV format is: yuyvyuyvyuyv...yuyv
     // NV12 format is: yyyy...yyyyuvuv...uvuvuv
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width / 2; j++) { // 2 y-pixels at a time
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-
-            // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
-            // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
-            // so skip odd numbered rows
-            if ((i % 2) == 0) {
-                *pDstUV++ = *pSrcU;
-                *pDstUV++ = *pSrcV;
-            }
-            pSrcU += 4;
-            pSrcV += 4;
+    for (int i = rowBegin; i < rowEnd; i++) {
+        // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
+        // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
+        // so skip odd numbered rows
+        if ((i % 2) == 0) {
+            kernels.yuyvToNV12Row(pSrc, pDstY, pDstUV, width);
+            pDstUV += rowBytes;
+        } else {
+            kernels.yuyvToLumaRow(pSrc, pDstY, width);
         }
+        pSrc += rowBytes * 2;
+        pDstY += rowBytes;
     }
 }
 
+void YUYVToNV12(int width, int height, void *src, void *dst)
+{
+    runConvertRows(YUYVToNV12Rows, width, height, src, dst);
+}
+
 /*
-convert YUV422H to NV12, the yuv422h is placed as Y(stride * alignheight),U(stride * alignheight),V(stride * alignheight)
-the valid data for U/V is width/2 * alignheight
-width: dst image width
-height: dst image height
-stride: stride for src image
-alignheight: aligned height for src image
+convert YUYV to NV12 laid out for the video encoder surface
+width: image width
+height: image height
+the dst luma/chroma rows are aligned to 128 bytes, the chroma plane starts
+after the luma plane aligned to 32 rows
 */
-void YUYVToNV12_withStride(int width, int height, void *src, void *dst)
+static void YUYVToNV12_withStrideRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    unsigned char *pSrcY = (unsigned char *) src;
-    unsigned char *pSrcU = pSrcY + 1;
-    unsigned char *pSrcV = pSrcY + 3;
-
-    unsigned char *pDstY = (unsigned char *)dst;
-
-    int stride = ALIGN(width, 128);
-    int alignedheight = ALIGN(height, 32);
-    unsigned char *pDstUV = pDstY + stride * alignedheight;
+    const ColorKernels &kernels = getColorKernels();
+    const int width = job.width;
+    const int stride = ALIGN(width, 128);
+    const int alignedheight = ALIGN(job.height, 32);
+    const int rowBytes = (width / 2) * 2; // 2 y-pixels at a time
+    const int dstPitch = rowBytes + (stride - width);
+    unsigned char *pSrc = job.src + rowBegin * rowBytes * 2;
+    unsigned char *pDstY = job.dst + rowBegin * dstPitch;
+    unsigned char *pDstUV = job.dst + stride * alignedheight + (rowBegin + 1) / 2 * dstPitch;
 
     // YUYV format is: yuyvyuyvyuyv...yuyv
     // NV12 format is: yyyy...yyyyuvuv...uvuvuv
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width / 2; j++) { // 2 y-pixels at a time
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-            *pDstY++ = *pSrcY;
-            pSrcY += 2;
-
-            // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
-            // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
-            // so skip odd numbered rows
-            if ((i % 2) == 0) {
-                *pDstUV++ = *pSrcU;
-                *pDstUV++ = *pSrcV;
-            }
-            pSrcU += 4;
-            pSrcV += 4;
-        }
-        pDstY += (stride-width);
-        if ((i % 2) == 0){
-            pDstUV += (stride - width);
+    for (int i = rowBegin; i < rowEnd; i++) {
+        // 4:2:2 chroma has 1/2 the horizontal and FULL vertical resolution of full image
+        // 4:2:0 chroma has 1/2 the horizontal and 1/2 vertical resolution of full image
+        // so skip odd numbered rows
+        if ((i % 2) == 0) {
+            kernels.yuyvToNV12Row(pSrc, pDstY, pDstUV, width);
+            pDstUV += dstPitch;
+        } else {
+            kernels.yuyvToLumaRow(pSrc, pDstY, width);
         }
+        pSrc += rowBytes * 2;
+        pDstY += dstPitch;
     }
 }
 
+void YUYVToNV12_withStride(int width, int height, void *src, void *dst)
+{
+    runConvertRows(YUYVToNV12_withStrideRows, width, height, src, dst);
+}
+
 /*
 yuyv copy should be consider pixel alignment
 src is consequent by width*height
 Dst should be aligned according stride
 */
-void copyYUYV_withStride(int stride, int width, int height, void *src, void *dst)
+static void copyYUYV_withStrideRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    unsigned char *pSrc = (unsigned char *) src;
-    unsigned char *pDst = (unsigned char *) dst;
+    const int srcPitch = job.width * 2; //yuyv 1 pixel = 2 bytes
+    const int dstPitch = srcPitch + (job.stride - job.width) * 2; //pixel should be alighed
+    unsigned char *pSrc = job.src + rowBegin * srcPitch;
+    unsigned char *pDst = job.dst + rowBegin * dstPitch;
+
+    for (int i = rowBegin; i < rowEnd; i++) {
+        memcpy(pDst, pSrc, srcPitch);
+        pSrc += srcPitch;
+        pDst += dstPitch;
+    }
+}
 
+void copyYUYV_withStride(int stride, int width, int height, void *src, void *dst)
+{
     ALOGV(":%s: stride, width, height = (%d, %d, %d)", __FUNCTION__, stride, width, height);
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width*2; j++) {//yuyv 1 pixel = 2 bytes
-            *pDst++ = *pSrc++;
-        }
-        pDst += (stride-width)*2;//pixel should be alighed
-    }
+    runConvertRowsWithStride(copyYUYV_withStrideRows, width, height, stride, height, src, dst);
+}
+
+// YUYV is converted as a sequence of 2-pixel macro pixels, regardless of rows
+static void YUYVToRGB8888Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int pairBegin = rowBegin * job.width / 2;
+    const int pairEnd = rowEnd * job.width / 2;
+    //four bytes of two pixels in, 8 rgba bytes for two pixels out
+    getColorKernels().yuyvToRGBA8888(job.src + pairBegin * 4, job.dst + pairBegin * 8, pairEnd - pairBegin);
 }
 
 void YUYVToRGB8888(int width, int height, void *src, void *dst)
 {
-    int len = width * height * 2;
-    int i = 0;
-    unsigned char *pYUV = (unsigned char *)src;   //four bytes of two pixels
-    unsigned char *pRGB = (unsigned char *)dst;       //6 rgb bytes for two pixels
-    int C, D, E;
-    len -= len % 4;
-    for (i = 0; i < len; i += 4) {
-        unsigned char y1 = *(pYUV++);
-        unsigned char u = *(pYUV++);
-        unsigned char y2 = *(pYUV++);
-        unsigned char v = *(pYUV++);
-//calculate 1st pixel
-        C = y1 - 16;
-        D = u - 128;
-        E = v -128;
-        *(pRGB++) = clamp((C * 298 + E * 409 + 128) >> 8);
-        *(pRGB++) = clamp((C * 298 - D * 100 - E * 208 + 128) >> 8);
-        *(pRGB++) = clamp((C * 298 + D * 516 + 128) >> 8);
-        //alpha
-        *(pRGB++) = 0xFF;
-//calculate 2nd pixel
-        C = y2 -16;
-        *(pRGB++) = clamp((C * 298 + E * 409 + 128) >> 8);
-        *(pRGB++) = clamp((C * 298 - D * 100 - E * 208 + 128) >> 8);
-        *(pRGB++) = clamp((C * 298 + D * 516 + 128) >> 8);
-        //alpha
-        *(pRGB++) = 0xFF;
+    runConvertRows(YUYVToRGB8888Rows, width, height, src, dst);
+}
 
-    }
+static void YUYVToRGB565Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int pairBegin = rowBegin * job.width / 2;
+    const int pairEnd = rowEnd * job.width / 2;
+    getColorKernels().yuyvToRGB565(job.src + pairBegin * 4, job.dst + pairBegin * 4, pairEnd - pairBegin);
 }
 
 void YUYVToRGB565(int width, int height, void *src, void *dst)
 {
+    runConvertRows(YUYVToRGB565Rows, width, height, src, dst);
+}
 
-    unsigned char *yuvs = (unsigned char *) src;
-    unsigned char *rgbs = (unsigned char *) dst;
+static void NV12ToRGB565Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    //the end of the luminance data
+    const int lumEnd = width * job.height;
 
-    //points to the next luminance value pair
-    int lumPtr = 0;
-    //points to the next chromiance value pair
-    int chrPtr = 1;
-    //points to the next byte output pair of RGB565 value
-    int outPtr = 0;
-
-    while (true) {
-
-        if (lumPtr == width * height * 2) // our work is done here!
-            break;
-
-        //read the luminance
-        int Y1 = yuvs[lumPtr] & 0xff;
-        lumPtr += 2;
-        int Y2 = yuvs[lumPtr] & 0xff;
-        lumPtr += 2;
-
-        //read the chroma
-        int Cb = (yuvs[chrPtr] & 0xff) - 128;
-        chrPtr += 2;
-        int Cr = (yuvs[chrPtr] & 0xff) - 128;
-        chrPtr += 2;
-        int R, G, B;
-
-        //generate first RGB components
-        B = clamp(Y1 + ((454 * Cb) >> 8));
-        G = clamp(Y1 - ((88 * Cb + 183 * Cr) >> 8));
-        R = clamp(Y1 + ((359 * Cr) >> 8));
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
-
-        //generate second RGB components
-        B = clamp(Y2 + ((454 * Cb) >> 8));
-        G = clamp(Y2 - ((88 * Cb + 183 * Cr) >> 8));
-        R = clamp(Y2 + ((359 * Cr) >> 8));
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
+    const ColorKernels &kernels = getColorKernels();
+
+    for (int i = rowBegin; i < rowEnd; i++) {
+        kernels.nv12ToRGB565Row(job.src + i * width,
+                                job.src + lumEnd + (i / 2) * width,
+                                job.dst + i * width * 2, width);
     }
 }
 
 void NV12ToRGB565(int width, int height, void *src, void *dst)
 {
+    runConvertRows(NV12ToRGB565Rows, width, height, src, dst);
+}
 
-    unsigned char *yuvs = (unsigned char *) src;
-    unsigned char *rgbs = (unsigned char *) dst;
-
+static void NV12ToRGB565withStrideRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const int stride = job.stride;
     //the end of the luminance data
-    int lumEnd = width * height;
-    //points to the next luminance value pair
-    int lumPtr = 0;
-    //points to the next chromiance value pair
-    int chrPtr = lumEnd;
-    //points to the next byte output pair of RGB565 value
-    int outPtr = 0;
-    //the end of the current luminance scanline
-    int lineEnd = width;
-
-    while (true) {
-        //skip back to the start of the chromiance values when necessary
-        if (lumPtr == lineEnd) {
-            if (lumPtr == lumEnd) break; //we've reached the end
-            //division here is a bit expensive, but's only done once per scanline
-            chrPtr = lumEnd + ((lumPtr  >> 1) / width) * width;
-            lineEnd += width;
-        }
-        //read the luminance and chromiance values
-        int Y1 = yuvs[lumPtr++] & 0xff;
-        int Y2 = yuvs[lumPtr++] & 0xff;
-        int Cb = (yuvs[chrPtr++] & 0xff) - 128;
-        int Cr = (yuvs[chrPtr++] & 0xff) - 128;
-        int R, G, B;
-
-        //generate first RGB components
-        B = Y1 + ((454 * Cb) >> 8);
-        if(B < 0) B = 0; else if(B > 255) B = 255;
-        G = Y1 - ((88 * Cb + 183 * Cr) >> 8);
-        if(G < 0) G = 0; else if(G > 255) G = 255;
-        R = Y1 + ((359 * Cr) >> 8);
-        if(R < 0) R = 0; else if(R > 255) R = 255;
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
-
-        //generate second RGB components
-        B = Y2 + ((454 * Cb) >> 8);
-        if(B < 0) B = 0; else if(B > 255) B = 255;
-        G = Y2 - ((88 * Cb + 183 * Cr) >> 8);
-        if(G < 0) G = 0; else if(G > 255) G = 255;
-        R = Y2 + ((359 * Cr) >> 8);
-        if(R < 0) R = 0; else if(R > 255) R = 255;
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
+    const int lumEnd = stride * job.alignHeight;
+
+    const ColorKernels &kernels = getColorKernels();
+    ColorReadback readback(job.srcUncached);
+    const unsigned char *srcUV = NULL;
+
+    for (int i = rowBegin; i < rowEnd; i++) {
+        // a chroma row serves two luma rows, read it once
+        if (i == rowBegin || (i & 1) == 0)
+            srcUV = readback.read(1, job.src + lumEnd + (i / 2) * stride, width);
+        kernels.nv12ToRGB565Row(readback.read(0, job.src + i * stride, width), srcUV,
+                                job.dst + i * width * 2, width);
     }
 }
 
 void NV12ToRGB565withStride(int width, int height,int stride,int alignheight, void *src, void *dst)
 {
-
-    unsigned char *yuvs = (unsigned char *) src;
-    unsigned char *rgbs = (unsigned char *) dst;
-
-    //the end of the luminance data
-    int lumEnd = stride * alignheight;
-    //points to the next luminance value pair
-    int lumPtr = 0;
-    //points to the next chromiance value pair
-    int chrPtr = lumEnd;
-    //points to the next byte output pair of RGB565 value
-    int outPtr = 0;
-    //the end of the current luminance scanline
-    int lineEnd = width;
-    int diff = stride-width;
-    int actLumEnd = stride*height;
-    while (true) {
-        //skip back to the start of the chromiance values when necessary
-        if (lumPtr == lineEnd) {
-            if (lumPtr == (actLumEnd-diff)) break; //we've reached the end
-            //division here is a bit expensive, but's only done once per scanline
-            lumPtr += diff;
-            chrPtr = lumEnd + ((lumPtr  >> 1) / stride) * stride;
-            lineEnd += stride;
-        }
-        //read the luminance and chromiance values
-        int Y1 = yuvs[lumPtr++] & 0xff;
-        int Y2 = yuvs[lumPtr++] & 0xff;
-        int Cb = (yuvs[chrPtr++] & 0xff) - 128;
-        int Cr = (yuvs[chrPtr++] & 0xff) - 128;
-        int R, G, B;
-
-        //generate first RGB components
-        B = Y1 + ((454 * Cb) >> 8);
-        if(B < 0) B = 0; else if(B > 255) B = 255;
-        G = Y1 - ((88 * Cb + 183 * Cr) >> 8);
-        if(G < 0) G = 0; else if(G > 255) G = 255;
-        R = Y1 + ((359 * Cr) >> 8);
-        if(R < 0) R = 0; else if(R > 255) R = 255;
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
-
-        //generate second RGB components
-        B = Y2 + ((454 * Cb) >> 8);
-        if(B < 0) B = 0; else if(B > 255) B = 255;
-        G = Y2 - ((88 * Cb + 183 * Cr) >> 8);
-        if(G < 0) G = 0; else if(G > 255) G = 255;
-        R = Y2 + ((359 * Cr) >> 8);
-        if(R < 0) R = 0; else if(R > 255) R = 255;
-        //NOTE: this assume little-endian encoding
-        rgbs[outPtr++]  = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
-        rgbs[outPtr++]  = (unsigned char) ((R & 0xf8) | (G >> 5));
-    }
+    runGrallocConvertRows(NV12ToRGB565withStrideRows, width, height, stride, alignheight, src, dst);
 }
-/*
-convert YUV422H to NV12, the yuv422h is placed as Y(stride * alignheight),U(stride * alignheight),V(stride * alignheight)
-the valid data for U/V is width/2 * alignheight
-width: dst image width
-height: dst image height
-stride: stride for src image
-alignheight: aligned height for src image
-*/
-void YUV422PToNV12withStride(int width, int height,int stride,int alignheight, void *src, void *dst)
-{
-    int planeSizeY = stride * alignheight;
-    int planeSizeU = planeSizeY;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) srcPtrU + planeSizeU;
-    unsigned char *dstPtr = (unsigned char *) dst;
-    // copy the entire Y plane
-    if(width == stride)
-    {
-       memcpy(dstPtr, srcPtr, width*height);
-       dstPtr += (width*height);
-    }
-    else
-    {
-       for(i=0;i<height;i++)
-       {
-          memcpy(dstPtr, srcPtr, width);
-          dstPtr += width;
-          srcPtr += stride;
-       }
-    }
-    // deinterlace the UV data
-    int vertical = height/2;
-    int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        for (j = 0; j < horizontal; j++) {
-            *dstPtr++ = srcPtrU[j];
-            *dstPtr++ = srcPtrV[j];
-        }
-        srcPtrV += stride << 1;
-        srcPtrU += stride << 1;
-    }
 
-}
-/*
-convert YUV422H to NV21, the yuv422h is placed as Y(stride * alignheight),U(stride * alignheight),V(stride * alignheight)
-the valid data for U/V is width/2 * alignheight
-width: dst image width
-height: dst image height
-stride: stride for src image
-alignheight: aligned height for src image
-*/
+// copy luma rows [rowBegin, rowEnd) from a plane with 'stride' bytes per row
+// into a packed plane of 'width' bytes per row
+static void copyLumaRows(const ColorConvertJob &job, ColorReadback &readback, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const int stride = job.stride;
+    unsigned char *srcPtr = job.src + rowBegin * stride;
+    unsigned char *dstPtr = job.dst + rowBegin * width;
 
-void YUV422PToNV21withStride(int width, int height,int stride,int alignheight, void *src, void *dst)
-{
-    int planeSizeY = stride * alignheight;
-    int planeSizeU = planeSizeY;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) srcPtrU + planeSizeU;
-    unsigned char *dstPtr = (unsigned char *) dst;
-    unsigned char *dstPtrVU = (unsigned char *) dst+ width*height;
-    // copy the entire Y plane
-    if(width == stride)
-    {
-       memcpy(dstPtr, srcPtr, width*height);
-       dstPtr += (width*height);
-    }
-    else
-    {
-      for(i = 0;i < height;i++)
-      {
-         memcpy(dstPtr, srcPtr, width);
-         dstPtr += width;
-         srcPtr += stride;
-      }
-   }
-    // deinterlace the VU data
-    int vertical = height / 2;
-    int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        for (j = 0; j < horizontal; j++) {
-            *dstPtrVU++ = srcPtrV[j];
-            *dstPtrVU++ = srcPtrU[j];
+    if (width == stride) {
+        readback.copy(dstPtr, srcPtr, width * (rowEnd - rowBegin));
+    } else {
+        for (int i = rowBegin; i < rowEnd; i++) {
+            readback.copy(dstPtr, srcPtr, width);
+            dstPtr += width;
+            srcPtr += stride;
         }
-        srcPtrV += stride << 1;
-        srcPtrU += stride << 1;
     }
-
 }
-/*
-convert YUV422H to YV12, the yuv422h is placed as Y(stride * alignheight),U(stride * alignheight),V(stride * alignheight)
-the valid data for U/V is width/2 * alignheight
-yuv422 from graphic buffer should be aligned to 128, so U/V should be aligned to 128, alreay satisfy the requirment of Android's 16 alignment
-width: dst image width
-height: dst image height
-stride: stride for src image
-alignheight: aligned height for src image
-*/
-void YUV422PToYV12withStride(int width, int height,int stride,int alignheight, void *src, void *dst)
-{
-    int planeSizeY = stride * alignheight;
-    int planeSizeU = planeSizeY;
-    int i = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) srcPtrU + planeSizeU;
-    unsigned char *dstPtr = (unsigned char *) dst;
-    const int dstStride = ALIGN(width >> 1,16);
-    unsigned char *dstPtrV = (unsigned char *) dst+ width*height;
-    unsigned char *dstPtrU = (unsigned char *) dstPtrV+ dstStride*height/2;
-    // copy the entire Y plane
-    if(width == stride)
-    {
-       memcpy(dstPtr, srcPtr, width*height);
-       dstPtr += (width*height);
-    }
-    else
-    {
-      for(i = 0;i < height;i++)
-      {
-         memcpy(dstPtr, srcPtr, width);
-         dstPtr += width;
-         srcPtr += stride;
-      }
-    }
-    // deinterlace the VU data
-    int vertical = height / 2;
-    int horizontal = width /2;
-    for(i = 0; i < vertical; i++) {
-        memcpy(dstPtrV,srcPtrV,dstStride);
-        srcPtrV += stride << 1;
-        dstPtrV += dstStride;
-        memcpy(dstPtrU,srcPtrU,dstStride);
-        srcPtrU += stride << 1;
-        dstPtrU += dstStride;
-    }
 
-}
-static void YV12ToBGR565(int width, int height, int stride, void *src, void *dst)
+// YV12 to RGB565 (BGR bit order), converted 2 rows at a time
+static void YV12ToBGR565Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    unsigned char *yuvs = (unsigned char *)src;
-    unsigned char *rgbs = (unsigned char *)dst;
+    const int width = job.width;
+    const int height = job.height;
+    const int stride = job.stride;
+    unsigned char *yuvs = job.src;
+    unsigned char *rgbs = job.dst + rowBegin * width * 2;
 
     //the end of the luminance data
     int lumEnd = stride * height;
@@ -507,7 +336,23 @@ static void YV12ToBGR565(int width, int height, int stride, void *src, void *dst
     //points to the next chromiance value pair
     int chrPtrU = 0, chrPtrV = 0;
 
-    for (int i = 0; i < height; i += 2) {
+    if ((width & 1) == 0) {
+        const ColorKernels &kernels = getColorKernels();
+        for (int i = rowBegin; i < rowEnd; i += 2) {
+            chrPtrV = i / 2 * stride / 2 + lumEnd;
+            chrPtrU = i / 2 * stride / 2 + lumEnd + (stride / 2 * height / 2);
+            // both rows of the pair share the chroma row
+            for (int m = 0; m < 2; m++) {
+                kernels.yv12ToRGB565Row(yuvs + (i + m) * stride, yuvs + chrPtrU, yuvs + chrPtrV,
+                                        rgbs + m * width * 2, width);
+            }
+            rgbs += 4 * width; // 2 lines
+        }
+        return;
+    }
+
+    // odd widths keep the historical 2x2 block walk
+    for (int i = rowBegin; i < rowEnd; i += 2) {
         lumPtr = i * stride;
         chrPtrV = i / 2 * stride / 2 + lumEnd;
         chrPtrU = i / 2 * stride / 2 + lumEnd + (stride / 2 * height / 2);
@@ -542,67 +387,50 @@ static void YV12ToBGR565(int width, int height, int stride, void *src, void *dst
    } // i
 }
 
-
-// covert NV12 (Y plane, interlaced UV bytes) to
-// NV21 (Y plane, interlaced VU bytes)
-void NV12ToNV21(int width, int height, void *src, void *dst)
+// P411's Y, U, V are seperated. But the NV12's U and V are interleaved.
+static void NV12ToP411Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    int planeSizeY = width * height;
-    int planeSizeUV = planeSizeY / 2;
-    int i = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *dstPtr = (unsigned char *) dst;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, src, planeSizeY);
+    const int width = job.width;
+    const int height = job.height;
+    const ColorKernels &kernels = getColorKernels();
 
-    // byte swap the UV data
-    for(i=planeSizeY; i<(planeSizeY+planeSizeUV); i=i+2)
-    {
-        dstPtr[i] = srcPtr[i + 1];
-        dstPtr[i + 1] = srcPtr[i];
+    // copy Y data
+    memcpy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
+    // split U data and V data
+    unsigned char *psrcUV = job.src + width * height;
+    unsigned char *pdstU = job.dst + width * height;
+    unsigned char *pdstV = pdstU + width * height / 4;
+    // each chroma row holds (width + 1) / 2 U samples and width / 2 V samples
+    const int pairs = width / 2;
+    const int uPitch = (width + 1) / 2;
+    for (int i = rowBegin / 2; i < rowEnd / 2; i++) {
+        const unsigned char *srcRow = psrcUV + i * width;
+        kernels.deinterleaveChroma(srcRow, pdstU + i * uPitch, pdstV + i * pairs, pairs);
+        if (width & 1)
+            pdstU[i * uPitch + pairs] = srcRow[width - 1];
     }
 }
 
-// P411's Y, U, V are seperated. But the NV12's U and V are interleaved.
 void NV12ToP411(int width, int height, void *src, void *dst)
 {
-    int i, j, p, q;
-    unsigned char *pdstU, *pdstV;
-    unsigned char *psrcUV;
-
-    // copy Y data
-    memcpy(dst, src, width * height);
-    // copy U data and V data
-    psrcUV = (unsigned char *)src + width * height;
-    pdstU = (unsigned char *)dst + width * height;
-    pdstV = pdstU + width * height / 4;
-    p = q = 0;
-    for (i = 0; i < height / 2; i++) {
-        for (j = 0; j < width; j++) {
-            if (j % 2 == 0) {
-                pdstU[p]= (psrcUV[i * width + j] & 0xFF) ;
-                p++;
-           } else {
-                pdstV[q]= (psrcUV[i * width + j] & 0xFF);
-                q++;
-            }
-        }
-    }
+    runConvertRows(NV12ToP411Rows, width, height, src, dst);
 }
 
-void YU16ToYUYV(int width, int height, void *src, void *dst)
+static void YU16ToYUYVRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    int planeSizeY = width * height;
-int planeSizeUV = planeSizeY / 2;
+    int planeSizeY = job.width * job.height;
+    int planeSizeUV = planeSizeY / 2;
+    // one macro pixel per chroma sample
+    const int pairBegin = rowBegin * job.width / 2;
+    const int pairEnd = (rowEnd == job.height) ? planeSizeUV : rowEnd * job.width / 2;
 
-    unsigned char *srcPtrY = (unsigned char *) src;
-    unsigned char *srcPtrU = srcPtrY + planeSizeY;
+    unsigned char *srcPtrY = job.src + pairBegin * 2;
+    unsigned char *srcPtrU = job.src + planeSizeY + pairBegin;
     unsigned char *srcPtrV = srcPtrU + planeSizeUV;
-    unsigned char *dstPtr = (unsigned char *) dst;
+    unsigned char *dstPtr = job.dst + pairBegin * 4;
 
 // interleave: YUYV a macro pixel
-    for  (int i = 0; i < planeSizeUV; i ++) {
+    for  (int i = pairBegin; i < pairEnd; i ++) {
         * dstPtr ++ = *srcPtrY ++; // Y
         * dstPtr ++ = *srcPtrU ++; // U
         * dstPtr ++ = *srcPtrY ++; // Y
@@ -610,219 +438,109 @@ int planeSizeUV = planeSizeY / 2;
     }
 }
 
-void YU16ToYV12(int width, int height, void *src, void *dst)
+void YU16ToYUYV(int width, int height, void *src, void *dst)
 {
-    int planeSizeY = width * height;
+    runConvertRows(YU16ToYUYVRows, width, height, src, dst);
+}
+
+static void YU16ToYV12Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const ColorKernels &kernels = getColorKernels();
+    int planeSizeY = width * job.height;
     int planeSizeU = planeSizeY / 2;
-    int planeSizeV = planeSizeY / 2;
     int newPlaneSizeV = planeSizeY / 4;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) src + planeSizeY + planeSizeU;
-
-    unsigned char *dstPtr = (unsigned char *) dst;
-    unsigned char *dstPtrV = (unsigned char *) dst + planeSizeY;
-    unsigned char *dstPtrU = (unsigned char *) dst + planeSizeY + newPlaneSizeV;
+    unsigned char *srcPtrU = job.src + planeSizeY;
+    unsigned char *srcPtrV = job.src + planeSizeY + planeSizeU;
 
-    unsigned char * pTmp;
+    // copy the Y plane
+    memcpy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
 
-    // copy the entire Y plane
-    memcpy(dstPtr, srcPtr, planeSizeY);
-
-    // handle the V data
-    int vertical = height / 2;
+    // average each pair of chroma rows, truncating like the converter always did
     int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        pTmp = srcPtrV + 2 * i * horizontal;
-        for (j = 0; j < horizontal; j++)
-            *dstPtrV++ = (pTmp[j] + (pTmp + horizontal)[j]) / 2;
-    }
-    // handle the U data
-    for(i = 0; i < vertical; i++) {
-        pTmp = srcPtrU + 2 * i * horizontal;
-        for (j = 0; j < horizontal; j++)
-            *dstPtrU++ = (pTmp[j] + (pTmp + horizontal)[j]) / 2;
+    unsigned char *dstPtrV = job.dst + planeSizeY;
+    unsigned char *dstPtrU = job.dst + planeSizeY + newPlaneSizeV;
+    for (int i = rowBegin / 2; i < rowEnd / 2; i++) {
+        const unsigned char *pV = srcPtrV + 2 * i * horizontal;
+        const unsigned char *pU = srcPtrU + 2 * i * horizontal;
+        kernels.averageChromaRows(pV, pV + horizontal, dstPtrV + i * horizontal, horizontal, false);
+        kernels.averageChromaRows(pU, pU + horizontal, dstPtrU + i * horizontal, horizontal, false);
     }
 }
 
-void YU16ToNV12(int width, int height, void *src, void *dst)
+void YU16ToYV12(int width, int height, void *src, void *dst)
 {
-    int planeSizeY = width * height;
-    int planeSizeU = planeSizeY / 2;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) srcPtrU + planeSizeU;
-    unsigned char *dstPtr = (unsigned char *) dst;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, srcPtr, planeSizeY);
-    dstPtr += planeSizeY;
-
-    // deinterlace the UV data
-    int vertical = height / 2;
-    int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        for (j = 0; j < horizontal; j++) {
-            *dstPtr++ = srcPtrU[2 * i * horizontal + j];
-            *dstPtr++ = srcPtrV[2 * i * horizontal + j];
-        }
-    }
+    runConvertRows(YU16ToYV12Rows, width, height, src, dst);
 }
-void YU16ToNV21(int width, int height, void *src, void *dst)
+
+static void YU16ToNV12Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    int planeSizeY = width * height;
+    const int width = job.width;
+    const ColorKernels &kernels = getColorKernels();
+    int planeSizeY = width * job.height;
     int planeSizeU = planeSizeY / 2;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrU = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrV = (unsigned char *) srcPtrU + planeSizeU;
-    unsigned char *dstPtr = (unsigned char *) dst;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, srcPtr, planeSizeY);
-    dstPtr += planeSizeY;
-
-    // deinterlace the UV data
-    int vertical = height / 2;
+    unsigned char *srcPtrU = job.src + planeSizeY;
+    unsigned char *srcPtrV = srcPtrU + planeSizeU;
+
+    // copy the Y plane
+    memcpy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
+
+    // interleave the even chroma rows
     int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        for (j = 0; j < horizontal; j++) {
-            *dstPtr++ = srcPtrV[2 * i * horizontal + j];
-            *dstPtr++ = srcPtrU[2 * i * horizontal + j];
-        }
-    }
+    unsigned char *dstPtr = job.dst + planeSizeY;
+    for (int i = rowBegin / 2; i < rowEnd / 2; i++)
+        kernels.interleaveChroma(srcPtrU + 2 * i * horizontal, srcPtrV + 2 * i * horizontal,
+                                 dstPtr + i * horizontal * 2, horizontal);
 }
 
-
-// covert NV12 (Y plane, interlaced UV bytes) to
-// YV12 (Y plane, V plane, U plane)
-void NV12ToYV12(int width, int height, void *src, void *dst)
+void YU16ToNV12(int width, int height, void *src, void *dst)
 {
-    int planeSizeY = width * height;
-    int planeSizeUV = planeSizeY / 2;
-    int planeUOffset = planeSizeUV / 2;
-    int i = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *dstPtr = (unsigned char *) dst;
-    unsigned char *dstPtrV = (unsigned char *) dst + planeSizeY;
-    unsigned char *dstPtrU = (unsigned char *) dst + planeSizeY + planeUOffset;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, src, planeSizeY);
-
-    // deinterlace the UV data
-    for(i=planeSizeY; i<(planeSizeY+planeSizeUV); i=i+2)
-    {
-        *dstPtrV++ = srcPtr[i + 1];
-        *dstPtrU++ = srcPtr[i];
-    }
+    runConvertRows(YU16ToNV12Rows, width, height, src, dst);
 }
 
-void YV12ToNV12(int width, int height, void *src, void *dst)
+static void YU16ToNV21Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    int planeSizeY = width * height;
-    int planeSizeV = planeSizeY / 4;
-    int newPlaneSizeUV = planeSizeY / 2;
-    int i = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrV = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrU = (unsigned char *) srcPtrV + planeSizeV;
-    unsigned char * dstPtr = (unsigned char *) dst;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, srcPtr, planeSizeY);
-    dstPtr += planeSizeY;
-
-    // deinterlace the UV data
-    for(i = 0; i < planeSizeV; i++) {
-        *dstPtr++ = srcPtrU[i];
-        *dstPtr++ = srcPtrV[i];
-    }
-}
-void YV12ToNV21(int width, int height, void *src, void *dst)
-{
-    int planeSizeY = width * height;
-    int planeSizeV = planeSizeY / 4;
-    int newPlaneSizeUV = planeSizeY / 2;
-    int i = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrV = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrU = (unsigned char *) srcPtrV + planeSizeV;
-    unsigned char * dstPtr = (unsigned char *) dst;
-
-    // copy the entire Y plane
-    memcpy(dstPtr, srcPtr, planeSizeY);
-    dstPtr += planeSizeY;
-
-    // deinterlace the UV data
-    for(i = 0; i < planeSizeV; i++) {
-        *dstPtr++ = srcPtrV[i];
-        *dstPtr++ = srcPtrU[i];
-    }
-}
-/*
-convert YV12 to NV21
-width: dst image width
-height: dst image height
-stride: stride for src image
-alignheight: aligned height for src image
-*/
+    const int width = job.width;
+    const ColorKernels &kernels = getColorKernels();
+    int planeSizeY = width * job.height;
+    int planeSizeU = planeSizeY / 2;
+    unsigned char *srcPtrU = job.src + planeSizeY;
+    unsigned char *srcPtrV = srcPtrU + planeSizeU;
 
-void YV12ToNV21withStride(int width, int height,int stride,int alignheight, void *src, void *dst)
-{
-    int planeSizeY = stride * alignheight;
-    int planeSizeV = stride * alignheight / 4;
-    int newPlaneSizeY = width * height;
-    int i = 0;
-    int j = 0;
-    unsigned char *srcPtr = (unsigned char *) src;
-    unsigned char *srcPtrV = (unsigned char *) src + planeSizeY;
-    unsigned char *srcPtrU = (unsigned char *) srcPtrV + planeSizeV;
-    unsigned char * dstPtr = (unsigned char *) dst;
-    unsigned char * dstPtrVU = (unsigned char *) dstPtr + newPlaneSizeY;
-
-    // copy the entire Y plane
-    if(width == stride)
-    {
-       memcpy(dstPtr, srcPtr, width * height);
-       dstPtr += (width * height);
-    }
-    else
-    {
-      for(i = 0;i < height;i++)
-      {
-         memcpy(dstPtr, srcPtr, width);
-         dstPtr += width;
-         srcPtr += stride;
-      }
-   }
-    // deinterlace the UV data
-    int vertical = height / 2;
+    // copy the Y plane
+    memcpy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
+
+    // interleave the even chroma rows
     int horizontal = width / 2;
-    for(i = 0; i < vertical; i++) {
-        for( j = 0; j < horizontal; j ++) {
-        *dstPtr++ = srcPtrV[j];
-        *dstPtr++ = srcPtrU[j];
-       }
-        srcPtrV += stride/2;
-        srcPtrU += stride/2;
-    }
+    unsigned char *dstPtr = job.dst + planeSizeY;
+    for (int i = rowBegin / 2; i < rowEnd / 2; i++)
+        kernels.interleaveChroma(srcPtrV + 2 * i * horizontal, srcPtrU + 2 * i * horizontal,
+                                 dstPtr + i * horizontal * 2, horizontal);
 }
-void RepaddingYV12(int width, int height, int srcStride, int dstStride,int alignheight, void *src, void *dst,int dstAlignTo16)
+
+void YU16ToNV21(int width, int height, void *src, void *dst)
 {
-    // copy the entire Y plane
+    runConvertRows(YU16ToNV21Rows, width, height, src, dst);
+}
+
+// job.stride/job.dstStride are the src/dst luma strides, job.option is dstAlignTo16
+static void RepaddingYV12Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const int height = job.height;
+    const int alignheight = job.alignHeight;
+    const int srcStride = job.stride;
+    const int dstStride = job.dstStride;
+    ColorReadback readback(job.srcUncached);
+    // copy the Y plane
     if (srcStride == dstStride) {
-        memcpy(dst, src, dstStride * height);
+        readback.copy(job.dst + rowBegin * dstStride, job.src + rowBegin * dstStride,
+                      dstStride * (rowEnd - rowBegin));
     } else {
-        unsigned char *srcPtrY = (unsigned char *)src;
-        unsigned char *dstPtrY = (unsigned char *)dst;
-        for (int i = 0; i < height; i ++) {
-            memcpy(dstPtrY, srcPtrY, width);
+        unsigned char *srcPtrY = job.src + rowBegin * srcStride;
+        unsigned char *dstPtrY = job.dst + rowBegin * dstStride;
+        for (int i = rowBegin; i < rowEnd; i ++) {
+            readback.copy(dstPtrY, srcPtrY, width);
             srcPtrY += srcStride;
             dstPtrY += dstStride;
         }
@@ -831,7 +549,7 @@ void RepaddingYV12(int width, int height, int srcStride, int dstStride,int align
     // copy VU plane
     const int scStride = srcStride >> 1;
     int dcStride = 0;
-    if(dstAlignTo16 == 1)
+    if(job.option == 1)
     {
        dcStride = ALIGN(dstStride >> 1,16); // Android CTS required: U/V plane needs 16 bytes aligned!
     }
@@ -839,23 +557,29 @@ void RepaddingYV12(int width, int height, int srcStride, int dstStride,int align
     {
        dcStride = dstStride >> 1;
     }
+    const int hBegin = rowBegin >> 1;
+    const int hEnd = rowEnd >> 1;
     if (dcStride == scStride) {
-        unsigned char *srcPtrV = (unsigned char *)src + alignheight * srcStride;
-        unsigned char *dstPtrV = (unsigned char *)dst + height * dstStride;
-        memcpy(dstPtrV, srcPtrV, height/2 * dcStride);
+        unsigned char *srcPtrV = job.src + alignheight * srcStride;
+        unsigned char *dstPtrV = job.dst + height * dstStride;
+        readback.copy(dstPtrV + hBegin * dcStride, srcPtrV + hBegin * dcStride, (hEnd - hBegin) * dcStride);
         unsigned char *srcPtrU = srcPtrV + alignheight/2 * scStride;
         unsigned char *dstPtrU = dstPtrV + height/2 * dcStride;
-        memcpy(dstPtrU, srcPtrU, height/2 * dcStride);
+        readback.copy(dstPtrU + hBegin * dcStride, srcPtrU + hBegin * dcStride, (hEnd - hBegin) * dcStride);
     } else {
         const int wHalf = width >> 1;
         const int hHalf = height >> 1;
-        unsigned char *srcPtrV = (unsigned char *)src + alignheight * srcStride;
+        unsigned char *srcPtrV = job.src + alignheight * srcStride;
         unsigned char *srcPtrU = srcPtrV + scStride * alignheight/2;
-        unsigned char *dstPtrV = (unsigned char *)dst + height * dstStride;
+        unsigned char *dstPtrV = job.dst + height * dstStride;
         unsigned char *dstPtrU = dstPtrV + dcStride * hHalf;
-        for (int i = 0; i < hHalf; i ++) {
-            memcpy(dstPtrU, srcPtrU, wHalf);
-            memcpy(dstPtrV, srcPtrV, wHalf);
+        srcPtrV += hBegin * scStride;
+        srcPtrU += hBegin * scStride;
+        dstPtrV += hBegin * dcStride;
+        dstPtrU += hBegin * dcStride;
+        for (int i = hBegin; i < hEnd; i ++) {
+            readback.copy(dstPtrU, srcPtrU, wHalf);
+            readback.copy(dstPtrV, srcPtrV, wHalf);
             dstPtrU += dcStride;
             srcPtrU += scStride;
             dstPtrV += dcStride;
@@ -864,174 +588,329 @@ void RepaddingYV12(int width, int height, int srcStride, int dstStride,int align
     }
 }
 
+static void initRepaddingYV12Job(ColorConvertJob *job, int width, int height, int srcStride, int dstStride,
+                                 int alignheight, void *src, void *dst, int dstAlignTo16)
+{
+    initConvertJob(job, RepaddingYV12Rows, width, height, srcStride, alignheight, src, dst);
+    job->dstStride = dstStride;
+    job->option = dstAlignTo16;
+}
 
-static status_t colorConvertYUYV(int dstFormat, int width, int height, void *src, void *dst)
+void RepaddingYV12(int width, int height, int srcStride, int dstStride,int alignheight, void *src, void *dst,int dstAlignTo16)
 {
-    switch (dstFormat) {
-    case V4L2_PIX_FMT_NV12:
-	YUYVToNV12_withStride(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_NV21:
-        YUYVToNV21(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_RGB565:
-        YUYVToRGB565(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_RGB32:
-        YUYVToRGB8888(width, height, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dest)");
-        return BAD_VALUE;
-    };
+    ColorConvertJob job;
+    initRepaddingYV12Job(&job, width, height, srcStride, dstStride, alignheight, src, dst, dstAlignTo16);
+    job.srcUncached = true;
+    runColorConvertJob(job);
+}
 
-    return NO_ERROR;
+/*
+The planar and semi-planar conversions all copy the luma plane and reshuffle
+the chroma samples, so they are written once, as convertPlanesRows<Src, Dst,
+Packed>, and instantiated for every pair of layouts the HAL converts between.
+The plane layouts are fixed at compile time, which leaves the sample steps,
+plane order and chroma subsampling as constants in the inner loops; only the
+frame dimensions are read at run time. 'Packed' instances are for sources
+whose rows are exactly 'width' bytes apart (stride == width and alignHeight
+== height), where the pitch is known to be the width and bands whose chroma
+rows are contiguous on both sides are reshuffled as a single run.
+
+The chroma is converted in whole 2x2 blocks: (width / 2) samples for each of
+the (height / 2) chroma rows, by the chroma primitives of ColorKernels. NV12
+and NV21 only swap their pairs, so colorConvert() also runs them in place.
+
+A layout places the chroma of a frame from its luma pitch and the rows of
+its luma plane (stride and alignHeight for surfaces, width and height for
+packed frames):
+    INTERLEAVED      U and V samples alternate in a single plane
+    V_FIRST          V comes first, in the pairs or in plane order
+    CHROMA_ROW_STEP  source chroma rows per 4:2:0 chroma row, 2 for the 4:2:2
+                     layouts, whose odd chroma rows are skipped
+    chromaPitch()    bytes from one chroma row to the next
+    secondPlane()    offset of the second chroma plane from the first
+*/
+
+// NV12: Y plane, interleaved UV pairs
+struct LayoutNV12 {
+    static const int INTERLEAVED = 1;
+    static const int V_FIRST = 0;
+    static const int CHROMA_ROW_STEP = 1;
+    static inline int chromaPitch(int pitch) { return pitch; }
+    static inline int secondPlane(int, int) { return 1; }
+};
+
+// NV21: Y plane, interleaved VU pairs
+struct LayoutNV21 {
+    static const int INTERLEAVED = 1;
+    static const int V_FIRST = 1;
+    static const int CHROMA_ROW_STEP = 1;
+    static inline int chromaPitch(int pitch) { return pitch; }
+    static inline int secondPlane(int, int) { return 1; }
+};
+
+// YV12 as the driver and the VPP lay it out: V and U planes at half the luma pitch
+struct LayoutYV12 {
+    static const int INTERLEAVED = 0;
+    static const int V_FIRST = 1;
+    static const int CHROMA_ROW_STEP = 1;
+    static inline int chromaPitch(int pitch) { return pitch / 2; }
+    static inline int secondPlane(int pitch, int planeRows) { return pitch * planeRows / 4; }
+};
+
+// YV12 as Android expects it from the HAL, chroma pitch aligned to 16 bytes
+struct LayoutYV12Aligned {
+    static const int INTERLEAVED = 0;
+    static const int V_FIRST = 1;
+    static const int CHROMA_ROW_STEP = 1;
+    static inline int chromaPitch(int pitch) { return ALIGN(pitch >> 1, 16); }
+    static inline int secondPlane(int pitch, int planeRows) { return chromaPitch(pitch) * planeRows / 2; }
+};
+
+// YUV422H surfaces: U and V planes as wide and as tall as the luma plane
+struct LayoutYUV422H {
+    static const int INTERLEAVED = 0;
+    static const int V_FIRST = 0;
+    static const int CHROMA_ROW_STEP = 2;
+    static inline int chromaPitch(int pitch) { return pitch; }
+    static inline int secondPlane(int pitch, int planeRows) { return pitch * planeRows; }
+};
+
+// first chroma byte (of the first plane, or the first pair) of 4:2:0 chroma row 'row'
+template <class Layout>
+static inline unsigned char *chromaRow(unsigned char *base, int pitch, int planeRows, int row)
+{
+    return base + pitch * planeRows + row * Layout::CHROMA_ROW_STEP * Layout::chromaPitch(pitch);
 }
 
-static status_t colorConvertNV12(int dstFormat, int width, int height, void *src, void *dst)
+template <class Src, class Dst, bool Packed>
+static void convertPlanesRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    switch (dstFormat) {
-    case V4L2_PIX_FMT_NV21:
-        NV12ToNV21(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_YUV420:
-        NV12ToYV12(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_RGB565:
-        NV12ToRGB565(width, height, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dest)");
-        return BAD_VALUE;
-    };
+    const int width = job.width;
+    const int height = job.height;
+    const int srcPitch = Packed ? width : job.stride;
+    const int srcRows = Packed ? height : job.alignHeight;
+    const int srcStep = Src::INTERLEAVED ? 2 : 1;
+    const int dstStep = Dst::INTERLEAVED ? 2 : 1;
+    const int srcChromaPitch = Src::CHROMA_ROW_STEP * Src::chromaPitch(srcPitch);
+    const int dstChromaPitch = Dst::chromaPitch(width);
+    const ColorKernels &kernels = getColorKernels();
+    ColorReadback readback(job.srcUncached);
+
+    // copy the Y plane, an in-place conversion leaves it where it is
+    if (job.src != job.dst) {
+        if (Packed)
+            readback.copy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
+        else
+            copyLumaRows(job, readback, rowBegin, rowEnd);
+    }
 
-    return NO_ERROR;
+    int samples = width / 2;
+    int rows = rowEnd / 2 - rowBegin / 2;
+    if (Packed && !job.srcUncached && srcChromaPitch == samples * srcStep && dstChromaPitch == samples * dstStep) {
+        // the chroma rows of the band follow each other on both sides
+        samples *= rows;
+        rows = rows > 0 ? 1 : 0;
+    }
+
+    // planar to planar copies whole destination chroma rows, with the padding
+    // of the aligned YV12 pitch, where the source rows hold that many bytes
+    const int planeBytes = (!Dst::INTERLEAVED && dstChromaPitch > samples &&
+                            dstChromaPitch <= Src::chromaPitch(srcPitch)) ? dstChromaPitch : samples;
+
+    unsigned char *srcFirst = chromaRow<Src>(job.src, srcPitch, srcRows, rowBegin / 2);
+    unsigned char *dstFirst = chromaRow<Dst>(job.dst, width, height, rowBegin / 2);
+    const int srcSecond = Src::secondPlane(srcPitch, srcRows);
+    const int dstSecond = Dst::secondPlane(width, height);
+    for (int i = 0; i < rows; i++) {
+        unsigned char *dstU = dstFirst + (Dst::V_FIRST ? dstSecond : 0);
+        unsigned char *dstV = dstFirst + (Dst::V_FIRST ? 0 : dstSecond);
+
+        if (Src::INTERLEAVED) {
+            const unsigned char *pairs = readback.read(0, srcFirst, samples * 2);
+            if (!Dst::INTERLEAVED)
+                kernels.deinterleaveChroma(pairs, Src::V_FIRST ? dstV : dstU, Src::V_FIRST ? dstU : dstV, samples);
+            else if (Src::V_FIRST != Dst::V_FIRST)
+                kernels.swapChromaPairs(pairs, dstFirst, samples);
+            else if (pairs != dstFirst)
+                memcpy(dstFirst, pairs, samples * 2);
+        } else {
+            const unsigned char *first = readback.read(0, srcFirst, planeBytes);
+            const unsigned char *second = readback.read(1, srcFirst + srcSecond, planeBytes);
+            const unsigned char *srcU = Src::V_FIRST ? second : first;
+            const unsigned char *srcV = Src::V_FIRST ? first : second;
+            if (Dst::INTERLEAVED) {
+                kernels.interleaveChroma(Dst::V_FIRST ? srcV : srcU, Dst::V_FIRST ? srcU : srcV, dstFirst, samples);
+            } else {
+                memcpy(dstU, srcU, planeBytes);
+                memcpy(dstV, srcV, planeBytes);
+            }
+        }
+        srcFirst += srcChromaPitch;
+        dstFirst += dstChromaPitch;
+    }
 }
-static status_t colorConvertYUV420(int dstFormat, int width, int height, void *src, void *dst)
+
+struct ColorConvertEntry {
+    int srcFormat;
+    int dstFormat;
+    bool packed;    // only for sources whose stride is their width
+    ColorConvertRowsFunc convertRows;
+};
+
+#define PLANES_ROWS(src, dst, packed) convertPlanesRows<Layout##src, Layout##dst, packed>
+
+// every conversion colorConvert() and colorConvertwithStride() run; a
+// packed entry is preferred to the stride-aware one of the same pair
+static const ColorConvertEntry sConvertTable[] = {
+    // YUYV goes through the row kernels, the NV12 output is the video surface
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, true, YUYVToNV12_withStrideRows },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21, true, YUYVToNV21Rows },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB565, true, YUYVToRGB565Rows },
+    { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB32, true, YUYVToRGB8888Rows },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, true, NV12ToRGB565Rows },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, false, NV12ToRGB565withStrideRows },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_RGB565, true, YV12ToBGR565Rows },
+
+    // plane reshuffles
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, true, PLANES_ROWS(NV12, NV21, true) },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, false, PLANES_ROWS(NV12, NV21, false) },
+    { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_NV12, true, PLANES_ROWS(NV21, NV12, true) },
+    { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_NV12, false, PLANES_ROWS(NV21, NV12, false) },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, true, PLANES_ROWS(NV12, YV12, true) },
+    { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, false, PLANES_ROWS(NV12, YV12, false) },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, true, PLANES_ROWS(YV12, NV12, true) },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, false, PLANES_ROWS(YV12, NV12, false) },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, true, PLANES_ROWS(YV12, NV21, true) },
+    { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, false, PLANES_ROWS(YV12, NV21, false) },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, true, PLANES_ROWS(YUV422H, NV12, true) },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, false, PLANES_ROWS(YUV422H, NV12, false) },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, true, PLANES_ROWS(YUV422H, NV21, true) },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, false, PLANES_ROWS(YUV422H, NV21, false) },
+    // the YV12 picture and callback buffers have the Android chroma alignment
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, true, PLANES_ROWS(YUV422H, YV12Aligned, true) },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, false, PLANES_ROWS(YUV422H, YV12Aligned, false) },
+};
+
+#undef PLANES_ROWS
+
+ColorConvertRowsFunc getColorConvertRows(int srcFormat, int dstFormat, bool packed)
 {
-    int stride = 0;
-    switch (dstFormat) {
-    case V4L2_PIX_FMT_NV21:
-        YV12ToNV21(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_NV12:
-        YV12ToNV12(width, height, src, dst);
-        break;
-    case V4L2_PIX_FMT_RGB565:
-        YV12ToBGR565(width, height,width,src, dst);
-        break;
-    case V4L2_PIX_FMT_YUV420:
-        stride = ALIGN(width,16);
-        RepaddingYV12(width, height, width, stride, height, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dest)");
-        return BAD_VALUE;
-    };
+    ColorConvertRowsFunc stridedRows = NULL;
+
+    if (srcFormat == HAL_PIXEL_FORMAT_NV12_TILED_INTEL)
+        srcFormat = V4L2_PIX_FMT_NV12;
+    else if (srcFormat == HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL)
+        srcFormat = V4L2_PIX_FMT_YUV422P;
+
+    for (unsigned int i = 0; i < sizeof(sConvertTable) / sizeof(sConvertTable[0]); i++) {
+        const ColorConvertEntry &entry = sConvertTable[i];
+        if (entry.srcFormat != srcFormat || entry.dstFormat != dstFormat)
+            continue;
+        if (!entry.packed)
+            stridedRows = entry.convertRows;
+        else if (packed)
+            return entry.convertRows;
+    }
+    return stridedRows;
+}
 
-    return NO_ERROR;
+void YV12ToNV12(int width, int height, void *src, void *dst)
+{
+    runConvertRows(convertPlanesRows<LayoutYV12, LayoutNV12, true>, width, height, src, dst);
+}
+
+// NV12 <-> NV21 keep every plane where it is, the only conversions that can run in place
+static bool convertsInPlace(int srcFormat, int dstFormat)
+{
+    return (srcFormat == V4L2_PIX_FMT_NV12 || srcFormat == V4L2_PIX_FMT_NV21)
+        && (dstFormat == V4L2_PIX_FMT_NV12 || dstFormat == V4L2_PIX_FMT_NV21);
 }
 
 status_t colorConvert(int srcFormat, int dstFormat, int width, int height, void *src, void *dst)
 {
-    status_t status = NO_ERROR;
-    int size = 0;
+    ColorConvertJob job;
+    initConvertJob(&job, NULL, width, height, width, height, src, dst);
+
+    if (src == dst) {
+        if (!convertsInPlace(srcFormat, dstFormat)) {
+            ALOGE("Color conversion 0x%x -> 0x%x can't run in place", srcFormat, dstFormat);
+            return BAD_VALUE;
+        }
+        if (srcFormat == dstFormat)
+            return NO_ERROR;
+    }
+
     if ((srcFormat == dstFormat) && (srcFormat != V4L2_PIX_FMT_YUV420)) {
         ALOGD("src format is the same as dst format");
-        size = frameSize(srcFormat,width,height);
-        memcpy(dst,src,size);
+        job.convertRows = copyFrameRows;
+        job.option = frameSize(srcFormat,width,height);
+        runColorConvertJob(job);
         return NO_ERROR;
     }
 
-    switch (srcFormat) {
-    case V4L2_PIX_FMT_YUYV:
-        return colorConvertYUYV(dstFormat, width, height, src, dst);
-    case V4L2_PIX_FMT_NV12:
-        return colorConvertNV12(dstFormat, width, height, src, dst);
-    case V4L2_PIX_FMT_YUV420:
-        return colorConvertYUV420(dstFormat, width, height, src, dst);
-    default:
-        ALOGE("invalid (source) color format");
-        return BAD_VALUE;
-    };
-}
-static status_t colorConvertNV12withStride(int dstFormat, int stride,int width, int alignheight,int height, void *src, void *dst)
-{
-    switch (dstFormat) {
-    case V4L2_PIX_FMT_RGB565:
-        NV12ToRGB565withStride(width, height,stride,alignheight, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dest)");
-        return BAD_VALUE;
-    };
+    if (srcFormat == V4L2_PIX_FMT_YUV420 && dstFormat == V4L2_PIX_FMT_YUV420) {
+        initRepaddingYV12Job(&job, width, height, width, ALIGN(width, 16), height, src, dst, 1);
+    } else {
+        job.convertRows = getColorConvertRows(srcFormat, dstFormat, true);
+        if (job.convertRows == NULL) {
+            ALOGE("Invalid color conversion 0x%x -> 0x%x", srcFormat, dstFormat);
+            return BAD_VALUE;
+        }
+    }
 
+    runColorConvertJob(job);
     return NO_ERROR;
 }
-static status_t colorConvertYUV422PwithStride(int dstFormat, int stride,int width, int alignheight,int height, void *src, void *dst)
-{
-    switch (dstFormat) {
-    case V4L2_PIX_FMT_NV12:
-        YUV422PToNV12withStride(width, height,stride,alignheight, src, dst);
-        break;
-    case V4L2_PIX_FMT_NV21:
-        YUV422PToNV21withStride(width, height,stride,alignheight, src, dst);
-        break;
-    case V4L2_PIX_FMT_YUV420:
-        YUV422PToYV12withStride(width, height,stride,alignheight, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dst)");
-        return BAD_VALUE;
-    };
 
-    return NO_ERROR;
-}
-static status_t colorConvertYV12withStride(int dstFormat, int stride,int width, int alignheight,int height, void *src, void *dst)
+// NV21 copy from a plane of job.stride bytes per row into a packed frame
+static void copyNV21WithStrideRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
 {
-    switch (dstFormat) {
-        case V4L2_PIX_FMT_NV21:
-        YV12ToNV21withStride(width, height,stride,alignheight, src, dst);
-        break;
-    default:
-        ALOGE("Invalid color format (dst)");
-        return BAD_VALUE;
-    };
+    const int width = job.width;
+    const int height = job.height;
+    const int srcstride = job.stride;
+    ColorReadback readback(job.srcUncached);
+
+    if (srcstride == width) {
+        // packed already, the frame is copied as one block of width*height*3/2
+        const int uvSize = width * height * 3 / 2 - width * height;
+        const int uvBegin = width * height + chromaOffset(job, rowBegin, width, uvSize);
+        const int uvEnd = width * height + chromaOffset(job, rowEnd, width, uvSize);
+        readback.copy(job.dst + rowBegin * width, job.src + rowBegin * width, (rowEnd - rowBegin) * width);
+        readback.copy(job.dst + uvBegin, job.src + uvBegin, uvEnd - uvBegin);
+        return;
+    }
 
-    return NO_ERROR;
+    copyLumaRows(job, readback, rowBegin, rowEnd);
+    // the VU rows follow the luma rows that were copied, at the same stride
+    const int uvwidth = width;
+    const int uvstride = srcstride;
+    unsigned char *psrc = job.src + height * srcstride + (rowBegin / 2) * uvstride;
+    unsigned char *pdst = job.dst + height * width + (rowBegin / 2) * uvwidth;
+    for (int i = rowBegin / 2; i < rowEnd / 2; i++) {
+        readback.copy(pdst, psrc, uvwidth);
+        pdst += uvwidth;
+        psrc += uvstride;
+    }
 }
 
 int copyBufWithStride(void *dst, void *src, int width, int height, int srcstride,int dststride,int alignheight,int srcFormat)
 {
-    char *psrc, *pdst;
-    int i, uvstride, uvwidth;
+    ColorConvertJob job;
     LOG1("@%s", __FUNCTION__);
-    psrc = (char *)src;
-    pdst = (char *)dst;
     if (srcFormat == HAL_PIXEL_FORMAT_YV12 ||srcFormat == V4L2_PIX_FMT_YUV420) {
-        RepaddingYV12(width,height,srcstride,dststride,alignheight,src,dst);
+        initRepaddingYV12Job(&job, width, height, srcstride, dststride, alignheight, src, dst, 1);
+        job.srcUncached = true;
+        runColorConvertJob(job);
     }
     else if(srcFormat == HAL_PIXEL_FORMAT_YCrCb_420_SP || srcFormat == V4L2_PIX_FMT_NV21)//nv21
     {
-        if (srcstride > width) {
-            for (i = 0; i < height; i++) {
-                memcpy(pdst, psrc, width);
-                pdst += width;
-                psrc += srcstride;
-            }
-            uvwidth = width;
-            uvstride = srcstride;
-            for (i = 0; i < height/2; i++) {
-                memcpy(pdst, psrc, uvwidth);
-                pdst += uvwidth;
-                psrc +=uvstride;
-            }
-        } else if (srcstride == width) {
-            memcpy(dst, src, width*height*3/2);
-        } else {
+        if (srcstride < width) {
             ALOGE("@%s, line:%d, wrong, stride:%d < width:%d", __FUNCTION__, __LINE__, srcstride, width);
             return -1;
         }
+        initConvertJob(&job, copyNV21WithStrideRows, width, height, srcstride, alignheight, src, dst);
+        job.srcUncached = true;
+        runColorConvertJob(job);
     }
     else
     {
@@ -1042,23 +921,500 @@ int copyBufWithStride(void *dst, void *src, int width, int height, int srcstride
 
 status_t colorConvertwithStride(int srcFormat, int dstFormat, int stride,int width, int alignHeight, int height, void *src, void *dst)
 {
+    ColorConvertJob job;
+
     if (srcFormat == dstFormat) {
         return copyBufWithStride(dst,src,width,height,stride,width,alignHeight,srcFormat);
     }
 
-    switch (srcFormat) {
-    case V4L2_PIX_FMT_NV12:
-    case HAL_PIXEL_FORMAT_NV12_TILED_INTEL:
-        return colorConvertNV12withStride(dstFormat,stride, width, alignHeight,height, src, dst);
+    initConvertJob(&job, NULL, width, height, stride, alignHeight, src, dst);
+    job.srcUncached = true;
+    job.convertRows = getColorConvertRows(srcFormat, dstFormat, stride == width && alignHeight == height);
+    if (job.convertRows == NULL) {
+        ALOGE("Invalid color conversion 0x%x -> 0x%x", srcFormat, dstFormat);
+        return BAD_VALUE;
+    }
+
+    runColorConvertJob(job);
+    return NO_ERROR;
+}
+
+/*
+NV12 surfaces of the video encoder (HAL_PIXEL_FORMAT_NV12_TILED_INTEL), filled
+and read back on the CPU. Rows are 'pitch' bytes apart and the UV plane starts
+at pitch * alignHeight.
+
+In graphics memory these surfaces are Y-tiled: each plane is a grid of 4 KB
+tiles of 128 bytes by 32 rows, pitch / 128 tiles per tile row, and inside a
+tile the 16 byte OWords are stored column first (the 32 rows of bytes 0-15,
+then the 32 rows of bytes 16-31, ...). One row of a plane is therefore spread
+over its tile row in OWords 512 bytes apart, which is what the yTileRow and
+yDetileRow kernels move. A gralloc lock() maps the surface through a fence
+that hides the tiling, SURFACE_LINEAR is the layout seen there, and
+SURFACE_Y_TILED is for mappings of the bo itself.
+
+Only the even part of the width is converted, two pixels at a time like the
+YUYV converters, and chroma row i is taken from source row 2 * i.
+*/
+
+static const int YTILE_WIDTH = 128;
+static const int YTILE_ROWS = 32;
+static const int YTILE_BYTES = YTILE_WIDTH * YTILE_ROWS;
+static const int YTILE_OWORD = 16;
+
+// first OWord of 'row' in a Y-tiled plane
+static inline unsigned char *yTiledRow(unsigned char *plane, int pitch, int row)
+{
+    return plane + (row / YTILE_ROWS) * pitch * YTILE_ROWS + (row % YTILE_ROWS) * YTILE_OWORD;
+}
+
+// 'bytes' bytes at column 'x' of 'row' of a surface plane, x a multiple of YTILE_WIDTH when Y-tiled
+template <bool YTiled>
+static inline void storeSurfaceRow(const ColorKernels &kernels, const unsigned char *src,
+                                   unsigned char *plane, int pitch, int row, int x, int bytes)
+{
+    if (YTiled)
+        kernels.yTileRow(src, yTiledRow(plane, pitch, row) + (x / YTILE_WIDTH) * YTILE_BYTES, bytes);
+    else
+        memcpy(plane + row * pitch + x, src, bytes);
+}
+
+// rows [first, last) of a surface plane into a packed plane of 'dstPitch' bytes per row
+template <bool YTiled>
+static void loadSurfaceRows(const ColorKernels &kernels, ColorReadback &readback, unsigned char *plane, int pitch,
+                            int first, int last, unsigned char *dst, int dstPitch, int bytes)
+{
+    if (!YTiled) {
+        for (int row = first; row < last; row++)
+            readback.copy(dst + row * dstPitch, plane + row * pitch, bytes);
+        return;
+    }
+
+    // the rows of a tile are spread over all of it, so it is read whole
+    for (int row = first; row < last; ) {
+        const int tileRow = row / YTILE_ROWS;
+        const int end = last < (tileRow + 1) * YTILE_ROWS ? last : (tileRow + 1) * YTILE_ROWS;
+        unsigned char *tiles = plane + tileRow * pitch * YTILE_ROWS;
+        for (int x = 0; x < bytes; x += YTILE_WIDTH) {
+            const unsigned char *tile = readback.read(0, tiles + (x / YTILE_WIDTH) * YTILE_BYTES, YTILE_BYTES);
+            const int count = bytes - x < YTILE_WIDTH ? bytes - x : YTILE_WIDTH;
+            for (int r = row; r < end; r++)
+                kernels.yDetileRow(tile + (r % YTILE_ROWS) * YTILE_OWORD, dst + r * dstPitch + x, count);
+        }
+        row = end;
+    }
+}
+
+// job.srcFormat, job.stride and job.alignHeight describe the source,
+// job.dstStride is the pitch of the surface and job.option its aligned height
+template <bool YTiled>
+static void toNV12SurfaceRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const ColorKernels &kernels = getColorKernels();
+    ColorReadback readback(job.srcUncached);
+    const int bytes = job.width & ~1;
+    const int srcPlane = job.stride * job.alignHeight;
+    unsigned char *dstUV = job.dst + job.dstStride * job.option;
+
+    // YUYV and YUV422H rows are converted to NV12 here first, one tile wide at a time
+    unsigned char scratch[2 * YTILE_WIDTH];
+
+    for (int row = rowBegin; row < rowEnd; row++) {
+        const bool hasChroma = (row % 2) == 0;
+
+        if (job.srcFormat == V4L2_PIX_FMT_NV12) {
+            const unsigned char *luma = readback.read(0, job.src + row * job.stride, bytes);
+            storeSurfaceRow<YTiled>(kernels, luma, job.dst, job.dstStride, row, 0, bytes);
+            if (hasChroma) {
+                const unsigned char *chroma = readback.read(1, job.src + srcPlane + (row / 2) * job.stride, bytes);
+                storeSurfaceRow<YTiled>(kernels, chroma, dstUV, job.dstStride, row / 2, 0, bytes);
+            }
+            continue;
+        }
+
+        if (job.srcFormat == V4L2_PIX_FMT_YUYV) {
+            const unsigned char *src = job.src + row * job.stride * 2;
+            for (int x = 0; x < bytes; x += YTILE_WIDTH) {
+                const int count = bytes - x < YTILE_WIDTH ? bytes - x : YTILE_WIDTH;
+                if (hasChroma)
+                    kernels.yuyvToNV12Row(src + x * 2, scratch, scratch + YTILE_WIDTH, count);
+                else
+                    kernels.yuyvToLumaRow(src + x * 2, scratch, count);
+                storeSurfaceRow<YTiled>(kernels, scratch, job.dst, job.dstStride, row, x, count);
+                if (hasChroma)
+                    storeSurfaceRow<YTiled>(kernels, scratch + YTILE_WIDTH, dstUV, job.dstStride, row / 2, x,
+                                            count);
+            }
+            continue;
+        }
+
+        // YUV422H
+        const unsigned char *luma = readback.read(0, job.src + row * job.stride, bytes);
+        storeSurfaceRow<YTiled>(kernels, luma, job.dst, job.dstStride, row, 0, bytes);
+        if (hasChroma) {
+            const unsigned char *u = readback.read(1, job.src + srcPlane + row * job.stride, bytes / 2);
+            const unsigned char *v = readback.read(2, job.src + 2 * srcPlane + row * job.stride, bytes / 2);
+            for (int x = 0; x < bytes; x += YTILE_WIDTH) {
+                const int count = bytes - x < YTILE_WIDTH ? bytes - x : YTILE_WIDTH;
+                kernels.interleaveChroma(u + x / 2, v + x / 2, scratch, count / 2);
+                storeSurfaceRow<YTiled>(kernels, scratch, dstUV, job.dstStride, row / 2, x, count);
+            }
+        }
+    }
+}
+
+// job.stride and job.alignHeight describe the surface, the destination is a packed NV12 frame
+template <bool YTiled>
+static void fromNV12SurfaceRows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const ColorKernels &kernels = getColorKernels();
+    ColorReadback readback(job.srcUncached);
+    const int bytes = job.width & ~1;
+    const int chromaEnd = (rowEnd == job.height) ? (job.height + 1) / 2 : rowEnd / 2;
+
+    loadSurfaceRows<YTiled>(kernels, readback, job.src, job.stride, rowBegin, rowEnd, job.dst, job.width, bytes);
+    loadSurfaceRows<YTiled>(kernels, readback, job.src + job.stride * job.alignHeight, job.stride,
+                            rowBegin / 2, chromaEnd, job.dst + job.width * job.height, job.width, bytes);
+}
+
+static bool checkSurfaceLayout(SurfaceLayout layout, int pitch, int alignHeight, int width, int height)
+{
+    if (pitch < width || alignHeight < height) {
+        ALOGE("%dx%d frame doesn't fit a surface of pitch %d and %d rows", width, height, pitch, alignHeight);
+        return false;
+    }
+    if (layout == SURFACE_Y_TILED && (pitch % YTILE_WIDTH != 0 || alignHeight % YTILE_ROWS != 0)) {
+        ALOGE("pitch %d and %d rows aren't whole Y-tiles", pitch, alignHeight);
+        return false;
+    }
+    return true;
+}
+
+status_t colorConvertToNV12Surface(int srcFormat, int srcStride, int srcAlignHeight, int width, int height, void *src,
+                                   SurfaceLayout layout, int pitch, int alignHeight, void *dst)
+{
+    ColorConvertJob job;
+
+    if (srcFormat == HAL_PIXEL_FORMAT_NV12_TILED_INTEL)
+        srcFormat = V4L2_PIX_FMT_NV12;
+    else if (srcFormat == HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL)
+        srcFormat = V4L2_PIX_FMT_YUV422P;
+    if (srcFormat != V4L2_PIX_FMT_YUYV && srcFormat != V4L2_PIX_FMT_NV12 && srcFormat != V4L2_PIX_FMT_YUV422P) {
+        ALOGE("Invalid color conversion 0x%x -> NV12 surface", srcFormat);
+        return BAD_VALUE;
+    }
+    if (!checkSurfaceLayout(layout, pitch, alignHeight, width, height))
+        return BAD_VALUE;
+
+    initConvertJob(&job, layout == SURFACE_Y_TILED ? toNV12SurfaceRows<true> : toNV12SurfaceRows<false>,
+                   width, height, srcStride, srcAlignHeight, src, dst);
+    job.srcFormat = srcFormat;
+    job.srcUncached = srcFormat != V4L2_PIX_FMT_YUYV;
+    job.dstStride = pitch;
+    job.option = alignHeight;
+    runColorConvertJob(job);
+    return NO_ERROR;
+}
+
+status_t colorConvertFromNV12Surface(SurfaceLayout layout, int pitch, int alignHeight, int width, int height,
+                                     void *src, void *dst)
+{
+    ColorConvertJob job;
+
+    if (!checkSurfaceLayout(layout, pitch, alignHeight, width, height))
+        return BAD_VALUE;
+
+    initConvertJob(&job, layout == SURFACE_Y_TILED ? fromNV12SurfaceRows<true> : fromNV12SurfaceRows<false>,
+                   width, height, pitch, alignHeight, src, dst);
+    job.srcUncached = true;
+    runColorConvertJob(job);
+    return NO_ERROR;
+}
+
+/*
+Converting and resizing in one pass. Every plane of the destination is
+resampled straight from the matching plane of the source, wherever its
+samples sit (packed, planar or interleaved), so there is no full resolution
+intermediate frame.
+*/
+
+// a plane of 8-bit samples, 'step' bytes apart within a row, rows 'pitch' bytes apart
+struct ScalePlane {
+    unsigned char *base;
+    int pitch;
+    int step;
+    int width;
+    int height;
+};
+
+static inline void setScalePlane(ScalePlane *plane, unsigned char *base, int pitch, int step, int width, int height)
+{
+    plane->base = base;
+    plane->pitch = pitch;
+    plane->step = step;
+    plane->width = width;
+    plane->height = height;
+}
+
+/*
+Source columns of each destination column, the same for every row, so a
+scaling job computes them once, for the luma and the chroma planes, and its
+bands share them.
+*/
+struct ScaleColumns {
+    int *table;     // the arrays below, in one allocation
+    int *xBegin;    // box: source columns [xBegin, xEnd) of each destination column
+    int *xEnd;
+    int *xOffset;   // bilinear: byte offsets of the two source samples of each destination column
+    int *xWeight;   // bilinear: 8-bit weight of the second one
+};
+
+// destination columns whose sums scalePlaneBox() keeps at a time
+static const int SCALE_BOX_COLUMNS = 256;
+
+/*
+area average of the source samples covered by each destination sample,
+rows [rowBegin, rowEnd) of the destination plane. When enlarging, each
+destination sample covers a single source sample.
+*/
+static void scalePlaneBox(const ScalePlane &src, const ScalePlane &dst, const ScaleColumns &columns,
+                          ColorReadback &readback, int rowBegin, int rowEnd)
+{
+    if (src.width == dst.width && src.height == dst.height && src.step == 1 && dst.step == 1) {
+        for (int y = rowBegin; y < rowEnd; y++)
+            readback.copy(dst.base + y * dst.pitch, src.base + y * src.pitch, dst.width);
+        return;
+    }
+
+    const int *xBegin = columns.xBegin;
+    const int *xEnd = columns.xEnd;
+    unsigned int sums[SCALE_BOX_COLUMNS];
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        int y0 = (int) ((long long) y * src.height / dst.height);
+        int y1 = (int) ((long long) (y + 1) * src.height / dst.height);
+        if (y1 <= y0)
+            y1 = y0 + 1;
+        unsigned char *dstRow = dst.base + y * dst.pitch;
+
+        for (int first = 0; first < dst.width; first += SCALE_BOX_COLUMNS) {
+            const int last = (dst.width - first < SCALE_BOX_COLUMNS) ? dst.width : first + SCALE_BOX_COLUMNS;
+            const int srcFirst = xBegin[first];
+            const int srcBytes = (xEnd[last - 1] - 1 - srcFirst) * src.step + 1;
+
+            // sums over the source rows of this destination row
+            memset(sums, 0, (last - first) * sizeof(sums[0]));
+            for (int r = y0; r < y1; r++) {
+                const unsigned char *srcRow = readback.read(0, src.base + r * src.pitch + srcFirst * src.step,
+                                                            srcBytes);
+                for (int x = first; x < last; x++) {
+                    unsigned int sum = 0;
+                    for (int i = xBegin[x]; i < xEnd[x]; i++)
+                        sum += srcRow[(i - srcFirst) * src.step];
+                    sums[x - first] += sum;
+                }
+            }
+
+            for (int x = first; x < last; x++) {
+                unsigned int count = (xEnd[x] - xBegin[x]) * (y1 - y0);
+                dstRow[x * dst.step] = (unsigned char) ((sums[x - first] + count / 2) / count);
+            }
+        }
+    }
+}
+
+// source position of destination sample i, pixel centers aligned, in 16.16
+static inline int bilinearPos(int i, int srcSize, int dstSize)
+{
+    long long pos = ((long long) (2 * i + 1) * srcSize - dstSize) * 65536 / (2 * dstSize);
+    if (pos < 0)
+        pos = 0;
+    if (pos > (long long) (srcSize - 1) << 16)
+        pos = (long long) (srcSize - 1) << 16;
+    return (int) pos;
+}
+
+// bilinear interpolation with 8-bit weights, rows [rowBegin, rowEnd) of the destination plane
+static void scalePlaneBilinear(const ScalePlane &src, const ScalePlane &dst, const ScaleColumns &columns,
+                               ColorReadback &readback, int rowBegin, int rowEnd)
+{
+    const int srcRowBytes = (src.width - 1) * src.step + 1;
+    const int *xOffset = columns.xOffset;
+    const int *xWeight = columns.xWeight;
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        int pos = bilinearPos(y, src.height, dst.height);
+        int y0 = pos >> 16;
+        int y1 = (y0 + 1 < src.height) ? y0 + 1 : y0;
+        int fy = (pos >> 8) & 0xff;
+        const unsigned char *top = readback.read(0, src.base + y0 * src.pitch, srcRowBytes);
+        const unsigned char *bottom = readback.read(1, src.base + y1 * src.pitch, srcRowBytes);
+        unsigned char *dstRow = dst.base + y * dst.pitch;
+        for (int x = 0; x < dst.width; x++) {
+            int fx = xWeight[x];
+            int a = xOffset[2 * x];
+            int b = xOffset[2 * x + 1];
+            int t = top[a] * (256 - fx) + top[b] * fx;
+            int d = bottom[a] * (256 - fx) + bottom[b] * fx;
+            dstRow[x * dst.step] = (unsigned char) ((t * (256 - fy) + d * fy + 32768) >> 16);
+        }
+    }
+}
+
+// the columns of 'dstWidth' destination samples scaled from the 'src' plane with 'filter'
+static void initScaleColumns(ScaleColumns *columns, const ScalePlane &src, int dstWidth, int filter)
+{
+    columns->table = new int[dstWidth * 3];
+    columns->xBegin = columns->table;
+    columns->xEnd = columns->table + dstWidth;
+    columns->xOffset = columns->table;
+    columns->xWeight = columns->table + dstWidth * 2;
+
+    for (int x = 0; x < dstWidth; x++) {
+        if (filter == COLOR_SCALE_BOX) {
+            int x0 = (int) ((long long) x * src.width / dstWidth);
+            int x1 = (int) ((long long) (x + 1) * src.width / dstWidth);
+            if (x1 <= x0)
+                x1 = x0 + 1;
+            columns->xBegin[x] = x0;
+            columns->xEnd[x] = x1;
+        } else {
+            int pos = bilinearPos(x, src.width, dstWidth);
+            int x0 = pos >> 16;
+            int x1 = (x0 + 1 < src.width) ? x0 + 1 : x0;
+            columns->xOffset[2 * x] = x0 * src.step;
+            columns->xOffset[2 * x + 1] = x1 * src.step;
+            columns->xWeight[x] = (pos >> 8) & 0xff;
+        }
+    }
+}
+
+// Y, U, V planes of the source of a scaling job
+static bool getScaleSourcePlanes(const ColorConvertJob &job, ScalePlane planes[3])
+{
+    const int width = job.srcWidth;
+    const int height = job.srcHeight;
+    const int stride = job.stride;
+    unsigned char *src = job.src;
+
+    switch (job.srcFormat) {
+    case V4L2_PIX_FMT_YUYV:
+        // stride is in pixels, 2 bytes each
+        setScalePlane(&planes[0], src, stride * 2, 2, width, height);
+        setScalePlane(&planes[1], src + 1, stride * 2, 4, width / 2, height);
+        setScalePlane(&planes[2], src + 3, stride * 2, 4, width / 2, height);
+        return true;
     case V4L2_PIX_FMT_YUV422P:
     case HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL:
-        return colorConvertYUV422PwithStride(dstFormat,stride, width, alignHeight,height, src, dst);
-    case V4L2_PIX_FMT_YUV420://yv12
-        return colorConvertYV12withStride(dstFormat,stride, width, alignHeight,height, src, dst);
+        setScalePlane(&planes[0], src, stride, 1, width, height);
+        setScalePlane(&planes[1], src + stride * job.alignHeight, stride, 1, width / 2, height);
+        setScalePlane(&planes[2], src + 2 * stride * job.alignHeight, stride, 1, width / 2, height);
+        return true;
+    case V4L2_PIX_FMT_YUV420:
+        // YV12 as gralloc lays it out: V, then U, at half the stride
+        setScalePlane(&planes[0], src, stride, 1, width, height);
+        setScalePlane(&planes[1], src + stride * job.alignHeight + (stride / 2) * (job.alignHeight / 2),
+                      stride / 2, 1, width / 2, height / 2);
+        setScalePlane(&planes[2], src + stride * job.alignHeight, stride / 2, 1, width / 2, height / 2);
+        return true;
+    case V4L2_PIX_FMT_NV12:
+    case HAL_PIXEL_FORMAT_NV12_TILED_INTEL:
+        setScalePlane(&planes[0], src, stride, 1, width, height);
+        setScalePlane(&planes[1], src + stride * job.alignHeight, stride, 2, width / 2, height / 2);
+        setScalePlane(&planes[2], src + stride * job.alignHeight + 1, stride, 2, width / 2, height / 2);
+        return true;
     default:
+        return false;
+    }
+}
+
+static void scalePlanesRows(const ColorConvertJob &job, const ScalePlane dstPlanes[3], int rowBegin, int rowEnd)
+{
+    ScalePlane srcPlanes[3];
+    ColorReadback readback(job.srcUncached);
+    getScaleSourcePlanes(job, srcPlanes);
+    void (*scalePlane)(const ScalePlane &, const ScalePlane &, const ScaleColumns &, ColorReadback &, int, int) =
+        (job.option == COLOR_SCALE_BOX) ? scalePlaneBox : scalePlaneBilinear;
+
+    // U and V share the chroma columns
+    scalePlane(srcPlanes[0], dstPlanes[0], job.scaleColumns[0], readback, rowBegin, rowEnd);
+    scalePlane(srcPlanes[1], dstPlanes[1], job.scaleColumns[1], readback, rowBegin / 2, rowEnd / 2);
+    scalePlane(srcPlanes[2], dstPlanes[2], job.scaleColumns[1], readback, rowBegin / 2, rowEnd / 2);
+}
+
+static void scaleToNV21Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const int height = job.height;
+    const int chromaPitch = (width / 2) * 2;
+    ScalePlane planes[3];
+
+    setScalePlane(&planes[0], job.dst, width, 1, width, height);
+    setScalePlane(&planes[1], job.dst + width * height + 1, chromaPitch, 2, width / 2, height / 2);
+    setScalePlane(&planes[2], job.dst + width * height, chromaPitch, 2, width / 2, height / 2);
+    scalePlanesRows(job, planes, rowBegin, rowEnd);
+}
+
+// same YV12 layout as LayoutYV12Aligned and the RepaddingYV12 output
+static void scaleToYV12Rows(const ColorConvertJob &job, int rowBegin, int rowEnd)
+{
+    const int width = job.width;
+    const int height = job.height;
+    const int chromaPitch = ALIGN(width >> 1, 16);
+    unsigned char *dstV = job.dst + width * height;
+    unsigned char *dstU = dstV + chromaPitch * height / 2;
+    ScalePlane planes[3];
+
+    setScalePlane(&planes[0], job.dst, width, 1, width, height);
+    setScalePlane(&planes[1], dstU, chromaPitch, 1, width / 2, height / 2);
+    setScalePlane(&planes[2], dstV, chromaPitch, 1, width / 2, height / 2);
+    scalePlanesRows(job, planes, rowBegin, rowEnd);
+}
+
+status_t colorConvertScaled(int srcFormat, int dstFormat, int stride, int srcWidth, int alignHeight, int srcHeight,
+                            void *src, int dstWidth, int dstHeight, void *dst, ColorScaleFilter filter)
+{
+    LOG2("@%s: %dx%d -> %dx%d, filter %d", __FUNCTION__, srcWidth, srcHeight, dstWidth, dstHeight, filter);
+    ColorConvertJob job;
+    ScalePlane planes[3];
+    ScaleColumns columns[2];
+
+    if (srcWidth < 2 || srcHeight < 2 || dstWidth < 2 || dstHeight < 2) {
+        ALOGE("invalid size %dx%d -> %dx%d", srcWidth, srcHeight, dstWidth, dstHeight);
+        return BAD_VALUE;
+    }
+
+    initConvertJob(&job, NULL, dstWidth, dstHeight, stride, alignHeight, src, dst);
+    job.srcWidth = srcWidth;
+    job.srcHeight = srcHeight;
+    job.srcFormat = srcFormat;
+    // the planar sources are gralloc surfaces, YUYV comes from the driver
+    job.srcUncached = (srcFormat != V4L2_PIX_FMT_YUYV);
+    job.option = filter;
+    if (!getScaleSourcePlanes(job, planes)) {
         ALOGE("invalid (source) color format");
         return BAD_VALUE;
+    }
+
+    switch (dstFormat) {
+    case V4L2_PIX_FMT_NV21:
+        job.convertRows = scaleToNV21Rows;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        job.convertRows = scaleToYV12Rows;
+        break;
+    default:
+        ALOGE("Invalid color format (dst)");
+        return BAD_VALUE;
     };
+
+    initScaleColumns(&columns[0], planes[0], dstWidth, filter);
+    initScaleColumns(&columns[1], planes[1], dstWidth / 2, filter);
+    job.scaleColumns = columns;
+    runColorConvertJob(job);
+    delete [] columns[0].table;
+    delete [] columns[1].table;
+    return NO_ERROR;
 }
 
 const char *cameraParametersFormat(int v4l2Format)
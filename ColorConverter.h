@@ -24,6 +24,52 @@ namespace android {
 status_t colorConvert(int srcFormat, int dstFormat, int width, int height, void *src, void *dst);
 status_t colorConvertwithStride(int srcFormat, int dstFormat, int stride,int width, int alignHeight, int height, void *src, void *dst);
 void RepaddingYV12(int width, int height, int srcStride, int dstStride,int alignheight, void *src, void *dst,int dstAlignTo16 = 1);
+int copyBufWithStride(void *dst, void *src, int width, int height, int srcstride,int dststride,int alignheight,int srcFormat);
+
+enum ColorScaleFilter {
+    COLOR_SCALE_BOX = 0,    // area average, for downscaling by 2x or more
+    COLOR_SCALE_BILINEAR,   // for small ratios and upscaling
+};
+
+/**
+ * Converts and resizes in a single pass, without a full resolution
+ * intermediate frame.
+ *
+ * Sources: V4L2_PIX_FMT_YUYV (stride in pixels), V4L2_PIX_FMT_YUV422P /
+ * HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL and V4L2_PIX_FMT_NV12 /
+ * HAL_PIXEL_FORMAT_NV12_TILED_INTEL (stride in bytes, chroma planes at
+ * stride * alignHeight), and V4L2_PIX_FMT_YUV420 (YV12 as gralloc lays it
+ * out, chroma at half the stride).
+ * Destinations: V4L2_PIX_FMT_NV21 and V4L2_PIX_FMT_YUV420 (YV12 with 16
+ * byte aligned chroma stride), both tightly packed at dstWidth x dstHeight.
+ */
+status_t colorConvertScaled(int srcFormat, int dstFormat, int stride, int srcWidth, int alignHeight, int srcHeight,
+                            void *src, int dstWidth, int dstHeight, void *dst, ColorScaleFilter filter);
+
+
+// how the CPU sees a gralloc surface
+enum SurfaceLayout {
+    SURFACE_LINEAR = 0,     // rows one after the other, as gralloc lock() maps them
+    SURFACE_Y_TILED,        // Intel Y-tiles (128 bytes x 32 rows), as the bo is in memory
+};
+
+/**
+ * Fills an NV12 surface, the video encoder's HAL_PIXEL_FORMAT_NV12_TILED_INTEL,
+ * without the VPP. The surface has 'pitch' bytes per row and its UV plane at
+ * pitch * alignHeight; both must be whole tiles (multiples of 128 and 32)
+ * for SURFACE_Y_TILED.
+ *
+ * Sources: V4L2_PIX_FMT_YUYV (plain memory, stride in pixels), and
+ * V4L2_PIX_FMT_NV12 / HAL_PIXEL_FORMAT_NV12_TILED_INTEL or
+ * V4L2_PIX_FMT_YUV422P / HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL (linear
+ * surfaces, stride in bytes, planes at stride * srcAlignHeight).
+ */
+status_t colorConvertToNV12Surface(int srcFormat, int srcStride, int srcAlignHeight, int width, int height, void *src,
+                                   SurfaceLayout layout, int pitch, int alignHeight, void *dst);
+
+// reads an NV12 surface laid out as above back into a packed NV12 frame
+status_t colorConvertFromNV12Surface(SurfaceLayout layout, int pitch, int alignHeight, int width, int height,
+                                     void *src, void *dst);
 
 
 const char *cameraParametersFormat(int v4l2Format);
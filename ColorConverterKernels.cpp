@@ -0,0 +1,1011 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_ColorConverterKernels"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "ColorConverterKernels.h"
+#include "LogHelper.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define COLOR_KERNELS_X86
+#include <cpuid.h>
+#include <immintrin.h>
+
+// GCC before 4.9 (and clang before 3.8) only declares the intrinsics of the
+// instruction sets enabled for the whole file, whatever the target
+// attribute of the function using them. With those compilers a kernel set
+// is built only if the compiler flags enable its instruction set: SSE2 and
+// SSSE3 on the GCC 4.7/4.8 x86 toolchains of KitKat, whose -march=atom
+// goes up to SSSE3. Newer compilers build every set and the CPU picks.
+#if defined(__clang__)
+#if __clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8)
+#define COLOR_KERNELS_TARGET_ATTRIBUTES
+#endif
+#elif __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define COLOR_KERNELS_TARGET_ATTRIBUTES
+#endif
+
+#ifdef COLOR_KERNELS_TARGET_ATTRIBUTES
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+// every set implies the ones below it, so the sets built are always the
+// first entries of the kernel table
+#if defined(COLOR_KERNELS_TARGET_ATTRIBUTES) || defined(__SSE2__)
+#define COLOR_KERNELS_SSE2
+#endif
+#if defined(COLOR_KERNELS_TARGET_ATTRIBUTES) || defined(__SSSE3__)
+#define COLOR_KERNELS_SSSE3
+#endif
+#if defined(COLOR_KERNELS_TARGET_ATTRIBUTES) || defined(__SSE4_1__)
+#define COLOR_KERNELS_SSE41
+#endif
+#if defined(COLOR_KERNELS_TARGET_ATTRIBUTES) || defined(__AVX2__)
+#define COLOR_KERNELS_AVX2
+#endif
+#endif // __i386__ || __x86_64__
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+// Scalar kernels, these define the expected output of all the others
+// ----------------------------------------------------------------------------
+
+static inline unsigned char clampToByte(int x)
+{
+    return (unsigned char) (x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+static void yuyvToLumaRow_C(const unsigned char *src, unsigned char *dstY, int width)
+{
+    for (int j = 0; j < width / 2; j++) {
+        dstY[0] = src[0];
+        dstY[1] = src[2];
+        dstY += 2;
+        src += 4;
+    }
+}
+
+static void yuyvToNV12Row_C(const unsigned char *src, unsigned char *dstY, unsigned char *dstUV, int width)
+{
+    for (int j = 0; j < width / 2; j++) {
+        dstY[0] = src[0];
+        dstY[1] = src[2];
+        dstUV[0] = src[1];
+        dstUV[1] = src[3];
+        dstY += 2;
+        dstUV += 2;
+        src += 4;
+    }
+}
+
+static void yuyvToNV21Row_C(const unsigned char *src, unsigned char *dstY, unsigned char *dstVU, int width)
+{
+    for (int j = 0; j < width / 2; j++) {
+        dstY[0] = src[0];
+        dstY[1] = src[2];
+        dstVU[0] = src[3];
+        dstVU[1] = src[1];
+        dstY += 2;
+        dstVU += 2;
+        src += 4;
+    }
+}
+
+// ITU-R BT.601 video range to RGBA, as YUYVToRGB8888 always did
+static inline void yuvToRGBA_C(int y, int u, int v, unsigned char *dst)
+{
+    const int C = y - 16;
+    const int D = u - 128;
+    const int E = v - 128;
+    dst[0] = clampToByte((C * 298 + E * 409 + 128) >> 8);
+    dst[1] = clampToByte((C * 298 - D * 100 - E * 208 + 128) >> 8);
+    dst[2] = clampToByte((C * 298 + D * 516 + 128) >> 8);
+    dst[3] = 0xFF;
+}
+
+// full range to RGB565, as the NV12/YUYV/YV12 to RGB565 converters always did
+static inline void yuvToRGB565_C(int y, int cb, int cr, unsigned char *dst)
+{
+    const int B = clampToByte(y + ((454 * cb) >> 8));
+    const int G = clampToByte(y - ((88 * cb + 183 * cr) >> 8));
+    const int R = clampToByte(y + ((359 * cr) >> 8));
+    //NOTE: this assume little-endian encoding
+    dst[0] = (unsigned char) (((G & 0x3c) << 3) | (B >> 3));
+    dst[1] = (unsigned char) ((R & 0xf8) | (G >> 5));
+}
+
+static void yuyvToRGBA8888_C(const unsigned char *src, unsigned char *dst, int pairs)
+{
+    for (int i = 0; i < pairs; i++) {
+        yuvToRGBA_C(src[0], src[1], src[3], dst);
+        yuvToRGBA_C(src[2], src[1], src[3], dst + 4);
+        src += 4;
+        dst += 8;
+    }
+}
+
+static void yuyvToRGB565_C(const unsigned char *src, unsigned char *dst, int pairs)
+{
+    for (int i = 0; i < pairs; i++) {
+        yuvToRGB565_C(src[0], src[1] - 128, src[3] - 128, dst);
+        yuvToRGB565_C(src[2], src[1] - 128, src[3] - 128, dst + 2);
+        src += 4;
+        dst += 4;
+    }
+}
+
+static void nv12ToRGB565Row_C(const unsigned char *srcY, const unsigned char *srcUV, unsigned char *dst, int width)
+{
+    for (int j = 0; j < width / 2; j++) {
+        yuvToRGB565_C(srcY[0], srcUV[0] - 128, srcUV[1] - 128, dst);
+        yuvToRGB565_C(srcY[1], srcUV[0] - 128, srcUV[1] - 128, dst + 2);
+        srcY += 2;
+        srcUV += 2;
+        dst += 4;
+    }
+}
+
+static void yv12ToRGB565Row_C(const unsigned char *srcY, const unsigned char *srcU, const unsigned char *srcV,
+                              unsigned char *dst, int width)
+{
+    for (int j = 0; j < width / 2; j++) {
+        yuvToRGB565_C(srcY[0], *srcU - 128, *srcV - 128, dst);
+        yuvToRGB565_C(srcY[1], *srcU - 128, *srcV - 128, dst + 2);
+        srcY += 2;
+        srcU++;
+        srcV++;
+        dst += 4;
+    }
+}
+
+static void interleaveChroma_C(const unsigned char *first, const unsigned char *second, unsigned char *dst, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dst[2 * i] = first[i];
+        dst[2 * i + 1] = second[i];
+    }
+}
+
+static void deinterleaveChroma_C(const unsigned char *src, unsigned char *first, unsigned char *second, int count)
+{
+    for (int i = 0; i < count; i++) {
+        first[i] = src[2 * i];
+        second[i] = src[2 * i + 1];
+    }
+}
+
+static void swapChromaPairs_C(const unsigned char *src, unsigned char *dst, int count)
+{
+    for (int i = 0; i < count; i++) {
+        unsigned char c0 = src[2 * i];
+        unsigned char c1 = src[2 * i + 1];
+        dst[2 * i] = c1;
+        dst[2 * i + 1] = c0;
+    }
+}
+
+static void averageChromaRows_C(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count,
+                                bool round)
+{
+    const int bias = round ? 1 : 0;
+    for (int i = 0; i < count; i++)
+        dst[i] = (a[i] + b[i] + bias) >> 1;
+}
+
+// OWord i of a Y-tiled row is 512 bytes after OWord i - 1, so byte x of the
+// row's first 16 is at x * 32
+static void yTileRow_C(const unsigned char *src, unsigned char *tiled, int bytes)
+{
+    for (int x = 0; x < bytes; x += 16)
+        memcpy(tiled + x * 32, src + x, bytes - x < 16 ? bytes - x : 16);
+}
+
+static void yDetileRow_C(const unsigned char *tiled, unsigned char *dst, int bytes)
+{
+    for (int x = 0; x < bytes; x += 16)
+        memcpy(dst + x, tiled + x * 32, bytes - x < 16 ? bytes - x : 16);
+}
+
+static void streamLoadCopy_C(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    memcpy(dst, src, bytes);
+}
+
+#ifdef COLOR_KERNELS_SSE2
+
+// ----------------------------------------------------------------------------
+// SSE2: 16 pixels per iteration, luma/chroma split with mask/shift + pack
+// ----------------------------------------------------------------------------
+
+TARGET_SSE2
+static void yuyvToLumaRow_SSE2(const unsigned char *src, unsigned char *dstY, int width)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+        __m128i y = _mm_packus_epi16(_mm_and_si128(a, lumaMask), _mm_and_si128(b, lumaMask));
+        _mm_storeu_si128((__m128i *)(dstY + x), y);
+    }
+    yuyvToLumaRow_C(src + 2 * x, dstY + x, pixels - x);
+}
+
+TARGET_SSE2
+static inline void yuyvSplit_SSE2(const unsigned char *src, unsigned char *dstY, unsigned char *dstC, bool swapChroma)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+    __m128i a = _mm_loadu_si128((const __m128i *)src);
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i y = _mm_packus_epi16(_mm_and_si128(a, lumaMask), _mm_and_si128(b, lumaMask));
+    __m128i ca = _mm_srli_epi16(a, 8);
+    __m128i cb = _mm_srli_epi16(b, 8);
+    if (swapChroma) {
+        // swap neighbouring 16-bit lanes: U,V -> V,U
+        ca = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ca, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        cb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cb, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    }
+    _mm_storeu_si128((__m128i *)dstY, y);
+    _mm_storeu_si128((__m128i *)dstC, _mm_packus_epi16(ca, cb));
+}
+
+TARGET_SSE2
+static void yuyvToNV12Row_SSE2(const unsigned char *src, unsigned char *dstY, unsigned char *dstUV, int width)
+{
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16)
+        yuyvSplit_SSE2(src + 2 * x, dstY + x, dstUV + x, false);
+    yuyvToNV12Row_C(src + 2 * x, dstY + x, dstUV + x, pixels - x);
+}
+
+TARGET_SSE2
+static void yuyvToNV21Row_SSE2(const unsigned char *src, unsigned char *dstY, unsigned char *dstVU, int width)
+{
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16)
+        yuyvSplit_SSE2(src + 2 * x, dstY + x, dstVU + x, true);
+    yuyvToNV21Row_C(src + 2 * x, dstY + x, dstVU + x, pixels - x);
+}
+
+// ----------------------------------------------------------------------------
+// SSE2 YUV to RGB, 8 pixels per step in 16-bit lanes. The products that can
+// overflow 16 bits go through pmaddwd, the others are rewritten so that they
+// fit while rounding exactly like the scalar code:
+//   (454 * cb) >> 8 == (227 * cb) >> 7
+//   (359 * cr) >> 8 == cr + ((103 * cr) >> 8)
+// Clamping is done by saturation, so the output matches the C kernels
+// bit for bit. SSSE3 and AVX2 add nothing worthwhile to this arithmetic and
+// use these kernels as well.
+// ----------------------------------------------------------------------------
+
+// y: 8 luma values, uv: 4 interleaved u,v pairs (16-bit lanes) -> 8 RGB565 pixels
+TARGET_SSE2
+static inline __m128i yuvToRGB565_SSE2(__m128i y, __m128i uv)
+{
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    uv = _mm_sub_epi16(uv, bias);
+    // one chroma pair per two pixels
+    __m128i cb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i cr = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+    __m128i b = _mm_add_epi16(y, _mm_srai_epi16(_mm_mullo_epi16(cb, _mm_set1_epi16(227)), 7));
+    __m128i r = _mm_add_epi16(_mm_add_epi16(y, cr), _mm_srai_epi16(_mm_mullo_epi16(cr, _mm_set1_epi16(103)), 8));
+    const __m128i gCoef = _mm_set1_epi32((183 << 16) | 88);
+    __m128i gLo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), gCoef), 8);
+    __m128i gHi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), gCoef), 8);
+    __m128i g = _mm_sub_epi16(y, _mm_packs_epi32(gLo, gHi));
+
+    b = _mm_min_epi16(_mm_max_epi16(b, zero), max);
+    g = _mm_min_epi16(_mm_max_epi16(g, zero), max);
+    r = _mm_min_epi16(_mm_max_epi16(r, zero), max);
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_and_si128(r, _mm_set1_epi16(0xf8)), 8),
+                                     _mm_slli_epi16(_mm_and_si128(g, _mm_set1_epi16(0xfc)), 3)),
+                        _mm_srli_epi16(b, 3));
+}
+
+// (c * c0 + d * c1 + 128) >> 8 for 8 lanes, in 32-bit precision
+TARGET_SSE2
+static inline __m128i madd2Round_SSE2(__m128i c, __m128i d, __m128i coef)
+{
+    const __m128i round = _mm_set1_epi32(128);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, d), coef), round);
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, d), coef), round);
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+}
+
+TARGET_SSE2
+static void yuyvToRGBA8888_SSE2(const unsigned char *src, unsigned char *dst, int pairs)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    const __m128i coefR = _mm_set1_epi32((409 << 16) | 298);
+    const __m128i coefB = _mm_set1_epi32((516 << 16) | 298);
+    const __m128i coefG1 = _mm_set1_epi32((-100 << 16) | 298);
+    const __m128i coefG2 = _mm_set1_epi32((128 << 16) | (-208 & 0xffff));
+    const __m128i one = _mm_set1_epi16(1);
+    int i = 0;
+    for (; i + 4 <= pairs; i += 4) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i c = _mm_sub_epi16(_mm_and_si128(in, lumaMask), _mm_set1_epi16(16));
+        __m128i uv = _mm_sub_epi16(_mm_srli_epi16(in, 8), _mm_set1_epi16(128));
+        __m128i d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        __m128i e = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+        __m128i r = madd2Round_SSE2(c, e, coefR);
+        __m128i b = madd2Round_SSE2(c, d, coefB);
+        // the rounding constant is folded into the second product: e * -208 + 1 * 128
+        __m128i gLo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(c, d), coefG1),
+                                    _mm_madd_epi16(_mm_unpacklo_epi16(e, one), coefG2));
+        __m128i gHi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(c, d), coefG1),
+                                    _mm_madd_epi16(_mm_unpackhi_epi16(e, one), coefG2));
+        __m128i g = _mm_packs_epi32(_mm_srai_epi32(gLo, 8), _mm_srai_epi32(gHi, 8));
+
+        __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+        __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+        _mm_storeu_si128((__m128i *)(dst + 8 * i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + 8 * i + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    yuyvToRGBA8888_C(src + 4 * i, dst + 8 * i, pairs - i);
+}
+
+TARGET_SSE2
+static void yuyvToRGB565_SSE2(const unsigned char *src, unsigned char *dst, int pairs)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+    int i = 0;
+    for (; i + 4 <= pairs; i += 4) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i rgb = yuvToRGB565_SSE2(_mm_and_si128(in, lumaMask), _mm_srli_epi16(in, 8));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), rgb);
+    }
+    yuyvToRGB565_C(src + 4 * i, dst + 4 * i, pairs - i);
+}
+
+TARGET_SSE2
+static void nv12ToRGB565Row_SSE2(const unsigned char *srcY, const unsigned char *srcUV, unsigned char *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(srcY + x));
+        __m128i uv = _mm_loadu_si128((const __m128i *)(srcUV + x));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x),
+                         yuvToRGB565_SSE2(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(uv, zero)));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x + 16),
+                         yuvToRGB565_SSE2(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(uv, zero)));
+    }
+    nv12ToRGB565Row_C(srcY + x, srcUV + x, dst + 2 * x, width - x);
+}
+
+TARGET_SSE2
+static void yv12ToRGB565Row_SSE2(const unsigned char *srcY, const unsigned char *srcU, const unsigned char *srcV,
+                                 unsigned char *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(srcY + x));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(srcU + x / 2)),
+                                       _mm_loadl_epi64((const __m128i *)(srcV + x / 2)));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x),
+                         yuvToRGB565_SSE2(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(uv, zero)));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x + 16),
+                         yuvToRGB565_SSE2(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(uv, zero)));
+    }
+    yv12ToRGB565Row_C(srcY + x, srcU + x / 2, srcV + x / 2, dst + 2 * x, width - x);
+}
+
+// ----------------------------------------------------------------------------
+// SSE2 chroma planes: 16 samples per plane and iteration. Pairs are swapped
+// with 16-bit shifts, which is as fast as pshufb, so SSSE3 uses these too.
+// pavgb rounds up, the truncating average subtracts the carry it added:
+//   (a + b) >> 1 == pavgb(a, b) - ((a ^ b) & 1)
+// ----------------------------------------------------------------------------
+
+TARGET_SSE2
+static void interleaveChroma_SSE2(const unsigned char *first, const unsigned char *second, unsigned char *dst,
+                                  int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(first + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(second + i));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+    interleaveChroma_C(first + i, second + i, dst + 2 * i, count - i);
+}
+
+TARGET_SSE2
+static void deinterleaveChroma_SSE2(const unsigned char *src, unsigned char *first, unsigned char *second,
+                                    int count)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00ff);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(first + i),
+                         _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask)));
+        _mm_storeu_si128((__m128i *)(second + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    deinterleaveChroma_C(src + 2 * i, first + i, second + i, count - i);
+}
+
+TARGET_SSE2
+static void swapChromaPairs_SSE2(const unsigned char *src, unsigned char *dst, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8)));
+    }
+    swapChromaPairs_C(src + 2 * i, dst + 2 * i, count - i);
+}
+
+TARGET_SSE2
+static void averageChromaRows_SSE2(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count,
+                                   bool round)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i avg = _mm_avg_epu8(x, y);
+        if (!round)
+            avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(x, y), one));
+        _mm_storeu_si128((__m128i *)(dst + i), avg);
+    }
+    averageChromaRows_C(a + i, b + i, dst + i, count - i, round);
+}
+
+// ----------------------------------------------------------------------------
+// SSE2 Y-tiling: a row moves in OWords, which SSE2 loads and stores whole,
+// four at a time. Wider registers would only have to be split again.
+// ----------------------------------------------------------------------------
+
+TARGET_SSE2
+static void yTileRow_SSE2(const unsigned char *src, unsigned char *tiled, int bytes)
+{
+    int x = 0;
+    for (; x + 64 <= bytes; x += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + x + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + x + 48));
+        _mm_storeu_si128((__m128i *)(tiled + x * 32), a);
+        _mm_storeu_si128((__m128i *)(tiled + x * 32 + 512), b);
+        _mm_storeu_si128((__m128i *)(tiled + x * 32 + 1024), c);
+        _mm_storeu_si128((__m128i *)(tiled + x * 32 + 1536), d);
+    }
+    for (; x + 16 <= bytes; x += 16)
+        _mm_storeu_si128((__m128i *)(tiled + x * 32), _mm_loadu_si128((const __m128i *)(src + x)));
+    yTileRow_C(src + x, tiled + x * 32, bytes - x);
+}
+
+TARGET_SSE2
+static void yDetileRow_SSE2(const unsigned char *tiled, unsigned char *dst, int bytes)
+{
+    int x = 0;
+    for (; x + 64 <= bytes; x += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(tiled + x * 32));
+        __m128i b = _mm_loadu_si128((const __m128i *)(tiled + x * 32 + 512));
+        __m128i c = _mm_loadu_si128((const __m128i *)(tiled + x * 32 + 1024));
+        __m128i d = _mm_loadu_si128((const __m128i *)(tiled + x * 32 + 1536));
+        _mm_storeu_si128((__m128i *)(dst + x), a);
+        _mm_storeu_si128((__m128i *)(dst + x + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + x + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + x + 48), d);
+    }
+    for (; x + 16 <= bytes; x += 16)
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_loadu_si128((const __m128i *)(tiled + x * 32)));
+    yDetileRow_C(tiled + x * 32, dst + x, bytes - x);
+}
+
+#endif // COLOR_KERNELS_SSE2
+
+#ifdef COLOR_KERNELS_SSSE3
+
+// ----------------------------------------------------------------------------
+// SSSE3: one pshufb per 8 pixels gathers luma to the low and chroma to the
+// high half of the register
+// ----------------------------------------------------------------------------
+
+TARGET_SSSE3
+static inline void yuyvSplit_SSSE3(const unsigned char *src, unsigned char *dstY, unsigned char *dstC, __m128i shuffle)
+{
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), shuffle);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16)), shuffle);
+    _mm_storeu_si128((__m128i *)dstY, _mm_unpacklo_epi64(a, b));
+    _mm_storeu_si128((__m128i *)dstC, _mm_unpackhi_epi64(a, b));
+}
+
+TARGET_SSSE3
+static void yuyvToLumaRow_SSSE3(const unsigned char *src, unsigned char *dstY, int width)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * x)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * x + 16)), shuffle);
+        _mm_storeu_si128((__m128i *)(dstY + x), _mm_unpacklo_epi64(a, b));
+    }
+    yuyvToLumaRow_C(src + 2 * x, dstY + x, pixels - x);
+}
+
+TARGET_SSSE3
+static void yuyvToNV12Row_SSSE3(const unsigned char *src, unsigned char *dstY, unsigned char *dstUV, int width)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16)
+        yuyvSplit_SSSE3(src + 2 * x, dstY + x, dstUV + x, shuffle);
+    yuyvToNV12Row_C(src + 2 * x, dstY + x, dstUV + x, pixels - x);
+}
+
+TARGET_SSSE3
+static void yuyvToNV21Row_SSSE3(const unsigned char *src, unsigned char *dstY, unsigned char *dstVU, int width)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 3, 1, 7, 5, 11, 9, 15, 13);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16)
+        yuyvSplit_SSSE3(src + 2 * x, dstY + x, dstVU + x, shuffle);
+    yuyvToNV21Row_C(src + 2 * x, dstY + x, dstVU + x, pixels - x);
+}
+
+#endif // COLOR_KERNELS_SSSE3
+
+#ifdef COLOR_KERNELS_SSE41
+
+// ----------------------------------------------------------------------------
+// SSE4.1: MOVNTDQA streaming loads, a cache line (4 loads) per iteration.
+// Only aligned 16 byte loads can stream, the unaligned head and the tail
+// are copied with plain loads.
+// ----------------------------------------------------------------------------
+
+TARGET_SSE41
+static void streamLoadCopy_SSE41(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    int head = (int) ((16 - ((uintptr_t) src & 15)) & 15);
+    if (head > bytes)
+        head = bytes;
+    memcpy(dst, src, head);
+    src += head;
+    dst += head;
+    bytes -= head;
+
+    __m128i *s = (__m128i *) src;
+    for (; bytes >= 64; bytes -= 64) {
+        __m128i a = _mm_stream_load_si128(s);
+        __m128i b = _mm_stream_load_si128(s + 1);
+        __m128i c = _mm_stream_load_si128(s + 2);
+        __m128i d = _mm_stream_load_si128(s + 3);
+        _mm_storeu_si128((__m128i *) dst, a);
+        _mm_storeu_si128((__m128i *) (dst + 16), b);
+        _mm_storeu_si128((__m128i *) (dst + 32), c);
+        _mm_storeu_si128((__m128i *) (dst + 48), d);
+        s += 4;
+        dst += 64;
+    }
+    for (; bytes >= 16; bytes -= 16) {
+        _mm_storeu_si128((__m128i *) dst, _mm_stream_load_si128(s));
+        s++;
+        dst += 16;
+    }
+    memcpy(dst, s, bytes);
+}
+
+#endif // COLOR_KERNELS_SSE41
+
+#ifdef COLOR_KERNELS_AVX2
+
+// ----------------------------------------------------------------------------
+// AVX2: 32 pixels per iteration. vpshufb works per 128-bit lane, so the
+// qword order is fixed up with vpermq before storing.
+// ----------------------------------------------------------------------------
+
+TARGET_AVX2
+static inline void yuyvSplit_AVX2(const unsigned char *src, unsigned char *dstY, unsigned char *dstC, __m256i shuffle)
+{
+    __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), shuffle);
+    __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 32)), shuffle);
+    __m256i y = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i c = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i *)dstY, y);
+    _mm256_storeu_si256((__m256i *)dstC, c);
+}
+
+TARGET_AVX2
+static void yuyvToLumaRow_AVX2(const unsigned char *src, unsigned char *dstY, int width)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 32 <= pixels; x += 32) {
+        __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 2 * x)), shuffle);
+        __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 2 * x + 32)), shuffle);
+        __m256i y = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(dstY + x), y);
+    }
+    yuyvToLumaRow_SSSE3(src + 2 * x, dstY + x, pixels - x);
+}
+
+TARGET_AVX2
+static void yuyvToNV12Row_AVX2(const unsigned char *src, unsigned char *dstY, unsigned char *dstUV, int width)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                                             0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 32 <= pixels; x += 32)
+        yuyvSplit_AVX2(src + 2 * x, dstY + x, dstUV + x, shuffle);
+    yuyvToNV12Row_SSSE3(src + 2 * x, dstY + x, dstUV + x, pixels - x);
+}
+
+TARGET_AVX2
+static void yuyvToNV21Row_AVX2(const unsigned char *src, unsigned char *dstY, unsigned char *dstVU, int width)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 3, 1, 7, 5, 11, 9, 15, 13,
+                                             0, 2, 4, 6, 8, 10, 12, 14, 3, 1, 7, 5, 11, 9, 15, 13);
+    const int pixels = width & ~1;
+    int x = 0;
+    for (; x + 32 <= pixels; x += 32)
+        yuyvSplit_AVX2(src + 2 * x, dstY + x, dstVU + x, shuffle);
+    yuyvToNV21Row_SSSE3(src + 2 * x, dstY + x, dstVU + x, pixels - x);
+}
+
+TARGET_AVX2
+static void interleaveChroma_AVX2(const unsigned char *first, const unsigned char *second, unsigned char *dst,
+                                  int count)
+{
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(first + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(second + i));
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    interleaveChroma_SSE2(first + i, second + i, dst + 2 * i, count - i);
+}
+
+TARGET_AVX2
+static void deinterleaveChroma_AVX2(const unsigned char *src, unsigned char *first, unsigned char *second,
+                                    int count)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00ff);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        __m256i c0 = _mm256_packus_epi16(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+        __m256i c1 = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(first + i), _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *)(second + i), _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    deinterleaveChroma_SSE2(src + 2 * i, first + i, second + i, count - i);
+}
+
+TARGET_AVX2
+static void swapChromaPairs_AVX2(const unsigned char *src, unsigned char *dst, int count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                             1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_shuffle_epi8(a, shuffle));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_shuffle_epi8(b, shuffle));
+    }
+    swapChromaPairs_SSE2(src + 2 * i, dst + 2 * i, count - i);
+}
+
+TARGET_AVX2
+static void averageChromaRows_AVX2(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count,
+                                   bool round)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i avg = _mm256_avg_epu8(x, y);
+        if (!round)
+            avg = _mm256_sub_epi8(avg, _mm256_and_si256(_mm256_xor_si256(x, y), one));
+        _mm256_storeu_si256((__m256i *)(dst + i), avg);
+    }
+    averageChromaRows_SSE2(a + i, b + i, dst + i, count - i, round);
+}
+
+#endif // COLOR_KERNELS_AVX2
+
+// ----------------------------------------------------------------------------
+// Dispatch
+// ----------------------------------------------------------------------------
+
+static const ColorKernels sKernelTable[COLOR_KERNEL_ISA_MAX] = {
+    {
+        COLOR_KERNEL_ISA_C, "C",
+        yuyvToLumaRow_C, yuyvToNV12Row_C, yuyvToNV21Row_C,
+        yuyvToRGBA8888_C, yuyvToRGB565_C, nv12ToRGB565Row_C, yv12ToRGB565Row_C,
+        interleaveChroma_C, deinterleaveChroma_C, swapChromaPairs_C, averageChromaRows_C,
+        yTileRow_C, yDetileRow_C,
+        streamLoadCopy_C, false,
+    },
+#ifdef COLOR_KERNELS_SSE2
+    {
+        COLOR_KERNEL_ISA_SSE2, "SSE2",
+        yuyvToLumaRow_SSE2, yuyvToNV12Row_SSE2, yuyvToNV21Row_SSE2,
+        yuyvToRGBA8888_SSE2, yuyvToRGB565_SSE2, nv12ToRGB565Row_SSE2, yv12ToRGB565Row_SSE2,
+        interleaveChroma_SSE2, deinterleaveChroma_SSE2, swapChromaPairs_SSE2, averageChromaRows_SSE2,
+        yTileRow_SSE2, yDetileRow_SSE2,
+        streamLoadCopy_C, false,
+    },
+#endif
+#ifdef COLOR_KERNELS_SSSE3
+    {
+        COLOR_KERNEL_ISA_SSSE3, "SSSE3",
+        yuyvToLumaRow_SSSE3, yuyvToNV12Row_SSSE3, yuyvToNV21Row_SSSE3,
+        yuyvToRGBA8888_SSE2, yuyvToRGB565_SSE2, nv12ToRGB565Row_SSE2, yv12ToRGB565Row_SSE2,
+        interleaveChroma_SSE2, deinterleaveChroma_SSE2, swapChromaPairs_SSE2, averageChromaRows_SSE2,
+        yTileRow_SSE2, yDetileRow_SSE2,
+        streamLoadCopy_C, false,
+    },
+#endif
+#ifdef COLOR_KERNELS_SSE41
+    {
+        COLOR_KERNEL_ISA_SSE41, "SSE4.1",
+        yuyvToLumaRow_SSSE3, yuyvToNV12Row_SSSE3, yuyvToNV21Row_SSSE3,
+        yuyvToRGBA8888_SSE2, yuyvToRGB565_SSE2, nv12ToRGB565Row_SSE2, yv12ToRGB565Row_SSE2,
+        interleaveChroma_SSE2, deinterleaveChroma_SSE2, swapChromaPairs_SSE2, averageChromaRows_SSE2,
+        yTileRow_SSE2, yDetileRow_SSE2,
+        streamLoadCopy_SSE41, true,
+    },
+#endif
+#ifdef COLOR_KERNELS_AVX2
+    {
+        COLOR_KERNEL_ISA_AVX2, "AVX2",
+        yuyvToLumaRow_AVX2, yuyvToNV12Row_AVX2, yuyvToNV21Row_AVX2,
+        yuyvToRGBA8888_SSE2, yuyvToRGB565_SSE2, nv12ToRGB565Row_SSE2, yv12ToRGB565Row_SSE2,
+        interleaveChroma_AVX2, deinterleaveChroma_AVX2, swapChromaPairs_AVX2, averageChromaRows_AVX2,
+        yTileRow_SSE2, yDetileRow_SSE2,
+        streamLoadCopy_SSE41, true,
+    },
+#endif
+};
+
+// best level built in
+#if defined(COLOR_KERNELS_AVX2)
+static const ColorKernelIsa sBuiltIsa = COLOR_KERNEL_ISA_AVX2;
+#elif defined(COLOR_KERNELS_SSE41)
+static const ColorKernelIsa sBuiltIsa = COLOR_KERNEL_ISA_SSE41;
+#elif defined(COLOR_KERNELS_SSSE3)
+static const ColorKernelIsa sBuiltIsa = COLOR_KERNEL_ISA_SSSE3;
+#elif defined(COLOR_KERNELS_SSE2)
+static const ColorKernelIsa sBuiltIsa = COLOR_KERNEL_ISA_SSE2;
+#else
+static const ColorKernelIsa sBuiltIsa = COLOR_KERNEL_ISA_C;
+#endif
+
+static pthread_once_t sKernelOnce = PTHREAD_ONCE_INIT;
+static ColorKernelIsa sMaxIsa = COLOR_KERNEL_ISA_C;
+static const ColorKernels *sActiveKernels = &sKernelTable[COLOR_KERNEL_ISA_C];
+
+#ifdef COLOR_KERNELS_X86
+// CPUID feature bits, <cpuid.h> of older compilers lacks some of them
+static const unsigned int CPUID1_EDX_SSE2 = 1 << 26;
+static const unsigned int CPUID1_ECX_SSSE3 = 1 << 9;
+static const unsigned int CPUID1_ECX_SSE41 = 1 << 19;
+static const unsigned int CPUID1_ECX_OSXSAVE = 1 << 27;
+static const unsigned int CPUID1_ECX_AVX = 1 << 28;
+static const unsigned int CPUID7_EBX_AVX2 = 1 << 5;
+
+// best level the CPU supports, and for AVX2 the OS, which has to save the YMM registers
+static ColorKernelIsa cpuColorKernelIsa()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & CPUID1_EDX_SSE2))
+        return COLOR_KERNEL_ISA_C;
+    if (!(ecx & CPUID1_ECX_SSSE3))
+        return COLOR_KERNEL_ISA_SSE2;
+    if (!(ecx & CPUID1_ECX_SSE41))
+        return COLOR_KERNEL_ISA_SSSE3;
+    if (!(ecx & CPUID1_ECX_OSXSAVE) || !(ecx & CPUID1_ECX_AVX) || __get_cpuid_max(0, NULL) < 7)
+        return COLOR_KERNEL_ISA_SSE41;
+
+    unsigned int xcr0, xcr0High;
+    // xgetbv, spelled out for assemblers that don't know it
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (xcr0High) : "c" (0));
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if ((xcr0 & 6) != 6 || !(ebx & CPUID7_EBX_AVX2))
+        return COLOR_KERNEL_ISA_SSE41;
+    return COLOR_KERNEL_ISA_AVX2;
+}
+#endif
+
+static void detectColorKernelIsa()
+{
+#ifdef COLOR_KERNELS_X86
+    sMaxIsa = cpuColorKernelIsa();
+#endif
+    if (sMaxIsa > sBuiltIsa)
+        sMaxIsa = sBuiltIsa;
+    sActiveKernels = &sKernelTable[sMaxIsa];
+    LOG1("@%s: using %s color conversion kernels", __FUNCTION__, sActiveKernels->name);
+}
+
+const ColorKernels &getColorKernels()
+{
+    pthread_once(&sKernelOnce, detectColorKernelIsa);
+    return *sActiveKernels;
+}
+
+ColorKernelIsa getMaxColorKernelIsa()
+{
+    pthread_once(&sKernelOnce, detectColorKernelIsa);
+    return sMaxIsa;
+}
+
+ColorKernelIsa setColorKernelIsa(ColorKernelIsa isa)
+{
+    pthread_once(&sKernelOnce, detectColorKernelIsa);
+    if (isa < COLOR_KERNEL_ISA_C || isa > sMaxIsa)
+        isa = sMaxIsa;
+    sActiveKernels = &sKernelTable[isa];
+    return isa;
+}
+
+// ----------------------------------------------------------------------------
+// Readback of gralloc sources
+// ----------------------------------------------------------------------------
+
+static volatile bool sReadbackEnabled = true;
+
+void setColorReadbackEnabled(bool enabled)
+{
+    LOG1("@%s: %d", __FUNCTION__, enabled);
+    sReadbackEnabled = enabled;
+}
+
+bool colorReadbackEnabled()
+{
+    return sReadbackEnabled;
+}
+
+// one bounce buffer for all the slots of a readback
+struct ColorReadbackBuffer {
+    unsigned char *allocation;
+    unsigned char *buffer;      // 64 byte aligned
+    bool inUse;
+};
+
+static pthread_once_t sReadbackKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sReadbackKey;     // the bounce buffer of each thread
+
+static ColorReadbackBuffer *newReadbackBuffer()
+{
+    ColorReadbackBuffer *buffer = new ColorReadbackBuffer;
+    buffer->allocation = new unsigned char[ColorReadback::SLOTS * ColorReadback::TILE_BYTES + 64];
+    buffer->buffer = buffer->allocation + ((64 - ((uintptr_t) buffer->allocation & 63)) & 63);
+    buffer->inUse = false;
+    return buffer;
+}
+
+static void freeReadbackBuffer(void *data)
+{
+    ColorReadbackBuffer *buffer = (ColorReadbackBuffer *) data;
+    if (buffer == NULL)
+        return;
+    delete [] buffer->allocation;
+    delete buffer;
+}
+
+static void createReadbackKey()
+{
+    pthread_key_create(&sReadbackKey, freeReadbackBuffer);
+}
+
+ColorReadback::ColorReadback(bool uncached) :
+    mStreaming(false)
+    ,mThreadBuffer(NULL)
+    ,mOwnBuffer(NULL)
+    ,mBuffer(NULL)
+    ,mStreamLoadCopy(NULL)
+{
+    const ColorKernels &kernels = getColorKernels();
+    if (!uncached || !sReadbackEnabled || !kernels.streamingLoads)
+        return;
+
+    // the bounce buffer of this thread, made by its first readback and
+    // freed when it exits, unless another readback of the thread holds it
+    pthread_once(&sReadbackKeyOnce, createReadbackKey);
+    ColorReadbackBuffer *buffer = (ColorReadbackBuffer *) pthread_getspecific(sReadbackKey);
+    if (buffer == NULL) {
+        buffer = newReadbackBuffer();
+        pthread_setspecific(sReadbackKey, buffer);
+    }
+    if (buffer->inUse) {
+        mOwnBuffer = newReadbackBuffer();
+        buffer = mOwnBuffer;
+    } else {
+        mThreadBuffer = buffer;
+    }
+    buffer->inUse = true;
+    mBuffer = buffer->buffer;
+    mStreamLoadCopy = kernels.streamLoadCopy;
+    mStreaming = true;
+}
+
+ColorReadback::~ColorReadback()
+{
+    if (mThreadBuffer != NULL)
+        mThreadBuffer->inUse = false;
+    freeReadbackBuffer(mOwnBuffer);
+}
+
+const unsigned char *ColorReadback::read(int slot, const unsigned char *src, int bytes)
+{
+    if (!mStreaming || bytes > TILE_BYTES - 16)
+        return src;
+    // same alignment as the source, so that the whole row but its ends streams
+    unsigned char *tile = mBuffer + slot * TILE_BYTES + ((uintptr_t) src & 15);
+    mStreamLoadCopy(tile, src, bytes);
+    return tile;
+}
+
+void ColorReadback::copy(unsigned char *dst, const unsigned char *src, int bytes)
+{
+    if (!mStreaming) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+    while (bytes > 0) {
+        int tile = bytes < TILE_BYTES ? bytes : TILE_BYTES;
+        mStreamLoadCopy(mBuffer, src, tile);
+        memcpy(dst, mBuffer, tile);
+        src += tile;
+        dst += tile;
+        bytes -= tile;
+    }
+}
+
+} // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_COLOR_CONVERTER_KERNELS_H
+#define ANDROID_LIBCAMERA_COLOR_CONVERTER_KERNELS_H
+
+namespace android {
+
+/**
+ * Instruction set levels of the color conversion kernels, in increasing
+ * order. The best level supported by the CPU, of those the compiler could
+ * build, is picked at runtime.
+ */
+enum ColorKernelIsa {
+    COLOR_KERNEL_ISA_C = 0,
+    COLOR_KERNEL_ISA_SSE2,
+    COLOR_KERNEL_ISA_SSSE3,
+    COLOR_KERNEL_ISA_SSE41,
+    COLOR_KERNEL_ISA_AVX2,
+
+    COLOR_KERNEL_ISA_MAX
+};
+
+/**
+ * Row kernels used by the converters in ColorConverter.cpp.
+ *
+ * Row kernels work on one image row of 'width' pixels. Packed 4:2:2
+ * sources are processed two pixels at a time, so an odd last pixel is
+ * ignored exactly like the scalar converters always did. The YUYV to RGB
+ * kernels take a number of 2-pixel macro pixels instead, since those
+ * converters never cared about rows.
+ */
+struct ColorKernels {
+    ColorKernelIsa isa;
+    const char *name;
+
+    // YUYV row -> Y row
+    void (*yuyvToLumaRow)(const unsigned char *src, unsigned char *dstY, int width);
+    // YUYV row -> Y row + interleaved UV (NV12 order) row
+    void (*yuyvToNV12Row)(const unsigned char *src, unsigned char *dstY, unsigned char *dstUV, int width);
+    // YUYV row -> Y row + interleaved VU (NV21 order) row
+    void (*yuyvToNV21Row)(const unsigned char *src, unsigned char *dstY, unsigned char *dstVU, int width);
+
+    // 'pairs' YUYV macro pixels -> RGBA8888 (BT.601 video range)
+    void (*yuyvToRGBA8888)(const unsigned char *src, unsigned char *dst, int pairs);
+    // 'pairs' YUYV macro pixels -> RGB565 (full range, like all the RGB565 converters)
+    void (*yuyvToRGB565)(const unsigned char *src, unsigned char *dst, int pairs);
+    // Y row + interleaved UV row -> RGB565 row
+    void (*nv12ToRGB565Row)(const unsigned char *srcY, const unsigned char *srcUV, unsigned char *dst, int width);
+    // Y row + U row + V row -> RGB565 row
+    void (*yv12ToRGB565Row)(const unsigned char *srcY, const unsigned char *srcU, const unsigned char *srcV,
+                            unsigned char *dst, int width);
+
+    // Chroma plane primitives, 'count' is in samples per plane (so in
+    // pairs for interleaved rows). swapChromaPairs may run in place.
+
+    // two planar rows -> one interleaved row: first[0], second[0], first[1], ...
+    void (*interleaveChroma)(const unsigned char *first, const unsigned char *second, unsigned char *dst, int count);
+    // one interleaved row -> two planar rows, the inverse of interleaveChroma
+    void (*deinterleaveChroma)(const unsigned char *src, unsigned char *first, unsigned char *second, int count);
+    // UV pairs <-> VU pairs
+    void (*swapChromaPairs)(const unsigned char *src, unsigned char *dst, int count);
+    // (a + b) / 2 for vertical 2:1 chroma subsampling, rounding up when 'round' is set
+    void (*averageChromaRows)(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count,
+                              bool round);
+
+    // One row of a plane in the Intel Y-tiled layout, whose 16 byte OWords
+    // are 512 bytes apart (see the Y-tiled surfaces in ColorConverter.cpp).
+    // 'tiled' points at the first OWord of the row.
+
+    // 'bytes' bytes of a linear row -> Y-tiled row
+    void (*yTileRow)(const unsigned char *src, unsigned char *tiled, int bytes);
+    // Y-tiled row -> 'bytes' bytes of a linear row
+    void (*yDetileRow)(const unsigned char *tiled, unsigned char *dst, int bytes);
+
+    // copy that reads 'src' with streaming loads (MOVNTDQA) where available, see ColorReadback
+    void (*streamLoadCopy)(unsigned char *dst, const unsigned char *src, int bytes);
+    // whether streamLoadCopy really uses streaming loads, rather than memcpy
+    bool streamingLoads;
+};
+
+// kernels for the best instruction set supported by this CPU and built in,
+// unless a lower level was forced with setColorKernelIsa()
+const ColorKernels &getColorKernels();
+
+// best instruction set supported by this CPU and built in
+ColorKernelIsa getMaxColorKernelIsa();
+
+// force the kernels of a given level (clamped to what the CPU supports),
+// mainly for benchmarking and for checking kernels against each other
+ColorKernelIsa setColorKernelIsa(ColorKernelIsa isa);
+
+/**
+ * Reads source images that live in gralloc surfaces.
+ *
+ * The VPP output surfaces are mapped uncached or write-combined, where
+ * every plain load stalls on memory. Streaming loads fetch a whole 64 byte
+ * line per access instead, but they only pay off when nothing else competes
+ * for the fill buffers in between, so the data is first streamed into a
+ * small cache resident bounce buffer, in tiles, and the converters read or
+ * copy it from there. Each thread keeps its bounce buffer for all the
+ * readbacks it constructs, so one per band or per image costs no
+ * allocation.
+ *
+ * A readback constructed for a cached source, or on a CPU without SSE4.1,
+ * or with readback disabled, just hands out the source pointers.
+ */
+struct ColorReadbackBuffer;
+
+class ColorReadback {
+public:
+    explicit ColorReadback(bool uncached);
+    ~ColorReadback();
+
+    // number of independent rows read() can hold at a time
+    static const int SLOTS = 4;
+    // bytes of a slot, and of the tiles copy() goes through
+    static const int TILE_BYTES = 16 * 1024;
+
+    // 'bytes' bytes at 'src', valid until the next read() into the same slot
+    const unsigned char *read(int slot, const unsigned char *src, int bytes);
+    // memcpy() from the source, through slot 0
+    void copy(unsigned char *dst, const unsigned char *src, int bytes);
+
+private:
+    bool mStreaming;
+    ColorReadbackBuffer *mThreadBuffer;     // the thread's bounce buffer, when this readback holds it
+    ColorReadbackBuffer *mOwnBuffer;        // or a bounce buffer of its own
+    unsigned char *mBuffer;
+    void (*mStreamLoadCopy)(unsigned char *dst, const unsigned char *src, int bytes);
+};
+
+// turn the streaming readback of gralloc sources on (the default) or off
+void setColorReadbackEnabled(bool enabled);
+bool colorReadbackEnabled();
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_COLOR_CONVERTER_KERNELS_H
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_ColorConverterPool"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include "ColorConverterPool.h"
+#include "LogHelper.h"
+
+namespace android {
+
+// upper limit of threads converting one image
+static const int MAX_CONVERT_THREADS = 8;
+
+// system properties overriding the default threads/bands, 0 means automatic
+static const char *PROP_CONVERT_THREADS = "camera.hal.convert.threads";
+static const char *PROP_CONVERT_BANDS = "camera.hal.convert.bands";
+
+static int intProperty(const char *key)
+{
+    char propVal[PROPERTY_VALUE_MAX];
+    if (0 == property_get(key, propVal, "0"))
+        return 0;
+    return atoi(propVal);
+}
+
+static int onlineCpus()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    return cpus > MAX_CONVERT_THREADS ? MAX_CONVERT_THREADS : (int) cpus;
+}
+
+ColorConvertPool *ColorConvertPool::instance()
+{
+    static ColorConvertPool theInstance;
+    return &theInstance;
+}
+
+ColorConvertPool::ColorConvertPool() :
+    mExiting(false)
+    ,mNumThreads(1)
+    ,mNumBands(0)
+    ,mJob(NULL)
+    ,mJobBands(0)
+    ,mJobBandRows(0)
+    ,mNextBand(0)
+    ,mBandsDone(0)
+{
+    setParallelism(intProperty(PROP_CONVERT_THREADS), intProperty(PROP_CONVERT_BANDS));
+}
+
+ColorConvertPool::~ColorConvertPool()
+{
+    stopWorkers();
+}
+
+void ColorConvertPool::setParallelism(int numThreads, int numBands)
+{
+    LOG1("@%s: threads %d, bands %d", __FUNCTION__, numThreads, numBands);
+    if (numThreads <= 0)
+        numThreads = onlineCpus();
+    else if (numThreads > MAX_CONVERT_THREADS)
+        numThreads = MAX_CONVERT_THREADS;
+    if (numBands < 0)
+        numBands = 0;
+
+    // wait for the conversion in flight, if any
+    Mutex::Autolock runLock(mRunLock);
+    if (numThreads != mNumThreads)
+        stopWorkers();
+    Mutex::Autolock lock(mLock);
+    mNumThreads = numThreads;
+    mNumBands = numBands;
+}
+
+// called with mLock held
+void ColorConvertPool::startWorkers()
+{
+    while ((int) mWorkers.size() < mNumThreads - 1) {
+        sp<Worker> worker = new Worker(this);
+        if (worker->run("CamHAL_COLORCONV") != NO_ERROR) {
+            ALOGE("failed to start color conversion worker");
+            break;
+        }
+        mWorkers.push(worker);
+    }
+}
+
+// called without mLock held
+void ColorConvertPool::stopWorkers()
+{
+    Vector< sp<Worker> > workers;
+    {
+        Mutex::Autolock lock(mLock);
+        mExiting = true;
+        mWorkCondition.broadcast();
+        workers = mWorkers;
+        mWorkers.clear();
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->requestExitAndWait();
+
+    Mutex::Autolock lock(mLock);
+    mExiting = false;
+}
+
+// called with mLock held
+void ColorConvertPool::bandRows(int band, int *rowBegin, int *rowEnd) const
+{
+    *rowBegin = band * mJobBandRows;
+    *rowEnd = *rowBegin + mJobBandRows;
+    if (*rowEnd > mJob->height)
+        *rowEnd = mJob->height;
+}
+
+// converts the next band of the current job, returns false when none is left
+bool ColorConvertPool::runNextBand()
+{
+    int rowBegin, rowEnd;
+    const ColorConvertJob *job;
+
+    mLock.lock();
+    if (mJob == NULL || mNextBand >= mJobBands) {
+        mLock.unlock();
+        return false;
+    }
+    job = mJob;
+    bandRows(mNextBand++, &rowBegin, &rowEnd);
+    mLock.unlock();
+
+    job->convertRows(*job, rowBegin, rowEnd);
+
+    mLock.lock();
+    if (++mBandsDone == mJobBands)
+        mDoneCondition.signal();
+    mLock.unlock();
+    return true;
+}
+
+bool ColorConvertPool::workerLoop()
+{
+    {
+        Mutex::Autolock lock(mLock);
+        while (!mExiting && (mJob == NULL || mNextBand >= mJobBands))
+            mWorkCondition.wait(mLock);
+        if (mExiting)
+            return false;
+    }
+    runNextBand();
+    return true;
+}
+
+void ColorConvertPool::run(const ColorConvertJob &job)
+{
+    int numThreads, bands;
+    {
+        Mutex::Autolock lock(mLock);
+        numThreads = mNumThreads;
+        bands = (mNumBands > 0) ? mNumBands : mNumThreads;
+    }
+
+    // bands have to start on a chroma row, which odd sizes can't guarantee
+    if ((job.width | job.height) & 1)
+        bands = 1;
+    if (bands > job.height / MIN_BAND_ROWS)
+        bands = job.height / MIN_BAND_ROWS;
+
+    // the preview, video and picture threads may convert at the same time,
+    // only one of them gets the pool and the others convert on their own
+    if (numThreads <= 1 || bands <= 1 || mRunLock.tryLock() != NO_ERROR) {
+        job.convertRows(job, 0, job.height);
+        return;
+    }
+
+    int rows = (job.height + bands - 1) / bands;
+    rows += rows & 1;
+
+    mLock.lock();
+    startWorkers();
+    mJob = &job;
+    mJobBandRows = rows;
+    mJobBands = (job.height + rows - 1) / rows;
+    mNextBand = 0;
+    mBandsDone = 0;
+    mWorkCondition.broadcast();
+    mLock.unlock();
+
+    // the caller converts bands too
+    while (runNextBand())
+        ;
+
+    mLock.lock();
+    while (mBandsDone < mJobBands)
+        mDoneCondition.wait(mLock);
+    mJob = NULL;
+    mLock.unlock();
+
+    mRunLock.unlock();
+}
+
+void runColorConvertJob(const ColorConvertJob &job)
+{
+    if (job.width <= 0 || job.height <= 0)
+        return;
+    ColorConvertPool::instance()->run(job);
+}
+
+void setColorConvertParallelism(int numThreads, int numBands)
+{
+    ColorConvertPool::instance()->setParallelism(numThreads, numBands);
+}
+
+}; // namespace android
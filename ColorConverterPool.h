@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_COLOR_CONVERTER_POOL_H
+#define ANDROID_LIBCAMERA_COLOR_CONVERTER_POOL_H
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ColorConvertJob;
+struct ScaleColumns;
+
+// converts rows [rowBegin, rowEnd) of the job's image
+typedef void (*ColorConvertRowsFunc)(const ColorConvertJob &job, int rowBegin, int rowEnd);
+
+/**
+ * One color conversion, described so that it can be split into
+ * horizontal bands. Every converter in ColorConverter.cpp has a rows
+ * function that produces exactly the bytes of the whole-image conversion
+ * when it is run over any partition of [0, height) into bands that start
+ * on even rows, so band results never depend on the split.
+ */
+struct ColorConvertJob {
+    ColorConvertRowsFunc convertRows;
+    int width;
+    int height;
+    int stride;         // source stride, for the ...withStride converters
+    int alignHeight;    // source aligned height, for the ...withStride converters
+    int dstStride;      // destination stride, where the converter takes one
+    int option;         // converter specific flag (e.g. dstAlignTo16 of RepaddingYV12)
+    int srcWidth;       // source size and format of the scaling converters,
+    int srcHeight;      // whose width/height above are the destination size
+    int srcFormat;
+    bool srcUncached;   // source is a gralloc surface, read through a ColorReadback
+    const ScaleColumns *scaleColumns;   // luma and chroma columns of the scaling converters
+    unsigned char *src;
+    unsigned char *dst;
+};
+
+/**
+ * Runs a conversion job, in parallel bands when the image is large enough.
+ *
+ * Bands are aligned to the 2-row chroma subsampling and run on a
+ * persistent pool of worker threads, with the calling thread converting
+ * bands as well. The call returns once all the bands are done. When the
+ * pool is already busy with a conversion from another thread, or the
+ * image has odd dimensions, the job runs serially on the calling thread.
+ */
+void runColorConvertJob(const ColorConvertJob &job);
+
+/**
+ * Rows function converting srcFormat to dstFormat, NULL when there is none.
+ *
+ * \param packed: the source rows are exactly 'width' bytes apart (stride ==
+ *                width, alignHeight == height). The converter specialized for
+ *                that is returned when the pair has one, the stride-aware one
+ *                otherwise.
+ */
+ColorConvertRowsFunc getColorConvertRows(int srcFormat, int dstFormat, bool packed);
+
+/**
+ * Configures the parallel conversion front end.
+ *
+ * \param numThreads: threads converting one image, including the caller.
+ *                    0 selects the number of online CPUs, 1 disables the pool.
+ * \param numBands: bands one image is split into. 0 selects one per thread.
+ */
+void setColorConvertParallelism(int numThreads, int numBands);
+
+class ColorConvertPool {
+public:
+    static ColorConvertPool *instance();
+
+    void setParallelism(int numThreads, int numBands);
+    void run(const ColorConvertJob &job);
+
+private:
+    ColorConvertPool();
+    ~ColorConvertPool();
+
+    class Worker : public Thread {
+    public:
+        Worker(ColorConvertPool *pool) : Thread(false), mPool(pool) {}
+    private:
+        virtual bool threadLoop() { return mPool->workerLoop(); }
+        ColorConvertPool *mPool;
+    };
+
+    bool workerLoop();
+    bool runNextBand();
+    void startWorkers();
+    void stopWorkers();
+    void bandRows(int band, int *rowBegin, int *rowEnd) const;
+
+    // minimum number of rows worth handing to another thread
+    static const int MIN_BAND_ROWS = 32;
+
+    Mutex mRunLock;             // one parallel conversion at a time
+    Mutex mLock;                // protects everything below
+    Condition mWorkCondition;   // signalled when bands are posted or on exit
+    Condition mDoneCondition;   // signalled when the last band completes
+    Vector< sp<Worker> > mWorkers;
+    bool mExiting;
+    int mNumThreads;
+    int mNumBands;
+
+    // current job
+    const ColorConvertJob *mJob;
+    int mJobBands;
+    int mJobBandRows;
+    int mNextBand;
+    int mBandsDone;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_COLOR_CONVERTER_POOL_H
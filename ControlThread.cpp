@@ -62,7 +62,6 @@ ControlThread::ControlThread(int cameraId) :
     ,mDecoderedFormat(V4L2_PIX_FMT_YUV422P)
     ,mRecordformat(V4L2_PIX_FMT_NV12)
     ,mJpegEncoderFormat(V4L2_PIX_FMT_YUV420)//V4L2_PIX_FMT_NV12
-    ,postviewBuffer(NULL)
     ,interBuff(NULL)
     ,driverWidth(640)
     ,driverHeight(480)
@@ -549,14 +548,11 @@ void ControlThread::returnBuffer(CameraBuffer *buff)
     msg.id = MESSAGE_ID_RETURN_BUFFER;
     msg.data.returnBuffer.buff = buff;
 
-    if(buff == yuvBuffer || buff == postviewBuffer || buff == interBuff) {
+    if(buff == yuvBuffer || buff == interBuff) {
         mGraphicBufAlloc->free(buff);
         if(buff == yuvBuffer) {
             delete yuvBuffer;
             yuvBuffer = NULL;
-        } else if (buff == postviewBuffer) {
-            delete postviewBuffer;
-            postviewBuffer = NULL;
         } else if (buff == interBuff) {
             delete interBuff;
             interBuff = NULL;
@@ -842,7 +838,8 @@ status_t ControlThread::startPreviewCore(bool videoMode)
 
     frameRate = mParameters.getPreviewFrameRate();
     mDriver->setPreviewFrameSize(driverWidth, driverHeight, frameRate);
-    mPreviewThread->setPreviewConfig(previewWidth, previewHeight, mDecoderedFormat, previewFormat);
+    mPreviewThread->setPreviewConfig(previewWidth, previewHeight, mDecoderedFormat, previewFormat,
+                                     driverWidth, driverHeight);
     // set video frame config
     if (videoMode) {
         mParameters.getVideoSize(&videoWidth, &videoHeight);
@@ -1220,7 +1217,15 @@ status_t ControlThread::handleMessageTakePicture()
     config.picture.format = mJpegEncoderFormat;
 
     config.picture.quality = mParameters.getInt(CameraParameters::KEY_JPEG_QUALITY);
-    if((config.picture.quality >= 90) && (width >= driverWidth)) {
+    config.jpegTargetSize = mParameters.getInt(PictureThread::KEY_JPEG_TARGET_SIZE);
+    if (config.jpegTargetSize < 0)
+        config.jpegTargetSize = 0;
+    config.jpegChunkSize = mParameters.getInt(PictureThread::KEY_JPEG_CHUNK_SIZE);
+    if (config.jpegChunkSize < 0)
+        config.jpegChunkSize = 0;
+    // the driver JPEG is remuxed to any quality, but isn't scaled, only
+    // an MJPEG camera has one, and a target size needs the SW encoder
+    if (mPictureMode && (width >= driverWidth) && config.jpegTargetSize == 0) {
           mJpegFromDriver = true;
           config.jpegfromdriver = true;
     } else {
@@ -1229,6 +1234,12 @@ status_t ControlThread::handleMessageTakePicture()
     }
     config.picture.width = width;
     config.picture.height = height;
+    // a YUYV preview frame is converted, at the size the driver streams it
+    config.snapshotFormat = mPictureMode ? V4L2_PIX_FMT_YUV422P : V4L2_PIX_FMT_YUYV;
+    config.snapshotWidth = mRestartdevice ? width : previewWidth;
+    config.snapshotHeight = mRestartdevice ? height : previewHeight;
+    config.jpegSpeed = JPEG_SPEED_BALANCED;
+    PictureThread::parseJpegSpeed(mParameters.get(PictureThread::KEY_JPEG_SPEED), &config.jpegSpeed);
 
     if (mThumbSupported) {
         config.thumbnail.format = mJpegEncoderFormat;
@@ -1269,28 +1280,10 @@ status_t ControlThread::handleMessageTakePicture()
                returnBuffer(snapshotBuffer);
            }
         }
-        if (mThumbSupported) {
-            int ret=0;
-            postviewBuffer = new CameraBuffer;
-            ret = mGraphicBufAlloc->allocate(postviewBuffer,config.thumbnail.width,config.thumbnail.height,mJpegEncoderFormat);
-            if(ret != NO_ERROR)
-            {
-                ALOGE("allocate graphic buffer failed");
-                delete postviewBuffer;
-                postviewBuffer = NULL;
-                if (yuvBuffer != NULL) {
-                    mGraphicBufAlloc->free(yuvBuffer);
-                    delete yuvBuffer;
-                    yuvBuffer = NULL;
-                }
-                return -1;
-            }
-            postviewBuffer->setOwner(this);
-            postviewBuffer->mType = BUFFER_TYPE_CAP;
-        }
-
         mCallbacksThread->shutterSound();
-        if( !mJpegFromDriver)
+        // A 422H snapshot (a captured or decoded MJPEG frame) is encoded as
+        // it is; only a YUYV preview frame is converted to YV12 for the encoder
+        if (!mJpegFromDriver && !mRestartdevice && !mPictureMode)
         {
             interBuff = new CameraBuffer;
             status = mGraphicBufAlloc->allocate(interBuff,width,height,mJpegEncoderFormat);
@@ -1304,29 +1297,17 @@ status_t ControlThread::handleMessageTakePicture()
                     delete yuvBuffer;
                     yuvBuffer = NULL;
                  }
-                 if (postviewBuffer != NULL) {
-                    mGraphicBufAlloc->free(postviewBuffer);
-                    delete postviewBuffer;
-                    postviewBuffer = NULL;
-                 }
                  return -1;
             }
             interBuff->setOwner(this);
             interBuff->mType = BUFFER_TYPE_CAP;
         }
         if(mRestartdevice) {
-            if (mThumbSupported && postviewBuffer != NULL) {
-                if(!mJpegFromDriver) {
-                   status = mPictureThread->encode(yuvBuffer,interBuff,postviewBuffer);
-                } else {
-                   status = mPictureThread->encode(snapshotBuffer,yuvBuffer,postviewBuffer);
-                }
+            // the thumbnail, if any, is made by the picture thread from the same surface
+            if(!mJpegFromDriver) {
+                status = mPictureThread->encode(yuvBuffer,interBuff);
             } else {
-                 if(!mJpegFromDriver) {
-                     status = mPictureThread->encode(yuvBuffer,interBuff);
-                 } else {
-                     status = mPictureThread->encode(snapshotBuffer,yuvBuffer);
-                 }
+                status = mPictureThread->encode(snapshotBuffer,yuvBuffer);
             }
         }
         mState = STATE_CAPTURE;
@@ -1336,28 +1317,12 @@ status_t ControlThread::handleMessageTakePicture()
         // No need to stop, reconfigure, and restart the driver
         if (mLastRecordingBuff !=0 && mLastRecordJpegBuff !=0)
         {
-            if (mThumbSupported)
-            {
-                 int ret=0;
-                 postviewBuffer = new CameraBuffer;
-                 ret = mGraphicBufAlloc->allocate(postviewBuffer,config.thumbnail.width,config.thumbnail.height,mJpegEncoderFormat);
-                 if(ret != NO_ERROR)
-                 {
-                      LOGE("allocate graphic buffer failed");
-                      delete postviewBuffer;
-                      postviewBuffer = NULL;
-                      return -1;
-                 }
-                 postviewBuffer->setOwner(this);
-                 postviewBuffer->mType = BUFFER_TYPE_CAP;
-           }
-            if (mThumbSupported && postviewBuffer != NULL) {
-                status = mPictureThread->encode(mLastRecordJpegBuff, mLastRecordingBuff,postviewBuffer);
-            }
-            else
-            {
+            // the 422H decode of the frame is encoded as it is, unless the
+            // driver's JPEG is taken
+            if (mJpegFromDriver)
                 status = mPictureThread->encode(mLastRecordJpegBuff,mLastRecordingBuff);
-            }
+            else
+                status = mPictureThread->encode(mLastRecordingBuff);
         }
     }
 
@@ -1650,6 +1615,31 @@ status_t ControlThread::validateParameters(const CameraParameters *params)
         }
     }
 
+    // JPEG SPEED
+    JpegSpeed jpegSpeed;
+    const char *pJpegSpeed = params->get(PictureThread::KEY_JPEG_SPEED);
+    if (pJpegSpeed != NULL && !PictureThread::parseJpegSpeed(pJpegSpeed, &jpegSpeed)) {
+        ALOGE("bad %s: %s", PictureThread::KEY_JPEG_SPEED, pJpegSpeed);
+        return BAD_VALUE;
+    }
+
+    // JPEG TARGET SIZE
+    const char *pJpegTargetSize = params->get(PictureThread::KEY_JPEG_TARGET_SIZE);
+    if (pJpegTargetSize != NULL && params->getInt(PictureThread::KEY_JPEG_TARGET_SIZE) < 0) {
+        ALOGE("bad %s: %s", PictureThread::KEY_JPEG_TARGET_SIZE, pJpegTargetSize);
+        return BAD_VALUE;
+    }
+
+    // JPEG CHUNK SIZE
+    const char *pJpegChunkSize = params->get(PictureThread::KEY_JPEG_CHUNK_SIZE);
+    if (pJpegChunkSize != NULL) {
+        const int chunkSize = params->getInt(PictureThread::KEY_JPEG_CHUNK_SIZE);
+        if (chunkSize != 0 && chunkSize < PictureThread::MIN_JPEG_CHUNK_SIZE) {
+            ALOGE("bad %s: %s", PictureThread::KEY_JPEG_CHUNK_SIZE, pJpegChunkSize);
+            return BAD_VALUE;
+        }
+    }
+
     // MISCELLANEOUS
     // TODO: implement validation for other features not listed above
 
@@ -2341,6 +2331,9 @@ status_t ControlThread::handleMessageGetParameters(MessageGetParameters *msg)
         CameraDriver::Mode mode = videoMode ? CameraDriver::MODE_VIDEO : CameraDriver::MODE_PREVIEW;
         mDriver->getZoomRatios(mode, &mParameters);
         mDriver->getFocusDistances(&mParameters);
+        const int achievedJpegSize = mPictureThread->getAchievedJpegSize();
+        if (achievedJpegSize > 0)
+            mParameters.set(PictureThread::KEY_JPEG_ACHIEVED_SIZE, achievedJpegSize);
 
         String8 params = mParameters.flatten();
         int len = params.length();
@@ -2611,17 +2604,9 @@ status_t ControlThread::dequeuePreviewYuyv()
             status = mPipeThread->preview(driverbuff, convBuff,mCallbackMidBuff);
             if(mState == STATE_CAPTURE) {
                 /*if(mJpegFromDriver) {
-                   if (mThumbSupported && postviewBuffer != NULL) {
-                       status = mPictureThread->encode(driverbuff, yuvbuff, postviewBuffer);
-                   } else {
-                       status = mPictureThread->encode(driverbuff, yuvbuff);
-                   }
+                   status = mPictureThread->encode(driverbuff, yuvbuff);
                 } else { */
-                   if (mThumbSupported && postviewBuffer != NULL) {
-                       status = mPictureThread->encode(driverbuff,interBuff, postviewBuffer);
-                   } else {
-                       status = mPictureThread->encode(driverbuff,interBuff);
-                   }
+                   status = mPictureThread->encode(driverbuff,interBuff);
                 //}
                 mState = STATE_PREVIEW_STILL;
             }
@@ -2756,17 +2741,9 @@ status_t ControlThread::dequeuePreviewMjpeg()
             status = mPipeThread->preview(yuvbuff, convBuff,mCallbackMidBuff);
             if(mState == STATE_CAPTURE) {
                 if(mJpegFromDriver) {
-                   if (mThumbSupported && postviewBuffer != NULL) {
-                       status = mPictureThread->encode(driverbuff, yuvbuff, postviewBuffer);
-                   } else {
-                       status = mPictureThread->encode(driverbuff, yuvbuff);
-                   }
+                   status = mPictureThread->encode(driverbuff, yuvbuff);
                 } else {
-                   if (mThumbSupported && postviewBuffer != NULL) {
-                       status = mPictureThread->encode(yuvbuff,interBuff, postviewBuffer);
-                   } else {
-                       status = mPictureThread->encode(yuvbuff,interBuff);
-                   }
+                   status = mPictureThread->encode(yuvbuff,interBuff);
                 }
                 mState = STATE_PREVIEW_STILL;
             }
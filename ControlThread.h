@@ -402,7 +402,6 @@ private:
     int mJpegEncoderFormat;
 
     CameraBuffer *yuvBuffer;
-    CameraBuffer *postviewBuffer;
     CameraBuffer *interBuff;
     int driverWidth; //the actual width from camera module
     int driverHeight;//the actual height from camera module
@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <cutils/properties.h>
 #include "IntelMetadataBuffer.h"
 #include "CameraBuffer.h"
 #include "LogHelper.h"
@@ -32,6 +33,19 @@
 
 namespace android
 {
+
+// set on platforms whose gralloc lock() hands out the Y-tiled bo of NV12
+// encoder surfaces as it is, rather than through a detiling fence
+static const char *PROP_NV12_LOCK_Y_TILED = "camera.hal.nv12.lockytiled";
+
+static SurfaceLayout nv12LockLayout()
+{
+    char propVal[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_NV12_LOCK_Y_TILED, propVal, "0") > 0 && atoi(propVal) != 0)
+        return SURFACE_Y_TILED;
+    return SURFACE_LINEAR;
+}
+
 CamGraphicBufferAllocator::CamGraphicBufferAllocator():
         mGrAllocDev(NULL)
         ,mGralloc_module(NULL)
@@ -139,6 +153,7 @@ status_t CamGraphicBufferAllocator::allocate(CameraBuffer * gcamBuff,int width,
 
     pGrallocHandle = (struct mfx_gralloc_drm_handle_t *)handle;
     gcamBuff->mStride = pGrallocHandle->pitch;
+    gcamBuff->mLockLayout = (HalFormat == HAL_PIXEL_FORMAT_NV12_TILED_INTEL) ? nv12LockLayout() : SURFACE_LINEAR;
     if((HalFormat == HAL_PIXEL_FORMAT_YV12) || (HalFormat == HAL_PIXEL_FORMAT_NV12_TILED_INTEL))
     {
          //gcamBuff->mGraBuffSize = gcamBuff->mStride * height *3/2;
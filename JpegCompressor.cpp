@@ -22,26 +22,135 @@
 #include "SWJpegEncoder.h"
 #include "LogHelper.h"
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <cutils/properties.h>
 
 namespace android {
+
+// system property overriding the default strip count, 0 means one per CPU
+static const char *PROP_JPEG_STRIPS = "camera.hal.jpeg.strips";
+// upper limit of strips, and of threads encoding one picture
+static const int MAX_JPEG_STRIPS = 16;
+static const int MAX_JPEG_THREADS = 8;
+// room for the headers libjpeg writes in front of a strip
+static const int STRIP_HEADER_BYTES = 4096;
+// the overflow buffer grows by this much
+static const int OVERFLOW_CHUNK_BYTES = 256 * 1024;
+
+// pixels of the largest picture of each resolution class (QVGA, VGA, 720p,
+// 1080p, 5MP), the last class takes anything bigger
+static const int SIZE_CLASS_PIXELS[] = { 320 * 240, 640 * 480, 1280 * 720, 1920 * 1088, 2592 * 1944 };
+// bytes per pixel of a 4:2:0 picture at quality 50, until one was seen
+static const float DEFAULT_COMPLEXITY = 0.2f;
+// predictions allow for a picture this much busier than the learned ones
+static const float PREDICTION_HEADROOM = 1.25f;
+
+// blocks the activity is measured on
+static const int ACTIVITY_BLOCKS = 1024;
+// complexity of a flat picture, in activity units: headers, DC and EOBs
+static const float ACTIVITY_FLOOR = 2.0f;
+// bytes per pixel at quality 50 per unit of activity, until one was seen
+static const float DEFAULT_ACTIVITY_GAIN = 0.015f;
+// fraction of the target a picture may be under it
+static const float RATE_TOLERANCE = 0.1f;
+// bytes ~ (100 / scale) ^ RATE_EXPONENT, for the steps until the target is bracketed
+static const float RATE_EXPONENT = 0.8f;
+// encodes of one picture at most, including a last fall back on the best fit
+static const int MAX_RATE_PASSES = 4;
+
+// JPEG markers the strips are joined with
+static const unsigned char MARKER_SOF0 = 0xC0;
+static const unsigned char MARKER_RST0 = 0xD0;
+static const unsigned char MARKER_EOI = 0xD9;
+static const unsigned char MARKER_SOS = 0xDA;
+static const unsigned char MARKER_DRI = 0xDD;
+
+static int onlineCpus()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    return cpus > MAX_JPEG_THREADS ? MAX_JPEG_THREADS : (int) cpus;
+}
+
 JpegCompressor::JpegCompressor() :
     mSWEncoder(NULL)
+    ,mStrips(0)
+    ,mSpeed(JPEG_SPEED_BALANCED)
+    ,mChunkSink(NULL)
+    ,mChunkBytes(0)
+    ,mOverflowBuf(NULL)
+    ,mOverflowBufSize(0)
+    ,mOverflowSize(0)
+    ,mActivityGain(DEFAULT_ACTIVITY_GAIN)
+    ,mEncodedQuality(0)
+    ,mExiting(false)
+    ,mInput(NULL)
+    ,mQuality(0)
+    ,mNumStrips(0)
+    ,mNextStrip(0)
+    ,mStripsDone(0)
 {
     LOG1("@%s", __FUNCTION__);
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++)
+        mComplexity[i] = 0;
 
     mSWEncoder = new SWJpegEncoder();
     mJpegSize = -1;
+
+    char propVal[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_JPEG_STRIPS, propVal, "0") > 0)
+        setStrips(atoi(propVal));
 }
 
 JpegCompressor::~JpegCompressor()
 {
     LOG1("@%s", __FUNCTION__);
+    stopWorkers();
+    for (size_t i = 0; i < mStripList.size(); i++) {
+        delete mStripList[i].encoder;
+        delete [] mStripList[i].buf;
+    }
+    delete [] mOverflowBuf;
     if (mSWEncoder != NULL) {
         LOG1("Deleting JPEG encoder...");
         delete mSWEncoder;
     }
 }
 
+void JpegCompressor::setStrips(int strips)
+{
+    LOG1("@%s: %d", __FUNCTION__, strips);
+    if (strips < 0)
+        strips = 0;
+    mStrips = strips > MAX_JPEG_STRIPS ? MAX_JPEG_STRIPS : strips;
+}
+
+void JpegCompressor::setSpeed(JpegSpeed speed)
+{
+    LOG1("@%s: %s", __FUNCTION__, SWJpegEncoder::jpegSpeedName(speed));
+    mSpeed = speed;
+}
+
+void JpegCompressor::setChunkSink(JpegChunkSink *sink, int chunkBytes)
+{
+    LOG1("@%s: %p, %d byte chunks", __FUNCTION__, sink, chunkBytes);
+    mChunkSink = (chunkBytes > 0) ? sink : NULL;
+    mChunkBytes = chunkBytes;
+}
+
+// the planes of a locked surface in one of the formats SWJpegEncoder takes
+static SWJpegEncoder::YuvPlanes inputPlanes(const JpegCompressor::InputBuffer &in)
+{
+    if (in.format == V4L2_PIX_FMT_YUYV)
+        return SWJpegEncoder::yuyvPlanes(in.buf, in.stride, true);
+    if (in.format == V4L2_PIX_FMT_YUV422P)
+        return SWJpegEncoder::yuv422pPlanes(in.buf, in.stride, in.alignHeight, true);
+    return SWJpegEncoder::yv12Planes(in.buf, in.stride, in.alignHeight, true);
+}
+
 int JpegCompressor::swEncode(const InputBuffer &in, const OutputBuffer &out)
 {
     LOG1("@%s, use the libjpeg to do sw jpeg encoding", __FUNCTION__);
@@ -55,11 +164,15 @@ int JpegCompressor::swEncode(const InputBuffer &in, const OutputBuffer &out)
 
     mSWEncoder->init();
     mSWEncoder->setJpegQuality(out.quality);
+    mSWEncoder->setJpegSpeed(mSpeed);
+    mSWEncoder->setInputFormat(in.format);
+    mSWEncoder->setChunkSink(out.targetSize > 0 ? NULL : mChunkSink, mChunkBytes);
     status = mSWEncoder->configEncoding(in.width, in.height, (JSAMPLE *)out.buf, out.size);
     if (status)
         goto exit;
 
-    status = mSWEncoder->doJpegEncoding(in.buf, in.format);
+    // the surface is encoded where it is, in its own stride
+    status = mSWEncoder->doJpegEncoding(inputPlanes(in));
     if (status)
         goto exit;
 
@@ -69,62 +182,550 @@ exit:
     else
         mSWEncoder->getJpegSize(&mJpegSize);
 
+    // the overflow chunks go with deInit()
+    if (mJpegSize > out.size) {
+        LOG1("@%s: %d bytes past the %d byte buffer", __FUNCTION__, mJpegSize - out.size, out.size);
+        mSWEncoder->copyOverflow(reserveOverflow(mJpegSize - out.size));
+        mOverflowSize = mJpegSize - out.size;
+    }
     mSWEncoder->deInit();
 
     return (status ? -1 : 0);
 }
 
-// Takes YUV data (NV12 or YUV420) and outputs JPEG encoded stream
+// Takes YUV data (YUV420, YUV422P or YUYV, as a locked gralloc surface) and outputs JPEG encoded stream
 int JpegCompressor::encode(const InputBuffer &in, const OutputBuffer &out)
 {
-    InputBuffer mid;
     LOG1("@%s:\n\t IN  = {buf:%p, w:%u, h:%u, sz:%u, f:%s}" \
-             "\n\t OUT = {buf:%p, w:%u, h:%u, sz:%u, q:%d}",
+             "\n\t OUT = {buf:%p, w:%u, h:%u, sz:%u, q:%d, target:%d}",
             __FUNCTION__,
             in.buf, in.width, in.height, in.size, v4l2Fmt2Str(in.format),
-            out.buf, out.width, out.height, out.size, out.quality);
-
-    // For HW path
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    JSAMPROW row_pointer[1];
+            out.buf, out.width, out.height, out.size, out.quality, out.targetSize);
 
     mJpegSize = -1;
+    mOverflowSize = 0;
+    mEncodedQuality = out.quality;
 
-    if (in.width == 0 || in.height == 0 || in.format == 0) {
+    if (in.width == 0 || in.height == 0 || !SWJpegEncoder::isSupportedFormat(in.format)) {
         ALOGE("Invalid input received!");
-        goto exit;
+        return mJpegSize;
+    }
+    if (in.stride < in.width || in.alignHeight < in.height) {
+        ALOGE("Invalid input geometry: %dx%d in stride %d, %d rows", in.width, in.height, in.stride, in.alignHeight);
+        return mJpegSize;
+    }
+
+    LOG1("Choosing SWJpegEncoder for JPEG encoding");
+    if (mSWEncoder == NULL) {
+        ALOGE("Skia JpegEncoder not created, cannot encode to JPEG!");
+        return mJpegSize;
+    }
+
+    if (out.targetSize > 0)
+        return encodeToTarget(in, out);
+    return encodePass(in, out);
+}
+
+// encodes the picture once, at out.quality
+int JpegCompressor::encodePass(const InputBuffer &in, const OutputBuffer &out)
+{
+    mJpegSize = -1;
+    mOverflowSize = 0;
+
+    int strips = (mStrips > 0) ? mStrips : onlineCpus();
+    const int mcuHeight = SWJpegEncoder::mcuRows(in.format);
+    const int mcuRows = (in.height + mcuHeight - 1) / mcuHeight;
+    if (strips > mcuRows / MIN_STRIP_MCU_ROWS)
+        strips = mcuRows / MIN_STRIP_MCU_ROWS;
+    // optimized Huffman tables would differ from strip to strip, and
+    // strips are only joined once they are all done
+    if (mSpeed == JPEG_SPEED_QUALITY || (mChunkSink != NULL && out.targetSize == 0))
+        strips = 1;
+    if (strips > 1) {
+        mJpegSize = stripEncode(in, out, strips);
+        if (mJpegSize <= 0)
+            ALOGW("Encoding in %d strips failed, trying as a single stream", strips);
+    }
+
+    //mJpegSize is updated
+    if (mJpegSize <= 0) {
+        mOverflowSize = 0;
+        swEncode(in, out);
+    }
+    if (mJpegSize > 0)
+        learnSize(in.width, in.height, in.format, out.quality, mJpegSize);
+    return mJpegSize;
+}
+
+void JpegCompressor::copyOverflow(unsigned char *dst) const
+{
+    memcpy(dst, mOverflowBuf, mOverflowSize);
+}
+
+// room for 'bytes' of overflow, the buffer is kept from one picture to the next
+unsigned char *JpegCompressor::reserveOverflow(int bytes)
+{
+    if (mOverflowBufSize < bytes) {
+        delete [] mOverflowBuf;
+        mOverflowBufSize = ALIGN(bytes, OVERFLOW_CHUNK_BYTES);
+        mOverflowBuf = new unsigned char[mOverflowBufSize];
     }
-    midbuf = (unsigned char*)malloc(in.width * in.height * 3/2);//yuv420
-    if(midbuf == NULL)
+    return mOverflowBuf;
+}
+
+/*
+Output size prediction. The buffers a picture is encoded into are sized
+for what it is expected to take rather than for the worst case. What a
+picture takes per pixel at quality 50 is learned per resolution class,
+since small pictures have more detail per pixel, and scaled to other
+qualities by the square root of the table scaling of jpeg_set_quality(),
+which is close enough over the range cameras use. 4:2:2 has a third more
+samples than 4:2:0. A picture that still doesn't fit goes on in overflow
+chunks, see encode().
+*/
+
+static int sizeClass(int pixels)
+{
+    const int classes = sizeof(SIZE_CLASS_PIXELS) / sizeof(SIZE_CLASS_PIXELS[0]);
+    int i = 0;
+    while (i < classes && pixels > SIZE_CLASS_PIXELS[i])
+        i++;
+    return i;
+}
+
+// the percentage jpeg_set_quality() scales the standard tables by
+static int qualityScale(int quality)
+{
+    quality = CLIP(quality, 100, 1);
+    int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+    return scale < 1 ? 1 : scale;
+}
+
+// the quality whose scale is closest to 'scale'
+static int scaleQuality(float scale)
+{
+    int quality = (scale >= 100) ? (int) (5000 / scale + 0.5f) : (int) ((200 - scale) / 2 + 0.5f);
+    return CLIP(quality, 100, 1);
+}
+
+// bytes at 'quality' relative to quality 50
+static float qualityFactor(int quality)
+{
+    return sqrtf(100.0f / qualityScale(quality));
+}
+
+// samples per pixel relative to 4:2:0
+static float samplingFactor(int format)
+{
+    return (format == V4L2_PIX_FMT_YUV420) ? 1.0f : 4.0f / 3.0f;
+}
+
+int JpegCompressor::predictSize(int width, int height, int format, int quality) const
+{
+    const int pixels = width * height;
+    float complexity = mComplexity[sizeClass(pixels)];
+    if (complexity <= 0)
+        complexity = DEFAULT_COMPLEXITY;
+    return (int) (pixels * complexity * qualityFactor(quality) * samplingFactor(format) * PREDICTION_HEADROOM)
+           + STRIP_HEADER_BYTES;
+}
+
+void JpegCompressor::learnSize(int width, int height, int format, int quality, int size)
+{
+    const int pixels = width * height;
+    const float complexity = size / (pixels * qualityFactor(quality) * samplingFactor(format));
+    float &learned = mComplexity[sizeClass(pixels)];
+
+    // follow a busier scene at once, and a plainer one slowly
+    if (learned <= 0 || complexity > learned)
+        learned = complexity;
+    else
+        learned = (learned * 3 + complexity) / 4;
+    LOG1("@%s: %d bytes, %.3f bytes per pixel at quality 50, %.3f learned for class %d", __FUNCTION__,
+         size, complexity, learned, sizeClass(pixels));
+}
+
+/*
+Target size encoding. The quality is picked for the picture to fit in
+out.targetSize bytes, with out.quality as the highest one. The size model
+is the one of predictSize(), with the complexity of this very picture
+estimated from its activity: the mean difference between neighbouring
+luma samples of a grid of 8x8 blocks, which takes a few thousand reads
+however big the picture. How activity maps to bytes is learned from the
+pictures encoded so far. The picture is encoded once at the quality the
+model gives, and only encoded again when it is over the target, or more
+than RATE_TOLERANCE under it with room for a higher quality. Further
+passes stay between the highest quality seen to fit and the lowest one
+seen over, with the size curve measured between both once there are two.
+*/
+
+float JpegCompressor::measureActivity(const InputBuffer &in)
+{
+    const SWJpegEncoder::YuvPlanes planes = inputPlanes(in);
+    // YUYV has a luma sample every other byte
+    const int step = (in.format == V4L2_PIX_FMT_YUYV) ? 2 : 1;
+    const int blocksX = in.width / 8;
+    const int blocksY = in.height / 8;
+    if (blocksX == 0 || blocksY == 0)
+        return 0;
+
+    // a grid of about ACTIVITY_BLOCKS blocks
+    int spacing = (int) sqrtf((float) blocksX * blocksY / ACTIVITY_BLOCKS);
+    if (spacing < 1)
+        spacing = 1;
+    unsigned char block[8][16];
+    long long sum = 0;
+    int count = 0;
+    for (int by = spacing / 2; by < blocksY; by += spacing) {
+        for (int bx = spacing / 2; bx < blocksX; bx += spacing) {
+            // one burst per row, the surface is uncached
+            for (int r = 0; r < 8; r++)
+                memcpy(block[r], planes.y + (by * 8 + r) * planes.yStride + bx * 8 * step, 8 * step);
+            for (int r = 0; r < 8; r++) {
+                for (int c = 0; c < 8; c++) {
+                    const int sample = block[r][c * step];
+                    if (c < 7)
+                        sum += abs(sample - block[r][(c + 1) * step]);
+                    if (r < 7)
+                        sum += abs(sample - block[r + 1][c * step]);
+                }
+            }
+            count += 2 * 7 * 8;
+        }
+    }
+    return count ? (float) sum / count : 0;
+}
+
+int JpegCompressor::encodeToTarget(const InputBuffer &in, const OutputBuffer &out)
+{
+    const float pixels = (float) in.width * in.height * samplingFactor(in.format);
+    const float activity = measureActivity(in) + ACTIVITY_FLOOR;
+    // the target is a ceiling, aim in the middle of the tolerance
+    const float aim = out.targetSize * (1.0f - RATE_TOLERANCE / 2);
+    OutputBuffer pass = out;
+    // the model of predictSize(), bytes ~ sqrt(100 / scale)
+    const float ratio = pixels * mActivityGain * activity / aim;
+    float scale = 100.0f * ratio * ratio;
+    // sizes fall faster than that away from quality 50, steps use bytes ~ (100 / scale) ^ exponent
+    float exponent = RATE_EXPONENT;
+    int quality = scaleQuality(scale);
+    int fitQuality = 0;         // highest quality seen to fit, and its size
+    int fitSize = 0;
+    int overQuality = 0;        // lowest quality seen over the target, and its size
+    int overSize = 0;
+    int passes = 0;
+
+    LOG1("@%s: %d bytes, activity %.2f, starting at quality %d", __FUNCTION__, out.targetSize, activity, quality);
+    while (passes < MAX_RATE_PASSES - 1) {
+        if (quality > out.quality)
+            quality = out.quality;
+        pass.quality = quality;
+        const int size = encodePass(in, pass);
+        passes++;
+        if (size <= 0)
+            return size;
+        LOG1("@%s: pass %d at quality %d: %d bytes", __FUNCTION__, passes, quality, size);
+
+        if (passes == 1) {
+            const float gain = size / (pixels * qualityFactor(quality) * activity);
+            mActivityGain = (mActivityGain + gain) / 2;
+        }
+        if (size <= out.targetSize) {
+            fitQuality = quality;
+            fitSize = size;
+            // on target, or as good as it gets
+            if (size >= out.targetSize * (1.0f - RATE_TOLERANCE) || quality == out.quality)
+                break;
+        } else {
+            overQuality = quality;
+            overSize = size;
+            if (quality == 1)
+                break;
+        }
+
+        // with the target bracketed, the exponent is the one between both ends
+        if (fitQuality > 0 && overQuality > 0) {
+            const float e = logf((float) overSize / fitSize) /
+                            logf((float) qualityScale(fitQuality) / qualityScale(overQuality));
+            exponent = CLIP(e, 2.0f, 0.2f);
+        }
+        scale = qualityScale(quality) * powf(size / aim, 1.0f / exponent);
+        const int next = scaleQuality(scale);
+        // stay strictly inside the bracket
+        const int low = fitQuality + 1;
+        const int high = overQuality > 0 ? overQuality - 1 : out.quality;
+        if (low > high)
+            break;
+        quality = CLIP(next, high, low);
+    }
+
+    // the last pass may be over, or under a better one
+    if (fitQuality > 0 && pass.quality != fitQuality) {
+        pass.quality = fitQuality;
+        encodePass(in, pass);
+        passes++;
+    }
+    mEncodedQuality = pass.quality;
+    LOG1("@%s: %d bytes for %d at quality %d, %d passes", __FUNCTION__, mJpegSize, out.targetSize,
+         mEncodedQuality, passes);
+    return mJpegSize;
+}
+
+/*
+Parallel encoding. The picture is cut into strips of whole MCU rows (16
+rows for 4:2:0, 8 rows for 4:2:2), every strip is compressed as a JPEG
+of its own, with the same quality and therefore the same tables, and the
+strips are joined into a single scan: the headers of the first strip with
+the full height in its SOF and a DRI of one strip worth of MCUs, then the
+entropy coded data of each strip, separated by RST0..RST7 markers. A
+restart resets the DC predictions and byte aligns the data exactly like
+the start of a scan does, so every strip decodes as it was encoded, and the
+result is the picture a single stream encode with that restart interval
+gives.
+*/
+
+// offset of the 'marker' segment among the headers of a JPEG, -1 if it isn't before the scan
+static int findSegment(const unsigned char *jpeg, int size, unsigned char marker)
+{
+    int pos = 2;    // after SOI
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        if (jpeg[pos + 1] == marker)
+            return pos;
+        if (jpeg[pos + 1] == MARKER_SOS)
+            return -1;
+        pos += 2 + ((jpeg[pos + 2] << 8) | jpeg[pos + 3]);
+    }
+    return -1;
+}
+
+// start and end of the entropy coded data of a JPEG, false if it isn't one
+static bool findScan(const unsigned char *jpeg, int size, int *sos, int *begin, int *end)
+{
+    *sos = findSegment(jpeg, size, MARKER_SOS);
+    if (*sos < 0 || size < 4 || jpeg[size - 2] != 0xFF || jpeg[size - 1] != MARKER_EOI)
+        return false;
+    *begin = *sos + 2 + ((jpeg[*sos + 2] << 8) | jpeg[*sos + 3]);
+    *end = size - 2;
+    return *begin <= *end;
+}
+
+int JpegCompressor::stripEncode(const InputBuffer &in, const OutputBuffer &out, int strips)
+{
+    const int mcuHeight = SWJpegEncoder::mcuRows(in.format);
+    const int mcusPerRow = (in.width + 15) / 16;
+    const int mcuRows = (in.height + mcuHeight - 1) / mcuHeight;
+    int stripMcuRows = (mcuRows + strips - 1) / strips;
+    // the restart interval is a 16 bit count of MCUs
+    if (stripMcuRows * mcusPerRow > 0xFFFF)
+        stripMcuRows = 0xFFFF / mcusPerRow;
+    const int numStrips = (mcuRows + stripMcuRows - 1) / stripMcuRows;
+    LOG1("@%s: %d strips of %d MCU rows", __FUNCTION__, numStrips, stripMcuRows);
+    // a strip is expected to take its share of the picture, one that
+    // takes more keeps the bigger buffer it needed
+    const int rowBytes = predictSize(in.width, in.height, in.format, out.quality) / in.height + 1;
+
+    while ((int) mStripList.size() < numStrips) {
+        Strip strip;
+        memset(&strip, 0, sizeof(strip));
+        strip.encoder = new SWJpegEncoder();
+        mStripList.push(strip);
+    }
+    for (int i = 0; i < numStrips; i++) {
+        Strip &strip = mStripList.editItemAt(i);
+        strip.rowBegin = i * stripMcuRows * mcuHeight;
+        strip.rowEnd = strip.rowBegin + stripMcuRows * mcuHeight;
+        if (strip.rowEnd > in.height)
+            strip.rowEnd = in.height;
+        const int bufSize = rowBytes * (strip.rowEnd - strip.rowBegin) + STRIP_HEADER_BYTES;
+        if (strip.bufSize < bufSize) {
+            delete [] strip.buf;
+            strip.buf = new unsigned char[bufSize];
+            strip.bufSize = bufSize;
+        }
+        strip.size = -1;
+    }
+
+    int threads = onlineCpus();
+    if (threads > numStrips)
+        threads = numStrips;
+
+    mLock.lock();
+    startWorkers(threads);
+    mInput = &in;
+    mQuality = out.quality;
+    mNumStrips = numStrips;
+    mNextStrip = 0;
+    mStripsDone = 0;
+    mWorkCondition.broadcast();
+    mLock.unlock();
+
+    // the caller encodes strips too
+    while (runNextStrip())
+        ;
+
+    mLock.lock();
+    while (mStripsDone < mNumStrips)
+        mDoneCondition.wait(mLock);
+    mInput = NULL;
+    mLock.unlock();
+
+    return joinStrips(numStrips, stripMcuRows * mcusPerRow, in.height, out);
+}
+
+void JpegCompressor::encodeStrip(Strip *strip)
+{
+    const InputBuffer &in = *mInput;
+    SWJpegEncoder *encoder = strip->encoder;
+    SWJpegEncoder::YuvPlanes planes = inputPlanes(in);
+    planes.y += strip->rowBegin * planes.yStride;
+    if (planes.format != V4L2_PIX_FMT_YUYV) {
+        const int chromaRow = (planes.format == V4L2_PIX_FMT_YUV420) ? strip->rowBegin / 2 : strip->rowBegin;
+        planes.u += chromaRow * planes.uvStride;
+        planes.v += chromaRow * planes.uvStride;
+    }
+
+    encoder->init();
+    encoder->setJpegQuality(mQuality);
+    encoder->setJpegSpeed(mSpeed);
+    encoder->setInputFormat(in.format);
+    strip->size = -1;
+    if (encoder->configEncoding(in.width, strip->rowEnd - strip->rowBegin, strip->buf, strip->bufSize) == 0 &&
+        encoder->doJpegEncoding(planes) == 0)
+        encoder->getJpegSize(&strip->size);
+    if (strip->size > strip->bufSize) {
+        // the strip outgrew its buffer, it gets one it fits with some room
+        const int bufSize = ALIGN(strip->size + strip->size / 4, STRIP_HEADER_BYTES);
+        unsigned char *buf = new unsigned char[bufSize];
+        memcpy(buf, strip->buf, strip->bufSize);
+        encoder->copyOverflow(buf + strip->bufSize);
+        delete [] strip->buf;
+        strip->buf = buf;
+        strip->bufSize = bufSize;
+    }
+    encoder->deInit();
+}
+
+// encodes the next strip of the current picture, returns false when none is left
+bool JpegCompressor::runNextStrip()
+{
+    Strip *strip;
+
+    mLock.lock();
+    if (mInput == NULL || mNextStrip >= mNumStrips) {
+        mLock.unlock();
+        return false;
+    }
+    strip = &mStripList.editItemAt(mNextStrip++);
+    mLock.unlock();
+
+    encodeStrip(strip);
+
+    mLock.lock();
+    if (++mStripsDone == mNumStrips)
+        mDoneCondition.signal();
+    mLock.unlock();
+    return true;
+}
+
+bool JpegCompressor::workerLoop()
+{
     {
-        ALOGE("alloc memory failed");
-        goto exit;
+        Mutex::Autolock lock(mLock);
+        while (!mExiting && (mInput == NULL || mNextStrip >= mNumStrips))
+            mWorkCondition.wait(mLock);
+        if (mExiting)
+            return false;
     }
+    runNextStrip();
+    return true;
+}
 
+// called with mLock held, the caller is one of the threads
+void JpegCompressor::startWorkers(int numThreads)
+{
+    while ((int) mWorkers.size() < numThreads - 1) {
+        sp<StripWorker> worker = new StripWorker(this);
+        if (worker->run("CamHAL_JPEGSTRIP") != NO_ERROR) {
+            ALOGE("failed to start JPEG strip worker");
+            break;
+        }
+        mWorkers.push(worker);
+    }
+}
+
+// called without mLock held
+void JpegCompressor::stopWorkers()
+{
+    Vector< sp<StripWorker> > workers;
     {
-        // Choose Skia
-        LOG1("Choosing SWJpegEncoder for JPEG encoding");
-        if (mSWEncoder == NULL) {
-            ALOGE("Skia JpegEncoder not created, cannot encode to JPEG!");
-            goto exit;
+        Mutex::Autolock lock(mLock);
+        mExiting = true;
+        mWorkCondition.broadcast();
+        workers = mWorkers;
+        mWorkers.clear();
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->requestExitAndWait();
+
+    Mutex::Autolock lock(mLock);
+    mExiting = false;
+}
+
+// joins the encoded strips into out.buf, returns the JPEG size or -1
+int JpegCompressor::joinStrips(int numStrips, int mcusPerStrip, int height, const OutputBuffer &out)
+{
+    int total = 0;
+    int sos = 0, begin = 0, end = 0;
+
+    for (int i = 0; i < numStrips; i++) {
+        const Strip &strip = mStripList[i];
+        if (strip.size <= 0 || !findScan(strip.buf, strip.size, &sos, &begin, &end)) {
+            ALOGE("JPEG strip %d (rows %d-%d) failed", i, strip.rowBegin, strip.rowEnd);
+            return -1;
         }
-        RepaddingYV12(out.width,out.height,in.stride,out.width,in.alignHeight,in.buf, midbuf,0);
+        // headers, DRI and EOI for the first strip, a RST marker before each other one
+        total += (i == 0) ? end + 6 + 2 : end - begin + 2;
+    }
+    // a JPEG bigger than the buffer is joined in the overflow buffer, and split
+    unsigned char *joined = (total > out.size) ? reserveOverflow(total) : out.buf;
 
-        mid.buf = midbuf;
-        mid.format = in.format;
-        mid.height = in.height;
-        mid.size = in.size;
-        mid.stride = in.stride;
-        mid.width = in.width;
-        //mJpegSize is updated
-        swEncode(mid, out);
+    const Strip &first = mStripList[0];
+    findScan(first.buf, first.size, &sos, &begin, &end);
+    const int sof = findSegment(first.buf, first.size, MARKER_SOF0);
+    if (sof < 0) {
+        ALOGE("no baseline SOF in the first JPEG strip");
+        return -1;
     }
-exit:
-    if(midbuf != NULL)
-    {
-        free(midbuf);
+
+    unsigned char *dst = joined;
+    memcpy(dst, first.buf, sos);
+    dst[sof + 5] = height >> 8;
+    dst[sof + 6] = height & 0xFF;
+    dst += sos;
+    const unsigned char dri[6] = { 0xFF, MARKER_DRI, 0x00, 0x04,
+                                   (unsigned char) (mcusPerStrip >> 8), (unsigned char) (mcusPerStrip & 0xFF) };
+    memcpy(dst, dri, sizeof(dri));
+    dst += sizeof(dri);
+    memcpy(dst, first.buf + sos, end - sos);
+    dst += end - sos;
+
+    for (int i = 1; i < numStrips; i++) {
+        const Strip &strip = mStripList[i];
+        findScan(strip.buf, strip.size, &sos, &begin, &end);
+        *dst++ = 0xFF;
+        *dst++ = MARKER_RST0 + (i - 1) % 8;
+        memcpy(dst, strip.buf + begin, end - begin);
+        dst += end - begin;
     }
-    return mJpegSize;
+    *dst++ = 0xFF;
+    *dst++ = MARKER_EOI;
+
+    if (joined != out.buf) {
+        LOG1("@%s: %d bytes past the %d byte buffer", __FUNCTION__, total - out.size, out.size);
+        memcpy(out.buf, joined, out.size);
+        memmove(joined, joined + out.size, total - out.size);
+        mOverflowSize = total - out.size;
+    }
+    return total;
 }
 }
@@ -20,9 +20,11 @@
 #include <stdio.h>
 #include "CameraCommon.h"
 #include <utils/Errors.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include "SWJpegEncoder.h"
 
 namespace android {
-class SWJpegEncoder;
 
 class JpegCompressor {
 public:
@@ -55,6 +57,7 @@ public:
         int height;
         int size;
         int quality;
+        int targetSize;     // bytes the JPEG has to fit in, quality is then the highest; 0 for none
 
         void clear()
         {
@@ -63,17 +66,116 @@ public:
             height = 0;
             size = 0;
             quality = 0;
+            targetSize = 0;
         }
     };
 
-    // Encoder functions
+    /**
+     * Encodes a picture, returns the size of the JPEG, -1 if it failed.
+     *
+     * A JPEG bigger than out.size fills out.buf, and the compressor keeps
+     * the rest until the next encode(): copyOverflow() puts it after
+     * out.size bytes of a buffer the whole JPEG fits in.
+     */
     int encode(const InputBuffer &in, const OutputBuffer &out);
+    void copyOverflow(unsigned char *dst) const;
+    // quality of the last JPEG, below out.quality when it was fitted in out.targetSize
+    int getQuality() const { return mEncodedQuality; }
+
+    /**
+     * Bytes a JPEG of the picture is expected to take, with some headroom,
+     * from what the previous pictures of its resolution class took.
+     */
+    int predictSize(int width, int height, int format, int quality) const;
+
+    /**
+     * Selects how many horizontal strips a picture is encoded in.
+     *
+     * Strips of whole MCU rows are encoded in parallel, each by its own
+     * libjpeg compressor, and joined into one baseline JPEG whose restart
+     * interval is a strip. 0 selects one strip per online CPU, 1 encodes
+     * single threaded without restart markers.
+     */
+    void setStrips(int strips);
+
+    /**
+     * Selects the speed profile of the following encodes. Pictures are
+     * encoded as a single stream with JPEG_SPEED_QUALITY, whose Huffman
+     * tables are made for the whole image.
+     */
+    void setSpeed(JpegSpeed speed);
+    JpegSpeed getSpeed() const { return mSpeed; }
+
+    /**
+     * Streams the following pictures to 'sink' in chunks of 'chunkBytes'
+     * as they are encoded, NULL to stop. Streamed pictures are encoded as
+     * a single stream, and target size encodes, which may take several
+     * passes, aren't streamed.
+     */
+    void setChunkSink(JpegChunkSink *sink, int chunkBytes);
+
 private:
+    class StripWorker : public Thread {
+    public:
+        StripWorker(JpegCompressor *compressor) : Thread(false), mCompressor(compressor) {}
+    private:
+        virtual bool threadLoop() { return mCompressor->workerLoop(); }
+        JpegCompressor *mCompressor;
+    };
+
+    struct Strip {
+        SWJpegEncoder *encoder;
+        unsigned char *buf;     // the strip, encoded as a JPEG of its own
+        int bufSize;
+        int rowBegin;
+        int rowEnd;
+        int size;               // bytes of 'buf' used, -1 if the strip failed
+    };
+
     int mJpegSize;
-    unsigned char* midbuf;
     SWJpegEncoder *mSWEncoder;
     int swEncode(const InputBuffer &in, const OutputBuffer &out);
+    int encodePass(const InputBuffer &in, const OutputBuffer &out);
+    int encodeToTarget(const InputBuffer &in, const OutputBuffer &out);
+    float measureActivity(const InputBuffer &in);
+    int stripEncode(const InputBuffer &in, const OutputBuffer &out, int strips);
+    void encodeStrip(Strip *strip);
+    int joinStrips(int numStrips, int mcusPerStrip, int height, const OutputBuffer &out);
+    unsigned char *reserveOverflow(int bytes);
+    void learnSize(int width, int height, int format, int quality, int size);
+    bool runNextStrip();
+    bool workerLoop();
+    void startWorkers(int numThreads);
+    void stopWorkers();
+
+    // strips shorter than this many MCU rows aren't worth a thread
+    static const int MIN_STRIP_MCU_ROWS = 8;
+
+    int mStrips;                // as set by setStrips()
+    JpegSpeed mSpeed;
+    JpegChunkSink *mChunkSink;  // as set by setChunkSink()
+    int mChunkBytes;
+    Vector<Strip> mStripList;   // kept from one picture to the next
+
+    // resolution classes the output sizes are learned for, see predictSize()
+    static const int NUM_SIZE_CLASSES = 6;
+    float mComplexity[NUM_SIZE_CLASSES]; // bytes per pixel at quality 50, 0 until learned
+    unsigned char *mOverflowBuf; // the last JPEG past the end of its output buffer
+    int mOverflowBufSize;
+    int mOverflowSize;
+    float mActivityGain;        // bytes per pixel at quality 50 per unit of activity
+    int mEncodedQuality;
 
+    Mutex mLock;                // protects everything below
+    Condition mWorkCondition;   // signalled when strips are posted or on exit
+    Condition mDoneCondition;   // signalled when the last strip completes
+    Vector< sp<StripWorker> > mWorkers;
+    bool mExiting;
+    const InputBuffer *mInput;  // picture being encoded, NULL when idle
+    int mQuality;
+    int mNumStrips;
+    int mNextStrip;
+    int mStripsDone;
 };
 
 }; // namespace android
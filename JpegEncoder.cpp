@@ -23,6 +23,7 @@
 #define MAIN_DUMP  0
 #define THUMB_DUMP 0
 
+#include <string.h>
 #include <utils/Log.h>
 #include <sys/mman.h>
 #include <fcntl.h>
@@ -31,12 +32,20 @@
 
 static const char ExifAsciiPrefix[] = { 0x41, 0x53, 0x43, 0x49, 0x49, 0x0, 0x0, 0x0 };
 
+// where the value is in an IFD entry: after the tag, type and count
+static const unsigned int IFD_VALUE = 8;
+
 namespace android {
 JpegEncoder::JpegEncoder() : available(false)
 {
     available = true;
 	m_thumbBuf = NULL;
 	m_thumbSize = 0;
+    mTemplateSize = 0;
+    mIfd1Start = 0;
+    mTemplateValid = false;
+    memset(&mTemplateKey, 0, sizeof(mTemplateKey));
+    memset(&mPatches, 0, sizeof(mPatches));
 }
 
 JpegEncoder::~JpegEncoder()
@@ -51,6 +60,24 @@ jpg_return_status JpegEncoder::setThumbData (const unsigned char *thumbBuf, unsi
     return JPG_SUCCESS;
 }
 
+unsigned int JpegEncoder::thumbnailExifSize(unsigned int thumbSize)
+{
+    // the X and Y resolutions are the rationals of IFD1
+    return NUM_SIZE + NUM_1TH_IFD_TIFF * IFD_SIZE + OFFSET_SIZE + 2 * sizeof(rational_t) + thumbSize;
+}
+
+/*
+ * makeExif: writes the APP1 segment of the EXIF, and the thumbnail set with
+ * setThumbData() in it, at 'exifOut'
+ *
+ * The EXIF is copied from a template built the first time and whenever a
+ * field other than the ones of the shot changes: the date, the orientation,
+ * the exposure, the ISO, the GPS position and time, and the thumbnail. Only
+ * those are then written, where the template has them.
+ *
+ * The thumbnail goes right after IFD1, thumbnailExifSize(0) bytes past the
+ * end of the EXIF without it: a thumbnail already there isn't copied.
+ */
 jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                                         exif_attribute_t *exifInfo,
                                         unsigned int *size,
@@ -61,9 +88,120 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
 
     ALOGD("Exif start");
 
+    exif_attribute_t key;
+    templateKey(exifInfo, &key);
+    if (!mTemplateValid || memcmp(&key, &mTemplateKey, sizeof(key)) != 0) {
+        mTemplateValid = false;
+        if (buildTemplate(exifInfo) != JPG_SUCCESS)
+            return JPG_FAIL;
+        memcpy(&mTemplateKey, &key, sizeof(key));
+        mTemplateValid = true;
+    }
+
+    const bool thumbnail = exifInfo->enableThumb && (m_thumbBuf != NULL) && (m_thumbSize > 0);
+    unsigned int exifSize = thumbnail ? mTemplateSize : mIfd1Start;
+    memcpy(exifOut, mTemplate, exifSize);
+    patchTemplate(exifOut, exifInfo);
+
+    // IFD1 follows IFD0 with a thumbnail, which follows IFD1
+    uint32_t tmp = thumbnail ? mIfd1Start - 10 : 0;
+    memcpy(exifOut + mPatches.nextIfd, &tmp, OFFSET_SIZE);
+    if (thumbnail) {
+        tmp = m_thumbSize;
+        memcpy(exifOut + mPatches.thumbSize, &tmp, 4);
+        // the thumbnail may have been encoded right where it goes
+        if (m_thumbBuf != exifOut + exifSize)
+            memcpy(exifOut + exifSize, m_thumbBuf, m_thumbSize);
+        exifSize += m_thumbSize;
+    }
+
+    *size = exifSize;
+//    tmp = *size - 2;    // APP1 Maker isn't counted
+    tmp = *size;
+    if(tmp > 0xffff) {
+        ALOGE("line:%d, in the makeExif, the size exceeds 64K", __LINE__);
+    }
+    exifOut[2] = (tmp >> 8) & 0xFF;
+    exifOut[3] = tmp & 0xFF;
+
+    ALOGD("Exif End");
+
+    return JPG_SUCCESS;
+}
+
+// the fields makeExif() builds the template from: all but the patched ones
+void JpegEncoder::templateKey(const exif_attribute_t *exifInfo, exif_attribute_t *key)
+{
+    memset(key, 0, sizeof(*key));
+    *key = *exifInfo;
+    key->enableThumb = false;       // the template has IFD1 either way
+    memset(key->date_time, 0, sizeof(key->date_time));
+    key->orientation = 0;
+    key->iso_speed_rating = 0;
+    // the exposure time and shutter speed tags are left out without them
+    key->exposure_time.num = 0;
+    key->exposure_time.den = (exifInfo->exposure_time.den != 0);
+    key->shutter_speed.num = 0;
+    key->shutter_speed.den = (exifInfo->shutter_speed.den != 0);
+    memset(&key->aperture, 0, sizeof(key->aperture));
+    memset(&key->brightness, 0, sizeof(key->brightness));
+    memset(&key->exposure_bias, 0, sizeof(key->exposure_bias));
+    memset(key->gps_latitude_ref, 0, sizeof(key->gps_latitude_ref));
+    memset(key->gps_longitude_ref, 0, sizeof(key->gps_longitude_ref));
+    key->gps_altitude_ref = 0;
+    memset(key->gps_latitude, 0, sizeof(key->gps_latitude));
+    memset(key->gps_longitude, 0, sizeof(key->gps_longitude));
+    memset(&key->gps_altitude, 0, sizeof(key->gps_altitude));
+    memset(key->gps_timestamp, 0, sizeof(key->gps_timestamp));
+    memset(key->gps_datestamp, 0, sizeof(key->gps_datestamp));
+}
+
+static inline void patchField(unsigned char *exifOut, unsigned int offset, const void *value, unsigned int bytes)
+{
+    if (offset != 0)
+        memcpy(exifOut + offset, value, bytes);
+}
+
+// writes the fields of the shot into a copy of the template
+void JpegEncoder::patchTemplate(unsigned char *exifOut, const exif_attribute_t *exifInfo)
+{
+    const uint32_t orientation = exifInfo->orientation;
+    const uint32_t isoSpeed = exifInfo->iso_speed_rating;
+    const uint32_t altitudeRef = exifInfo->gps_altitude_ref;
+
+    for (int i = 0; i < 3; i++)
+        patchField(exifOut, mPatches.dateTime[i], exifInfo->date_time, 20);
+    for (int i = 0; i < 2; i++)
+        patchField(exifOut, mPatches.orientation[i], &orientation, 4);
+    patchField(exifOut, mPatches.exposureTime, &exifInfo->exposure_time, sizeof(rational_t));
+    patchField(exifOut, mPatches.shutterSpeed, &exifInfo->shutter_speed, sizeof(srational_t));
+    patchField(exifOut, mPatches.aperture, &exifInfo->aperture, sizeof(rational_t));
+    patchField(exifOut, mPatches.brightness, &exifInfo->brightness, sizeof(srational_t));
+    patchField(exifOut, mPatches.exposureBias, &exifInfo->exposure_bias, sizeof(srational_t));
+    patchField(exifOut, mPatches.isoSpeed, &isoSpeed, 4);
+    patchField(exifOut, mPatches.gpsLatitudeRef, exifInfo->gps_latitude_ref, 2);
+    patchField(exifOut, mPatches.gpsLatitude, exifInfo->gps_latitude, 3 * sizeof(rational_t));
+    patchField(exifOut, mPatches.gpsLongitudeRef, exifInfo->gps_longitude_ref, 2);
+    patchField(exifOut, mPatches.gpsLongitude, exifInfo->gps_longitude, 3 * sizeof(rational_t));
+    patchField(exifOut, mPatches.gpsAltitudeRef, &altitudeRef, 4);
+    patchField(exifOut, mPatches.gpsAltitude, &exifInfo->gps_altitude, sizeof(rational_t));
+    patchField(exifOut, mPatches.gpsTimestamp, exifInfo->gps_timestamp, 3 * sizeof(rational_t));
+    patchField(exifOut, mPatches.gpsDatestamp, exifInfo->gps_datestamp, 11);
+}
+
+/*
+ * buildTemplate: writes the EXIF of 'exifInfo' into mTemplate, with IFD1 for
+ * a thumbnail of no bytes, and notes where the fields of the shot are
+ */
+jpg_return_status JpegEncoder::buildTemplate(exif_attribute_t *exifInfo)
+{
+    ALOGD("Exif template");
+
     unsigned char *pCur, *pApp1Start, *pIfdStart, *pGpsIfdPtr, *pNextIfdOffset;
     unsigned int tmp, LongerTagOffest = 0;
-    pApp1Start = pCur = exifOut;
+    memset(mTemplate, 0, sizeof(mTemplate));
+    memset(&mPatches, 0, sizeof(mPatches));
+    pApp1Start = pCur = mTemplate;
 
     //2 Exif Identifier Code & TIFF Header
     pCur += 4;  // Skip 4 Byte for APP1 marker and length
@@ -98,6 +236,7 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                  strlen((char *)exifInfo->maker) + 1, exifInfo->maker, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_MODEL, EXIF_TYPE_ASCII,
                  strlen((char *)exifInfo->model) + 1, exifInfo->model, &LongerTagOffest, pIfdStart);
+    mPatches.orientation[0] = pCur + IFD_VALUE - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_ORIENTATION, EXIF_TYPE_SHORT,
                  1, exifInfo->orientation);
     writeExifIfd(&pCur, EXIF_TAG_X_RESOLUTION, EXIF_TYPE_RATIONAL,
@@ -108,6 +247,7 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                  1, exifInfo->resolution_unit);
     writeExifIfd(&pCur, EXIF_TAG_SOFTWARE, EXIF_TYPE_ASCII,
                  strlen((char *)exifInfo->software) + 1, exifInfo->software, &LongerTagOffest, pIfdStart);
+    mPatches.dateTime[0] = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_DATE_TIME, EXIF_TYPE_ASCII,
                  20, exifInfo->date_time, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_YCBCR_POSITIONING, EXIF_TYPE_SHORT,
@@ -136,6 +276,7 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
 
     LongerTagOffest += NUM_SIZE + NUM_0TH_IFD_EXIF*IFD_SIZE + OFFSET_SIZE;
     if (exifInfo->exposure_time.den) {
+        mPatches.exposureTime = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_EXPOSURE_TIME, EXIF_TYPE_RATIONAL,
                      1, &exifInfo->exposure_time, &LongerTagOffest, pIfdStart);
     }
@@ -143,24 +284,31 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                  1, &exifInfo->fnumber, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_EXPOSURE_PROGRAM, EXIF_TYPE_SHORT,
                  1, exifInfo->exposure_program);
+    mPatches.isoSpeed = pCur + IFD_VALUE - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_ISO_SPEED_RATING, EXIF_TYPE_SHORT,
                  1, exifInfo->iso_speed_rating);
     writeExifIfd(&pCur, EXIF_TAG_EXIF_VERSION, EXIF_TYPE_UNDEFINED,
                  4, exifInfo->exif_version);
+    mPatches.dateTime[1] = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_DATE_TIME_ORG, EXIF_TYPE_ASCII,
                  20, exifInfo->date_time, &LongerTagOffest, pIfdStart);
+    mPatches.dateTime[2] = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_DATE_TIME_DIGITIZE, EXIF_TYPE_ASCII,
                  20, exifInfo->date_time, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_COMPONENTS_CONFIGURATION, EXIF_TYPE_UNDEFINED,
                  4, exifInfo->components_configuration);
     if (exifInfo->shutter_speed.den) {
+        mPatches.shutterSpeed = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_SHUTTER_SPEED, EXIF_TYPE_SRATIONAL,
                      1, (rational_t *)&exifInfo->shutter_speed, &LongerTagOffest, pIfdStart);
     }
+    mPatches.aperture = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_APERTURE, EXIF_TYPE_RATIONAL,
                  1, &exifInfo->aperture, &LongerTagOffest, pIfdStart);
+    mPatches.brightness = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_BRIGHTNESS, EXIF_TYPE_SRATIONAL,
                  1, (rational_t *)&exifInfo->brightness, &LongerTagOffest, pIfdStart);
+    mPatches.exposureBias = pIfdStart + LongerTagOffest - mTemplate;
     writeExifIfd(&pCur, EXIF_TAG_EXPOSURE_BIAS, EXIF_TYPE_SRATIONAL,
                  1, (rational_t *)&exifInfo->exposure_bias, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_MAX_APERTURE, EXIF_TYPE_RATIONAL,
@@ -180,10 +328,12 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
     int commentsLen = strlen((char *)exifInfo->user_comment) + 1;
     if(commentsLen > (sizeof(exifInfo->user_comment) - sizeof(code)))
         return JPG_FAIL;
-    memmove(exifInfo->user_comment + sizeof(code), exifInfo->user_comment, commentsLen);
-    memcpy(exifInfo->user_comment, code, sizeof(code));
+    // prefixed in a copy, the template may be built from exifInfo again
+    unsigned char comment[sizeof(exifInfo->user_comment)];
+    memcpy(comment, code, sizeof(code));
+    memcpy(comment + sizeof(code), exifInfo->user_comment, commentsLen);
     writeExifIfd(&pCur, EXIF_TAG_USER_COMMENT, EXIF_TYPE_UNDEFINED,
-                 commentsLen + sizeof(code), exifInfo->user_comment, &LongerTagOffest, pIfdStart);
+                 commentsLen + sizeof(code), comment, &LongerTagOffest, pIfdStart);
     writeExifIfd(&pCur, EXIF_TAG_FLASH_PIX_VERSION, EXIF_TYPE_UNDEFINED,
                  4, exifInfo->flashpix_version);
     writeExifIfd(&pCur, EXIF_TAG_COLOR_SPACE, EXIF_TYPE_SHORT,
@@ -227,18 +377,25 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
 
         writeExifIfd(&pCur, EXIF_TAG_GPS_VERSION_ID, EXIF_TYPE_BYTE,
                      4, exifInfo->gps_version_id);
+        mPatches.gpsLatitudeRef = pCur + IFD_VALUE - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_LATITUDE_REF, EXIF_TYPE_ASCII,
                      2, exifInfo->gps_latitude_ref);
+        mPatches.gpsLatitude = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_LATITUDE, EXIF_TYPE_RATIONAL,
                      3, exifInfo->gps_latitude, &LongerTagOffest, pIfdStart);
+        mPatches.gpsLongitudeRef = pCur + IFD_VALUE - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_LONGITUDE_REF, EXIF_TYPE_ASCII,
                      2, exifInfo->gps_longitude_ref);
+        mPatches.gpsLongitude = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_LONGITUDE, EXIF_TYPE_RATIONAL,
                      3, exifInfo->gps_longitude, &LongerTagOffest, pIfdStart);
+        mPatches.gpsAltitudeRef = pCur + IFD_VALUE - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_ALTITUDE_REF, EXIF_TYPE_BYTE,
                      1, exifInfo->gps_altitude_ref);
+        mPatches.gpsAltitude = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_ALTITUDE, EXIF_TYPE_RATIONAL,
                      1, &exifInfo->gps_altitude, &LongerTagOffest, pIfdStart);
+        mPatches.gpsTimestamp = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_TIMESTAMP, EXIF_TYPE_RATIONAL,
                      3, exifInfo->gps_timestamp, &LongerTagOffest, pIfdStart);
         tmp = strlen((char*)exifInfo->gps_processing_method);
@@ -252,6 +409,7 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
             writeExifIfd(&pCur, EXIF_TAG_GPS_PROCESSING_METHOD, EXIF_TYPE_UNDEFINED,
                          tmp+sizeof(ExifAsciiPrefix), tmp_buf, &LongerTagOffest, pIfdStart);
         }
+        mPatches.gpsDatestamp = pIfdStart + LongerTagOffest - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_GPS_DATESTAMP, EXIF_TYPE_ASCII,
                      11, exifInfo->gps_datestamp, &LongerTagOffest, pIfdStart);
         tmp = 0;
@@ -261,21 +419,10 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
 
     //2 1th IFD TIFF Tags
 
-    unsigned char *thumbBuf = m_thumbBuf;
-    unsigned int thumbSize = m_thumbSize;
-/* MAP: Disable thumbnail
-    if (useMainbufForThumb) {
-        thumbBuf = mArgs.out_buf;
-        thumbSize = mArgs.enc_param->file_size;
-    } else {
-        thumbBuf = mArgs.out_thumb_buf;
-        thumbSize = mArgs.thumb_enc_param->file_size;
-    }
-*/
-    if (exifInfo->enableThumb && (thumbBuf != NULL) && (thumbSize > 0)) {
-        tmp = LongerTagOffest;
-        memcpy(pNextIfdOffset, &tmp, OFFSET_SIZE);  // NEXT IFD offset skipped on 0th IFD
-
+    // makeExif() links it from IFD0 and appends the thumbnail, if there is one
+    mPatches.nextIfd = pNextIfdOffset - mTemplate;
+    mIfd1Start = pIfdStart + LongerTagOffest - mTemplate;
+    {
         pCur = pIfdStart + LongerTagOffest;
 
         tmp = NUM_1TH_IFD_TIFF;
@@ -290,6 +437,7 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                      1, exifInfo->heightThumb);
         writeExifIfd(&pCur, EXIF_TAG_COMPRESSION_SCHEME, EXIF_TYPE_SHORT,
                      1, exifInfo->compression_scheme);
+        mPatches.orientation[1] = pCur + IFD_VALUE - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_ORIENTATION, EXIF_TYPE_SHORT,
                      1, exifInfo->orientation);
         writeExifIfd(&pCur, EXIF_TAG_X_RESOLUTION, EXIF_TYPE_RATIONAL,
@@ -300,36 +448,23 @@ jpg_return_status JpegEncoder::makeExif (unsigned char *exifOut,
                      1, exifInfo->resolution_unit);
         writeExifIfd(&pCur, EXIF_TAG_JPEG_INTERCHANGE_FORMAT, EXIF_TYPE_LONG,
                      1, LongerTagOffest);
+        mPatches.thumbSize = pCur + IFD_VALUE - mTemplate;
         writeExifIfd(&pCur, EXIF_TAG_JPEG_INTERCHANGE_FORMAT_LEN, EXIF_TYPE_LONG,
-                     1, thumbSize);
+                     1, (uint32_t) 0);
 
         tmp = 0;
         memcpy(pCur, &tmp, OFFSET_SIZE); // next IFD offset
         pCur += OFFSET_SIZE;
-
-        memcpy(pIfdStart + LongerTagOffest,
-               thumbBuf, thumbSize);
-        LongerTagOffest += thumbSize;
-    } else {
-        tmp = 0;
-        memcpy(pNextIfdOffset, &tmp, OFFSET_SIZE);  // NEXT IFD offset skipped on 0th IFD
     }
 
     unsigned char App1Marker[2] = { 0xff, 0xe1 };
     memcpy(pApp1Start, App1Marker, 2);
-    pApp1Start += 2;
 
-    *size = 10 + LongerTagOffest;
-//    tmp = *size - 2;    // APP1 Maker isn't counted
-    tmp = *size;
-    if(tmp > 0xffff) {
-        ALOGE("line:%d, in the makeExif, the size exceeds 64K", __LINE__);
+    mTemplateSize = 10 + LongerTagOffest;
+    if (mTemplateSize > sizeof(mTemplate)) {
+        ALOGE("EXIF template of %u bytes overran its %u", mTemplateSize, (unsigned int) sizeof(mTemplate));
+        return JPG_FAIL;
     }
-    unsigned char size_mm[2] = {(tmp >> 8) & 0xFF, tmp & 0xFF};
-    memcpy(pApp1Start, size_mm, 2);
-
-    ALOGD("Exif End");
-
     return JPG_SUCCESS;
 }
 
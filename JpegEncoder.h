@@ -91,8 +91,41 @@ public:
                                unsigned int *size,
                                bool useMainbufForThumb = false);
 
+    // bytes a thumbnail of 'thumbSize' bytes adds to makeExif()'s output: IFD1, its rationals and the JPEG
+    static unsigned int thumbnailExifSize(unsigned int thumbSize);
+
 private:
 
+    // the EXIF without its thumbnail is well under this
+    static const unsigned int EXIF_TEMPLATE_SIZE = 2048;
+
+    // where the fields that change from shot to shot are in the template,
+    // 0 for the ones it doesn't have
+    struct ExifPatches {
+        unsigned int dateTime[3];
+        unsigned int orientation[2];    // of IFD0 and IFD1
+        unsigned int exposureTime;
+        unsigned int shutterSpeed;
+        unsigned int aperture;
+        unsigned int brightness;
+        unsigned int exposureBias;
+        unsigned int isoSpeed;
+        unsigned int gpsLatitudeRef;
+        unsigned int gpsLatitude;
+        unsigned int gpsLongitudeRef;
+        unsigned int gpsLongitude;
+        unsigned int gpsAltitudeRef;
+        unsigned int gpsAltitude;
+        unsigned int gpsTimestamp;
+        unsigned int gpsDatestamp;
+        unsigned int nextIfd;           // of IFD0, IFD1 with a thumbnail
+        unsigned int thumbSize;         // JPEGInterchangeFormatLength of IFD1
+    };
+
+    jpg_return_status buildTemplate(exif_attribute_t *exifInfo);
+    void patchTemplate(unsigned char *exifOut, const exif_attribute_t *exifInfo);
+    static void templateKey(const exif_attribute_t *exifInfo, exif_attribute_t *key);
+
     inline void writeExifIfd(unsigned char **pCur,
                                  unsigned short tag,
                                  unsigned short type,
@@ -121,6 +154,13 @@ private:
 
 	unsigned char * m_thumbBuf; // MAP: Added to set thumbnail from external data
 	unsigned int m_thumbSize; // MAP: Added to set thumbnail from external data
+
+    unsigned char mTemplate[EXIF_TEMPLATE_SIZE]; // the EXIF, IFD1 included but no thumbnail
+    unsigned int mTemplateSize;     // its bytes
+    unsigned int mIfd1Start;        // where IFD1 starts in it, the size of the EXIF without
+    bool mTemplateValid;
+    exif_attribute_t mTemplateKey;  // what it was built from, the patched fields cleared
+    ExifPatches mPatches;
 };
 };
 #endif /* __JPG_API_H__ */
@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_JpegRemuxer"
+
+#include "JpegRemuxer.h"
+#include "LogHelper.h"
+#include <string.h>
+#include <setjmp.h>
+
+extern "C" {
+#include "jerror.h"
+}
+
+namespace android {
+
+// JPEG markers
+static const unsigned char MARKER_SOF0 = 0xC0;
+static const unsigned char MARKER_SOF1 = 0xC1;
+static const unsigned char MARKER_SOF15 = 0xCF;
+static const unsigned char MARKER_DHT = 0xC4;
+static const unsigned char MARKER_JPG = 0xC8;
+static const unsigned char MARKER_DAC = 0xCC;
+static const unsigned char MARKER_SOI = 0xD8;
+static const unsigned char MARKER_EOI = 0xD9;
+static const unsigned char MARKER_SOS = 0xDA;
+static const unsigned char MARKER_DQT = 0xDB;
+static const unsigned char MARKER_APP0 = 0xE0;
+static const unsigned char MARKER_APP15 = 0xEF;
+static const unsigned char MARKER_COM = 0xFE;
+
+static const unsigned char SOI_BYTES[2] = { 0xFF, MARKER_SOI };
+static const unsigned char EOI_BYTES[2] = { 0xFF, MARKER_EOI };
+
+// natural order of the coefficients of a DQT, which is in zigzag order
+static const int ZIGZAG_ORDER[DCTSIZE2] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// libjpeg errors end the remux rather than the process
+struct RemuxError {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void remuxErrorExit(j_common_ptr cInfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cInfo->err->format_message)(cInfo, message);
+    ALOGE("libjpeg: %s", message);
+    longjmp(((RemuxError *) cInfo->err)->jump, 1);
+}
+
+static void remuxOutputMessage(j_common_ptr cInfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cInfo->err->format_message)(cInfo, message);
+    LOG1("libjpeg: %s", message);
+}
+
+// source manager reading the remuxed JPEG from its pieces
+struct SegmentSource {
+    struct jpeg_source_mgr pub;
+    const unsigned char *data[3];
+    int size[3];
+    int next;
+};
+
+static void initSource(j_decompress_ptr cInfo) {}
+static void termSource(j_decompress_ptr cInfo) {}
+
+static boolean fillInputBuffer(j_decompress_ptr cInfo)
+{
+    SegmentSource *src = (SegmentSource *) cInfo->src;
+    if (src->next < 3) {
+        src->pub.next_input_byte = src->data[src->next];
+        src->pub.bytes_in_buffer = src->size[src->next];
+        src->next++;
+    } else {
+        // past the end, as libjpeg asks for it
+        WARNMS(cInfo, JWRN_JPEG_EOF);
+        src->pub.next_input_byte = EOI_BYTES;
+        src->pub.bytes_in_buffer = sizeof(EOI_BYTES);
+    }
+    return TRUE;
+}
+
+static void skipInputData(j_decompress_ptr cInfo, long bytes)
+{
+    SegmentSource *src = (SegmentSource *) cInfo->src;
+    while (bytes > (long) src->pub.bytes_in_buffer) {
+        bytes -= src->pub.bytes_in_buffer;
+        fillInputBuffer(cInfo);
+    }
+    if (bytes > 0) {
+        src->pub.next_input_byte += bytes;
+        src->pub.bytes_in_buffer -= bytes;
+    }
+}
+
+// destination manager writing into a buffer, which must be big enough
+struct BufferDest {
+    struct jpeg_destination_mgr pub;
+    unsigned char *buf;
+    int size;
+};
+
+static void initDestination(j_compress_ptr cInfo)
+{
+    BufferDest *dest = (BufferDest *) cInfo->dest;
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+}
+
+static boolean emptyOutputBuffer(j_compress_ptr cInfo)
+{
+    ERREXIT(cInfo, JERR_BUFFER_SIZE);
+    return FALSE;
+}
+
+static void termDestination(j_compress_ptr cInfo) {}
+
+// 'coef' quantized by 'from' instead, rounded to nearest
+static inline JCOEF requantizeCoef(JCOEF coef, int from, int to)
+{
+    const int value = coef * from;
+    return (JCOEF) ((value >= 0) ? (value + to / 2) / to : -((-value + to / 2) / to));
+}
+
+JpegRemuxer::JpegRemuxer() :
+    mHeaders(NULL)
+    ,mHeadersSize(0)
+    ,mHeadersCapacity(0)
+    ,mNumComponents(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    struct jpeg_compress_struct cInfo;
+    struct jpeg_error_mgr jErr;
+
+    // the standard tables, as libjpeg has them: quality 50 doesn't scale them
+    memset(&cInfo, 0, sizeof(cInfo));
+    cInfo.err = jpeg_std_error(&jErr);
+    jpeg_create_compress(&cInfo);
+    cInfo.input_components = 3;
+    cInfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cInfo);
+    jpeg_set_quality(&cInfo, 50, TRUE);
+    for (int t = 0; t < 2; t++)
+        memcpy(mStdTables[t], cInfo.quant_tbl_ptrs[t]->quantval, sizeof(mStdTables[t]));
+
+    JHUFF_TBL *tables[4] = { cInfo.dc_huff_tbl_ptrs[0], cInfo.dc_huff_tbl_ptrs[1],
+                             cInfo.ac_huff_tbl_ptrs[0], cInfo.ac_huff_tbl_ptrs[1] };
+    const unsigned char ids[4] = { 0x00, 0x01, 0x10, 0x11 };    // class and destination
+    unsigned char *p = mDht;
+    *p++ = 0xFF;
+    *p++ = MARKER_DHT;
+    *p++ = (DHT_BYTES - 2) >> 8;
+    *p++ = (DHT_BYTES - 2) & 0xFF;
+    for (int i = 0; i < 4; i++) {
+        int count = 0;
+        *p++ = ids[i];
+        for (int len = 1; len <= 16; len++) {
+            *p++ = tables[i]->bits[len];
+            count += tables[i]->bits[len];
+        }
+        // the standard tables are known to fit in DHT_BYTES
+        memcpy(p, tables[i]->huffval, count);
+        p += count;
+    }
+    if (p != mDht + DHT_BYTES)
+        ALOGE("standard Huffman tables of %d bytes, %d expected", (int) (p - mDht), DHT_BYTES);
+    jpeg_destroy_compress(&cInfo);
+
+    memset(mSegments, 0, sizeof(mSegments));
+    memset(mHasFrameTable, 0, sizeof(mHasFrameTable));
+}
+
+JpegRemuxer::~JpegRemuxer()
+{
+    LOG1("@%s", __FUNCTION__);
+    delete [] mHeaders;
+}
+
+int JpegRemuxer::maxSize(int size)
+{
+    // the DHT, and an EOI if the frame is missing it
+    return size + DHT_BYTES + sizeof(EOI_BYTES);
+}
+
+void JpegRemuxer::appendHeaders(const unsigned char *data, int bytes)
+{
+    if (mHeadersSize + bytes > mHeadersCapacity) {
+        const int capacity = ALIGN(mHeadersSize + bytes + DHT_BYTES, 1024);
+        unsigned char *headers = new unsigned char[capacity];
+        memcpy(headers, mHeaders, mHeadersSize);
+        delete [] mHeaders;
+        mHeaders = headers;
+        mHeadersCapacity = capacity;
+    }
+    memcpy(mHeaders + mHeadersSize, data, bytes);
+    mHeadersSize += bytes;
+}
+
+/*
+ * parse: makes the headers of the remuxed JPEG from the ones of the frame
+ *
+ * The frame is walked to its scan, keeping every segment but the APPn and
+ * COM ones, with the standard DHT in front of the SOS if the frame has
+ * none. The entropy coded data ends at the EOI marker, which can't occur
+ * in it, since UVC frames may be padded past it.
+ */
+bool JpegRemuxer::parse(const unsigned char *frame, int size)
+{
+    bool hasDht = false;
+    bool hasSof = false;
+    int pos = sizeof(SOI_BYTES);
+
+    if (size < (int) sizeof(SOI_BYTES) || frame[0] != 0xFF || frame[1] != MARKER_SOI) {
+        ALOGE("MJPEG frame without SOI");
+        return false;
+    }
+    mHeadersSize = 0;
+    mNumComponents = 0;
+    memset(mHasFrameTable, 0, sizeof(mHasFrameTable));
+    appendHeaders(SOI_BYTES, sizeof(SOI_BYTES));
+
+    for (;;) {
+        // markers may be preceded by fill bytes
+        while (pos + 1 < size && frame[pos] == 0xFF && frame[pos + 1] == 0xFF)
+            pos++;
+        if (pos + 4 > size || frame[pos] != 0xFF) {
+            ALOGE("MJPEG frame without a scan");
+            return false;
+        }
+        const unsigned char marker = frame[pos + 1];
+        const unsigned char *segment = frame + pos;
+        const int bytes = 2 + ((frame[pos + 2] << 8) | frame[pos + 3]);
+        if (bytes < 4 || pos + bytes > size) {
+            ALOGE("MJPEG segment 0x%02x of %d bytes past the frame", marker, bytes);
+            return false;
+        }
+
+        if ((marker >= MARKER_APP0 && marker <= MARKER_APP15) || marker == MARKER_COM) {
+            // of no use in a still, the EXIF goes in front
+        } else if (marker == MARKER_SOF0 || marker == MARKER_SOF1) {
+            const int components = (bytes >= 10) ? segment[9] : 0;
+            if (segment[4] != 8 || components == 0 || components > MAX_COMPONENTS ||
+                bytes < 10 + 3 * components) {
+                ALOGE("MJPEG frame of %d bit samples, %d components", segment[4], components);
+                return false;
+            }
+            for (int i = 0; i < components; i++)
+                mComponentTables[i] = segment[10 + 3 * i + 2] & 0x0F;
+            mNumComponents = components;
+            hasSof = true;
+            appendHeaders(segment, bytes);
+        } else if (marker > MARKER_SOF1 && marker <= MARKER_SOF15 &&
+                   marker != MARKER_DHT && marker != MARKER_JPG && marker != MARKER_DAC) {
+            ALOGE("MJPEG frame isn't baseline (SOF 0x%02x)", marker);
+            return false;
+        } else if (marker == MARKER_DQT) {
+            int q = 4;
+            while (q < bytes) {
+                const int precision = segment[q] >> 4;
+                const int table = segment[q] & 0x0F;
+                const int tableBytes = 1 + DCTSIZE2 * (precision + 1);
+                if (table >= NUM_QUANT_TBLS || q + tableBytes > bytes) {
+                    ALOGE("bad MJPEG DQT");
+                    return false;
+                }
+                for (int k = 0; k < DCTSIZE2; k++) {
+                    mFrameTables[table][ZIGZAG_ORDER[k]] = precision ?
+                        (segment[q + 1 + 2 * k] << 8) | segment[q + 2 + 2 * k] : segment[q + 1 + k];
+                }
+                mHasFrameTable[table] = true;
+                q += tableBytes;
+            }
+            appendHeaders(segment, bytes);
+        } else if (marker == MARKER_SOS) {
+            if (!hasSof) {
+                ALOGE("MJPEG scan without a frame header");
+                return false;
+            }
+            if (!hasDht)
+                appendHeaders(mDht, DHT_BYTES);
+            appendHeaders(segment, bytes);
+            pos += bytes;
+            break;
+        } else {
+            if (marker == MARKER_DHT)
+                hasDht = true;
+            appendHeaders(segment, bytes);
+        }
+        pos += bytes;
+    }
+
+    int end = pos;
+    for (;;) {
+        const unsigned char *ff = (const unsigned char *) memchr(frame + end, 0xFF, size - end);
+        if (ff == NULL) {
+            LOG1("MJPEG frame without EOI");
+            end = size;
+            break;
+        }
+        end = ff - frame;
+        if (end + 1 < size && frame[end + 1] == MARKER_EOI)
+            break;
+        end++;
+    }
+
+    mSegments[0].data = mHeaders;
+    mSegments[0].size = mHeadersSize;
+    mSegments[1].data = frame + pos;
+    mSegments[1].size = end - pos;
+    mSegments[2].data = EOI_BYTES;
+    mSegments[2].size = sizeof(EOI_BYTES);
+    return true;
+}
+
+// whether the tables of 'quality' are coarser than the frame's anywhere
+bool JpegRemuxer::needsRequantizing(int quality) const
+{
+    quality = CLIP(quality, 100, 1);
+    const int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+
+    for (int c = 0; c < mNumComponents; c++) {
+        const int table = mComponentTables[c];
+        if (!mHasFrameTable[table])
+            return false;
+        const UINT16 *std = mStdTables[(c == 0) ? 0 : 1];
+        for (int k = 0; k < DCTSIZE2; k++) {
+            const int q = CLIP((std[k] * scale + 50) / 100, 255, 1);
+            if (q > mFrameTables[table][k])
+                return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * requantize: transcodes the parsed frame to the tables of 'quality'
+ *
+ * libjpeg reads the coefficients of the frame, which takes the entropy
+ * decode only, and writes them back with tables that are the ones of
+ * 'quality' but never finer than the frame's, since that would only cost
+ * bytes. Returns the size of the JPEG, -1 if it failed or didn't fit.
+ */
+int JpegRemuxer::requantize(int quality, unsigned char *out, int outSize)
+{
+    struct jpeg_decompress_struct src;
+    struct jpeg_compress_struct dst;
+    RemuxError err;
+    SegmentSource source;
+    BufferDest dest;
+
+    memset(&src, 0, sizeof(src));
+    memset(&dst, 0, sizeof(dst));
+    src.err = jpeg_std_error(&err.pub);
+    dst.err = &err.pub;
+    err.pub.error_exit = remuxErrorExit;
+    err.pub.output_message = remuxOutputMessage;
+    jpeg_create_decompress(&src);
+    jpeg_create_compress(&dst);
+    if (setjmp(err.jump)) {
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        return -1;
+    }
+
+    memset(&source, 0, sizeof(source));
+    source.pub.init_source = initSource;
+    source.pub.fill_input_buffer = fillInputBuffer;
+    source.pub.skip_input_data = skipInputData;
+    source.pub.resync_to_restart = jpeg_resync_to_restart;
+    source.pub.term_source = termSource;
+    for (int i = 0; i < NUM_SEGMENTS; i++) {
+        source.data[i] = mSegments[i].data;
+        source.size[i] = mSegments[i].size;
+    }
+    src.src = &source.pub;
+    jpeg_read_header(&src, TRUE);
+    jvirt_barray_ptr *coefs = jpeg_read_coefficients(&src);
+
+    memset(&dest, 0, sizeof(dest));
+    dest.pub.init_destination = initDestination;
+    dest.pub.empty_output_buffer = emptyOutputBuffer;
+    dest.pub.term_destination = termDestination;
+    dest.buf = out;
+    dest.size = outSize;
+    jpeg_copy_critical_parameters(&src, &dst);
+    dst.dest = &dest.pub;
+    dst.write_JFIF_header = FALSE;  // the EXIF goes in front
+    dst.optimize_coding = FALSE;
+    jpeg_set_quality(&dst, quality, TRUE);
+    for (int t = 0; t < NUM_QUANT_TBLS; t++) {
+        if (dst.quant_tbl_ptrs[t] == NULL || src.quant_tbl_ptrs[t] == NULL)
+            continue;
+        for (int k = 0; k < DCTSIZE2; k++) {
+            if (dst.quant_tbl_ptrs[t]->quantval[k] < src.quant_tbl_ptrs[t]->quantval[k])
+                dst.quant_tbl_ptrs[t]->quantval[k] = src.quant_tbl_ptrs[t]->quantval[k];
+        }
+    }
+
+    for (int c = 0; c < src.num_components; c++) {
+        const jpeg_component_info *comp = &src.comp_info[c];
+        const UINT16 *from = comp->quant_table->quantval;
+        const UINT16 *to = dst.quant_tbl_ptrs[dst.comp_info[c].quant_tbl_no]->quantval;
+        if (memcmp(from, to, sizeof(comp->quant_table->quantval)) == 0)
+            continue;
+        // the coefficient arrays are padded to whole MCUs, and so is the scan
+        const int hSamp = comp->h_samp_factor;
+        const int vSamp = comp->v_samp_factor;
+        const JDIMENSION width = (comp->width_in_blocks + hSamp - 1) / hSamp * hSamp;
+        const JDIMENSION height = (comp->height_in_blocks + vSamp - 1) / vSamp * vSamp;
+        for (JDIMENSION row = 0; row < height; row += vSamp) {
+            JBLOCKARRAY rows = (*src.mem->access_virt_barray)((j_common_ptr) &src, coefs[c], row,
+                                                             (JDIMENSION) vSamp, TRUE);
+            for (int r = 0; r < vSamp; r++) {
+                for (JDIMENSION b = 0; b < width; b++) {
+                    JCOEF *block = rows[r][b];
+                    for (int k = 0; k < DCTSIZE2; k++)
+                        block[k] = requantizeCoef(block[k], from[k], to[k]);
+                }
+            }
+        }
+    }
+
+    jpeg_write_coefficients(&dst, coefs);
+    jpeg_finish_compress(&dst);
+    const int size = dest.pub.next_output_byte - out;
+    jpeg_finish_decompress(&src);
+    jpeg_destroy_compress(&dst);
+    jpeg_destroy_decompress(&src);
+    return size;
+}
+
+int JpegRemuxer::remux(const unsigned char *frame, int size, int quality, unsigned char *out, int outSize)
+{
+    LOG1("@%s: %d byte frame, quality %d", __FUNCTION__, size, quality);
+    if (frame == NULL || out == NULL || !parse(frame, size))
+        return -1;
+
+    if (needsRequantizing(quality)) {
+        const int bytes = requantize(quality, out, outSize);
+        if (bytes > 0) {
+            LOG1("@%s: requantized to %d bytes", __FUNCTION__, bytes);
+            return bytes;
+        }
+        ALOGW("Requantizing the MJPEG frame to quality %d failed, remuxing it as it is", quality);
+    }
+
+    int total = 0;
+    for (int i = 0; i < NUM_SEGMENTS; i++)
+        total += mSegments[i].size;
+    if (total > outSize) {
+        ALOGE("remuxed JPEG of %d bytes doesn't fit in %d", total, outSize);
+        return -1;
+    }
+    unsigned char *dst = out;
+    for (int i = 0; i < NUM_SEGMENTS; i++) {
+        memcpy(dst, mSegments[i].data, mSegments[i].size);
+        dst += mSegments[i].size;
+    }
+    LOG1("@%s: remuxed to %d bytes", __FUNCTION__, total);
+    return total;
+}
+
+}; // namespace android
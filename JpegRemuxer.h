@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_JPEG_REMUXER_H
+#define ANDROID_LIBCAMERA_JPEG_REMUXER_H
+
+#include "SWJpegEncoder.h"
+
+namespace android {
+
+/**
+ * \class JpegRemuxer
+ *
+ * Makes a still JPEG out of a frame of the camera's MJPEG stream, without
+ * decoding it to pixels.
+ *
+ * UVC MJPEG frames leave the Huffman tables out, since the standard ones
+ * are implied, and carry APPn segments (AVI1) of no use in a still. The
+ * remuxed JPEG has the headers of the frame less its APPn and COM
+ * segments, the standard DHT if the frame has none, and the entropy coded
+ * data of the frame as it is.
+ *
+ * When the quality asked for has coarser quantization tables than the
+ * frame, the coefficients are requantized instead: libjpeg only entropy
+ * decodes the frame, every coefficient is scaled to the tables of the
+ * quality asked for, and the result is entropy coded with the standard
+ * Huffman tables.
+ */
+class JpegRemuxer {
+public:
+    JpegRemuxer();
+    ~JpegRemuxer();
+
+    /**
+     * Remuxes the 'size' byte MJPEG frame at 'frame' into 'out', returns
+     * the size of the JPEG, from its SOI marker on, or -1 if the frame
+     * isn't a baseline JPEG or the JPEG doesn't fit in 'outSize' bytes.
+     */
+    int remux(const unsigned char *frame, int size, int quality, unsigned char *out, int outSize);
+
+    // bytes remux() needs at most for a frame of 'size' bytes
+    static int maxSize(int size);
+
+// prevent copy constructor and assignment operator
+private:
+    JpegRemuxer(const JpegRemuxer& other);
+    JpegRemuxer& operator=(const JpegRemuxer& other);
+
+private:
+    // a piece of the remuxed JPEG: headers, entropy coded data or EOI
+    struct Segment {
+        const unsigned char *data;
+        int size;
+    };
+
+    static const int NUM_SEGMENTS = 3;
+    // the standard DHT segment, marker included
+    static const int DHT_BYTES = 2 + 2 + 4 * (1 + 16) + 12 + 12 + 162 + 162;
+
+    bool parse(const unsigned char *frame, int size);
+    void appendHeaders(const unsigned char *data, int bytes);
+    bool needsRequantizing(int quality) const;
+    int requantize(int quality, unsigned char *out, int outSize);
+
+    unsigned char mDht[DHT_BYTES];          // the standard Huffman tables
+    UINT16 mStdTables[2][DCTSIZE2];         // the standard quantization tables, natural order
+    unsigned char *mHeaders;                // headers of the remuxed JPEG, SOI to SOS
+    int mHeadersSize;
+    int mHeadersCapacity;
+    Segment mSegments[NUM_SEGMENTS];        // the remuxed JPEG, as parsed
+    UINT16 mFrameTables[NUM_QUANT_TBLS][DCTSIZE2]; // quantization tables of the frame, natural order
+    bool mHasFrameTable[NUM_QUANT_TBLS];
+    int mComponentTables[MAX_COMPONENTS];   // table of every component of the frame
+    int mNumComponents;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_JPEG_REMUXER_H
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_MjpegDecoder"
+
+#include "MjpegDecoder.h"
+#include "LogHelper.h"
+#include <string.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
+
+namespace android {
+
+// system property selecting the MJPEG decoder, "va" or "sw"
+static const char *PROP_MJPEG_DECODER = "camera.hal.mjpeg.decoder";
+// system property setting the threads of the SW decoder, 0 means one per CPU
+static const char *PROP_MJPEG_THREADS = "camera.hal.mjpeg.threads";
+
+IMjpegDecoder *createMjpegDecoder(int width, int height, RenderTarget **targets, int numTargets)
+{
+    char propVal[PROPERTY_VALUE_MAX];
+    IMjpegDecoder *decoder = NULL;
+
+    property_get(PROP_MJPEG_DECODER, propVal, "va");
+    if (strcmp(propVal, "sw") != 0) {
+        decoder = new VaMjpegDecoder();
+        if (decoder->init(width, height, targets, numTargets) != NO_ERROR) {
+            ALOGW("VA MJPEG decoder unavailable, decoding on the CPU");
+            delete decoder;
+            decoder = NULL;
+        }
+    }
+    if (decoder == NULL) {
+        decoder = new SwMjpegDecoder();
+        if (decoder->init(width, height, targets, numTargets) != NO_ERROR) {
+            ALOGE("init SW MJPEG decoder failed");
+            delete decoder;
+            decoder = NULL;
+        }
+    }
+    return decoder;
+}
+
+VaMjpegDecoder::VaMjpegDecoder() :
+    mDecoder(NULL)
+    ,mJpegHeader(NULL)
+    ,mJpegHeaderSize(0)
+    ,mJpegHeaderCapacity(0)
+    ,mJpegSliceEnd(0)
+    ,mJpegEoiOffset(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    memset(&mParseStats, 0, sizeof(mParseStats));
+}
+
+VaMjpegDecoder::~VaMjpegDecoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    deinit();
+    delete [] mJpegHeader;
+}
+
+status_t VaMjpegDecoder::init(int width, int height, RenderTarget **targets, int numTargets)
+{
+    LOG1("@%s", __FUNCTION__);
+    mDecoder = new JpegDecoder();
+    if (mDecoder->init(width, height, targets, numTargets) != JD_SUCCESS) {
+        ALOGE("init JpegDecoder failed");
+        delete mDecoder;
+        mDecoder = NULL;
+        return UNKNOWN_ERROR;
+    }
+    mJpegHeaderSize = 0;
+    memset(&mParseStats, 0, sizeof(mParseStats));
+    return NO_ERROR;
+}
+
+void VaMjpegDecoder::deinit()
+{
+    LOG1("@%s", __FUNCTION__);
+    if (mDecoder == NULL)
+        return;
+    mDecoder->deinit();
+    delete mDecoder;
+    mDecoder = NULL;
+    mJpegHeaderSize = 0;
+}
+
+status_t VaMjpegDecoder::decode(const unsigned char *frame, int size, CameraBuffer *target)
+{
+    int status = parseFrame(frame, size);
+    if (status != 0) {
+        ALOGE("parse fail for jpegdec,status=%d", status);
+        return UNKNOWN_ERROR;
+    }
+    status = mDecoder->decode(mJpegInfo, *target->GetRenderTargetHandle());
+    if (status != 0) {
+        ALOGE("decoder fail,status=%d", status);
+        mJpegHeaderSize = 0;
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+void VaMjpegDecoder::getParseStats(MjpegParseStats *stats) const
+{
+    *stats = mParseStats;
+}
+
+/*
+ * MJPEG header cache
+ *
+ * Frames are told apart by their headers, from the SOI marker to the end
+ * of the SOS segment: a frame with the headers of the last one parsed
+ * differs only in its entropy coded data, and reuses its parse, but for
+ * the end of the scan and the EOI marker, found in the frame. Comparing
+ * the headers costs what a fingerprint of them would, and is exact. Only
+ * frames of one scan are reused.
+ */
+
+// bytes of the headers of a JPEG, to the end of its first SOS segment, 0 if none
+static int mjpegHeaderSize(const unsigned char *frame, int size)
+{
+    int pos = 2;
+
+    if (size < 2 || frame[0] != 0xFF || frame[1] != 0xD8)
+        return 0;
+    for (;;) {
+        while (pos + 1 < size && frame[pos] == 0xFF && frame[pos + 1] == 0xFF)
+            pos++;
+        if (pos + 4 > size || frame[pos] != 0xFF)
+            return 0;
+        const int bytes = 2 + ((frame[pos + 2] << 8) | frame[pos + 3]);
+        if (pos + bytes > size)
+            return 0;
+        if (frame[pos + 1] == 0xDA)
+            return pos + bytes;
+        pos += bytes;
+    }
+}
+
+// where the EOI marker after 'start' is, 'size' if there is none
+static int mjpegEoi(const unsigned char *frame, int start, int size)
+{
+    int pos = start;
+    for (;;) {
+        const unsigned char *ff = (const unsigned char *) memchr(frame + pos, 0xFF, size - pos);
+        if (ff == NULL)
+            return size;
+        pos = ff - frame;
+        if (pos + 1 < size && frame[pos + 1] == 0xD9)
+            return pos;
+        pos++;
+    }
+}
+
+// fills mJpegInfo for the MJPEG frame, from the last one if it can
+int VaMjpegDecoder::parseFrame(const unsigned char *frame, int size)
+{
+    const int headerSize = mjpegHeaderSize(frame, size);
+
+    mParseStats.frames++;
+    if (headerSize > 0 && headerSize == mJpegHeaderSize &&
+        memcmp(frame, mJpegHeader, headerSize) == 0) {
+        const int eoi = mjpegEoi(frame, headerSize, size);
+        mJpegInfo.buf = (uint8_t *) frame;
+        mJpegInfo.bufsize = size;
+        mJpegInfo.eoi_offset = eoi + mJpegEoiOffset;
+        mJpegInfo.slice_param_buf[0].slice_data_size =
+            eoi + mJpegSliceEnd - mJpegInfo.slice_param_buf[0].slice_data_offset;
+        mParseStats.headerHits++;
+        return 0;
+    }
+
+    nsecs_t startTime = systemTime();
+    mJpegInfo = JpegInfo();
+    mJpegInfo.buf = (uint8_t *) frame;
+    mJpegInfo.bufsize = size;
+    int status = mDecoder->parse(mJpegInfo);
+    mParseStats.parseTime += systemTime() - startTime;
+
+    mJpegHeaderSize = 0;
+    if (status == 0 && headerSize > 0 && mJpegInfo.scan_ctrl_count == 1) {
+        if (headerSize > mJpegHeaderCapacity) {
+            delete [] mJpegHeader;
+            mJpegHeader = new unsigned char[headerSize];
+            mJpegHeaderCapacity = headerSize;
+        }
+        memcpy(mJpegHeader, frame, headerSize);
+        const int eoi = mjpegEoi(frame, headerSize, size);
+        mJpegSliceEnd = mJpegInfo.slice_param_buf[0].slice_data_offset +
+                        mJpegInfo.slice_param_buf[0].slice_data_size - eoi;
+        mJpegEoiOffset = mJpegInfo.eoi_offset - eoi;
+        mJpegHeaderSize = headerSize;
+    }
+    return status;
+}
+
+SwMjpegDecoder::SwMjpegDecoder() :
+    mWidth(0)
+    ,mHeight(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    memset(&mParseStats, 0, sizeof(mParseStats));
+
+    char propVal[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_MJPEG_THREADS, propVal, "0") > 0)
+        mDecoder.setThreads(atoi(propVal));
+}
+
+SwMjpegDecoder::~SwMjpegDecoder()
+{
+    LOG1("@%s", __FUNCTION__);
+}
+
+status_t SwMjpegDecoder::init(int width, int height, RenderTarget **targets, int numTargets)
+{
+    LOG1("@%s: %dx%d", __FUNCTION__, width, height);
+    mWidth = width;
+    mHeight = height;
+    memset(&mParseStats, 0, sizeof(mParseStats));
+    return NO_ERROR;
+}
+
+void SwMjpegDecoder::deinit()
+{
+    LOG1("@%s", __FUNCTION__);
+}
+
+status_t SwMjpegDecoder::decode(const unsigned char *frame, int size, CameraBuffer *target)
+{
+    void *addr[3];
+    int bufSize = 0;
+
+    status_t status = target->LockGrallocData(addr, &bufSize);
+    if (status != NO_ERROR) {
+        ALOGE("lock data failed,ret=%d, in line %d", status, __LINE__);
+        return status;
+    }
+    SWJpegDecoder::OutputPlanes planes = SWJpegDecoder::yuv422hPlanes(addr[0], target->GetGraStride(),
+                                                                       target->GetRenderTargetHandle()->height,
+                                                                       mWidth, mHeight);
+    mParseStats.frames++;
+    if (mDecoder.decode(frame, size, planes) != 0)
+        status = UNKNOWN_ERROR;
+    target->UnLockGrallocData();
+    return status;
+}
+
+void SwMjpegDecoder::getParseStats(MjpegParseStats *stats) const
+{
+    *stats = mParseStats;
+}
+
+}; // namespace android
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_MJPEG_DECODER_H
+#define ANDROID_LIBCAMERA_MJPEG_DECODER_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <JPEGDecoder.h>
+#include "CameraCommon.h"
+#include "SWJpegDecoder.h"
+
+namespace android {
+
+// how the MJPEG frames of a configuration were parsed
+struct MjpegParseStats {
+    int frames;             // decoded
+    int headerHits;         // of them with the headers of the last one parsed
+    nsecs_t parseTime;      // spent parsing the others
+};
+
+/**
+ * \class IMjpegDecoder
+ *
+ * Decodes the MJPEG frames of the camera into the YUV422H gralloc buffers
+ * the rest of the HAL takes them in. See createMjpegDecoder() for the
+ * backends.
+ */
+class IMjpegDecoder {
+public:
+    virtual ~IMjpegDecoder() {}
+
+    // sets up for frames of 'width' x 'height', decoded into the buffers of 'targets'
+    virtual status_t init(int width, int height, RenderTarget **targets, int numTargets) = 0;
+    virtual void deinit() = 0;
+
+    // decodes the 'size' byte frame at 'frame' into 'target', one of the buffers of init()
+    virtual status_t decode(const unsigned char *frame, int size, CameraBuffer *target) = 0;
+
+    virtual void getParseStats(MjpegParseStats *stats) const = 0;
+    virtual const char *getName() const = 0;
+};
+
+/**
+ * \class VaMjpegDecoder
+ *
+ * Decodes with the VA JpegDecoder of libjpegdec.
+ *
+ * UVC cameras repeat the headers and tables of every MJPEG frame: the
+ * parse of the last frame is kept, with its headers, SOI to the scan, and
+ * a frame with the same headers reuses it.
+ */
+class VaMjpegDecoder : public IMjpegDecoder {
+public:
+    VaMjpegDecoder();
+    virtual ~VaMjpegDecoder();
+
+    virtual status_t init(int width, int height, RenderTarget **targets, int numTargets);
+    virtual void deinit();
+    virtual status_t decode(const unsigned char *frame, int size, CameraBuffer *target);
+    virtual void getParseStats(MjpegParseStats *stats) const;
+    virtual const char *getName() const { return "va"; }
+
+// prevent copy constructor and assignment operator
+private:
+    VaMjpegDecoder(const VaMjpegDecoder& other);
+    VaMjpegDecoder& operator=(const VaMjpegDecoder& other);
+
+private:
+    int parseFrame(const unsigned char *frame, int size);
+
+    JpegDecoder *mDecoder;
+    JpegInfo mJpegInfo;
+    unsigned char *mJpegHeader;
+    int mJpegHeaderSize;        // 0 if mJpegInfo can't be reused
+    int mJpegHeaderCapacity;
+    int mJpegSliceEnd;          // where the scan of mJpegInfo ends, from the EOI marker
+    int mJpegEoiOffset;         // and where it has the EOI, from the marker
+    MjpegParseStats mParseStats;
+};
+
+/**
+ * \class SwMjpegDecoder
+ *
+ * Decodes with libjpeg, on the CPU, through SWJpegDecoder: for when the VA
+ * decoder isn't there, or can't be used.
+ */
+class SwMjpegDecoder : public IMjpegDecoder {
+public:
+    SwMjpegDecoder();
+    virtual ~SwMjpegDecoder();
+
+    virtual status_t init(int width, int height, RenderTarget **targets, int numTargets);
+    virtual void deinit();
+    virtual status_t decode(const unsigned char *frame, int size, CameraBuffer *target);
+    virtual void getParseStats(MjpegParseStats *stats) const;
+    virtual const char *getName() const { return "sw"; }
+
+// prevent copy constructor and assignment operator
+private:
+    SwMjpegDecoder(const SwMjpegDecoder& other);
+    SwMjpegDecoder& operator=(const SwMjpegDecoder& other);
+
+private:
+    SWJpegDecoder mDecoder;
+    int mWidth;
+    int mHeight;
+    MjpegParseStats mParseStats;    // frames only, libjpeg parses them as it decodes
+};
+
+/**
+ * Creates and initializes the MJPEG decoder of the backend the
+ * camera.hal.mjpeg.decoder property selects: "va", the default, or "sw".
+ * The SW decoder is used when the VA one can't be initialized, and NULL
+ * is returned when neither can.
+ */
+IMjpegDecoder *createMjpegDecoder(int width, int height, RenderTarget **targets, int numTargets);
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_MJPEG_DECODER_H
@@ -17,6 +17,7 @@
 
 #include "CameraBufferAllocator.h"
 #include "ColorConverter.h"
+#include "ColorConvertPlanner.h"
 #include "PictureThread.h"
 #include "LogHelper.h"
 #include "Callbacks.h"
@@ -24,20 +25,44 @@
 #include "VAConvertor.h"
 
 #include <utils/Timers.h>
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <unistd.h>
 #include <assert.h>
 namespace android {
 
 static const int MAX_EXIF_SIZE = 0xFFFF;
 static const unsigned char JPEG_MARKER_SOI[2] = {0xFF, 0xD8}; // JPEG StartOfImage marker
 static const unsigned char JPEG_MARKER_EOI[2] = {0xFF, 0xD9}; // JPEG EndOfImage marker
+static const int THUMB_MARGIN = 256; // bytes reserved for a thumbnail beyond its expected size
 
 PictureThread::PictureThread() :
     Thread(true) // callbacks may call into java
     ,mMessageQueue("PictureThread", MESSAGE_ID_MAX)
     ,mThreadRunning(false)
     ,mCallbacks(NULL)
-    ,mOutData(NULL)
-    ,mExifBuf(NULL)
+    ,mOutData(new unsigned char[MAX_EXIF_SIZE])
+    ,mJpegFd(-1)
+    ,mJpegData(NULL)
+    ,mJpegDataSize(0)
+    ,mThumbPrediction(0)
+    ,mAchievedJpegSize(0)
+    ,mChunkStreamer(this)
+    ,mStreaming(false)
+    ,mChunkMem(NULL)
+    ,mChunkCount(0)
+    ,mNextChunk(0)
+    ,mStreamOffset(0)
+    ,mStreamSkip(0)
+    ,mThumbYuv(NULL)
+    ,mThumbYuvSize(0)
+    ,mThumbSource(NULL)
+    ,mThumbSlot(NULL)
+    ,mThumbSlotSize(0)
+    ,mThumbSize(-1)
+    ,mThumbExiting(false)
     ,mVaConvertor(new VAConvertor(false))
     ,mInputFormat(V4L2_PIX_FMT_YUV422P)
 {
@@ -47,12 +72,12 @@ PictureThread::PictureThread() :
 PictureThread::~PictureThread()
 {
     LOG1("@%s", __FUNCTION__);
+    stopThumbnailWorker();
     if (mOutData != NULL) {
         delete[] mOutData;
     }
-    if (mExifBuf != NULL) {
-        delete[] mExifBuf;
-    }
+    delete [] mThumbYuv;
+    releaseJpegRegion();
     if (mVaConvertor !=NULL)
         delete mVaConvertor;
     if (mCallbacks.get())
@@ -61,158 +86,422 @@ PictureThread::~PictureThread()
 
 /*
  * encodeToJpeg: encodes the given buffer and creates the final JPEG file
- * Input:  mainBuf  - buffer containing the main picture image
- *         thumbBuf - buffer containing the thumbnail image (optional, can be NULL)
+ * Input:  yuv      - the locked YUV surface the picture and the thumbnail are
+ *                    made from, its data is NULL if it couldn't be locked
+ *         driverJpeg - the picture as the driver encoded it, NULL unless
+ *                    mConfig.jpegfromdriver
  * Output: destBuf  - buffer containing the final JPEG image including EXIF header
- *         Note that, if present, thumbBuf will be included in EXIF header
- * picture_stride: stride for src main image
- * thumbnail_stride: stride for src thumbnail image
- * alignPicHeight: main picture height
- * alignThumHeight: thumbnail picture height
+ *         Note that, if enabled, the thumbnail will be included in EXIF header
  */
 
-status_t PictureThread::encodeToJpeg(void *mainBuf, int mainSize, void *thumbBuf, CameraBuffer *destBuf,int picture_stride,int thumbnail_stride,int alignPicHeight,int alignThumHeight)
+status_t PictureThread::encodeToJpeg(const YuvImage &yuv, void *driverJpeg, int driverJpegSize, CameraBuffer *destBuf)
 {
     LOG1("@%s", __FUNCTION__);
     status_t status = NO_ERROR;
-    char *copyFrom = NULL;
+    int mainSize = driverJpegSize;
 
     nsecs_t startTime = systemTime();
     nsecs_t endTime = 0;
-
-    // Convert and encode the thumbnail, if present and EXIF maker is initialized
-
-    if (mConfig.exif.enableThumb) {
-
+    const char *speedName = SWJpegEncoder::jpegSpeedName(mConfig.jpegSpeed);
+    const char *backend = SWJpegEncoder::hasSimdBackend() ? "SIMD" : "C";
+
+    compressor.setSpeed(mConfig.jpegSpeed);
+
+    const bool thumbnail = mConfig.exif.enableThumb && yuv.data != NULL &&
+                           mConfig.thumbnail.width > 0 && mConfig.thumbnail.height > 0;
+
+    // The final JPEG is SOI, EXIF, and the main stream without its SOI.
+    // Make the region it is written into big enough for any of them
+    int maxMainSize = mConfig.jpegfromdriver ? JpegRemuxer::maxSize(driverJpegSize) :
+        compressor.predictSize(mConfig.picture.width, mConfig.picture.height, yuv.format, mConfig.picture.quality);
+    if (createJpegRegion(sizeof(JPEG_MARKER_SOI) + MAX_EXIF_SIZE + sizeof(JPEG_MARKER_EOI) + maxMainSize) != NO_ERROR)
+        return NO_MEMORY;
+
+    // The EXIF is written once the thumbnail is in, the main stream goes
+    // after room for it: the exact size without a thumbnail, with one the
+    // size the last thumbnail took plus a margin, which ends up as padding
+    unsigned int baseExifSize = 0;
+    encoder.setThumbData(NULL, 0);
+    if (encoder.makeExif(mJpegData + sizeof(JPEG_MARKER_SOI), &mConfig.exif, &baseExifSize, false) != JPG_SUCCESS)
+        ALOGE("Error making EXIF");
+    unsigned int exifSize = baseExifSize;
+    if (thumbnail)
+        exifSize += JpegEncoder::thumbnailExifSize(mThumbPrediction);
+    if (exifSize > (unsigned int)MAX_EXIF_SIZE)
+        exifSize = MAX_EXIF_SIZE;
+    int dataStart = sizeof(JPEG_MARKER_SOI) + exifSize + sizeof(JPEG_MARKER_EOI);
+
+    // The thumbnail is scaled and encoded by the worker, next to the main
+    // picture, straight into its place in the EXIF: after IFD1, up to the
+    // EOI marker
+    if (thumbnail) {
         LOG1("Encoding thumbnail");
-
-        // setup the JpegCompressor input and output buffers
-        mEncoderInBuf.clear();
-        mEncoderInBuf.buf = (unsigned char*)thumbBuf;
-        mEncoderInBuf.width = mConfig.thumbnail.width;
-        mEncoderInBuf.height = mConfig.thumbnail.height;
-        mEncoderInBuf.format = mConfig.thumbnail.format;
-        mEncoderInBuf.stride = thumbnail_stride;
-        mEncoderInBuf.alignHeight = alignThumHeight;
-        mEncoderInBuf.size = frameSize(mConfig.thumbnail.format,
-                thumbnail_stride,
-                mConfig.thumbnail.height);
-        mEncoderOutBuf.clear();
-        mEncoderOutBuf.buf = mOutData;
-        mEncoderOutBuf.width = mConfig.thumbnail.width;
-        mEncoderOutBuf.height = mConfig.thumbnail.height;
-        mEncoderOutBuf.quality = mConfig.thumbnail.quality;
-        mEncoderOutBuf.size = mMaxOutDataSize;
-        endTime = systemTime();
-        int size = compressor.encode(mEncoderInBuf, mEncoderOutBuf);
-        LOG1("Thumbnail JPEG size: %d (time to encode: %ums)", size, (unsigned)((systemTime() - endTime) / 1000000));
-        if (size > 0) {
-            encoder.setThumbData(mEncoderOutBuf.buf, size);
-        } else {
-            // This is not critical, we can continue with main picture image
-            ALOGE("Could not encode thumbnail stream!");
-        }
+        const int thumbSlot = sizeof(JPEG_MARKER_SOI) + baseExifSize + JpegEncoder::thumbnailExifSize(0);
+        startThumbnail(&yuv, mJpegData + thumbSlot, dataStart - sizeof(JPEG_MARKER_EOI) - thumbSlot);
     } else {
         LOG1("Skipping thumbnail");
     }
-    int totalSize = 0;
-    unsigned int exifSize = 0;
-    // Copy the SOI marker
-    unsigned char* currentPtr = mExifBuf;
-    memcpy(currentPtr, JPEG_MARKER_SOI, sizeof(JPEG_MARKER_SOI));
-    totalSize += sizeof(JPEG_MARKER_SOI);
-    currentPtr += sizeof(JPEG_MARKER_SOI);
-    if (encoder.makeExif(currentPtr, &mConfig.exif, &exifSize, false) != JPG_SUCCESS)
-        ALOGE("Error making EXIF");
-    currentPtr += exifSize;
-    totalSize += exifSize;
-    // Copy the EOI marker
-    memcpy(currentPtr, (void*)JPEG_MARKER_EOI, sizeof(JPEG_MARKER_EOI));
-    totalSize += sizeof(JPEG_MARKER_EOI);
-    exifSize = totalSize;
 
+    // The main stream goes right after the EXIF, less its SOI marker, which
+    // is encoded over the end of the EXIF room and overwritten with it
+    unsigned char *mainStart = mJpegData + dataStart - sizeof(JPEG_MARKER_SOI);
+    if (mConfig.jpegChunkSize > 0 && mCallbacks.get() != NULL &&
+        mCallbacks->msgTypeEnabled(CAMERA_MSG_COMPRESSED_IMAGE))
+        startStream(dataStart, dataStart + maxMainSize);
+    compressor.setChunkSink(mStreaming ? &mChunkStreamer : NULL, mConfig.jpegChunkSize);
     if(!mConfig.jpegfromdriver) {
     // Convert and encode the main picture image
     // setup the JpegCompressor input and output buffers
         mEncoderInBuf.clear();
-        mEncoderInBuf.buf = (unsigned char *) mainBuf;
+        mEncoderInBuf.buf = (unsigned char *) yuv.data;
 
         mEncoderInBuf.width = mConfig.picture.width;
         mEncoderInBuf.height = mConfig.picture.height;
-        mEncoderInBuf.format = mConfig.picture.format;
-        mEncoderInBuf.stride = picture_stride;
-        mEncoderInBuf.alignHeight = alignPicHeight;
-        mEncoderInBuf.size = frameSize(mConfig.picture.format,
-                            picture_stride,
+        mEncoderInBuf.format = yuv.format;
+        mEncoderInBuf.stride = yuv.stride;
+        mEncoderInBuf.alignHeight = yuv.alignHeight;
+        mEncoderInBuf.size = frameSize(yuv.format,
+                            yuv.stride,
                             mConfig.picture.height);
         mEncoderOutBuf.clear();
-        mEncoderOutBuf.buf = (unsigned char*)mOutData;
+        mEncoderOutBuf.buf = mainStart;
         mEncoderOutBuf.width = mConfig.picture.width;
         mEncoderOutBuf.height = mConfig.picture.height;
         mEncoderOutBuf.quality = mConfig.picture.quality;
-        mEncoderOutBuf.size = mMaxOutDataSize;
+        mEncoderOutBuf.size = maxMainSize;
+        // a target size is for the whole file, the SOI and EXIF room take their part
+        if (mConfig.jpegTargetSize > 0) {
+            mEncoderOutBuf.targetSize = mConfig.jpegTargetSize - (dataStart - sizeof(JPEG_MARKER_SOI));
+            if (mEncoderOutBuf.targetSize < 1)
+                mEncoderOutBuf.targetSize = 1;
+        }
         endTime = systemTime();
         mainSize = compressor.encode(mEncoderInBuf, mEncoderOutBuf);
+        if (mainSize > mEncoderOutBuf.size) {
+            // bigger than predicted: the region grows to fit the picture,
+            // whose end the compressor kept, once the thumbnail is in it
+            if (thumbnail)
+                waitThumbnail();
+            if (growJpegRegion(sizeof(JPEG_MARKER_SOI) + MAX_EXIF_SIZE + sizeof(JPEG_MARKER_EOI) + mainSize) == NO_ERROR) {
+                compressor.copyOverflow(mJpegData + dataStart - sizeof(JPEG_MARKER_SOI) + mEncoderOutBuf.size);
+            } else {
+                mainSize = -1;
+            }
+        }
+    } else {
+        // the driver's stream has to be copied out of the driver buffer
+        // anyway, it is remuxed on the way: Huffman tables in, AVI1 out,
+        // and requantized if the quality asked for is below the frame's.
+        // A frame that can't be remuxed isn't a JPEG, and fails the shot
+        endTime = systemTime();
+        mainSize = mRemuxer.remux((const unsigned char *) driverJpeg, driverJpegSize,
+                                  mConfig.picture.quality, mainStart, maxMainSize);
+        if (mainSize < 0)
+            ALOGE("Could not remux the %d byte driver frame", driverJpegSize);
+    }
+    // a main stream the compressor didn't stream goes now
+    if (mStreaming && mainSize > (int)sizeof(JPEG_MARKER_SOI) && mStreamOffset == dataStart) {
+        streamChunks(dataStart, mJpegData + dataStart, mainSize - sizeof(JPEG_MARKER_SOI), 0);
+        mStreamOffset += mainSize - sizeof(JPEG_MARKER_SOI);
+    }
+    LOG1("Picture JPEG size: %d (time to encode: %ums, speed %s, %s backend, quality %d)", mainSize,
+         (unsigned)((systemTime() - endTime) / 1000000), mConfig.jpegfromdriver ? "remux" : speedName, backend,
+         mConfig.jpegfromdriver ? mConfig.picture.quality : compressor.getQuality());
+
+    int thumbSize = 0;
+    if (thumbnail) {
+        endTime = systemTime();
+        thumbSize = waitThumbnail();
+        LOG1("Thumbnail JPEG size: %d (waited %ums for it, %d bytes were reserved)", thumbSize,
+             (unsigned)((systemTime() - endTime) / 1000000), mThumbPrediction);
+        if (thumbSize > 0) {
+            mThumbPrediction = thumbSize + thumbSize / 4 + THUMB_MARGIN;
+        } else {
+            // This is not critical, we can continue with main picture image
+            ALOGE("Could not encode thumbnail stream!");
+            thumbSize = 0;
+        }
     }
-    LOG1("Picture JPEG size: %d (time to encode: %ums)", mainSize, (unsigned)((systemTime() - endTime) / 1000000));
+
     if (mainSize > 0) {
-        // We will skip SOI marker from final file
-        totalSize += (mainSize - sizeof(JPEG_MARKER_SOI));
+        dataStart = writeExif(baseExifSize, thumbSize, mainSize, dataStart);
     } else {
         ALOGE("Could not encode picture stream!");
         status = UNKNOWN_ERROR;
     }
 
+    // We skip the SOI marker of the main stream
+    int totalSize = dataStart + mainSize - sizeof(JPEG_MARKER_SOI);
     if (status == NO_ERROR) {
-        CameraMemoryAllocator::instance()->allocateMemory(destBuf,totalSize,mCallbacks.get());
-        if (destBuf->getData() == 0) {
+        // The client maps the JPEG where it was written
+        if (CameraMemoryAllocator::shareMemory(destBuf, mJpegFd, totalSize, mCallbacks.get()) < 0) {
             ALOGE("No memory for final JPEG file!");
             status = NO_MEMORY;
         }
     }
+    if (mStreaming) {
+        // the headers close the stream
+        if (status == NO_ERROR)
+            streamChunks(0, mJpegData, dataStart, COMPRESSED_CHUNK_LAST);
+        else
+            streamChunks(0, NULL, 0, COMPRESSED_CHUNK_ABORTED);
+    }
+    endStream();
     if (status == NO_ERROR) {
-        // Copy EXIF (it will also have the SOI and EOI markers
-        memcpy(destBuf->getData(), mExifBuf, exifSize);
-        // Copy the final JPEG stream into the final destination buffer, but exclude the SOI marker
-        char *copyTo = (char*)destBuf->getData() + exifSize;
-        if(!mConfig.jpegfromdriver) {
-            copyFrom = (char*)mOutData + sizeof(JPEG_MARKER_SOI);
-        } else {
-            copyFrom = (char*)mainBuf + sizeof(JPEG_MARKER_SOI);
-        }
-        memcpy(copyTo, copyFrom, mainSize - sizeof(JPEG_MARKER_SOI));
+        android_atomic_write(totalSize, &mAchievedJpegSize);
+        if (mConfig.jpegTargetSize > 0 && totalSize > mConfig.jpegTargetSize)
+            ALOGW("JPEG of %d bytes is over the %d byte target", totalSize, mConfig.jpegTargetSize);
     }
+    releaseJpegRegion();
     LOG1("Total JPEG size: %d (time to encode: %ums)", totalSize, (unsigned)((systemTime() - startTime) / 1000000));
     return status;
 }
 
+/*
+ * writeExif: writes the SOI marker and the EXIF in front of the main stream
+ *
+ * The EXIF normally fits the room left for it, whatever is left over is
+ * covered by the APP1 segment. A thumbnail bigger than the room makes the
+ * main stream move, unless it is being streamed, one too big for APP1 or
+ * the room of a streamed picture is left out.
+ *
+ * Returns where the main stream, less its SOI marker, starts now.
+ */
+int PictureThread::writeExif(unsigned int baseExifSize, int thumbSize, int mainSize, int dataStart)
+{
+    unsigned int exifSize = baseExifSize;
+    if (thumbSize > 0) {
+        exifSize += JpegEncoder::thumbnailExifSize(thumbSize);
+        if (exifSize > (unsigned int)MAX_EXIF_SIZE) {
+            ALOGE("Thumbnail of %d bytes doesn't fit the EXIF, leaving it out", thumbSize);
+            exifSize = baseExifSize;
+            thumbSize = 0;
+        }
+    }
+    if (mStreaming && sizeof(JPEG_MARKER_SOI) + exifSize + sizeof(JPEG_MARKER_EOI) > (unsigned int)dataStart) {
+        ALOGW("Thumbnail of %d bytes doesn't fit the room of a streamed picture, leaving it out", thumbSize);
+        exifSize = baseExifSize;
+        thumbSize = 0;
+    }
+    const int exifEnd = sizeof(JPEG_MARKER_SOI) + exifSize + sizeof(JPEG_MARKER_EOI);
+    if (exifEnd > dataStart) {
+        ALOGW("EXIF needs %d more bytes than reserved, moving the picture", exifEnd - dataStart);
+        memmove(mJpegData + exifEnd, mJpegData + dataStart, mainSize - sizeof(JPEG_MARKER_SOI));
+        dataStart = exifEnd;
+    }
+
+    unsigned char *currentPtr = mJpegData;
+    // Copy the SOI marker
+    memcpy(currentPtr, JPEG_MARKER_SOI, sizeof(JPEG_MARKER_SOI));
+    currentPtr += sizeof(JPEG_MARKER_SOI);
+    // a thumbnail that fit its slot is in place already
+    if (thumbSize <= mThumbSlotSize)
+        encoder.setThumbData(mJpegData + sizeof(JPEG_MARKER_SOI) + baseExifSize + JpegEncoder::thumbnailExifSize(0), thumbSize);
+    else
+        encoder.setThumbData(mOutData, thumbSize);
+    if (encoder.makeExif(currentPtr, &mConfig.exif, &exifSize, false) != JPG_SUCCESS)
+        ALOGE("Error making EXIF");
+    currentPtr += exifSize;
+    // Copy the EOI marker, and pad up to the main stream
+    memcpy(currentPtr, (void*)JPEG_MARKER_EOI, sizeof(JPEG_MARKER_EOI));
+    currentPtr += sizeof(JPEG_MARKER_EOI);
+    memset(currentPtr, 0, mJpegData + dataStart - currentPtr);
+
+    // makeExif() counts the APP1 marker in the segment length, so the
+    // segment covers the EOI marker; make it cover the padding too
+    if (exifSize > 0) {
+        const int length = dataStart - sizeof(JPEG_MARKER_SOI) - sizeof(JPEG_MARKER_EOI);
+        mJpegData[sizeof(JPEG_MARKER_SOI) + 2] = (length >> 8) & 0xFF;
+        mJpegData[sizeof(JPEG_MARKER_SOI) + 3] = length & 0xFF;
+    }
+    return dataStart;
+}
+
+/*
+ * Streaming: with a chunk size set, the JPEG goes to the client in
+ * CAMERA_MSG_COMPRESSED_IMAGE_CHUNK messages while it is made. The
+ * compressor hands out the main stream as the entropy coder fills it, less
+ * its SOI marker, which the EXIF replaces; the SOI and the EXIF in front
+ * of it go last, once the thumbnail is in, so the main stream must not
+ * move for them. A main stream the compressor doesn't stream, the one of
+ * the driver or one fitted to a target size, goes once it is complete.
+ * The chunks are buffers of one client memory, allocated for as many as
+ * the JPEG is expected to take.
+ */
+void PictureThread::startStream(int dataStart, int expectedBytes)
+{
+    LOG1("@%s: %d byte chunks", __FUNCTION__, mConfig.jpegChunkSize);
+    mStreaming = true;
+    mChunkCount = expectedBytes / mConfig.jpegChunkSize + 2;
+    mNextChunk = mChunkCount;
+    mStreamOffset = dataStart;
+    mStreamSkip = sizeof(JPEG_MARKER_SOI);
+}
+
+void PictureThread::streamMain(const unsigned char *data, int bytes)
+{
+    if (!mStreaming)
+        return;
+    if (mStreamSkip > 0) {
+        const int skip = (bytes < mStreamSkip) ? bytes : mStreamSkip;
+        data += skip;
+        bytes -= skip;
+        mStreamSkip -= skip;
+    }
+    if (bytes > 0) {
+        streamChunks(mStreamOffset, data, bytes, 0);
+        mStreamOffset += bytes;
+    }
+}
+
+// sends 'size' bytes at 'offset' in the file, as many chunks as they take
+void PictureThread::streamChunks(int offset, const unsigned char *data, int size, int flags)
+{
+    const int slotSize = sizeof(CompressedChunkHeader) + mConfig.jpegChunkSize;
+
+    do {
+        const int bytes = (size < mConfig.jpegChunkSize) ? size : mConfig.jpegChunkSize;
+        if (mNextChunk >= mChunkCount) {
+            if (mChunkMem != NULL)
+                mChunkMem->release(mChunkMem);
+            mChunkMem = mCallbacks->allocateMemory(slotSize, mChunkCount);
+            mNextChunk = 0;
+            if (mChunkMem == NULL || mChunkMem->data == NULL) {
+                ALOGE("No memory for %d JPEG chunks, streaming stops", mChunkCount);
+                mChunkMem = NULL;
+                mStreaming = false;
+                return;
+            }
+        }
+        CompressedChunkHeader header;
+        header.offset = offset;
+        header.size = bytes;
+        header.flags = (bytes == size) ? flags : 0;
+        unsigned char *slot = (unsigned char *) mChunkMem->data + mNextChunk * slotSize;
+        memcpy(slot, &header, sizeof(header));
+        if (bytes > 0)
+            memcpy(slot + sizeof(header), data, bytes);
+        mCallbacks->compressedChunkDone(mChunkMem, mNextChunk++);
+        offset += bytes;
+        data += bytes;
+        size -= bytes;
+    } while (size > 0);
+}
+
+void PictureThread::endStream()
+{
+    // the client keeps the memory of the chunks in flight
+    if (mChunkMem != NULL)
+        mChunkMem->release(mChunkMem);
+    mChunkMem = NULL;
+    mStreaming = false;
+}
 
-status_t PictureThread::encode(CameraBuffer *snaphotBuf,CameraBuffer *interBuf, CameraBuffer *postviewBuf)
+/*
+ * createJpegRegion: creates the shared memory the final JPEG is written into
+ *
+ * The client maps the very same region once the JPEG is complete, so the
+ * compressed picture is never copied. A region is used for one picture
+ * only, since the client may still read it while the next one is encoded.
+ * It is sized for the JPEG the picture is expected to make, see
+ * JpegCompressor::predictSize(), and grows if the picture makes more.
+ */
+status_t PictureThread::createJpegRegion(int size)
+{
+    LOG1("@%s: size = %d", __FUNCTION__, size);
+    releaseJpegRegion();
+
+    mJpegFd = ashmem_create_region("Camera_Jpeg", size);
+    if (mJpegFd < 0) {
+        ALOGE("Could not create a JPEG region of %d bytes", size);
+        return NO_MEMORY;
+    }
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mJpegFd, 0);
+    if (data == MAP_FAILED) {
+        ALOGE("Could not map the JPEG region: %s", strerror(errno));
+        close(mJpegFd);
+        mJpegFd = -1;
+        return NO_MEMORY;
+    }
+    mJpegData = (unsigned char *)data;
+    mJpegDataSize = size;
+    return NO_ERROR;
+}
+
+// moves the content of the JPEG region to a new, bigger one
+status_t PictureThread::growJpegRegion(int size)
+{
+    LOG1("@%s: %d -> %d bytes", __FUNCTION__, mJpegDataSize, size);
+    int oldFd = mJpegFd;
+    unsigned char *oldData = mJpegData;
+    int oldSize = mJpegDataSize;
+
+    mJpegFd = -1;
+    mJpegData = NULL;
+    mJpegDataSize = 0;
+    status_t status = createJpegRegion(size);
+    if (status == NO_ERROR)
+        memcpy(mJpegData, oldData, oldSize);
+    munmap(oldData, oldSize);
+    close(oldFd);
+    return status;
+}
+
+// drops this thread's hold on the JPEG region, the client keeps its own
+void PictureThread::releaseJpegRegion()
+{
+    if (mJpegData != NULL) {
+        munmap(mJpegData, mJpegDataSize);
+        mJpegData = NULL;
+        mJpegDataSize = 0;
+    }
+    if (mJpegFd >= 0) {
+        close(mJpegFd);
+        mJpegFd = -1;
+    }
+}
+
+
+status_t PictureThread::encode(CameraBuffer *snaphotBuf,CameraBuffer *interBuf)
 {
     LOG1("@%s", __FUNCTION__);
     Message msg;
     msg.id = MESSAGE_ID_ENCODE;
     msg.data.encode.snaphotBuf = snaphotBuf;
     msg.data.encode.interBuf = interBuf;
-    msg.data.encode.postviewBuf = postviewBuf;
     status_t ret = INVALID_OPERATION;
     if (snaphotBuf != 0)
         snaphotBuf->incrementProcessor();
     if (interBuf != 0)
         interBuf->incrementProcessor();
-    if (postviewBuf != 0)
-        postviewBuf->incrementProcessor();
     if ((ret = mMessageQueue.send(&msg)) != NO_ERROR) {
         if (snaphotBuf != 0)
             snaphotBuf->decrementProcessor();
         if (interBuf != 0)
             interBuf->decrementProcessor();
-        if (postviewBuf != 0)
-            postviewBuf->decrementProcessor();
     }
     return ret;
 }
 
+const char PictureThread::KEY_JPEG_SPEED[] = "intel-jpeg-speed";
+const char PictureThread::KEY_SUPPORTED_JPEG_SPEEDS[] = "intel-jpeg-speed-values";
+const char PictureThread::KEY_JPEG_TARGET_SIZE[] = "intel-jpeg-target-size";
+const char PictureThread::KEY_JPEG_ACHIEVED_SIZE[] = "intel-jpeg-achieved-size";
+const char PictureThread::KEY_JPEG_CHUNK_SIZE[] = "intel-jpeg-chunk-size";
+
+bool PictureThread::parseJpegSpeed(const char *value, JpegSpeed *speed)
+{
+    static const JpegSpeed speeds[] = { JPEG_SPEED_FAST, JPEG_SPEED_BALANCED, JPEG_SPEED_QUALITY };
+
+    for (unsigned int i = 0; value != NULL && i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (strcmp(value, SWJpegEncoder::jpegSpeedName(speeds[i])) == 0) {
+            *speed = speeds[i];
+            return true;
+        }
+    }
+    return false;
+}
+
 void PictureThread::getDefaultParameters(CameraParameters *params)
 {
     LOG1("@%s", __FUNCTION__);
@@ -226,20 +515,26 @@ void PictureThread::getDefaultParameters(CameraParameters *params)
             CameraParameters::PIXEL_FORMAT_JPEG);
     params->set(CameraParameters::KEY_JPEG_QUALITY, "80");
     params->set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, "50");
+    params->set(KEY_JPEG_SPEED, SWJpegEncoder::jpegSpeedName(JPEG_SPEED_BALANCED));
+    params->set(KEY_SUPPORTED_JPEG_SPEEDS, "fast,balanced,quality");
+    params->set(KEY_JPEG_TARGET_SIZE, "0");
+    params->set(KEY_JPEG_CHUNK_SIZE, "0");
 }
 
 void PictureThread::setConfig(Config *config)
 {
+    // a thumbnail of another size or quality has nothing to do with the last one
+    if (mConfig.thumbnail.width != config->thumbnail.width ||
+        mConfig.thumbnail.height != config->thumbnail.height ||
+        mConfig.thumbnail.quality != config->thumbnail.quality ||
+        mThumbPrediction == 0)
+        mThumbPrediction = config->thumbnail.width * config->thumbnail.height / 4;
     mConfig = *config;
-    if(mOutData != NULL)
-        delete []mOutData;
-    mMaxOutDataSize = (mConfig.picture.width * mConfig.picture.height * 3/2);
-    if(mMaxOutDataSize != 0)
-        mOutData = new unsigned char[mMaxOutDataSize];
-
-    if (mExifBuf != NULL)
-        delete mExifBuf;
-    mExifBuf = new unsigned char[MAX_EXIF_SIZE];
+}
+
+int PictureThread::getAchievedJpegSize() const
+{
+    return android_atomic_acquire_load(&mAchievedJpegSize);
 }
 
 status_t PictureThread::flushBuffers()
@@ -259,18 +554,56 @@ status_t PictureThread::handleMessageExit()
     return status;
 }
 
+// converts/scales the snapshot into a gralloc surface, along the planned chain
+status_t PictureThread::convertSnapshot(CameraBuffer *src, CameraBuffer *dst, int dstFormat)
+{
+    LOG1("@%s", __FUNCTION__);
+    ConvertRequest request;
+    ConvertBuffers buffers;
+    RenderTarget *dstRT = dst->GetRenderTargetHandle();
+
+    // MJPEG frames are decoded into YUV422H gralloc buffers, YUYV ones come straight from the driver
+    request.srcFormat = mConfig.snapshotFormat;
+    if (mConfig.snapshotFormat == V4L2_PIX_FMT_YUV422P) {
+        RenderTarget *srcRT = src->GetRenderTargetHandle();
+        request.srcWidth = srcRT->rect.width;
+        request.srcHeight = srcRT->rect.height;
+        request.srcStride = src->GetGraStride();
+        request.srcSurface = true;
+    } else {
+        request.srcWidth = mConfig.snapshotWidth;
+        request.srcHeight = mConfig.snapshotHeight;
+        request.srcStride = mConfig.snapshotWidth;
+        request.srcSurface = false;
+    }
+    request.dstFormat = dstFormat;
+    request.dstWidth = dstRT->rect.width;
+    request.dstHeight = dstRT->rect.height;
+    request.dstSurface = true;
+    request.midFormat = 0;
+
+    buffers.src = src;
+    buffers.mid = NULL;
+    buffers.dst = dst;
+    buffers.vpp = mVaConvertor;
+    return ColorConvertPlanner::instance()->run(request, buffers);
+}
+
 status_t PictureThread::handleMessageEncode(MessageEncode *msg)
 {
     LOG1("@%s: snapshot ID = %d", __FUNCTION__, msg->snaphotBuf->getID());
     status_t status = NO_ERROR;
     CameraBuffer jpegBuf;
     void *snapshotbuff[3];
-    void *thumbnailbuff[3];
-    void *mainbuf = NULL;
-    int mainSize = 0;
     int size=0;
-    int alignPicHeight=0;
-    int alignThumbnailHeight=0;
+    bool locked = false;
+    YuvImage yuv;
+    // Without an intermediate YV12 surface the picture is encoded as 4:2:2
+    // straight from the 422H snapshot. A driver JPEG comes with its 422H
+    // decode, which the thumbnail is made from
+    const bool native = !mConfig.jpegfromdriver && msg->interBuf == NULL;
+    CameraBuffer *yuvBuf = native ? msg->snaphotBuf : msg->interBuf;
+    const int yuvFormat = (mConfig.jpegfromdriver || native) ? V4L2_PIX_FMT_YUV422P : V4L2_PIX_FMT_YUV420;
 
     if (mConfig.picture.width == 0 ||
         mConfig.picture.height == 0 ||
@@ -279,87 +612,62 @@ status_t PictureThread::handleMessageEncode(MessageEncode *msg)
         if (msg->snaphotBuf != NULL)
         {
            msg->snaphotBuf->decrementProcessor();
-           msg->interBuf->decrementProcessor();
+           if (msg->interBuf != NULL)
+               msg->interBuf->decrementProcessor();
         }
         return UNKNOWN_ERROR;
     }
-    if((msg->snaphotBuf == NULL) || (msg->interBuf == NULL))
+    if((msg->snaphotBuf == NULL) || (yuvBuf == NULL))
     {
         ALOGE("snaphotBuf or interBuf is NULL!");
+        if (msg->snaphotBuf != NULL)
+            msg->snaphotBuf->decrementProcessor();
+        if (msg->interBuf != NULL)
+            msg->interBuf->decrementProcessor();
         return UNKNOWN_ERROR;
     }
 
     // Encode the image
-    alignPicHeight = msg->interBuf->GetRenderTargetHandle()->height;
-    if(!mConfig.jpegfromdriver) {
-        mVaConvertor->VPPBitBlit(msg->snaphotBuf->GetRenderTargetHandle(),msg->interBuf->GetRenderTargetHandle());
+    if(!mConfig.jpegfromdriver && !native) {
+        status = convertSnapshot(msg->snaphotBuf, msg->interBuf, V4L2_PIX_FMT_YUV420);
+        if (status != NO_ERROR)
+            ALOGE("Could not convert the snapshot for the encoder!");
     }
-    if(mConfig.exif.enableThumb)
-    {
-         if(msg->postviewBuf == NULL)
-         {
-             ALOGE("postviewBuf is NULL!");
-             return UNKNOWN_ERROR;
-         }
-         alignThumbnailHeight = mConfig.thumbnail.height;
-
-         mVaConvertor->VPPBitBlit(msg->interBuf->GetRenderTargetHandle(),msg->postviewBuf->GetRenderTargetHandle());
-         status = msg->postviewBuf->LockGrallocData(thumbnailbuff,&size);
-         if (status != NO_ERROR) {
-             LOGE("lock data failed,ret=%d, in line %d",status, __LINE__);
-         }
-         if(!mConfig.jpegfromdriver) {
-             status = msg->interBuf->LockGrallocData(snapshotbuff,&size);
-             if (status != NO_ERROR) {
-                 LOGE("lock data failed,ret=%d, in line %d",status, __LINE__);
-             }
-             mainbuf = snapshotbuff[0];
-             mainSize = size;
-         } else {
-             mainbuf = msg->snaphotBuf->getData();
-             mainSize = msg->snaphotBuf->getDataSize();
-         }
-         if ((status = encodeToJpeg(mainbuf, mainSize, thumbnailbuff[0], &jpegBuf,msg->interBuf->GetGraStride(),msg->postviewBuf->GetGraStride(),alignPicHeight,alignThumbnailHeight)) == NO_ERROR) {
-               mCallbacks->compressedRawFrameDone(msg->snaphotBuf);
-               mCallbacks->compressedFrameDone(&jpegBuf);
-         } else {
-           ALOGE("Error generating JPEG image!");
-         }
-         msg->postviewBuf->UnLockGrallocData();
-         if(!mConfig.jpegfromdriver) {
-             msg->interBuf->UnLockGrallocData();
-         }
+    memset(&yuv, 0, sizeof(yuv));
+    if (status == NO_ERROR && (!mConfig.jpegfromdriver || mConfig.exif.enableThumb)) {
+        status_t lockStatus = yuvBuf->LockGrallocData(snapshotbuff,&size);
+        if (lockStatus != NO_ERROR) {
+            LOGE("lock data failed,ret=%d, in line %d",lockStatus, __LINE__);
+            if (!mConfig.jpegfromdriver)
+                status = lockStatus;
+        } else {
+            locked = true;
+            yuv.data = snapshotbuff[0];
+            yuv.format = yuvFormat;
+            yuv.width = yuvBuf->GetRenderTargetHandle()->rect.width;
+            yuv.height = yuvBuf->GetRenderTargetHandle()->rect.height;
+            yuv.stride = yuvBuf->GetGraStride();
+            yuv.alignHeight = yuvBuf->GetRenderTargetHandle()->height;
+        }
     }
-    else
-    {
-         if(!mConfig.jpegfromdriver) {
-            status = msg->interBuf->LockGrallocData(snapshotbuff,&size);
-            if (status != NO_ERROR) {
-                LOGE("lock data failed,ret=%d, in line %d",status, __LINE__);
-            }
-            mainbuf = snapshotbuff[0];
-            mainSize = size;
-         } else {
-            mainbuf = msg->snaphotBuf->getData();
-            mainSize = msg->snaphotBuf->getDataSize();
-         }
-         if ((status = encodeToJpeg(mainbuf, mainSize, NULL, &jpegBuf,msg->interBuf->GetGraStride(),0,alignPicHeight,0)) == NO_ERROR) {
-               mCallbacks->compressedRawFrameDone(msg->snaphotBuf);
-               mCallbacks->compressedFrameDone(&jpegBuf);
-         } else {
-           ALOGE("Error generating JPEG image!");
-         }
-         if(!mConfig.jpegfromdriver) {
-             msg->interBuf->UnLockGrallocData();
-         }
+    if (status == NO_ERROR) {
+        void *driverJpeg = mConfig.jpegfromdriver ? msg->snaphotBuf->getData() : NULL;
+        int driverJpegSize = mConfig.jpegfromdriver ? msg->snaphotBuf->getDataSize() : 0;
+        if ((status = encodeToJpeg(yuv, driverJpeg, driverJpegSize, &jpegBuf)) == NO_ERROR) {
+            mCallbacks->compressedRawFrameDone(msg->snaphotBuf);
+            mCallbacks->compressedFrameDone(&jpegBuf);
+        } else {
+            ALOGE("Error generating JPEG image!");
+        }
     }
+    if (locked)
+        yuvBuf->UnLockGrallocData();
+
     // When the encoding is done, send back the buffers to camera
     if (msg->snaphotBuf != NULL)
         msg->snaphotBuf->decrementProcessor();
     if (msg->interBuf!= NULL)
         msg->interBuf->decrementProcessor();
-    if (msg->postviewBuf!= NULL)
-        msg->postviewBuf->decrementProcessor();
 
     LOG1("Releasing jpegBuf @%p", jpegBuf.getData());
     jpegBuf.releaseMemory();
@@ -367,6 +675,151 @@ status_t PictureThread::handleMessageEncode(MessageEncode *msg)
     return status;
 }
 
+/*
+ * Thumbnail worker
+ *
+ * The thumbnail is box scaled on the CPU from the image the main picture is
+ * encoded from, and encoded with its own SWJpegEncoder into its slot in the
+ * EXIF, all while the main picture is encoded. One too big for the slot
+ * ends up in mOutData instead. The source stays locked, and the JPEG region
+ * where it is, until waitThumbnail() returns.
+ */
+
+void PictureThread::startThumbnail(const YuvImage *yuv, unsigned char *slot, int slotSize)
+{
+    LOG2("@%s", __FUNCTION__);
+    Mutex::Autolock lock(mThumbLock);
+    if (mThumbWorker.get() == NULL) {
+        sp<ThumbnailWorker> worker = new ThumbnailWorker(this);
+        if (worker->run("CamHAL_THUMBNAIL") == NO_ERROR)
+            mThumbWorker = worker;
+        else
+            ALOGE("Could not start the thumbnail worker, encoding the thumbnail in line");
+    }
+    mThumbSource = yuv;
+    mThumbSlot = slot;
+    mThumbSlotSize = (slotSize > 0) ? slotSize : 0;
+    mThumbSize = -1;
+    mThumbCondition.broadcast();
+}
+
+// returns the size of the thumbnail JPEG, in its slot if it fit, in
+// mOutData if not, -1 if it failed
+int PictureThread::waitThumbnail()
+{
+    LOG2("@%s", __FUNCTION__);
+    Mutex::Autolock lock(mThumbLock);
+    if (mThumbWorker.get() == NULL && mThumbSource != NULL) {
+        mThumbSize = encodeThumbnail(*mThumbSource, mThumbSlot, mThumbSlotSize);
+        mThumbSource = NULL;
+    }
+    while (mThumbSource != NULL)
+        mThumbCondition.wait(mThumbLock);
+    return mThumbSize;
+}
+
+bool PictureThread::thumbnailLoop()
+{
+    const YuvImage *yuv;
+    unsigned char *slot;
+    int slotSize;
+    {
+        Mutex::Autolock lock(mThumbLock);
+        while (!mThumbExiting && mThumbSource == NULL)
+            mThumbCondition.wait(mThumbLock);
+        if (mThumbExiting)
+            return false;
+        yuv = mThumbSource;
+        slot = mThumbSlot;
+        slotSize = mThumbSlotSize;
+    }
+
+    int size = encodeThumbnail(*yuv, slot, slotSize);
+
+    Mutex::Autolock lock(mThumbLock);
+    mThumbSize = size;
+    mThumbSource = NULL;
+    mThumbCondition.broadcast();
+    return true;
+}
+
+int PictureThread::encodeThumbnail(const YuvImage &yuv, unsigned char *slot, int slotSize)
+{
+    LOG1("@%s", __FUNCTION__);
+    const int width = mConfig.thumbnail.width;
+    const int height = mConfig.thumbnail.height;
+    // packed YV12, as colorConvertScaled() writes it, and a row of slack
+    // for the MCU rows libjpeg reads past the bottom
+    const int chromaStride = ALIGN(width / 2, 16);
+    const int yuvSize = width * height + chromaStride * height + ALIGN(width, 16);
+    int jpegSize = -1;
+
+    if (yuvSize > mThumbYuvSize) {
+        delete [] mThumbYuv;
+        mThumbYuv = new unsigned char[yuvSize];
+        mThumbYuvSize = yuvSize;
+    }
+
+    // a box filter is exact, and cheaper, once every output pixel covers
+    // whole source pixels
+    ColorScaleFilter filter = (yuv.width >= 2 * width && yuv.height >= 2 * height) ?
+                              COLOR_SCALE_BOX : COLOR_SCALE_BILINEAR;
+    status_t status = colorConvertScaled(yuv.format, V4L2_PIX_FMT_YUV420, yuv.stride,
+                                         yuv.width, yuv.alignHeight, yuv.height, yuv.data,
+                                         width, height, mThumbYuv, filter);
+    if (status != NO_ERROR) {
+        ALOGE("Could not scale the thumbnail: %d", status);
+        return -1;
+    }
+
+    SWJpegEncoder::YuvPlanes planes;
+    planes.y = mThumbYuv;
+    planes.v = planes.y + width * height;
+    planes.u = planes.v + chromaStride * height / 2;
+    planes.yStride = width;
+    planes.uvStride = chromaStride;
+    planes.format = V4L2_PIX_FMT_YUV420;
+    planes.uncached = false;
+
+    mThumbEncoder.init();
+    mThumbEncoder.setJpegQuality(mConfig.thumbnail.quality);
+    mThumbEncoder.setJpegSpeed(mConfig.jpegSpeed);
+    mThumbEncoder.setInputFormat(V4L2_PIX_FMT_YUV420);
+    if (slot == NULL || slotSize <= 0) {
+        slot = mOutData;
+        slotSize = MAX_EXIF_SIZE;
+    }
+    if (mThumbEncoder.configEncoding(width, height, slot, slotSize) == 0 &&
+        mThumbEncoder.doJpegEncoding(planes) == 0)
+        mThumbEncoder.getJpegSize(&jpegSize);
+    // the thumbnail has to fit in the EXIF
+    if (jpegSize > MAX_EXIF_SIZE) {
+        ALOGE("Thumbnail of %d bytes is too big for the EXIF", jpegSize);
+        jpegSize = -1;
+    } else if (jpegSize > slotSize) {
+        // past its slot, where the main picture goes: it moves to mOutData
+        LOG1("Thumbnail of %d bytes overflowed its %d byte slot", jpegSize, slotSize);
+        memcpy(mOutData, slot, slotSize);
+        mThumbEncoder.copyOverflow(mOutData + slotSize);
+    }
+    mThumbEncoder.deInit();
+    return jpegSize;
+}
+
+void PictureThread::stopThumbnailWorker()
+{
+    sp<ThumbnailWorker> worker;
+    {
+        Mutex::Autolock lock(mThumbLock);
+        mThumbExiting = true;
+        mThumbCondition.broadcast();
+        worker = mThumbWorker;
+        mThumbWorker.clear();
+    }
+    if (worker.get() != NULL)
+        worker->requestExitAndWait();
+}
+
 status_t PictureThread::handleMessageFlush()
 {
     LOG1("@%s", __FUNCTION__);
@@ -22,6 +22,7 @@
 #include "MessageQueue.h"
 #include "CameraCommon.h"
 #include "JpegCompressor.h"
+#include "JpegRemuxer.h"
 #include "JpegEncoder.h" // for EXIF
 #include "VAConvertor.h"
 
@@ -55,15 +56,39 @@ public:
         Image thumbnail;
         exif_attribute_t exif;
         bool jpegfromdriver;
+        JpegSpeed jpegSpeed;
+        int jpegTargetSize;     // bytes the whole JPEG has to fit in, 0 for none
+        int jpegChunkSize;      // bytes of the chunks the JPEG is streamed in, 0 for none
+        // the frame an intermediate buffer is converted from: a YUYV driver
+        // frame or a YUV422H surface (V4L2_PIX_FMT_YUV422P), and its size
+        int snapshotFormat;
+        int snapshotWidth;
+        int snapshotHeight;
     };
 
+    // vendor parameter selecting the speed profile of the SW jpeg encoder
+    static const char KEY_JPEG_SPEED[];
+    static const char KEY_SUPPORTED_JPEG_SPEEDS[];
+    // parses a KEY_JPEG_SPEED value, false if it is not one
+    static bool parseJpegSpeed(const char *value, JpegSpeed *speed);
+    // vendor parameters: bytes the JPEG has to fit in, lowering the quality
+    // as needed (0 for none), and the bytes the last JPEG took, read only
+    static const char KEY_JPEG_TARGET_SIZE[];
+    static const char KEY_JPEG_ACHIEVED_SIZE[];
+    // vendor parameter: bytes of the CAMERA_MSG_COMPRESSED_IMAGE_CHUNK
+    // messages the JPEG is streamed in as it is encoded, 0 for none
+    static const char KEY_JPEG_CHUNK_SIZE[];
+    static const int MIN_JPEG_CHUNK_SIZE = 4096;
+
 // public methods
 public:
 
-    status_t encode(CameraBuffer *snaphotBuf,CameraBuffer *interBuf=NULL,CameraBuffer *postviewBuf = NULL);
+    status_t encode(CameraBuffer *snaphotBuf,CameraBuffer *interBuf=NULL);
     void getDefaultParameters(CameraParameters *params);
     void setConfig(Config *config);
     status_t flushBuffers();
+    // bytes of the last JPEG, 0 before the first one
+    int getAchievedJpegSize() const;
 
     void setCallbacks(sp<Callbacks> &callbacks) { mCallbacks = callbacks; }
 
@@ -88,7 +113,6 @@ private:
     struct MessageEncode {
         CameraBuffer *snaphotBuf;
         CameraBuffer *interBuf;
-        CameraBuffer *postviewBuf;
     };
 
     // union of all message data
@@ -104,6 +128,34 @@ private:
         MessageData data;
     };
 
+    // a locked YUV surface, YV12 or 422H
+    struct YuvImage {
+        void *data;
+        int format;
+        int width;
+        int height;
+        int stride;
+        int alignHeight;
+    };
+
+    // scales and encodes the thumbnail while the main picture is encoded
+    class ThumbnailWorker : public Thread {
+    public:
+        ThumbnailWorker(PictureThread *owner) : Thread(false), mOwner(owner) {}
+    private:
+        virtual bool threadLoop() { return mOwner->thumbnailLoop(); }
+        PictureThread *mOwner;
+    };
+
+    // hands the main stream to the client as the compressor produces it
+    class ChunkStreamer : public JpegChunkSink {
+    public:
+        ChunkStreamer(PictureThread *owner) : mOwner(owner) {}
+    private:
+        virtual void jpegChunk(const unsigned char *data, int bytes) { mOwner->streamMain(data, bytes); }
+        PictureThread *mOwner;
+    };
+
 // private methods
 private:
 
@@ -115,7 +167,25 @@ private:
     // main message function
     status_t waitForAndExecuteMessage();
 
-    status_t encodeToJpeg(void *mainBuf, int mainSize, void *thumbBuf, CameraBuffer *destBuf,int picture_stride,int thumbnail_stride,int alignPicHeight,int alignThumHeight);
+    status_t encodeToJpeg(const YuvImage &yuv, void *driverJpeg, int driverJpegSize, CameraBuffer *destBuf);
+    status_t convertSnapshot(CameraBuffer *src, CameraBuffer *dst, int dstFormat);
+    status_t createJpegRegion(int size);
+    status_t growJpegRegion(int size);
+    void releaseJpegRegion();
+    int writeExif(unsigned int baseExifSize, int thumbSize, int mainSize, int dataStart);
+
+    // thumbnail worker
+    void startThumbnail(const YuvImage *yuv, unsigned char *slot, int slotSize);
+    int waitThumbnail();
+    bool thumbnailLoop();
+    int encodeThumbnail(const YuvImage &yuv, unsigned char *slot, int slotSize);
+    void stopThumbnailWorker();
+
+    // streaming
+    void startStream(int dataStart, int expectedBytes);
+    void streamMain(const unsigned char *data, int bytes);
+    void streamChunks(int offset, const unsigned char *data, int size, int flags);
+    void endStream();
 
 // inherited from Thread
 private:
@@ -131,9 +201,34 @@ private:
     JpegCompressor compressor;
     JpegCompressor::InputBuffer mEncoderInBuf;
     JpegCompressor::OutputBuffer mEncoderOutBuf;
-    unsigned char* mOutData; //temporary buffer to hold output data
-    int mMaxOutDataSize;
-    unsigned char* mExifBuf;//temporary buffer to hold exif data
+    unsigned char* mOutData; // a thumbnail JPEG too big for its slot, MAX_EXIF_SIZE bytes
+    int mJpegFd;                // ashmem region the final JPEG is written into
+    unsigned char* mJpegData;   // its mapping
+    int mJpegDataSize;
+    int mThumbPrediction;       // bytes reserved for the next thumbnail JPEG
+    volatile int32_t mAchievedJpegSize; // bytes of the last JPEG, read by the control thread
+
+    ChunkStreamer mChunkStreamer;
+    bool mStreaming;            // the JPEG being encoded is streamed
+    camera_memory_t *mChunkMem; // buffers the chunks are sent in
+    int mChunkCount;            // of them
+    int mNextChunk;
+    int mStreamOffset;          // where the next bytes of the main stream go in the file
+    int mStreamSkip;            // bytes of the main stream not sent, its SOI
+
+    JpegRemuxer mRemuxer;       // makes the picture out of the driver JPEG
+
+    SWJpegEncoder mThumbEncoder;
+    unsigned char *mThumbYuv;   // the scaled thumbnail, packed YV12
+    int mThumbYuvSize;
+    sp<ThumbnailWorker> mThumbWorker;
+    Mutex mThumbLock;           // protects everything below
+    Condition mThumbCondition;  // signalled when a thumbnail is posted or done, and on exit
+    const YuvImage *mThumbSource; // image the thumbnail is scaled from, NULL when idle
+    unsigned char *mThumbSlot;  // where the thumbnail JPEG goes in the EXIF of the JPEG region
+    int mThumbSlotSize;         // bytes it has there
+    int mThumbSize;             // JPEG bytes of the thumbnail, -1 if it failed
+    bool mThumbExiting;
     Config mConfig;
     VAConvertor *mVaConvertor;
     int mInputFormat;
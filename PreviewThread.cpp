@@ -20,6 +20,7 @@
 #include "DebugFrameRate.h"
 #include "Callbacks.h"
 #include "ColorConverter.h"
+#include "ColorConvertPlanner.h"
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferMapper.h>
 #include "CameraCommon.h"
@@ -37,6 +38,8 @@ PreviewThread::PreviewThread() :
     ,mPreviewWindow(NULL)
     ,mPreviewWidth(640)
     ,mPreviewHeight(480)
+    ,mInputWidth(640)
+    ,mInputHeight(480)
     ,mInputFormat(0)
     ,mOutputFormat(0)
     ,mGFXHALPixelFormat(HAL_PIXEL_FORMAT_YCbCr_422_I)
@@ -64,7 +67,7 @@ status_t PreviewThread::setPreviewWindow(struct preview_stream_ops *window)
     return mMessageQueue.send(&msg);
 }
 status_t PreviewThread::setPreviewConfig(int preview_width, int preview_height,
-        int input_format, int output_format)
+        int input_format, int output_format, int input_width, int input_height)
 {
     LOG1("@%s", __FUNCTION__);
     Message msg;
@@ -73,6 +76,8 @@ status_t PreviewThread::setPreviewConfig(int preview_width, int preview_height,
     msg.data.setPreviewConfig.height = preview_height;
     msg.data.setPreviewConfig.inputFormat = input_format;
     msg.data.setPreviewConfig.outputFormat = output_format;
+    msg.data.setPreviewConfig.inputWidth = input_width;
+    msg.data.setPreviewConfig.inputHeight = input_height;
     return mMessageQueue.send(&msg);
 }
 
@@ -177,33 +182,7 @@ exit:
 
     if (mCallbacks->msgTypeEnabled(CAMERA_MSG_PREVIEW_FRAME)&& (msg->outputBuff))
     {
-        void *srcaddr[3];
-        int size = 0;
-        int alignHeight = 0;
-
-        alignHeight = msg->midConvert->GetRenderTargetHandle()->height;
-
-        if(mOutputFormat == V4L2_PIX_FMT_NV21)
-        {
-           //currently, vpp don't support colorconvert from yuv422h to nv21, so convert to yv12 with vpp, and then convert from yv12 to NV21
-           mVaConvertor->VPPBitBlit(msg->inputBuff->GetRenderTargetHandle(),msg->midConvert->GetRenderTargetHandle());
-           status = msg->midConvert->LockGrallocData((void**)&srcaddr,&size);
-           if (status != NO_ERROR) {
-              LOGE("lock data failed,ret=%d, in line %d",status, __LINE__);
-           }
-           colorConvertwithStride(V4L2_PIX_FMT_YUV420,mOutputFormat,msg->midConvert->GetGraStride(),mPreviewWidth,alignHeight,mPreviewHeight,srcaddr[0],msg->outputBuff->getData());
-           msg->midConvert->UnLockGrallocData();
-        }
-        else
-        {
-           mVaConvertor->VPPBitBlit(msg->inputBuff->GetRenderTargetHandle(),msg->midConvert->GetRenderTargetHandle());
-           status  = msg->midConvert->LockGrallocData((void**)&srcaddr,&size);
-           if (status != NO_ERROR) {
-               LOGE("lock data failed,ret=%d, in line %d",status, __LINE__);
-           }
-           colorConvertwithStride(mOutputFormat,mOutputFormat,msg->midConvert->GetGraStride(),mPreviewWidth,alignHeight,mPreviewHeight,srcaddr[0],msg->outputBuff->getData());
-           msg->midConvert->UnLockGrallocData();
-        }
+        status = convertCallbackFrame(msg);
         mCallbacks->previewFrameDone(msg->outputBuff);
     }
     if(msg->inputBuff)
@@ -217,6 +196,37 @@ exit:
 
 
 
+/**
+ * Fills the preview callback buffer (mPreviewWidth x mPreviewHeight, in
+ * mOutputFormat) from the driver frame (mInputWidth x mInputHeight), along
+ * the cheapest chain the planner finds. The mid conversion buffer is a
+ * gralloc surface the chain may go through.
+ */
+status_t PreviewThread::convertCallbackFrame(MessagePreview *msg)
+{
+    LOG2("@%s", __FUNCTION__);
+    ConvertRequest request;
+    ConvertBuffers buffers;
+
+    // MJPEG frames are decoded into YUV422H gralloc buffers, YUYV ones come straight from the driver
+    request.srcFormat = mPictureMode ? V4L2_PIX_FMT_YUV422P : V4L2_PIX_FMT_YUYV;
+    request.srcWidth = mInputWidth;
+    request.srcHeight = mInputHeight;
+    request.srcStride = mPictureMode ? msg->inputBuff->GetGraStride() : mInputWidth;
+    request.srcSurface = mPictureMode;
+    request.dstFormat = mOutputFormat;
+    request.dstWidth = mPreviewWidth;
+    request.dstHeight = mPreviewHeight;
+    request.dstSurface = false;
+    request.midFormat = msg->midConvert ? ColorConvertPlanner::surfaceFormat(mOutputFormat) : 0;
+
+    buffers.src = msg->inputBuff;
+    buffers.mid = msg->midConvert;
+    buffers.dst = msg->outputBuff;
+    buffers.vpp = mVaConvertor;
+    return ColorConvertPlanner::instance()->run(request, buffers);
+}
+
 status_t PreviewThread::handleMessageSetPreviewWindow(MessageSetPreviewWindow *msg)
 {
     LOG1("@%s: window = %p", __FUNCTION__, msg->window);
@@ -259,6 +269,8 @@ status_t PreviewThread::handleMessageSetPreviewConfig(MessageSetPreviewConfig *m
         mPreviewHeight = msg->height;
     }
 
+    mInputWidth = (msg->inputWidth > 0) ? msg->inputWidth : mPreviewWidth;
+    mInputHeight = (msg->inputHeight > 0) ? msg->inputHeight : mPreviewHeight;
     mInputFormat = msg->inputFormat;
     mOutputFormat = msg->outputFormat;
 
@@ -47,7 +47,8 @@ public:
     void setPictureMode (bool mode);
     status_t preview(CameraBuffer *inputBuff, CameraBuffer *outputBuff,CameraBuffer *midConvert);
     status_t setPreviewWindow(struct preview_stream_ops *window);
-    status_t setPreviewConfig(int preview_width, int preview_height, int input_format, int output_format);
+    status_t setPreviewConfig(int preview_width, int preview_height, int input_format, int output_format,
+                              int input_width = 0, int input_height = 0);
     status_t flushBuffers();
     void setCallbacks(sp<Callbacks> &callbacks) { mCallbacks = callbacks; }
 
@@ -89,6 +90,8 @@ private:
         int height;
         int inputFormat;
         int outputFormat;
+        int inputWidth;     // size of the frames from the driver, 0 for the preview size
+        int inputHeight;
     };
 
     // union of all message data
@@ -120,6 +123,8 @@ private:
     status_t handleMessageSetPreviewConfig(MessageSetPreviewConfig *msg);
     status_t handleMessageFlush();
 
+    status_t convertCallbackFrame(MessagePreview *msg);
+
     // main message function
     status_t waitForAndExecuteMessage();
 // inherited from Thread
@@ -138,6 +143,8 @@ private:
 
     int mPreviewWidth;
     int mPreviewHeight;
+    int mInputWidth;
+    int mInputHeight;
     int mInputFormat;
     int mOutputFormat;
     int mGFXHALPixelFormat;
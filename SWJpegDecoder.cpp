@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "Camera_SWJpegDecoder"
+
+#include "SWJpegDecoder.h"
+#include "LogHelper.h"
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+#include "jerror.h"
+}
+
+namespace android {
+
+// JPEG markers
+static const unsigned char MARKER_SOF0 = 0xC0;
+static const unsigned char MARKER_SOF1 = 0xC1;
+static const unsigned char MARKER_SOF15 = 0xCF;
+static const unsigned char MARKER_DHT = 0xC4;
+static const unsigned char MARKER_JPG = 0xC8;
+static const unsigned char MARKER_DAC = 0xCC;
+static const unsigned char MARKER_RST0 = 0xD0;
+static const unsigned char MARKER_RST7 = 0xD7;
+static const unsigned char MARKER_SOI = 0xD8;
+static const unsigned char MARKER_EOI = 0xD9;
+static const unsigned char MARKER_SOS = 0xDA;
+static const unsigned char MARKER_DRI = 0xDD;
+
+static const unsigned char EOI_BYTES[2] = { 0xFF, MARKER_EOI };
+static const unsigned char RST_BYTES[8][2] = {
+    { 0xFF, 0xD0 }, { 0xFF, 0xD1 }, { 0xFF, 0xD2 }, { 0xFF, 0xD3 },
+    { 0xFF, 0xD4 }, { 0xFF, 0xD5 }, { 0xFF, 0xD6 }, { 0xFF, 0xD7 },
+};
+
+static int onlineCpus(int maxThreads)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    return cpus > maxThreads ? maxThreads : (int) cpus;
+}
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        const int r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+void SWJpegDecoder::errorExit(j_common_ptr cInfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cInfo->err->format_message)(cInfo, message);
+    ALOGE("libjpeg: %s", message);
+    longjmp(((DecodeError *) cInfo->err)->jump, 1);
+}
+
+static void outputMessage(j_common_ptr cInfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cInfo->err->format_message)(cInfo, message);
+    LOG1("libjpeg: %s", message);
+}
+
+static void initSource(j_decompress_ptr dInfo) {}
+static void termSource(j_decompress_ptr dInfo) {}
+
+boolean SWJpegDecoder::fillInputBuffer(j_decompress_ptr dInfo)
+{
+    PieceSource *src = (PieceSource *) dInfo->src;
+    const Strip *strip = src->strip;
+    while (src->next < strip->numPieces && strip->pieces[src->next].size <= 0)
+        src->next++;
+    if (src->next < strip->numPieces) {
+        src->pub.next_input_byte = strip->pieces[src->next].data;
+        src->pub.bytes_in_buffer = strip->pieces[src->next].size;
+        src->next++;
+    } else {
+        // past the end, as libjpeg asks for it
+        WARNMS(dInfo, JWRN_JPEG_EOF);
+        src->pub.next_input_byte = EOI_BYTES;
+        src->pub.bytes_in_buffer = sizeof(EOI_BYTES);
+    }
+    return TRUE;
+}
+
+void SWJpegDecoder::skipInputData(j_decompress_ptr dInfo, long bytes)
+{
+    PieceSource *src = (PieceSource *) dInfo->src;
+    while (bytes > (long) src->pub.bytes_in_buffer) {
+        bytes -= src->pub.bytes_in_buffer;
+        fillInputBuffer(dInfo);
+    }
+    if (bytes > 0) {
+        src->pub.next_input_byte += bytes;
+        src->pub.bytes_in_buffer -= bytes;
+    }
+}
+
+SWJpegDecoder::SWJpegDecoder() :
+    mThreads(0)
+    ,mFrame(NULL)
+    ,mFrameSize(0)
+    ,mSplittable(false)
+    ,mSofHeight(0)
+    ,mScanStart(0)
+    ,mWidth(0)
+    ,mHeight(0)
+    ,mMcuWidth(0)
+    ,mMcuHeight(0)
+    ,mRestartInterval(0)
+    ,mIntervals(NULL)
+    ,mIntervalsCapacity(0)
+    ,mNumIntervals(0)
+    ,mExiting(false)
+    ,mOutput(NULL)
+    ,mNumStrips(0)
+    ,mNextStrip(0)
+    ,mStripsDone(0)
+{
+    LOG1("@%s", __FUNCTION__);
+    struct jpeg_compress_struct cInfo;
+    struct jpeg_error_mgr jErr;
+
+    // the standard Huffman tables, as libjpeg has them
+    memset(&cInfo, 0, sizeof(cInfo));
+    cInfo.err = jpeg_std_error(&jErr);
+    jpeg_create_compress(&cInfo);
+    cInfo.input_components = 3;
+    cInfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cInfo);
+    JHUFF_TBL *tables[4] = { cInfo.dc_huff_tbl_ptrs[0], cInfo.dc_huff_tbl_ptrs[1],
+                             cInfo.ac_huff_tbl_ptrs[0], cInfo.ac_huff_tbl_ptrs[1] };
+    for (int i = 0; i < 4; i++) {
+        memcpy(mStdBits[i], tables[i]->bits, sizeof(mStdBits[i]));
+        memcpy(mStdValues[i], tables[i]->huffval, sizeof(mStdValues[i]));
+    }
+    jpeg_destroy_compress(&cInfo);
+}
+
+SWJpegDecoder::~SWJpegDecoder()
+{
+    LOG1("@%s", __FUNCTION__);
+    stopWorkers();
+    for (size_t i = 0; i < mStripList.size(); i++) {
+        Strip *strip = mStripList[i];
+        jpeg_destroy_decompress(&strip->dInfo);
+        delete [] strip->pieces;
+        delete [] strip->scratch;
+        delete strip;
+    }
+    delete [] mIntervals;
+}
+
+SWJpegDecoder::OutputPlanes SWJpegDecoder::yuv422hPlanes(void *buf, int stride, int alignHeight, int width, int height)
+{
+    OutputPlanes planes;
+    planes.y = (unsigned char *) buf;
+    planes.u = planes.y + stride * alignHeight;
+    planes.v = planes.u + stride * alignHeight;
+    planes.stride = stride;
+    planes.rows = alignHeight;
+    planes.width = width;
+    planes.height = height;
+    return planes;
+}
+
+void SWJpegDecoder::setThreads(int threads)
+{
+    LOG1("@%s: %d", __FUNCTION__, threads);
+    if (threads < 0)
+        threads = 0;
+    mThreads = threads > MAX_DECODE_THREADS ? MAX_DECODE_THREADS : threads;
+}
+
+/*
+Finds the restart intervals of the frame. A frame is only cut into strips
+when it is a single interleaved baseline scan whose restart intervals are
+all there, as many as its MCUs make: anything else, a progressive frame
+or a corrupt one, is decoded as it is, and libjpeg copes with it as it can.
+*/
+bool SWJpegDecoder::parse(const unsigned char *frame, int size)
+{
+    int pos = 2;    // after SOI
+    int components = 0;
+
+    mSplittable = false;
+    mSofHeight = 0;
+    mRestartInterval = 0;
+    mNumIntervals = 1;
+    if (size < 4 || frame[0] != 0xFF || frame[1] != MARKER_SOI)
+        return false;
+    for (;;) {
+        while (pos + 1 < size && frame[pos] == 0xFF && frame[pos + 1] == 0xFF)
+            pos++;
+        if (pos + 4 > size || frame[pos] != 0xFF)
+            return false;
+        const unsigned char marker = frame[pos + 1];
+        const int bytes = 2 + ((frame[pos + 2] << 8) | frame[pos + 3]);
+        if (pos + bytes > size)
+            return false;
+        if (marker == MARKER_SOF0 || marker == MARKER_SOF1) {
+            if (bytes < 10)
+                return false;
+            mSofHeight = pos + 5;
+            mHeight = (frame[pos + 5] << 8) | frame[pos + 6];
+            mWidth = (frame[pos + 7] << 8) | frame[pos + 8];
+            components = frame[pos + 9];
+            if (bytes < 10 + 3 * components)
+                return false;
+            int hMax = 1, vMax = 1;
+            for (int c = 0; c < components; c++) {
+                const int sampling = frame[pos + 11 + 3 * c];
+                if ((sampling >> 4) > hMax)
+                    hMax = sampling >> 4;
+                if ((sampling & 0x0F) > vMax)
+                    vMax = sampling & 0x0F;
+            }
+            mMcuWidth = hMax * DCTSIZE;
+            mMcuHeight = vMax * DCTSIZE;
+        } else if (marker > MARKER_SOF1 && marker <= MARKER_SOF15 &&
+                   marker != MARKER_DHT && marker != MARKER_JPG && marker != MARKER_DAC) {
+            return false;
+        } else if (marker == MARKER_DRI) {
+            if (bytes >= 6)
+                mRestartInterval = (frame[pos + 4] << 8) | frame[pos + 5];
+        } else if (marker == MARKER_SOS) {
+            if (mSofHeight == 0 || bytes < 5 || frame[pos + 4] != components)
+                return false;
+            mScanStart = pos + bytes;
+            break;
+        }
+        pos += bytes;
+    }
+    if (mWidth <= 0 || mHeight <= 0)
+        return false;
+
+    // every restart interval, and the end of the scan
+    int found = 0;
+    pos = mScanStart;
+    for (;;) {
+        const unsigned char *ff = (const unsigned char *) memchr(frame + pos, 0xFF, size - pos);
+        if (ff == NULL || ff + 1 >= frame + size)
+            return false;
+        pos = ff - frame;
+        const unsigned char marker = frame[pos + 1];
+        if (marker == 0x00 || marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker != MARKER_EOI && (marker < MARKER_RST0 || marker > MARKER_RST7 || mRestartInterval == 0))
+            return false;
+        if (found + 2 > mIntervalsCapacity) {
+            const int capacity = (mIntervalsCapacity > 0) ? mIntervalsCapacity * 2 : 256;
+            int *intervals = new int[capacity];
+            memcpy(intervals, mIntervals, found * sizeof(int));
+            delete [] mIntervals;
+            mIntervals = intervals;
+            mIntervalsCapacity = capacity;
+        }
+        if (found == 0)
+            mIntervals[found++] = mScanStart;
+        mIntervals[found++] = pos + 2;
+        if (marker == MARKER_EOI)
+            break;
+        pos += 2;
+    }
+
+    const int mcus = ((mWidth + mMcuWidth - 1) / mMcuWidth) * ((mHeight + mMcuHeight - 1) / mMcuHeight);
+    const int expected = (mRestartInterval > 0) ? (mcus + mRestartInterval - 1) / mRestartInterval : 1;
+    mNumIntervals = found - 1;
+    mSplittable = (mNumIntervals == expected);
+    if (!mSplittable)
+        LOG1("%d restart intervals in the frame, %d expected", mNumIntervals, expected);
+    return mSplittable;
+}
+
+// the strip 'index', made to take 'numPieces' pieces
+SWJpegDecoder::Strip *SWJpegDecoder::setupStrip(int index, int rowBegin, int rowEnd, int numPieces)
+{
+    while ((int) mStripList.size() <= index) {
+        Strip *strip = new Strip;
+        memset(strip, 0, sizeof(*strip));
+        strip->dInfo.err = jpeg_std_error(&strip->err.pub);
+        strip->err.pub.error_exit = errorExit;
+        strip->err.pub.output_message = outputMessage;
+        jpeg_create_decompress(&strip->dInfo);
+        strip->src.pub.init_source = initSource;
+        strip->src.pub.fill_input_buffer = fillInputBuffer;
+        strip->src.pub.skip_input_data = skipInputData;
+        strip->src.pub.resync_to_restart = jpeg_resync_to_restart;
+        strip->src.pub.term_source = termSource;
+        strip->src.strip = strip;
+        strip->dInfo.src = &strip->src.pub;
+        mStripList.push(strip);
+    }
+
+    Strip *strip = mStripList[index];
+    if (strip->piecesCapacity < numPieces) {
+        delete [] strip->pieces;
+        strip->pieces = new Piece[numPieces];
+        strip->piecesCapacity = numPieces;
+    }
+    strip->numPieces = 0;
+    strip->rowBegin = rowBegin;
+    strip->rowEnd = rowEnd;
+    strip->status = -1;
+    return strip;
+}
+
+// the JPEG of a strip: the headers with its height in the SOF, its intervals and an EOI
+void SWJpegDecoder::addIntervals(Strip *strip, int firstInterval, int endInterval)
+{
+    Piece *piece = strip->pieces;
+    const int height = strip->rowEnd - strip->rowBegin;
+
+    strip->sofHeight[0] = height >> 8;
+    strip->sofHeight[1] = height & 0xFF;
+    piece->data = mFrame;
+    piece->size = mSofHeight;
+    piece++;
+    piece->data = strip->sofHeight;
+    piece->size = sizeof(strip->sofHeight);
+    piece++;
+    piece->data = mFrame + mSofHeight + sizeof(strip->sofHeight);
+    piece->size = mScanStart - mSofHeight - sizeof(strip->sofHeight);
+    piece++;
+    for (int i = firstInterval; i < endInterval; i++) {
+        if (i > firstInterval) {
+            piece->data = RST_BYTES[(i - firstInterval - 1) & 7];
+            piece->size = sizeof(RST_BYTES[0]);
+            piece++;
+        }
+        piece->data = mFrame + mIntervals[i];
+        piece->size = mIntervals[i + 1] - 2 - mIntervals[i];
+        piece++;
+    }
+    piece->data = EOI_BYTES;
+    piece->size = sizeof(EOI_BYTES);
+    piece++;
+    strip->numPieces = piece - strip->pieces;
+}
+
+/*
+Strips start on MCU rows, at a restart interval: every so many intervals
+when the interval isn't a whole number of MCU rows. They are about as many
+as the threads, and no shorter than MIN_STRIP_MCU_ROWS, so a frame without
+restart markers, or with too few, is a single strip, the whole frame.
+*/
+int SWJpegDecoder::planStrips(int threads, int height)
+{
+    int numStrips = 1;
+
+    if (mSplittable && mRestartInterval > 0 && threads > 1) {
+        const int mcusPerRow = (mWidth + mMcuWidth - 1) / mMcuWidth;
+        const int mcuRows = (mHeight + mMcuHeight - 1) / mMcuHeight;
+        const int stepIntervals = mcusPerRow / gcd(mRestartInterval, mcusPerRow);
+        const int stepMcuRows = stepIntervals * mRestartInterval / mcusPerRow;
+        const int steps = (mcuRows + stepMcuRows - 1) / stepMcuRows;
+        int stripSteps = (steps + threads - 1) / threads;
+        if (stripSteps * stepMcuRows < MIN_STRIP_MCU_ROWS)
+            stripSteps = (MIN_STRIP_MCU_ROWS + stepMcuRows - 1) / stepMcuRows;
+        numStrips = (steps + stripSteps - 1) / stripSteps;
+
+        for (int i = 0; numStrips > 1 && i < numStrips; i++) {
+            const int firstInterval = i * stripSteps * stepIntervals;
+            int endInterval = firstInterval + stripSteps * stepIntervals;
+            if (endInterval > mNumIntervals)
+                endInterval = mNumIntervals;
+            const int rowBegin = i * stripSteps * stepMcuRows * mMcuHeight;
+            int rowEnd = rowBegin + stripSteps * stepMcuRows * mMcuHeight;
+            if (rowEnd > mHeight)
+                rowEnd = mHeight;
+            Strip *strip = setupStrip(i, rowBegin, rowEnd, 2 * (endInterval - firstInterval) + 3);
+            addIntervals(strip, firstInterval, endInterval);
+        }
+    }
+    if (numStrips == 1) {
+        Strip *strip = setupStrip(0, 0, height, 1);
+        strip->pieces[0].data = mFrame;
+        strip->pieces[0].size = mFrameSize;
+        strip->numPieces = 1;
+    }
+    return numStrips;
+}
+
+// loads the standard Huffman tables, which the DHT of the frame replaces if it has one
+void SWJpegDecoder::setStandardTables(j_decompress_ptr dInfo)
+{
+    JHUFF_TBL **tables[4] = { &dInfo->dc_huff_tbl_ptrs[0], &dInfo->dc_huff_tbl_ptrs[1],
+                              &dInfo->ac_huff_tbl_ptrs[0], &dInfo->ac_huff_tbl_ptrs[1] };
+    for (int i = 0; i < 4; i++) {
+        if (*tables[i] == NULL)
+            *tables[i] = jpeg_alloc_huff_table((j_common_ptr) dInfo);
+        memcpy((*tables[i])->bits, mStdBits[i], sizeof(mStdBits[i]));
+        memcpy((*tables[i])->huffval, mStdValues[i], sizeof(mStdValues[i]));
+    }
+}
+
+/*
+Decodes a strip into its rows of the planes. libjpeg gives an MCU row of
+raw data at a time: MCU rows of 8 rows for 4:2:2, whose chroma rows are
+the rows of the chroma planes, and of 16 rows for 4:2:0, whose chroma rows
+go to the even rows of the chroma planes and are copied to the odd ones.
+Rows past the planes, the padding of the last MCU row, and rows wider
+than the stride go to the scratch rows first.
+*/
+void SWJpegDecoder::decodeStrip(Strip *strip)
+{
+    const OutputPlanes &out = *mOutput;
+    j_decompress_ptr dInfo = &strip->dInfo;
+    JSAMPROW rows[3][2 * DCTSIZE];
+    JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+
+    strip->status = -1;
+    strip->src.next = 0;
+    strip->src.pub.next_input_byte = NULL;
+    strip->src.pub.bytes_in_buffer = 0;
+    if (setjmp(strip->err.jump)) {
+        jpeg_abort_decompress(dInfo);
+        return;
+    }
+
+    setStandardTables(dInfo);
+    jpeg_read_header(dInfo, TRUE);
+    const jpeg_component_info *comp = dInfo->comp_info;
+    if (dInfo->num_components != 3 || comp[0].h_samp_factor != 2 || comp[0].v_samp_factor > 2 ||
+        comp[1].h_samp_factor != 1 || comp[1].v_samp_factor != 1 ||
+        comp[2].h_samp_factor != 1 || comp[2].v_samp_factor != 1) {
+        ALOGE("MJPEG frame of %d components isn't 4:2:2 or 4:2:0", dInfo->num_components);
+        jpeg_abort_decompress(dInfo);
+        return;
+    }
+    if ((int) dInfo->image_width != out.width || (int) dInfo->image_height != strip->rowEnd - strip->rowBegin) {
+        ALOGE("MJPEG frame of %dx%d, %dx%d expected", dInfo->image_width, dInfo->image_height,
+              out.width, strip->rowEnd - strip->rowBegin);
+        jpeg_abort_decompress(dInfo);
+        return;
+    }
+    dInfo->raw_data_out = TRUE;
+    dInfo->do_fancy_upsampling = FALSE;
+    dInfo->dct_method = JDCT_ISLOW;
+    jpeg_start_decompress(dInfo);
+
+    const int vSamp = comp[0].v_samp_factor;
+    const int mcuRows = vSamp * DCTSIZE;
+    const int yBytes = comp[0].width_in_blocks * DCTSIZE;
+    const int cBytes = comp[1].width_in_blocks * DCTSIZE;
+    const int cWidth = (out.width + 1) / 2;
+    const int scratchSize = mcuRows * yBytes + 2 * DCTSIZE * cBytes;
+    if (strip->scratchSize < scratchSize) {
+        delete [] strip->scratch;
+        strip->scratch = new unsigned char[scratchSize];
+        strip->scratchSize = scratchSize;
+    }
+    unsigned char *scratch[3] = { strip->scratch, strip->scratch + mcuRows * yBytes,
+                                  strip->scratch + mcuRows * yBytes + DCTSIZE * cBytes };
+    unsigned char *base[3] = { out.y, out.u, out.v };
+    const int bytes[3] = { yBytes, cBytes, cBytes };
+    const int copyBytes[3] = { out.width, cWidth, cWidth };
+
+    while (dInfo->output_scanline < dInfo->output_height) {
+        const int row = strip->rowBegin + dInfo->output_scanline;
+        for (int c = 0; c < 3; c++) {
+            const int lines = (c == 0) ? mcuRows : DCTSIZE;
+            const int step = (c == 0) ? 1 : vSamp;
+            const bool fits = bytes[c] <= out.stride;
+            for (int i = 0; i < lines; i++) {
+                const int r = row + i * step;
+                rows[c][i] = (fits && r < out.rows) ? base[c] + r * out.stride : scratch[c] + i * bytes[c];
+            }
+        }
+        jpeg_read_raw_data(dInfo, planes, mcuRows);
+        for (int c = 0; c < 3; c++) {
+            const int lines = (c == 0) ? mcuRows : DCTSIZE;
+            const int step = (c == 0) ? 1 : vSamp;
+            for (int i = 0; i < lines; i++) {
+                const int r = row + i * step;
+                if (r >= out.rows)
+                    break;
+                unsigned char *dst = base[c] + r * out.stride;
+                if (rows[c][i] != dst)
+                    memcpy(dst, rows[c][i], copyBytes[c]);
+                if (step == 2 && r + 1 < out.rows)
+                    memcpy(dst + out.stride, dst, copyBytes[c]);
+            }
+        }
+    }
+    jpeg_finish_decompress(dInfo);
+    strip->status = 0;
+}
+
+int SWJpegDecoder::decode(const unsigned char *frame, int size, const OutputPlanes &out)
+{
+    LOG2("@%s: %d bytes", __FUNCTION__, size);
+    mFrame = frame;
+    mFrameSize = size;
+    if (parse(frame, size) && (mWidth != out.width || mHeight != out.height)) {
+        ALOGE("MJPEG frame of %dx%d, %dx%d expected", mWidth, mHeight, out.width, out.height);
+        return -1;
+    }
+
+    const int threads = (mThreads > 0) ? mThreads : onlineCpus(MAX_DECODE_THREADS);
+    const int numStrips = planStrips(threads, out.height);
+    LOG2("%d restart intervals, %d strips", mNumIntervals, numStrips);
+
+    mLock.lock();
+    if (numStrips > 1) {
+        startWorkers(threads < numStrips ? threads : numStrips);
+        mWorkCondition.broadcast();
+    }
+    mOutput = &out;
+    mNumStrips = numStrips;
+    mNextStrip = 0;
+    mStripsDone = 0;
+    mLock.unlock();
+
+    // the caller decodes strips too
+    while (runNextStrip())
+        ;
+
+    mLock.lock();
+    while (mStripsDone < mNumStrips)
+        mDoneCondition.wait(mLock);
+    mOutput = NULL;
+    mLock.unlock();
+
+    for (int i = 0; i < numStrips; i++) {
+        const Strip *strip = mStripList[i];
+        if (strip->status != 0) {
+            ALOGE("MJPEG strip %d (rows %d-%d) failed", i, strip->rowBegin, strip->rowEnd);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// decodes the next strip of the current frame, returns false when none is left
+bool SWJpegDecoder::runNextStrip()
+{
+    Strip *strip;
+
+    mLock.lock();
+    if (mOutput == NULL || mNextStrip >= mNumStrips) {
+        mLock.unlock();
+        return false;
+    }
+    strip = mStripList[mNextStrip++];
+    mLock.unlock();
+
+    decodeStrip(strip);
+
+    mLock.lock();
+    if (++mStripsDone == mNumStrips)
+        mDoneCondition.signal();
+    mLock.unlock();
+    return true;
+}
+
+bool SWJpegDecoder::workerLoop()
+{
+    {
+        Mutex::Autolock lock(mLock);
+        while (!mExiting && (mOutput == NULL || mNextStrip >= mNumStrips))
+            mWorkCondition.wait(mLock);
+        if (mExiting)
+            return false;
+    }
+    runNextStrip();
+    return true;
+}
+
+// called with mLock held, the caller is one of the threads
+void SWJpegDecoder::startWorkers(int numThreads)
+{
+    while ((int) mWorkers.size() < numThreads - 1) {
+        sp<StripWorker> worker = new StripWorker(this);
+        if (worker->run("CamHAL_MJPEGDEC") != NO_ERROR) {
+            ALOGE("failed to start MJPEG strip worker");
+            break;
+        }
+        mWorkers.push(worker);
+    }
+}
+
+// called without mLock held
+void SWJpegDecoder::stopWorkers()
+{
+    Vector< sp<StripWorker> > workers;
+    {
+        Mutex::Autolock lock(mLock);
+        mExiting = true;
+        mWorkCondition.broadcast();
+        workers = mWorkers;
+        mWorkers.clear();
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->requestExitAndWait();
+
+    Mutex::Autolock lock(mLock);
+    mExiting = false;
+}
+
+}; // namespace android
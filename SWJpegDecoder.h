@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBCAMERA_SW_JPEG_DECODER_H
+#define ANDROID_LIBCAMERA_SW_JPEG_DECODER_H
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+extern "C" {
+#include "jpeglib.h"
+}
+
+namespace android {
+
+/**
+ * \class SWJpegDecoder
+ *
+ * Decodes MJPEG frames with libjpeg into 4:2:2 planar buffers, laid out
+ * like the YUV422H surfaces the VA decoder writes: U and V planes after
+ * the Y plane, with as many rows and the same stride.
+ *
+ * libjpeg outputs the decoded blocks as they are (raw data), so the
+ * chroma of a 4:2:2 frame is written as it is and the chroma rows of a
+ * 4:2:0 frame are doubled. Frames of other samplings aren't decoded.
+ *
+ * A frame with restart markers is cut at the markers into strips of
+ * whole MCU rows, decoded in parallel: every strip is given to its own
+ * libjpeg decompressor as a JPEG of its own, the headers of the frame
+ * with the height of the strip, and its restart intervals with their
+ * RST markers numbered from RST0. A restart resets the decoder like the
+ * start of a scan does, so the strips decode to the very pixels the
+ * whole frame does. Frames without restart markers are decoded on the
+ * calling thread.
+ */
+class SWJpegDecoder {
+public:
+    SWJpegDecoder();
+    ~SWJpegDecoder();
+
+    // where decode() writes a frame
+    struct OutputPlanes {
+        unsigned char *y;
+        unsigned char *u;
+        unsigned char *v;
+        int stride;         // bytes per row of every plane
+        int rows;           // rows of every plane, from 'height' up
+        int width;          // the frame size expected
+        int height;
+    };
+
+    // the planes of a YUV422H surface at 'buf'
+    static OutputPlanes yuv422hPlanes(void *buf, int stride, int alignHeight, int width, int height);
+
+    /**
+     * Sets the threads decoding one frame, including the caller, 0 for one
+     * per online CPU
+     */
+    void setThreads(int threads);
+
+    /**
+     * Decodes the 'size' byte MJPEG frame at 'frame' into 'out', returns 0
+     * or -1 if the frame isn't one of out.width x out.height it can decode
+     */
+    int decode(const unsigned char *frame, int size, const OutputPlanes &out);
+
+    // the restart intervals of the last frame, 1 if it had none
+    int getIntervals() const { return mNumIntervals; }
+
+    // the strips the last frame was decoded in
+    int getStrips() const { return mNumStrips; }
+
+// prevent copy constructor and assignment operator
+private:
+    SWJpegDecoder(const SWJpegDecoder& other);
+    SWJpegDecoder& operator=(const SWJpegDecoder& other);
+
+private:
+    // libjpeg errors end the strip rather than the process
+    struct DecodeError {
+        struct jpeg_error_mgr pub;
+        jmp_buf jump;
+    };
+
+    // a piece of the JPEG a strip is decoded from
+    struct Piece {
+        const unsigned char *data;
+        int size;
+    };
+
+    struct Strip;
+
+    // source manager reading a strip from its pieces
+    struct PieceSource {
+        struct jpeg_source_mgr pub;
+        const Strip *strip;
+        int next;
+    };
+
+    struct Strip {
+        struct jpeg_decompress_struct dInfo;
+        DecodeError err;
+        PieceSource src;
+        Piece *pieces;
+        int piecesCapacity;
+        int numPieces;
+        unsigned char sofHeight[2];     // height of the strip, as its SOF has it
+        int rowBegin;
+        int rowEnd;
+        unsigned char *scratch;         // rows that don't go straight to the planes
+        int scratchSize;
+        int status;                     // 0 once decoded, -1 if it failed
+    };
+
+    class StripWorker : public Thread {
+    public:
+        StripWorker(SWJpegDecoder *decoder) : Thread(false), mDecoder(decoder) {}
+    private:
+        virtual bool threadLoop() { return mDecoder->workerLoop(); }
+        SWJpegDecoder *mDecoder;
+    };
+
+    static void errorExit(j_common_ptr cInfo);
+    static boolean fillInputBuffer(j_decompress_ptr dInfo);
+    static void skipInputData(j_decompress_ptr dInfo, long bytes);
+
+    bool parse(const unsigned char *frame, int size);
+    int planStrips(int threads, int height);
+    Strip *setupStrip(int index, int rowBegin, int rowEnd, int numPieces);
+    void addIntervals(Strip *strip, int firstInterval, int endInterval);
+    void decodeStrip(Strip *strip);
+    void setStandardTables(j_decompress_ptr dInfo);
+    bool runNextStrip();
+    bool workerLoop();
+    void startWorkers(int numThreads);
+    void stopWorkers();
+
+    // upper limit of threads decoding one frame
+    static const int MAX_DECODE_THREADS = 8;
+    // strips shorter than this many MCU rows aren't worth a thread
+    static const int MIN_STRIP_MCU_ROWS = 4;
+
+    int mThreads;                       // as set by setThreads()
+    Vector<Strip *> mStripList;         // kept from one frame to the next, with their decompressors
+
+    // the standard Huffman tables, for frames without a DHT, as MJPEG frames are
+    UINT8 mStdBits[4][17];              // DC 0, DC 1, AC 0, AC 1
+    UINT8 mStdValues[4][256];
+
+    // the last frame, as parsed
+    const unsigned char *mFrame;
+    int mFrameSize;
+    bool mSplittable;                   // a single baseline scan, with the restart intervals found
+    int mSofHeight;                     // where the height is in the SOF
+    int mScanStart;                     // where the entropy coded data starts
+    int mWidth;
+    int mHeight;
+    int mMcuWidth;                      // pixels of an MCU
+    int mMcuHeight;
+    int mRestartInterval;               // MCUs, 0 without restart markers
+    int *mIntervals;                    // start of every restart interval, then 2 past the end of
+                                        // the scan: interval i ends 2 bytes before interval i + 1
+    int mIntervalsCapacity;
+    int mNumIntervals;
+
+    Mutex mLock;                        // protects everything below
+    Condition mWorkCondition;           // signalled when strips are posted or on exit
+    Condition mDoneCondition;           // signalled when the last strip completes
+    Vector< sp<StripWorker> > mWorkers;
+    bool mExiting;
+    const OutputPlanes *mOutput;        // frame being decoded, NULL when idle
+    int mNumStrips;
+    int mNextStrip;
+    int mStripsDone;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LIBCAMERA_SW_JPEG_DECODER_H
@@ -18,13 +18,23 @@
 
 #include "SWJpegEncoder.h"
 #include "ColorConverter.h"
+#include "ColorConverterKernels.h"
 #include "LogHelper.h"
 #include <string.h>
 
 namespace android {
 
 SWJpegEncoder::SWJpegEncoder() :
-    mJpegQuality(mDefaultJpegQuality)
+    mCreated(false)
+    ,mJpegQuality(mDefaultJpegQuality)
+    ,mJpegSpeed(JPEG_SPEED_BALANCED)
+    ,mInputFormat(V4L2_PIX_FMT_YUV420)
+    ,mTablesQuality(0)
+    ,mHuffOptimized(false)
+    ,mBand(NULL)
+    ,mBandSize(0)
+    ,mChunkSink(NULL)
+    ,mChunkBytes(0)
 {
     LOG1("@%s", __FUNCTION__);
 }
@@ -32,30 +42,148 @@ SWJpegEncoder::SWJpegEncoder() :
 SWJpegEncoder::~SWJpegEncoder()
 {
     LOG1("@%s", __FUNCTION__);
+    if (mCreated)
+        jpeg_destroy_compress(&mCInfo);
+    delete [] mBand;
+    releaseOverflow();
+}
+
+/**
+ * Describe a YV12 buffer
+ *
+ * The V plane follows the 'alignHeight' rows of the Y plane, and the U plane
+ * the V plane, both with rows of stride / 2 bytes, as gralloc lays out YV12.
+ *
+ * \param buf: the start of the buffer
+ * \param stride: bytes per row of the Y plane
+ * \param alignHeight: rows of the Y plane
+ * \param uncached: whether the buffer is a gralloc surface
+ */
+SWJpegEncoder::YuvPlanes SWJpegEncoder::yv12Planes(const void *buf, int stride, int alignHeight, bool uncached)
+{
+    YuvPlanes planes;
+    planes.y = (const unsigned char *)buf;
+    planes.v = planes.y + stride * alignHeight;
+    planes.u = planes.v + (stride / 2) * (alignHeight / 2);
+    planes.yStride = stride;
+    planes.uvStride = stride / 2;
+    planes.format = V4L2_PIX_FMT_YUV420;
+    planes.uncached = uncached;
+    return planes;
+}
+
+/**
+ * Describe a 4:2:2 planar buffer, as the MJPEG decoder writes its 422H surfaces
+ *
+ * The U plane follows the 'alignHeight' rows of the Y plane, and the V plane
+ * the U plane, with as many rows as the Y plane and the same stride.
+ *
+ * \param buf: the start of the buffer
+ * \param stride: bytes per row of every plane
+ * \param alignHeight: rows of every plane
+ * \param uncached: whether the buffer is a gralloc surface
+ */
+SWJpegEncoder::YuvPlanes SWJpegEncoder::yuv422pPlanes(const void *buf, int stride, int alignHeight, bool uncached)
+{
+    YuvPlanes planes;
+    planes.y = (const unsigned char *)buf;
+    planes.u = planes.y + stride * alignHeight;
+    planes.v = planes.u + stride * alignHeight;
+    planes.yStride = stride;
+    planes.uvStride = stride;
+    planes.format = V4L2_PIX_FMT_YUV422P;
+    planes.uncached = uncached;
+    return planes;
+}
+
+/**
+ * Describe a YUYV buffer
+ *
+ * \param buf: the start of the buffer
+ * \param stride: bytes per row
+ * \param uncached: whether the buffer is a gralloc surface
+ */
+SWJpegEncoder::YuvPlanes SWJpegEncoder::yuyvPlanes(const void *buf, int stride, bool uncached)
+{
+    YuvPlanes planes;
+    planes.y = (const unsigned char *)buf;
+    planes.u = NULL;
+    planes.v = NULL;
+    planes.yStride = stride;
+    planes.uvStride = 0;
+    planes.format = V4L2_PIX_FMT_YUYV;
+    planes.uncached = uncached;
+    return planes;
+}
+
+bool SWJpegEncoder::isSupportedFormat(int format)
+{
+    return format == V4L2_PIX_FMT_YUV420 || format == V4L2_PIX_FMT_YUV422P
+        || format == V4L2_PIX_FMT_YUYV;
+}
+
+int SWJpegEncoder::mcuRows(int format)
+{
+    return (format == V4L2_PIX_FMT_YUV420) ? 16 : 8;
 }
 
 /**
  * Init the SW jpeg encoder
  *
- * It will init the libjpeg library
+ * It will init the libjpeg library the first time, and set the parameters
+ * that are the same for every image
  */
 void SWJpegEncoder::init(void)
 {
     LOG1("@%s", __FUNCTION__);
+    if (mCreated)
+        return;
+
     memset(&mCInfo, 0, sizeof(mCInfo));
     mCInfo.err = jpeg_std_error(&mJErr);
     jpeg_create_compress(&mCInfo);
+
+    mCInfo.input_components = 3;
+    mCInfo.in_color_space = (J_COLOR_SPACE)mSupportedFormat;
+    jpeg_set_defaults(&mCInfo);
+    jpeg_set_colorspace(&mCInfo, (J_COLOR_SPACE)mSupportedFormat);
+    mCInfo.raw_data_in = TRUE;
+    mCInfo.comp_info[0].h_samp_factor = 2;
+    mCInfo.comp_info[0].v_samp_factor = 2;
+    mCInfo.comp_info[1].h_samp_factor = 1;
+    mCInfo.comp_info[1].v_samp_factor = 1;
+    mCInfo.comp_info[2].h_samp_factor = 1;
+    mCInfo.comp_info[2].v_samp_factor = 1;
+    // jpeg_set_defaults() left the quality 75 tables and the standard
+    // Huffman tables, which optimized encodes overwrite in place
+    mTablesQuality = 0;
+    for (int t = 0; t < 2; t++) {
+        mStdDcTables[t] = *mCInfo.dc_huff_tbl_ptrs[t];
+        mStdAcTables[t] = *mCInfo.ac_huff_tbl_ptrs[t];
+    }
+    mHuffOptimized = false;
+    mCreated = true;
 }
 
 /**
  * deInit the SW jpeg encoder
  *
- * It will deinit the libjpeg library
+ * It will release what libjpeg allocated for the last image, and its
+ * overflow chunks, the compressor itself is kept for the next one
  */
 void SWJpegEncoder::deInit(void)
 {
     LOG1("@%s", __FUNCTION__);
-    jpeg_destroy_compress(&mCInfo);
+    if (mCreated)
+        jpeg_abort_compress(&mCInfo);
+    releaseOverflow();
+}
+
+void SWJpegEncoder::releaseOverflow()
+{
+    for (size_t i = 0; i < mOverflowChunks.size(); i++)
+        delete [] mOverflowChunks[i];
+    mOverflowChunks.clear();
 }
 
 /**
@@ -70,6 +198,54 @@ void SWJpegEncoder::setJpegQuality(int quality)
     mJpegQuality = CLIP(quality, 100, 1);
 }
 
+/**
+ * Set the speed profile
+ *
+ * \param speed: how the DCT and the entropy coding trade speed for quality
+ *
+ */
+void SWJpegEncoder::setJpegSpeed(JpegSpeed speed)
+{
+    LOG1("@%s, speed:%s", __FUNCTION__, jpegSpeedName(speed));
+    mJpegSpeed = speed;
+}
+
+/**
+ * Set the format of the next images
+ *
+ * YV12 is encoded with 2x2 luma sampling (4:2:0), the 4:2:2 formats with
+ * 2x1 sampling, so their full vertical chroma resolution is kept.
+ *
+ * \param format: one V4L2 format that isSupportedFormat()
+ *
+ */
+void SWJpegEncoder::setInputFormat(int format)
+{
+    LOG1("@%s, format:%s", __FUNCTION__, v4l2Fmt2Str(format));
+    mInputFormat = format;
+}
+
+const char *SWJpegEncoder::jpegSpeedName(JpegSpeed speed)
+{
+    switch (speed) {
+    case JPEG_SPEED_FAST:
+        return "fast";
+    case JPEG_SPEED_QUALITY:
+        return "quality";
+    default:
+        return "balanced";
+    }
+}
+
+bool SWJpegEncoder::hasSimdBackend()
+{
+#ifdef LIBJPEG_TURBO_VERSION
+    return true;
+#else
+    return false;
+#endif
+}
+
 /**
  * Config the SW jpeg encoder.
  *
@@ -87,69 +263,234 @@ int SWJpegEncoder::configEncoding(int width, int height, void *jpegBuf, int jpeg
 {
     LOG1("@%s", __FUNCTION__);
 
-    mCInfo.input_components = 3;
-    mCInfo.in_color_space = (J_COLOR_SPACE)mSupportedFormat;
+    if (!mCreated) {
+        LOGE("@%s, line:%d, init() not called", __FUNCTION__, __LINE__);
+        return -1;
+    }
+
+    if (!isSupportedFormat(mInputFormat)) {
+        LOGE("@%s, line:%d, unsupported format %s", __FUNCTION__, __LINE__, v4l2Fmt2Str(mInputFormat));
+        return -1;
+    }
+
     mCInfo.image_width = width;
     mCInfo.image_height = height;
+    mCInfo.comp_info[0].v_samp_factor = mcuRows(mInputFormat) / DCTSIZE;
 
     if(setupJpegDestMgr(&mCInfo, (JSAMPLE *)jpegBuf, jpegBufSize) < 0) {
         LOGE("@%s, line:%d, setupJpegDestMgr fail", __FUNCTION__, __LINE__);
         return -1;
     }
 
-    jpeg_set_defaults(&mCInfo);
-    jpeg_set_colorspace(&mCInfo, (J_COLOR_SPACE)mSupportedFormat);
-    jpeg_set_quality(&mCInfo, mJpegQuality, TRUE);
-    mCInfo.raw_data_in = TRUE;
-    mCInfo.dct_method = JDCT_ISLOW;
-    mCInfo.comp_info[0].h_samp_factor = 2;
-    mCInfo.comp_info[0].v_samp_factor = 2;
-    mCInfo.comp_info[1].h_samp_factor = 1;
-    mCInfo.comp_info[1].v_samp_factor = 1;
-    mCInfo.comp_info[2].h_samp_factor = 1;
-    mCInfo.comp_info[2].v_samp_factor = 1;
+    setQuantTables(mJpegQuality);
+
+    // the fast DCT loses too much precision for the finest quantization steps
+    if (mJpegSpeed == JPEG_SPEED_FAST && mJpegQuality < 98)
+        mCInfo.dct_method = JDCT_IFAST;
+    else
+        mCInfo.dct_method = JDCT_ISLOW;
+    setHuffTables(mJpegSpeed == JPEG_SPEED_QUALITY);
+
     jpeg_start_compress(&mCInfo, TRUE);
 
     return 0;
 }
 
+/**
+ * Load the quantization tables of a quality
+ *
+ * The tables libjpeg scales for a quality are kept, and copied back
+ * whenever the quality comes up again, e.g. when thumbnails and pictures
+ * are encoded in turn.
+ *
+ * \param quality: one value from 1 to 100
+ */
+void SWJpegEncoder::setQuantTables(int quality)
+{
+    if (quality == mTablesQuality)
+        return;
+
+    for (size_t i = 0; i < mQuantTables.size(); i++) {
+        const QuantTables &cached = mQuantTables[i];
+        if (cached.quality != quality)
+            continue;
+        for (int t = 0; t < 2; t++) {
+            JQUANT_TBL *table = mCInfo.quant_tbl_ptrs[t];
+            memcpy(table->quantval, cached.table[t], sizeof(cached.table[t]));
+            table->sent_table = FALSE;
+        }
+        mTablesQuality = quality;
+        return;
+    }
+
+    LOG1("@%s, scaling the tables of quality %d", __FUNCTION__, quality);
+    jpeg_set_quality(&mCInfo, quality, TRUE);
+    QuantTables tables;
+    tables.quality = quality;
+    for (int t = 0; t < 2; t++)
+        memcpy(tables.table[t], mCInfo.quant_tbl_ptrs[t]->quantval, sizeof(tables.table[t]));
+    mQuantTables.push(tables);
+    mTablesQuality = quality;
+}
+
+/**
+ * Select the Huffman tables
+ *
+ * libjpeg writes the tables it optimizes for an image over the ones in the
+ * compressor, so the standard tables are copied back before an image that
+ * is not optimized, or it would be coded with the previous image's tables.
+ *
+ * \param optimize: whether the tables are optimized for the image
+ */
+void SWJpegEncoder::setHuffTables(bool optimize)
+{
+    mCInfo.optimize_coding = optimize ? TRUE : FALSE;
+    if (optimize) {
+        mHuffOptimized = true;
+        return;
+    }
+    if (!mHuffOptimized)
+        return;
+
+    for (int t = 0; t < 2; t++) {
+        *mCInfo.dc_huff_tbl_ptrs[t] = mStdDcTables[t];
+        *mCInfo.ac_huff_tbl_ptrs[t] = mStdAcTables[t];
+        mCInfo.dc_huff_tbl_ptrs[t]->sent_table = FALSE;
+        mCInfo.ac_huff_tbl_ptrs[t]->sent_table = FALSE;
+    }
+    mHuffOptimized = false;
+}
+
+/**
+ * Unpack YUYV rows into planar 4:2:2 rows
+ *
+ * Every row is padded to 'padWidth' luma samples by repeating its last
+ * pixel, since libjpeg reads whole MCUs.
+ */
+static void unpackYuyvRows(const unsigned char *src, int srcStride, int rows, int width,
+                           unsigned char *dstY, unsigned char *dstU, unsigned char *dstV, int padWidth,
+                           unsigned char *tmpUV, ColorReadback &readback)
+{
+    const ColorKernels &kernels = getColorKernels();
+    const int chromaWidth = width / 2;
+    const int padChroma = padWidth / 2;
+
+    for (int r = 0; r < rows; r++) {
+        const unsigned char *row = readback.read(0, src + r * srcStride, width * 2);
+        kernels.yuyvToNV12Row(row, dstY, tmpUV, width);
+        kernels.deinterleaveChroma(tmpUV, dstU, dstV, chromaWidth);
+        if (padWidth > width)
+            memset(dstY + width, dstY[width - 1], padWidth - width);
+        if (padChroma > chromaWidth) {
+            memset(dstU + chromaWidth, dstU[chromaWidth - 1], padChroma - chromaWidth);
+            memset(dstV + chromaWidth, dstV[chromaWidth - 1], padChroma - chromaWidth);
+        }
+        dstY += padWidth;
+        dstU += padChroma;
+        dstV += padChroma;
+    }
+}
+
 /**
  * Do the SW jpeg encoding.
  *
- * it will convert the YUV data to P411 and then do jpeg encoding.
+ * The rows handed to libjpeg point straight into the source planes, so the
+ * source is neither repacked nor copied whole. An uncached source is
+ * streamed into a band of one MCU row first (16 luma and 8 chroma rows for
+ * 4:2:0, 8 of each for 4:2:2), which is the most libjpeg reads at a time,
+ * and a YUYV source is unpacked into such a band. Rows past the bottom of
+ * the image repeat the last one.
  *
- * \param yuv_buf: the source buffer for YUV data
+ * \param planes: the source planes and their strides, in the format set with setInputFormat()
  * \return 0 if the encoding is successful.
  * \return -1 if the encoding fails.
  */
-int SWJpegEncoder::doJpegEncoding(const void* yuv_buf, int format)
+int SWJpegEncoder::doJpegEncoding(const YuvPlanes &planes)
 {
     LOG1("@%s", __FUNCTION__);
 
-    unsigned char * srcY = NULL;
-    unsigned char * srcU = NULL;
-    unsigned char * srcV = NULL;
-    JSAMPROW y[16],u[16],v[16];
+    JSAMPROW y[16],u[8],v[8];
     JSAMPARRAY data[3];
     int i, j, width, height;
 
     width= mCInfo.image_width;
     height=mCInfo.image_height;
-    srcY = (unsigned char *)yuv_buf;
-    srcV = (unsigned char *)yuv_buf + width * height;
-    srcU = (unsigned char *)yuv_buf + width * height + width * height / 4;
+    const bool packed = (planes.format == V4L2_PIX_FMT_YUYV);
+    if (planes.format != mInputFormat) {
+        LOGE("@%s, line:%d, planes are %s, the encoder was set up for %s", __FUNCTION__, __LINE__,
+             v4l2Fmt2Str(planes.format), v4l2Fmt2Str(mInputFormat));
+        jpeg_abort_compress(&mCInfo);
+        return -1;
+    }
+    if (packed ? planes.yStride < width * 2
+               : planes.yStride < width || planes.uvStride < (width + 1) / 2) {
+        LOGE("@%s, line:%d, strides %d/%d too small for width %d", __FUNCTION__, __LINE__,
+             planes.yStride, planes.uvStride, width);
+        jpeg_abort_compress(&mCInfo);
+        return -1;
+    }
+
+    // luma rows of an MCU row, and log2 of the luma rows per chroma row
+    const int mcu = mcuRows(planes.format);
+    const int chromaShift = (mcu == 16) ? 1 : 0;
+    // strides of the band, packed sources are unpacked to whole MCUs
+    const int bandYStride = packed ? ALIGN(width, 16) : planes.yStride;
+    const int bandUVStride = packed ? bandYStride / 2 : planes.uvStride;
+
+    const int bandSize = mcu * bandYStride + 2 * 8 * bandUVStride + (packed ? width : 0);
+    if ((planes.uncached || packed) && bandSize > mBandSize) {
+        delete [] mBand;
+        mBand = new unsigned char[bandSize];
+        mBandSize = bandSize;
+    }
+    ColorReadback readback(planes.uncached);
+
     data[0] = y;
     data[1] = u;
     data[2] = v;
-    for (i = 0; i < height; i += 16) {
-        for (j = 0; j < 16 && (i + j) < height; j++) {
-            y[j] = srcY + width * (j + i);
-            if (j % 2 == 0) {
-                u[j / 2] = srcU + width / 2 * ((j + i) / 2);
-                v[j / 2] = srcV + width / 2 * ((j + i) / 2);
+    for (i = 0; i < height; i += mcu) {
+        const int rows = (height - i < mcu) ? height - i : mcu;
+        const int chromaRows = (rows + chromaShift) >> chromaShift;
+        const unsigned char *srcY = planes.y + i * planes.yStride;
+        const unsigned char *srcU = NULL;
+        const unsigned char *srcV = NULL;
+        int yStride = planes.yStride;
+        int uvStride = planes.uvStride;
+
+        if (packed) {
+            unsigned char *bandY = mBand;
+            unsigned char *bandU = bandY + mcu * bandYStride;
+            unsigned char *bandV = bandU + 8 * bandUVStride;
+            unpackYuyvRows(srcY, planes.yStride, rows, width, bandY, bandU, bandV, bandYStride,
+                           bandV + 8 * bandUVStride, readback);
+            srcY = bandY;
+            srcU = bandU;
+            srcV = bandV;
+            yStride = bandYStride;
+            uvStride = bandUVStride;
+        } else {
+            srcU = planes.u + (i >> chromaShift) * planes.uvStride;
+            srcV = planes.v + (i >> chromaShift) * planes.uvStride;
+            if (planes.uncached) {
+                unsigned char *bandY = mBand;
+                unsigned char *bandU = bandY + mcu * planes.yStride;
+                unsigned char *bandV = bandU + 8 * planes.uvStride;
+                readback.copy(bandY, srcY, rows * planes.yStride);
+                readback.copy(bandU, srcU, chromaRows * planes.uvStride);
+                readback.copy(bandV, srcV, chromaRows * planes.uvStride);
+                srcY = bandY;
+                srcU = bandU;
+                srcV = bandV;
             }
         }
-        jpeg_write_raw_data(&mCInfo, data, 16);
+
+        for (j = 0; j < mcu; j++)
+            y[j] = (JSAMPROW)(srcY + (j < rows ? j : rows - 1) * yStride);
+        for (j = 0; j < 8; j++) {
+            u[j] = (JSAMPROW)(srcU + (j < chromaRows ? j : chromaRows - 1) * uvStride);
+            v[j] = (JSAMPROW)(srcV + (j < chromaRows ? j : chromaRows - 1) * uvStride);
+        }
+        jpeg_write_raw_data(&mCInfo, data, mcu);
     }
 
     jpeg_finish_compress(&mCInfo);
@@ -171,6 +512,42 @@ void SWJpegEncoder::getJpegSize(int *jpegSize)
     *jpegSize = (false == dest->encodeSuccess) ? -1 : dest->codedSize;
 }
 
+/**
+ * Copy the overflow of the last image
+ *
+ * \param dst: where the bytes past the end of the output buffer go,
+ *             codedSize minus the buffer size of them
+ */
+void SWJpegEncoder::copyOverflow(unsigned char *dst)
+{
+    LOG1("@%s", __FUNCTION__);
+    JpegDestMgrPtr dest = (JpegDestMgrPtr)mCInfo.dest;
+    int remaining = dest->codedSize - dest->outJpegBufSize;
+
+    for (int i = 0; i < dest->overflowChunks && remaining > 0; i++) {
+        int bytes = mOverflowChunkBytes;
+        if (bytes > remaining)
+            bytes = remaining;
+        memcpy(dst, mOverflowChunks[i], bytes);
+        dst += bytes;
+        remaining -= bytes;
+    }
+}
+
+/**
+ * Set the chunk sink
+ *
+ * \param sink: gets the stream of the following images as it is produced,
+ *              NULL to stop
+ * \param chunkBytes: bytes of every chunk but the last one of an image
+ */
+void SWJpegEncoder::setChunkSink(JpegChunkSink *sink, int chunkBytes)
+{
+    LOG1("@%s, sink:%p, chunkBytes:%d", __FUNCTION__, sink, chunkBytes);
+    mChunkSink = (chunkBytes > 0) ? sink : NULL;
+    mChunkBytes = chunkBytes;
+}
+
 /**
  * Setup the jpeg destination buffer manager
  *
@@ -206,6 +583,7 @@ setupJpegDestMgr(j_compress_ptr cInfo, JSAMPLE *jpegBuf, int jpegBufSize)
     dest->pub.term_destination = termDestination;
     dest->outJpegBuf = jpegBuf;
     dest->outJpegBufSize = jpegBufSize;
+    dest->owner = this;
 
     return 0;
 }
@@ -223,18 +601,40 @@ void SWJpegEncoder::initDestination(j_compress_ptr cInfo)
     LOG1("@%s", __FUNCTION__);
     JpegDestMgrPtr dest = (JpegDestMgrPtr)cInfo->dest;
 
-    dest->pub.next_output_byte = dest->outJpegBuf;
-    dest->pub.free_in_buffer = dest->outJpegBufSize;
     dest->encodeSuccess = true;
+    dest->overflowChunks = 0;
+    dest->bufEnd = dest->outJpegBuf + dest->outJpegBufSize;
+    startChunk(dest, dest->outJpegBuf);
+}
+
+/**
+ * Let libjpeg fill the next chunk
+ *
+ * Without a sink, a chunk is the rest of the buffer or overflow chunk.
+ *
+ * \param dest: the destination manager
+ * \param start: where the chunk starts, in the buffer being written
+ */
+void SWJpegEncoder::startChunk(JpegDestMgrPtr dest, JSAMPLE *start)
+{
+    size_t bytes = dest->bufEnd - start;
+    if (dest->owner->mChunkSink != NULL && bytes > (size_t) dest->owner->mChunkBytes)
+        bytes = dest->owner->mChunkBytes;
+    dest->chunkStart = start;
+    dest->chunkEnd = start + bytes;
+    dest->pub.next_output_byte = start;
+    dest->pub.free_in_buffer = bytes;
 }
 
 /**
  * Empty the output buffer
  *
- * The function should not be called,
- * because we should allocate enough memory for the jpeg destination buffer
+ * The function is called when the chunk libjpeg was given is full, which
+ * goes to the sink if there is one. The output goes on in the rest of the
+ * buffer, and when the jpeg destination buffer, or the last overflow
+ * chunk, is full, in a new overflow chunk.
  * If we return FALSE, the libjpeg will terminate, so return TRUE always.
- * But when the function is called, the encoding failing will be recorded.
+ * But when no chunk is left, the encoding failing will be recorded.
  *
  * \param cInfo: the compress pointer
  * \return TRUE if it is successful.
@@ -243,13 +643,33 @@ void SWJpegEncoder::initDestination(j_compress_ptr cInfo)
 boolean SWJpegEncoder::emptyOutputBuffer(j_compress_ptr cInfo)
 {
     LOG1("@%s", __FUNCTION__);
-    LOGE("@%s, line:%d, buffer overflow!", __FUNCTION__, __LINE__);
     JpegDestMgrPtr dest = (JpegDestMgrPtr)cInfo->dest;
+    JpegChunkSink *sink = dest->owner->mChunkSink;
+    // the entropy coder doesn't update next_output_byte, the chunk is full
+    JSAMPLE *end = dest->chunkEnd;
+
+    if (sink != NULL && dest->encodeSuccess)
+        sink->jpegChunk(dest->chunkStart, end - dest->chunkStart);
+    if (end < dest->bufEnd) {
+        startChunk(dest, end);
+        return TRUE;
+    }
 
+    if (dest->encodeSuccess && dest->overflowChunks < mMaxOverflowChunks) {
+        unsigned char *chunk = new unsigned char[mOverflowChunkBytes];
+        dest->owner->mOverflowChunks.push(chunk);
+        dest->overflowChunks++;
+        LOG1("@%s, output continues in overflow chunk %d", __FUNCTION__, dest->overflowChunks);
+        dest->bufEnd = chunk + mOverflowChunkBytes;
+        startChunk(dest, chunk);
+        return TRUE;
+    }
+
+    LOGE("@%s, line:%d, buffer overflow!", __FUNCTION__, __LINE__);
     /* re-cfg the buffer info */
-    dest->pub.next_output_byte = dest->outJpegBuf;
-    dest->pub.free_in_buffer = dest->outJpegBufSize;
     dest->encodeSuccess = false;
+    dest->bufEnd = dest->outJpegBuf + dest->outJpegBufSize;
+    startChunk(dest, dest->outJpegBuf);
 
     return TRUE; /* if return FALSE, the total taking picture will fail */
 }
@@ -268,8 +688,14 @@ void SWJpegEncoder::termDestination(j_compress_ptr cInfo)
     LOG1("@%s", __FUNCTION__);
     JpegDestMgrPtr dest = (JpegDestMgrPtr)cInfo->dest;
 
-    dest->codedSize = dest->outJpegBufSize - dest->pub.free_in_buffer;
+    JpegChunkSink *sink = dest->owner->mChunkSink;
+
+    // the overflow chunks before the last one are full
+    dest->codedSize = dest->outJpegBufSize + dest->overflowChunks * mOverflowChunkBytes
+                      - (dest->bufEnd - dest->pub.next_output_byte);
     LOG1("@%s, line:%d, codedSize:%d", __FUNCTION__, __LINE__, dest->codedSize);
+    if (sink != NULL && dest->encodeSuccess && dest->pub.next_output_byte > dest->chunkStart)
+        sink->jpegChunk(dest->chunkStart, dest->pub.next_output_byte - dest->chunkStart);
 }
 
 }
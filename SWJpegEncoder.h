@@ -33,6 +33,7 @@
 //#include "AtomCommon.h"
 #include "CameraCommon.h"
 #include <utils/Errors.h>
+#include <utils/Vector.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,24 +46,102 @@ extern "C" {
 
 namespace android {
 
+/**
+ * Speed profiles of the SW jpeg encoder, from the intel-jpeg-speed parameter
+ */
+enum JpegSpeed {
+    JPEG_SPEED_BALANCED = 0,    // accurate integer DCT, standard Huffman tables
+    JPEG_SPEED_FAST,            // fast integer DCT, standard Huffman tables
+    JPEG_SPEED_QUALITY,         // accurate integer DCT, Huffman tables optimized per image
+};
+
+/**
+ * Receives the stream of a SWJpegEncoder as it is produced, see
+ * SWJpegEncoder::setChunkSink()
+ */
+class JpegChunkSink {
+public:
+    virtual ~JpegChunkSink() {}
+    // the 'bytes' bytes that follow the previous chunk, valid until deInit()
+    virtual void jpegChunk(const unsigned char *data, int bytes) = 0;
+};
+
 /**
  * \class SWJpegEncoder
  *
  * This class is used for sw jpeg encoder.
  * It will call the libjpeg directly.
- * It just support NV12 input currently.
+ * It takes YV12 input, encoded as 4:2:0, and 4:2:2 planar or YUYV input,
+ * encoded as 4:2:2 so that the chroma is never subsampled vertically.
+ *
+ * The libjpeg compressor is created by the first init() and kept until the
+ * encoder is destroyed, with its parameters, destination manager and the
+ * quantization tables of every quality used so far, so that setting up an
+ * image only changes what differs from the previous one. The standard
+ * Huffman tables are kept aside too, since an optimized encode overwrites
+ * the ones in the compressor.
+ *
+ * An image that doesn't fit the buffer given to configEncoding() goes on
+ * in overflow chunks: getJpegSize() then gives more than the buffer holds,
+ * and copyOverflow() fetches the rest, until deInit().
+ *
+ * With a chunk sink, the stream is handed out in chunks of a fixed size as
+ * the entropy coder fills them, the last one shorter, from where it was
+ * written: the buffer, or the overflow chunks.
  */
 class SWJpegEncoder {
 public:
     SWJpegEncoder();
     ~SWJpegEncoder();
 
+    /**
+     * The planes of a source, wherever they are: rows of the Y plane are
+     * yStride bytes apart, rows of the U and V planes uvStride bytes. The
+     * format is V4L2_PIX_FMT_YUV420 (one chroma row per two luma rows),
+     * V4L2_PIX_FMT_YUV422P (one chroma row per luma row) or
+     * V4L2_PIX_FMT_YUYV, whose packed rows are all in 'y'.
+     * An uncached source (a locked gralloc surface) is read through a
+     * ColorReadback one MCU row at a time, anything else in place,
+     * except YUYV, which is always unpacked one MCU row at a time.
+     */
+    struct YuvPlanes {
+        const unsigned char *y;
+        const unsigned char *u;
+        const unsigned char *v;
+        int yStride;
+        int uvStride;
+        int format;
+        bool uncached;
+    };
+
+    // the planes of a YV12 buffer of 'stride' bytes per row and 'alignHeight' rows
+    static YuvPlanes yv12Planes(const void *buf, int stride, int alignHeight, bool uncached);
+    // the planes of a 4:2:2 planar (422H) buffer of 'stride' bytes per row and 'alignHeight' rows
+    static YuvPlanes yuv422pPlanes(const void *buf, int stride, int alignHeight, bool uncached);
+    // a YUYV buffer of 'stride' bytes per row
+    static YuvPlanes yuyvPlanes(const void *buf, int stride, bool uncached);
+
+    // whether a V4L2 format can be encoded, and the luma rows of its MCUs
+    static bool isSupportedFormat(int format);
+    static int mcuRows(int format);
+
     void init(void);
     void deInit(void);
     void setJpegQuality(int quality);
+    void setJpegSpeed(JpegSpeed speed);
+    void setInputFormat(int format);
     int configEncoding(int width, int height, void *jpegBuf, int jpegBufSize);
-    int doJpegEncoding(const void* yuv_buf, int format);
+    int doJpegEncoding(const YuvPlanes &planes);
     void getJpegSize(int *jpegSize);
+    // copies the bytes of the last image past the end of its buffer to 'dst'
+    void copyOverflow(unsigned char *dst);
+    // hands the following images to 'sink' in chunks of 'chunkBytes', NULL for none
+    void setChunkSink(JpegChunkSink *sink, int chunkBytes);
+
+    // name of a profile, as in the intel-jpeg-speed parameter
+    static const char *jpegSpeedName(JpegSpeed speed);
+    // whether the linked libjpeg has SIMD DCT and color kernels (libjpeg-turbo)
+    static bool hasSimdBackend();
 
 // prevent copy constructor and assignment operator
 private:
@@ -76,19 +155,49 @@ private:
         int outJpegBufSize;  /*!< jpeg output buffer size */
         int codedSize;  /*!< the final encoded out jpeg size */
         bool encodeSuccess;  /*!< if buffer overflow, it will be set to false */
+        SWJpegEncoder *owner;  /*!< keeps the overflow chunks */
+        int overflowChunks;  /*!< overflow chunks used by this image */
+        JSAMPLE *bufEnd;  /*!< end of the buffer or overflow chunk written */
+        JSAMPLE *chunkStart;  /*!< start of the chunk libjpeg is filling */
+        JSAMPLE *chunkEnd;  /*!< and its end */
     } JpegDestMgr, *JpegDestMgrPtr;
 
+    // scaled quantization tables of one quality, luma and chroma
+    struct QuantTables {
+        int quality;
+        UINT16 table[2][DCTSIZE2];
+    };
+
     struct jpeg_compress_struct mCInfo;
     struct jpeg_error_mgr mJErr;
+    bool mCreated;          // mCInfo holds a compressor, with its defaults set
     int mJpegQuality;
+    JpegSpeed mJpegSpeed;
+    int mInputFormat;       // V4L2 format of the next image, sets the sampling factors
+    int mTablesQuality;     // quality of the tables in mCInfo, 0 if none yet
+    Vector<QuantTables> mQuantTables;
+    JHUFF_TBL mStdDcTables[2];  // the tables jpeg_set_defaults() left, luma and chroma
+    JHUFF_TBL mStdAcTables[2];
+    bool mHuffOptimized;    // the Huffman tables in mCInfo were optimized for an image
+    unsigned char *mBand;   // one MCU row of an uncached or packed source
+    int mBandSize;
+    Vector<unsigned char *> mOverflowChunks; // output past the buffer, released by deInit()
+    JpegChunkSink *mChunkSink;
+    int mChunkBytes;
     static const unsigned int mSupportedFormat = JCS_YCbCr;
     static const int mDefaultJpegQuality = 90;
+    static const int mOverflowChunkBytes = 256 * 1024;
+    static const int mMaxOverflowChunks = 64;
 
+    void setQuantTables(int quality);
+    void setHuffTables(bool optimize);
+    void releaseOverflow();
     int setupJpegDestMgr(j_compress_ptr cInfo, JSAMPLE *jpegBuf, int jpegBufSize);
     // the below three functions are for the dest buffer manager.
     static void initDestination(j_compress_ptr cInfo);
     static boolean emptyOutputBuffer(j_compress_ptr cInfo);
     static void termDestination(j_compress_ptr cInfo);
+    static void startChunk(JpegDestMgrPtr dest, JSAMPLE *start);
 };
 
 }; // namespace android
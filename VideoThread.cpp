@@ -19,6 +19,7 @@
 #include "LogHelper.h"
 #include "Callbacks.h"
 #include "ColorConverter.h"
+#include "ColorConvertPlanner.h"
 #include "DumpImage.h"
 
 namespace android {
@@ -103,8 +104,8 @@ status_t VideoThread::handleMessageExit()
 status_t VideoThread::handleMessageVideo(MessageVideo *msg)
 {
     LOG2("@%s", __FUNCTION__);
-    void *srcaddr[3];
-    int size = 0;
+    ConvertRequest request;
+    ConvertBuffers buffers;
     status_t status = NO_ERROR;
     if((msg->yuv422hbuff == NULL) || (msg->nv12buff == NULL))
     {
@@ -112,13 +113,31 @@ status_t VideoThread::handleMessageVideo(MessageVideo *msg)
         return UNKNOWN_ERROR;
     }
 
+    // MJPEG frames are decoded into YUV422H gralloc buffers, YUYV ones come straight from the driver
     if(mPictureMode) {
-        mVaConvertor->VPPBitBlit(msg->yuv422hbuff->GetRenderTargetHandle(),msg->nv12buff->GetRenderTargetHandle());
+        RenderTarget *rt = msg->yuv422hbuff->GetRenderTargetHandle();
+        request.srcFormat = V4L2_PIX_FMT_YUV422P;
+        request.srcWidth = rt->rect.width;
+        request.srcHeight = rt->rect.height;
+        request.srcStride = msg->yuv422hbuff->GetGraStride();
     } else {
-        msg->nv12buff->LockGrallocData((void**)&srcaddr,&size);
-        colorConvert(V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12,mWidth, mHeight,msg->yuv422hbuff->getData(), srcaddr[0]);
-        msg->nv12buff->UnLockGrallocData();
+        request.srcFormat = V4L2_PIX_FMT_YUYV;
+        request.srcWidth = mWidth;
+        request.srcHeight = mHeight;
+        request.srcStride = mWidth;
     }
+    request.srcSurface = mPictureMode;
+    request.dstFormat = V4L2_PIX_FMT_NV12;
+    request.dstWidth = mWidth;
+    request.dstHeight = mHeight;
+    request.dstSurface = true;
+    request.midFormat = 0;
+
+    buffers.src = msg->yuv422hbuff;
+    buffers.mid = NULL;
+    buffers.dst = msg->nv12buff;
+    buffers.vpp = mVaConvertor;
+    status = ColorConvertPlanner::instance()->run(request, buffers);
     mCallbacks->videoFrameDone(msg->nv12buff, msg->timestamp);
     if (msg->yuv422hbuff != 0)
         msg->yuv422hbuff->decrementProcessor();
@@ -38,4 +38,17 @@ $(foreach file,$(test_src_files), \
     $(eval include $(BUILD_EXECUTABLE)) \
 )
 
+# Build the gralloc readback benchmark, against the HAL's kernels.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+    camtest_Readback.cpp \
+    ../ColorConverterKernels.cpp \
+
+LOCAL_SHARED_LIBRARIES := $(shared_libraries) libui
+LOCAL_STATIC_LIBRARIES := $(static_libraries)
+LOCAL_C_INCLUDES := $(c_includes) $(LOCAL_PATH)/..
+LOCAL_MODULE := camtest_Readback
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_EXECUTABLE)
+
 include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gtest/gtest.h>
+#include <hardware/gralloc.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
+#include "ColorConverterKernels.h"
+
+#define LOG_TAG "CameraReadback"
+#include <utils/Log.h>
+
+namespace android {
+
+// 1080p YV12 sized, like the picture/preview VPP outputs
+static const int SURFACE_WIDTH = 1920;
+static const int SURFACE_HEIGHT = 1088;
+static const int SURFACE_BYTES = SURFACE_WIDTH * SURFACE_HEIGHT * 3 / 2;
+static const int LOOPS = 20;
+
+class ColorReadbackBench : public testing::Test {
+protected:
+
+    // A VPP-like render target, mapped the way LockGrallocData() maps it
+    virtual void SetUp()
+    {
+        void *vaddr = NULL;
+
+        mSrc = NULL;
+        mDst = new unsigned char[SURFACE_BYTES];
+        mExpected = new unsigned char[SURFACE_BYTES];
+        mSurface = new GraphicBuffer(SURFACE_WIDTH, SURFACE_HEIGHT, HAL_PIXEL_FORMAT_YV12,
+                                     GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_SW_READ_RARELY |
+                                     GRALLOC_USAGE_SW_WRITE_RARELY);
+        ASSERT_EQ(mSurface->initCheck(), NO_ERROR) << "Failed to allocate the gralloc surface";
+
+        ASSERT_EQ(mSurface->lock(GRALLOC_USAGE_SW_WRITE_RARELY, &vaddr), NO_ERROR);
+        for (int i = 0; i < SURFACE_BYTES; i++)
+            mExpected[i] = (unsigned char) (i * 7 + (i >> 11));
+        memcpy(vaddr, mExpected, SURFACE_BYTES);
+        mSurface->unlock();
+
+        ASSERT_EQ(mSurface->lock(GRALLOC_USAGE_SW_READ_MASK, &vaddr), NO_ERROR);
+        mSrc = (unsigned char *) vaddr;
+    }
+
+    virtual void TearDown()
+    {
+        if (mSrc != NULL)
+            mSurface->unlock();
+        mSurface.clear();
+        delete [] mExpected;
+        delete [] mDst;
+    }
+
+    // MB/s of 'LOOPS' whole surface reads
+    static double bandwidth(nsecs_t elapsed)
+    {
+        return (double) SURFACE_BYTES * LOOPS / 1024 / 1024 / (elapsed / 1e9);
+    }
+
+    sp<GraphicBuffer> mSurface;
+    unsigned char *mSrc;
+    unsigned char *mDst;
+    unsigned char *mExpected;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Test description:
+//      Reads a whole gralloc surface back into system memory, once with
+//      plain memcpy() and once through ColorReadback, both as a block copy
+//      and row by row the way the stride-aware converters consume it.
+// Expected result:
+//      1. Both reads return the surface contents
+//      2. Bandwidths are printed, the streaming one should not be lower
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(ColorReadbackBench, Bandwidth)
+{
+    const ColorKernels &kernels = getColorKernels();
+    nsecs_t start;
+
+    printf("kernels %s, streaming loads %s\n", kernels.name, kernels.streamingLoads ? "yes" : "no");
+
+    start = systemTime();
+    for (int i = 0; i < LOOPS; i++)
+        memcpy(mDst, mSrc, SURFACE_BYTES);
+    double plainCopy = bandwidth(systemTime() - start);
+    ASSERT_EQ(memcmp(mDst, mExpected, SURFACE_BYTES), 0);
+
+    memset(mDst, 0, SURFACE_BYTES);
+    start = systemTime();
+    for (int i = 0; i < LOOPS; i++) {
+        ColorReadback readback(true);
+        readback.copy(mDst, mSrc, SURFACE_BYTES);
+    }
+    double streamCopy = bandwidth(systemTime() - start);
+    ASSERT_EQ(memcmp(mDst, mExpected, SURFACE_BYTES), 0);
+
+    // rows consumed in place, like the chroma interleaving of the converters
+    const int rows = SURFACE_BYTES / SURFACE_WIDTH;
+    unsigned int plainSum = 0;
+    start = systemTime();
+    for (int i = 0; i < LOOPS; i++) {
+        for (int r = 0; r < rows; r++) {
+            const unsigned char *row = mSrc + r * SURFACE_WIDTH;
+            for (int x = 0; x < SURFACE_WIDTH; x++)
+                plainSum += row[x];
+        }
+    }
+    double plainRows = bandwidth(systemTime() - start);
+
+    unsigned int streamSum = 0;
+    start = systemTime();
+    for (int i = 0; i < LOOPS; i++) {
+        ColorReadback readback(true);
+        for (int r = 0; r < rows; r++) {
+            const unsigned char *row = readback.read(0, mSrc + r * SURFACE_WIDTH, SURFACE_WIDTH);
+            for (int x = 0; x < SURFACE_WIDTH; x++)
+                streamSum += row[x];
+        }
+    }
+    double streamRows = bandwidth(systemTime() - start);
+    ASSERT_EQ(plainSum, streamSum);
+
+    printf("block copy: plain %.1f MB/s, streaming %.1f MB/s\n", plainCopy, streamCopy);
+    printf("row reads:  plain %.1f MB/s, streaming %.1f MB/s\n", plainRows, streamRows);
+    ALOGD("block copy: plain %.1f MB/s, streaming %.1f MB/s", plainCopy, streamCopy);
+    ALOGD("row reads: plain %.1f MB/s, streaming %.1f MB/s", plainRows, streamRows);
+}
+
+}; // namespace android
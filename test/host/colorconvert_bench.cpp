@@ -0,0 +1,762 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+Host benchmark and regression check of the color converters, see the
+Makefile next to this file.
+
+The check runs every row kernel of every instruction set level against the
+C kernels, on all the widths up to a few vectors plus a few real ones and on
+misaligned buffers, and then every conversion of the benchmark at every
+level. Conversions the HAL had before the row kernels are checked against
+the frozen converters of colorconvert_reference.cpp, the newer ones against
+their C kernel, single threaded, no readback run. Outputs must be identical,
+including the bytes around them.
+
+The benchmark runs every conversion at the usual camera sizes and reports
+frame time, megapixels per second, and bytes read plus written per cycle.
+Cycles are time stamp counter cycles, at the nominal CPU frequency.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include "ColorConverter.h"
+#include "ColorConverterKernels.h"
+#include "ColorConverterPool.h"
+#include "CameraCommon.h"
+#include "colorconvert_reference.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+namespace android {
+
+// public converters that ColorConverter.h doesn't declare
+void YUYVToNV21(int width, int height, void *src, void *dst);
+void YUYVToNV12(int width, int height, void *src, void *dst);
+void YUYVToNV12_withStride(int width, int height, void *src, void *dst);
+void YUYVToRGB8888(int width, int height, void *src, void *dst);
+void YUYVToRGB565(int width, int height, void *src, void *dst);
+void NV12ToRGB565(int width, int height, void *src, void *dst);
+void NV12ToRGB565withStride(int width, int height, int stride, int alignheight, void *src, void *dst);
+void YU16ToNV21(int width, int height, void *src, void *dst);
+
+// largest frame: 5MP, stride aligned to 128, 32 rows of height padding, 4 bytes per pixel
+static const int MAX_WIDTH = 2592;
+static const int MAX_HEIGHT = 1944;
+static const int BUFFER_BYTES = ALIGN(MAX_WIDTH, 128) * ALIGN(MAX_HEIGHT, 32) * 4 + 4096;
+
+// surfaces are benchmarked with the gralloc geometry of the VPP outputs
+static inline int surfaceStride(int width) { return ALIGN(width, 128); }
+static inline int surfaceRows(int height) { return ALIGN(height, 32); }
+
+struct FrameSize {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const FrameSize sBenchSizes[] = {
+    { "QVGA", 320, 240 },
+    { "VGA", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "5MP", 2592, 1944 },
+};
+
+// small enough to check everything at every level, with widths that leave vector tails
+static const FrameSize sCheckSizes[] = {
+    { "tails", 322, 242 },
+    { "720p", 1280, 720 },
+};
+
+enum CaseKind {
+    CASE_ROWS = 0,      // a rows function of getColorConvertRows(), packed or strided source
+    CASE_CONVERT,       // colorConvert()
+    CASE_IN_PLACE,      // colorConvert() of a copy of the source onto itself
+    CASE_STRIDE,        // colorConvertwithStride(), from a surface
+    CASE_SCALED,        // colorConvertScaled() to 'option' / 4 of the size
+    CASE_REPAD,         // RepaddingYV12(), from a surface
+    CASE_COPYBUF,       // copyBufWithStride(), from a surface
+    CASE_COPY_YUYV,     // copyYUYV_withStride(), into a surface
+    CASE_FRAME,         // one of the (width, height, src, dst) converters
+    CASE_FRAME_STRIDE,  // one of the (width, height, stride, alignheight, src, dst) converters
+    CASE_TO_SURFACE,    // colorConvertToNV12Surface(), 'option' is the SurfaceLayout
+    CASE_FROM_SURFACE,  // colorConvertFromNV12Surface(), 'option' is the SurfaceLayout
+};
+
+struct BenchCase {
+    const char *name;
+    CaseKind kind;
+    int srcFormat;
+    int dstFormat;
+    int option;         // CASE_ROWS: packed; CASE_SCALED: size in quarters and filter
+    void (*frame)(int width, int height, void *src, void *dst);
+    void (*frameStride)(int width, int height, int stride, int alignheight, void *src, void *dst);
+    // the frozen converter of CASE_FRAME and CASE_FRAME_STRIDE cases
+    void (*referenceFrame)(int width, int height, void *src, void *dst);
+    void (*referenceFrameStride)(int width, int height, int stride, int alignheight, void *src, void *dst);
+};
+
+#define ROWS(src, dst) \
+    { "rows " #src "->" #dst, CASE_ROWS, V4L2_PIX_FMT_##src, V4L2_PIX_FMT_##dst, 1, NULL, NULL }, \
+    { "rows " #src "->" #dst " strided", CASE_ROWS, V4L2_PIX_FMT_##src, V4L2_PIX_FMT_##dst, 0, NULL, NULL }
+#define SCALED(src, dst, quarters, filter) \
+    { "colorConvertScaled " #src "->" #dst " " #quarters "/4 " #filter, CASE_SCALED, \
+      V4L2_PIX_FMT_##src, V4L2_PIX_FMT_##dst, (quarters) | (COLOR_SCALE_##filter << 8), NULL, NULL }
+#define TO_SURFACE(src, layout) \
+    { "colorConvertToNV12Surface " #src " " #layout, CASE_TO_SURFACE, V4L2_PIX_FMT_##src, V4L2_PIX_FMT_NV12, \
+      SURFACE_##layout, NULL, NULL }
+#define FROM_SURFACE(layout) \
+    { "colorConvertFromNV12Surface " #layout, CASE_FROM_SURFACE, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, \
+      SURFACE_##layout, NULL, NULL }
+#define FRAME(func, src, dst) \
+    { #func, CASE_FRAME, V4L2_PIX_FMT_##src, V4L2_PIX_FMT_##dst, 0, func, NULL, reference::func, NULL }
+#define FRAME_STRIDE(func, src, dst) \
+    { #func, CASE_FRAME_STRIDE, V4L2_PIX_FMT_##src, V4L2_PIX_FMT_##dst, 0, NULL, func, NULL, reference::func }
+
+// V4L2_PIX_FMT_YUV420 is YV12, like everywhere in the HAL
+static const BenchCase sCases[] = {
+    // every rows function of the conversion table, see caseIsSkipped()
+    ROWS(YUYV, NV12), ROWS(YUYV, NV21), ROWS(YUYV, RGB565), ROWS(YUYV, RGB32),
+    ROWS(NV12, NV21), ROWS(NV12, YUV420), ROWS(NV12, RGB565), ROWS(NV21, NV12),
+    ROWS(YUV420, NV12), ROWS(YUV420, NV21), ROWS(YUV420, RGB565),
+    ROWS(YUV422P, NV12), ROWS(YUV422P, NV21), ROWS(YUV422P, YUV420),
+
+    { "colorConvert NV12->NV12 copy", CASE_CONVERT, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, 0, NULL, NULL },
+    { "colorConvert YUV420->YUV420 repad", CASE_CONVERT, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, 0, NULL, NULL },
+    { "colorConvert NV12->NV21 in place", CASE_IN_PLACE, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, 0, NULL, NULL },
+    { "colorConvertwithStride YUV422P->NV21", CASE_STRIDE, V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, 0, NULL, NULL },
+    { "colorConvertwithStride YUV422P->YUV420", CASE_STRIDE, V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, 0, NULL, NULL },
+    { "colorConvertwithStride YUV420->NV21", CASE_STRIDE, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, 0, NULL, NULL },
+    { "colorConvertwithStride NV12->RGB565", CASE_STRIDE, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, 0, NULL, NULL },
+    SCALED(YUYV, NV21, 2, BOX), SCALED(YUYV, NV21, 3, BILINEAR), SCALED(YUYV, YUV420, 2, BOX),
+    SCALED(YUV422P, NV21, 2, BOX), SCALED(YUV422P, YUV420, 3, BILINEAR), SCALED(NV12, NV21, 2, BOX),
+    SCALED(YUV420, YUV420, 1, BOX),
+    { "RepaddingYV12", CASE_REPAD, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, 0, NULL, NULL },
+    { "copyBufWithStride YUV420", CASE_COPYBUF, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, 0, NULL, NULL },
+    { "copyBufWithStride NV21", CASE_COPYBUF, V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_NV21, 0, NULL, NULL },
+    { "copyYUYV_withStride", CASE_COPY_YUYV, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUYV, 0, NULL, NULL },
+    TO_SURFACE(YUYV, LINEAR), TO_SURFACE(YUYV, Y_TILED), TO_SURFACE(YUV422P, LINEAR), TO_SURFACE(YUV422P, Y_TILED),
+    TO_SURFACE(NV12, Y_TILED), FROM_SURFACE(LINEAR), FROM_SURFACE(Y_TILED),
+
+    FRAME(YUYVToNV21, YUYV, NV21), FRAME(YUYVToNV12, YUYV, NV12), FRAME(YUYVToNV12_withStride, YUYV, NV12),
+    FRAME(YUYVToRGB8888, YUYV, RGB32), FRAME(YUYVToRGB565, YUYV, RGB565), FRAME(NV12ToRGB565, NV12, RGB565),
+    FRAME(NV12ToP411, NV12, YUV411P), FRAME(YV12ToNV12, YUV420, NV12),
+    FRAME(YU16ToYUYV, YUV422P, YUYV), FRAME(YU16ToYV12, YUV422P, YUV420), FRAME(YU16ToNV12, YUV422P, NV12),
+    FRAME(YU16ToNV21, YUV422P, NV21),
+    FRAME_STRIDE(NV12ToRGB565withStride, NV12, RGB565),
+};
+
+#undef ROWS
+#undef SCALED
+#undef TO_SURFACE
+#undef FROM_SURFACE
+#undef FRAME
+#undef FRAME_STRIDE
+
+// bytes of a packed frame
+static int formatBytes(int format, int width, int height)
+{
+    switch (format) {
+    case V4L2_PIX_FMT_RGB32:
+        return width * height * 4;
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_RGB565:
+    case V4L2_PIX_FMT_YUV422P:
+        return width * height * 2;
+    default:
+        return width * height * 3 / 2;
+    }
+}
+
+static void scaledSize(const BenchCase &c, int width, int height, int *dstWidth, int *dstHeight)
+{
+    const int quarters = c.option & 0xff;
+    *dstWidth = ALIGN(width * quarters / 4, 2);
+    *dstHeight = ALIGN(height * quarters / 4, 2);
+}
+
+// bytes read and written by one conversion
+static long long caseBytes(const BenchCase &c, int width, int height)
+{
+    int dstWidth = width;
+    int dstHeight = height;
+    if (c.kind == CASE_SCALED)
+        scaledSize(c, width, height, &dstWidth, &dstHeight);
+    return (long long) formatBytes(c.srcFormat, width, height) + formatBytes(c.dstFormat, dstWidth, dstHeight);
+}
+
+static ColorConvertRowsFunc caseRows(const BenchCase &c)
+{
+    return getColorConvertRows(c.srcFormat, c.dstFormat, c.option != 0);
+}
+
+// strided twins of pairs that only have a packed converter, or whose lookup
+// ends up in the converter of the packed case, are skipped
+static bool caseIsSkipped(const BenchCase &c)
+{
+    if (c.kind != CASE_ROWS || c.option != 0)
+        return false;
+    ColorConvertRowsFunc strided = getColorConvertRows(c.srcFormat, c.dstFormat, false);
+    return strided == NULL || strided == getColorConvertRows(c.srcFormat, c.dstFormat, true);
+}
+
+static bool runCase(const BenchCase &c, int width, int height, unsigned char *src, unsigned char *dst)
+{
+    const int stride = surfaceStride(width);
+    const int rows = surfaceRows(height);
+
+    switch (c.kind) {
+    case CASE_ROWS: {
+        ColorConvertJob job;
+        memset(&job, 0, sizeof(job));
+        job.convertRows = caseRows(c);
+        if (job.convertRows == NULL)
+            return false;
+        job.width = job.srcWidth = width;
+        job.height = job.srcHeight = height;
+        job.stride = c.option ? width : stride;
+        job.alignHeight = c.option ? height : rows;
+        job.src = src;
+        job.dst = dst;
+        runColorConvertJob(job);
+        return true;
+    }
+    case CASE_CONVERT:
+        return colorConvert(c.srcFormat, c.dstFormat, width, height, src, dst) == NO_ERROR;
+    case CASE_IN_PLACE:
+        memcpy(dst, src, formatBytes(c.srcFormat, width, height));
+        return colorConvert(c.srcFormat, c.dstFormat, width, height, dst, dst) == NO_ERROR;
+    case CASE_STRIDE:
+        return colorConvertwithStride(c.srcFormat, c.dstFormat, stride, width, rows, height, src, dst) == NO_ERROR;
+    case CASE_SCALED: {
+        int dstWidth, dstHeight;
+        int srcStride = (c.srcFormat == V4L2_PIX_FMT_YUYV) ? width : stride;
+        scaledSize(c, width, height, &dstWidth, &dstHeight);
+        return colorConvertScaled(c.srcFormat, c.dstFormat, srcStride, width, rows, height, src,
+                                  dstWidth, dstHeight, dst, (ColorScaleFilter) (c.option >> 8)) == NO_ERROR;
+    }
+    case CASE_REPAD:
+        RepaddingYV12(width, height, stride, ALIGN(width, 16), rows, src, dst, 1);
+        return true;
+    case CASE_COPYBUF:
+        return copyBufWithStride(dst, src, width, height, stride, width, rows, c.srcFormat) == 0;
+    case CASE_COPY_YUYV:
+        copyYUYV_withStride(stride, width, height, src, dst);
+        return true;
+    case CASE_FRAME:
+        c.frame(width, height, src, dst);
+        return true;
+    case CASE_FRAME_STRIDE:
+        c.frameStride(width, height, stride, rows, src, dst);
+        return true;
+    case CASE_TO_SURFACE: {
+        int srcStride = (c.srcFormat == V4L2_PIX_FMT_YUYV) ? width : stride;
+        return colorConvertToNV12Surface(c.srcFormat, srcStride, rows, width, height, src,
+                                         (SurfaceLayout) c.option, stride, rows, dst) == NO_ERROR;
+    }
+    case CASE_FROM_SURFACE:
+        return colorConvertFromNV12Surface((SurfaceLayout) c.option, stride, rows, width, height, src, dst) == NO_ERROR;
+    }
+    return false;
+}
+
+// whether the frozen converters have the conversion, in colorConvert() when
+// 'packed' and in colorConvertwithStride() otherwise
+static bool referenceConverts(int srcFormat, int dstFormat, bool packed)
+{
+    static const struct {
+        int srcFormat;
+        int dstFormat;
+        bool packed;
+    } conversions[] = {
+        { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, true },
+        { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21, true },
+        { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB565, true },
+        { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_RGB32, true },
+        { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12, true },
+        { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, true },
+        { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, true },
+        { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, true },
+        { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, true },
+        { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, true },
+        { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_RGB565, true },
+        { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, true },
+        { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_RGB565, false },
+        { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV12, false },
+        { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_NV21, false },
+        { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420, false },
+        { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, false },
+    };
+
+    for (unsigned int i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++) {
+        if (conversions[i].srcFormat == srcFormat && conversions[i].dstFormat == dstFormat &&
+            conversions[i].packed == packed)
+            return true;
+    }
+    return false;
+}
+
+// runs the case with the frozen converters, false if they don't have it
+static bool runReference(const BenchCase &c, int width, int height, unsigned char *src, unsigned char *dst)
+{
+    const int stride = surfaceStride(width);
+    const int rows = surfaceRows(height);
+
+    switch (c.kind) {
+    case CASE_ROWS:
+    case CASE_CONVERT:
+    case CASE_STRIDE: {
+        // a packed rows function is what colorConvert() runs, a strided one
+        // what colorConvertwithStride() runs
+        const bool packed = (c.kind == CASE_CONVERT) || (c.kind == CASE_ROWS && c.option != 0);
+        if (!referenceConverts(c.srcFormat, c.dstFormat, packed))
+            return false;
+        if (packed)
+            return reference::colorConvert(c.srcFormat, c.dstFormat, width, height, src, dst) == NO_ERROR;
+        return reference::colorConvertwithStride(c.srcFormat, c.dstFormat, stride, width, rows, height,
+                                                 src, dst) == NO_ERROR;
+    }
+    case CASE_REPAD:
+        reference::RepaddingYV12(width, height, stride, ALIGN(width, 16), rows, src, dst, 1);
+        return true;
+    case CASE_COPYBUF:
+        return reference::copyBufWithStride(dst, src, width, height, stride, width, rows, c.srcFormat) == 0;
+    case CASE_COPY_YUYV:
+        reference::copyYUYV_withStride(stride, width, height, src, dst);
+        return true;
+    case CASE_FRAME:
+        c.referenceFrame(width, height, src, dst);
+        return true;
+    case CASE_FRAME_STRIDE:
+        c.referenceFrameStride(width, height, stride, rows, src, dst);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void fillRandom(unsigned char *buffer, int bytes, unsigned int seed)
+{
+    for (int i = 0; i < bytes; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = (unsigned char) (seed >> 16);
+    }
+}
+
+static unsigned char *allocBuffer(int bytes)
+{
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, 64, bytes) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    return (unsigned char *) buffer;
+}
+
+static long long nowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static unsigned long long nowCycles()
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static bool matchesFilter(const BenchCase &c, const char *filter)
+{
+    return filter == NULL || strstr(c.name, filter) != NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Kernel check
+// ----------------------------------------------------------------------------
+
+// a Y-tiled row spreads 16 bytes over every 512
+static const int KERNEL_BYTES = MAX_WIDTH * 32 + 256;
+static const int NUM_KERNELS = 16;
+
+struct KernelBuffers {
+    unsigned char *src[3];
+    unsigned char *dst[2][2];   // [reference, tested][plane]
+};
+
+static int checkWidths(int *widths)
+{
+    int count = 0;
+    for (int w = 1; w <= 80; w++)
+        widths[count++] = w;
+    static const int real[] = { 176, 318, 320, 640, 1280, 1918, 1920, 2592 };
+    for (unsigned int i = 0; i < sizeof(real) / sizeof(real[0]); i++)
+        widths[count++] = real[i];
+    return count;
+}
+
+// runs kernel 'index' of 'kernels' on 'width' pixels, with the buffers offset by 'shift' bytes
+static const char *runKernel(const ColorKernels &kernels, int index, int width, int shift,
+                             unsigned char *const src[3], unsigned char *const dst[2])
+{
+    const unsigned char *s0 = src[0] + shift;
+    const unsigned char *s1 = src[1] + shift;
+    const unsigned char *s2 = src[2] + shift;
+    unsigned char *d0 = dst[0] + shift;
+    unsigned char *d1 = dst[1] + shift;
+
+    switch (index) {
+    case 0: kernels.yuyvToLumaRow(s0, d0, width); return "yuyvToLumaRow";
+    case 1: kernels.yuyvToNV12Row(s0, d0, d1, width); return "yuyvToNV12Row";
+    case 2: kernels.yuyvToNV21Row(s0, d0, d1, width); return "yuyvToNV21Row";
+    case 3: kernels.yuyvToRGBA8888(s0, d0, width / 2); return "yuyvToRGBA8888";
+    case 4: kernels.yuyvToRGB565(s0, d0, width / 2); return "yuyvToRGB565";
+    case 5: kernels.nv12ToRGB565Row(s0, s1, d0, width); return "nv12ToRGB565Row";
+    case 6: kernels.yv12ToRGB565Row(s0, s1, s2, d0, width); return "yv12ToRGB565Row";
+    case 7: kernels.streamLoadCopy(d0, s0, width); return "streamLoadCopy";
+    case 8: kernels.interleaveChroma(s0, s1, d0, width); return "interleaveChroma";
+    case 9: kernels.deinterleaveChroma(s0, d0, d1, width); return "deinterleaveChroma";
+    case 10: kernels.swapChromaPairs(s0, d0, width); return "swapChromaPairs";
+    case 11:
+        memcpy(d0, s0, width * 2);
+        kernels.swapChromaPairs(d0, d0, width);
+        return "swapChromaPairs in place";
+    case 12: kernels.averageChromaRows(s0, s1, d0, width, false); return "averageChromaRows";
+    case 13: kernels.averageChromaRows(s0, s1, d0, width, true); return "averageChromaRows rounded";
+    case 14: kernels.yTileRow(s0, d0, width); return "yTileRow";
+    case 15: kernels.yDetileRow(s0, d0, width); return "yDetileRow";
+    default: return "?";
+    }
+}
+
+static int checkKernels(ColorKernelIsa maxIsa)
+{
+    KernelBuffers buffers;
+    int widths[128];
+    const int numWidths = checkWidths(widths);
+    static const int shifts[] = { 0, 1, 3, 15, 33 };
+    int failures = 0;
+
+    for (int i = 0; i < 3; i++) {
+        buffers.src[i] = allocBuffer(KERNEL_BYTES);
+        fillRandom(buffers.src[i], KERNEL_BYTES, 17 + i);
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++)
+            buffers.dst[i][j] = allocBuffer(KERNEL_BYTES);
+    }
+
+    setColorKernelIsa(COLOR_KERNEL_ISA_C);
+    const ColorKernels reference = getColorKernels();
+
+    for (int isa = COLOR_KERNEL_ISA_C + 1; isa <= maxIsa; isa++) {
+        setColorKernelIsa((ColorKernelIsa) isa);
+        const ColorKernels &kernels = getColorKernels();
+        int runs = 0;
+        int isaFailures = 0;
+        for (int index = 0; index < NUM_KERNELS; index++) {
+            for (int w = 0; w < numWidths; w++) {
+                for (unsigned int s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++) {
+                    for (int i = 0; i < 2; i++) {
+                        memset(buffers.dst[i][0], 0xa5, KERNEL_BYTES);
+                        memset(buffers.dst[i][1], 0x5a, KERNEL_BYTES);
+                    }
+                    runKernel(reference, index, widths[w], shifts[s], buffers.src, buffers.dst[0]);
+                    const char *name = runKernel(kernels, index, widths[w], shifts[s], buffers.src, buffers.dst[1]);
+                    runs++;
+                    if (memcmp(buffers.dst[0][0], buffers.dst[1][0], KERNEL_BYTES) != 0 ||
+                        memcmp(buffers.dst[0][1], buffers.dst[1][1], KERNEL_BYTES) != 0) {
+                        if (isaFailures++ < 10)
+                            printf("FAIL %s %s: width %d, shift %d\n", kernels.name, name, widths[w], shifts[s]);
+                    }
+                }
+            }
+        }
+        printf("kernels %-6s %6d runs, %d failures\n", kernels.name, runs, isaFailures);
+        failures += isaFailures;
+    }
+
+    for (int i = 0; i < 3; i++)
+        free(buffers.src[i]);
+    for (int i = 0; i < 2; i++) {
+        free(buffers.dst[i][0]);
+        free(buffers.dst[i][1]);
+    }
+    return failures;
+}
+
+// ----------------------------------------------------------------------------
+// Conversion check
+// ----------------------------------------------------------------------------
+
+static int checkConversions(ColorKernelIsa maxIsa, const char *filter, unsigned char *src,
+                            unsigned char *reference, unsigned char *dst)
+{
+    static const int threads[] = { 1, 4 };
+    int failures = 0;
+    int runs = 0;
+
+    fillRandom(src, BUFFER_BYTES, 1);
+    for (unsigned int s = 0; s < sizeof(sCheckSizes) / sizeof(sCheckSizes[0]); s++) {
+        const int width = sCheckSizes[s].width;
+        const int height = sCheckSizes[s].height;
+        // the largest output is 4 bytes per pixel, or a surface of 1.5 bytes per pixel
+        const int bytes = surfaceStride(width) * surfaceRows(height) * 4;
+
+        for (unsigned int i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++) {
+            const BenchCase &c = sCases[i];
+            if (!matchesFilter(c, filter) || caseIsSkipped(c))
+                continue;
+
+            setColorKernelIsa(COLOR_KERNEL_ISA_C);
+            setColorConvertParallelism(1, 0);
+            setColorReadbackEnabled(false);
+            memset(reference, 0x5a, bytes);
+            if (!runReference(c, width, height, src, reference) &&
+                !runCase(c, width, height, src, reference)) {
+                printf("FAIL %s: not supported\n", c.name);
+                failures++;
+                continue;
+            }
+
+            setColorReadbackEnabled(true);
+            for (int isa = COLOR_KERNEL_ISA_C; isa <= maxIsa; isa++) {
+                for (unsigned int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+                    setColorKernelIsa((ColorKernelIsa) isa);
+                    setColorConvertParallelism(threads[t], 0);
+                    memset(dst, 0x5a, bytes);
+                    runCase(c, width, height, src, dst);
+                    runs++;
+                    if (memcmp(reference, dst, bytes) != 0) {
+                        printf("FAIL %s %dx%d: %s kernels, %d threads\n", c.name, width, height,
+                               getColorKernels().name, threads[t]);
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("conversions   %6d runs, %d failures\n", runs, failures);
+    return failures;
+}
+
+// ----------------------------------------------------------------------------
+// Y-tiled surface check
+// ----------------------------------------------------------------------------
+
+// byte (x, y) of a Y-tiled plane, straight from the tile layout
+static int yTiledOffset(int pitch, int x, int y)
+{
+    return (y / 32) * pitch * 32 + (x / 128) * 4096 + ((x % 128) / 16) * 512 + (y % 32) * 16 + x % 16;
+}
+
+// the tiled fill must put every byte of the linear fill where the tiling
+// says, and reading it back must give the packed frame of the CPU converters
+static int checkTiling(ColorKernelIsa maxIsa, unsigned char *src, unsigned char *reference, unsigned char *dst)
+{
+    static const int sources[] = { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV422P };
+    static const int threads[] = { 1, 4 };
+    unsigned char *linear = allocBuffer(BUFFER_BYTES);
+    int failures = 0;
+    int runs = 0;
+
+    fillRandom(src, BUFFER_BYTES, 3);
+    for (unsigned int s = 0; s < sizeof(sCheckSizes) / sizeof(sCheckSizes[0]); s++) {
+        const int width = sCheckSizes[s].width;
+        const int height = sCheckSizes[s].height;
+        const int pitch = surfaceStride(width);
+        const int rows = surfaceRows(height);
+        const int bytes = pitch * rows * 3 / 2;
+
+        for (unsigned int f = 0; f < sizeof(sources) / sizeof(sources[0]); f++) {
+            const int format = sources[f];
+            const int srcStride = (format == V4L2_PIX_FMT_YUYV) ? width : pitch;
+
+            setColorKernelIsa(COLOR_KERNEL_ISA_C);
+            setColorConvertParallelism(1, 0);
+            memset(linear, 0x5a, bytes);
+            colorConvertToNV12Surface(format, srcStride, rows, width, height, src,
+                                      SURFACE_LINEAR, pitch, rows, linear);
+            // the packed frame the encoder should see
+            memset(reference, 0x5a, bytes);
+            colorConvertFromNV12Surface(SURFACE_LINEAR, pitch, rows, width, height, linear, reference);
+
+            for (int isa = COLOR_KERNEL_ISA_C; isa <= maxIsa; isa++) {
+                for (unsigned int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+                    setColorKernelIsa((ColorKernelIsa) isa);
+                    setColorConvertParallelism(threads[t], 0);
+                    memset(dst, 0x5a, BUFFER_BYTES / 2);
+                    colorConvertToNV12Surface(format, srcStride, rows, width, height, src,
+                                              SURFACE_Y_TILED, pitch, rows, dst);
+                    runs++;
+
+                    bool placed = true;
+                    for (int y = 0; y < height && placed; y++) {
+                        for (int x = 0; x < (width & ~1) && placed; x++) {
+                            placed = dst[yTiledOffset(pitch, x, y)] == linear[y * pitch + x];
+                            if (y < (height + 1) / 2)
+                                placed = placed && dst[pitch * rows + yTiledOffset(pitch, x, y)] ==
+                                                   linear[pitch * rows + y * pitch + x];
+                        }
+                    }
+
+                    unsigned char *packed = dst + BUFFER_BYTES / 2;
+                    memset(packed, 0x5a, bytes);
+                    colorConvertFromNV12Surface(SURFACE_Y_TILED, pitch, rows, width, height, dst, packed);
+                    if (!placed || memcmp(reference, packed, bytes) != 0) {
+                        printf("FAIL Y-tiled NV12 surface from 0x%x %dx%d: %s kernels, %d threads, %s\n",
+                               format, width, height, getColorKernels().name, threads[t],
+                               placed ? "readback" : "layout");
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    free(linear);
+    printf("Y-tiling      %6d runs, %d failures\n", runs, failures);
+    return failures;
+}
+
+// ----------------------------------------------------------------------------
+// Benchmark
+// ----------------------------------------------------------------------------
+
+static void benchmark(const char *filter, const char *sizeFilter, double minSeconds,
+                      unsigned char *src, unsigned char *dst)
+{
+    const ColorKernels &kernels = getColorKernels();
+    printf("kernels %s, streaming loads %s\n\n", kernels.name, kernels.streamingLoads ? "yes" : "no");
+    printf("%-48s %-6s %10s %10s %9s\n", "conversion", "size", "ms/frame", "MP/s", "B/cycle");
+
+    fillRandom(src, BUFFER_BYTES, 1);
+    memset(dst, 0, BUFFER_BYTES);
+    for (unsigned int i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++) {
+        const BenchCase &c = sCases[i];
+        if (!matchesFilter(c, filter) || caseIsSkipped(c))
+            continue;
+
+        for (unsigned int s = 0; s < sizeof(sBenchSizes) / sizeof(sBenchSizes[0]); s++) {
+            const FrameSize &size = sBenchSizes[s];
+            if (sizeFilter != NULL && strcmp(sizeFilter, size.name) != 0)
+                continue;
+
+            // warm up the caches, the pool and the page tables
+            if (!runCase(c, size.width, size.height, src, dst)) {
+                printf("%-48s %-6s %10s\n", c.name, size.name, "n/a");
+                continue;
+            }
+
+            int loops = 0;
+            const long long start = nowNs();
+            const unsigned long long startCycles = nowCycles();
+            long long elapsed = 0;
+            do {
+                runCase(c, size.width, size.height, src, dst);
+                loops++;
+                elapsed = nowNs() - start;
+            } while (loops < 3 || elapsed < minSeconds * 1e9);
+            const unsigned long long cycles = nowCycles() - startCycles;
+
+            const double frameMs = elapsed / 1e6 / loops;
+            const double megapixels = (double) size.width * size.height / 1e6;
+            const double bytes = (double) caseBytes(c, size.width, size.height) * loops;
+            printf("%-48s %-6s %10.3f %10.1f %9.2f\n", c.name, size.name, frameMs,
+                   megapixels / (frameMs / 1e3), cycles ? bytes / cycles : 0.0);
+        }
+    }
+}
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [-c | -b] [-i isa] [-t threads] [-f filter] [-s size] [-m seconds]\n"
+           "  -c          check only\n"
+           "  -b          benchmark only\n"
+           "  -i isa      highest kernel level: 0 C, 1 SSE2, 2 SSSE3, 3 SSE4.1, 4 AVX2\n"
+           "  -t threads  conversion threads of the benchmark, 0 for one per CPU (default 1)\n"
+           "  -f filter   only the conversions whose name contains 'filter'\n"
+           "  -s size     only one of QVGA, VGA, 720p, 1080p, 5MP\n"
+           "  -m seconds  minimum time per benchmark (default 0.2)\n", argv0);
+}
+
+}; // namespace android
+
+using namespace android;
+
+int main(int argc, char **argv)
+{
+    bool check = true;
+    bool bench = true;
+    int isa = COLOR_KERNEL_ISA_MAX;
+    int threads = 1;
+    const char *filter = NULL;
+    const char *sizeFilter = NULL;
+    double minSeconds = 0.2;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "cbi:t:f:s:m:h")) != -1) {
+        switch (opt) {
+        case 'c': bench = false; break;
+        case 'b': check = false; break;
+        case 'i': isa = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 's': sizeFilter = optarg; break;
+        case 'm': minSeconds = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    const ColorKernelIsa maxIsa = setColorKernelIsa((ColorKernelIsa) isa);
+    unsigned char *src = allocBuffer(BUFFER_BYTES);
+    unsigned char *dst = allocBuffer(BUFFER_BYTES);
+    int failures = 0;
+
+    if (check) {
+        unsigned char *reference = allocBuffer(BUFFER_BYTES);
+        failures += checkKernels(maxIsa);
+        failures += checkConversions(maxIsa, filter, src, reference, dst);
+        failures += checkTiling(maxIsa, src, reference, dst);
+        free(reference);
+        printf("%s\n\n", failures ? "CHECK FAILED" : "check passed");
+    }
+
+    if (bench) {
+        setColorKernelIsa(maxIsa);
+        setColorReadbackEnabled(true);
+        setColorConvertParallelism(threads, 0);
+        benchmark(filter, sizeFilter, minSeconds, src, dst);
+    }
+
+    free(dst);
+    free(src);
+    return failures ? 1 : 0;
+}
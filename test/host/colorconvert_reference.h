@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The frozen C converters colorconvert_bench checks against, see colorconvert_reference.cpp
+
+#ifndef HOST_COLORCONVERT_REFERENCE_H
+#define HOST_COLORCONVERT_REFERENCE_H
+
+#include <utils/Errors.h>
+
+namespace android {
+namespace reference {
+
+status_t colorConvert(int srcFormat, int dstFormat, int width, int height, void *src, void *dst);
+status_t colorConvertwithStride(int srcFormat, int dstFormat, int stride,int width, int alignHeight, int height, void *src, void *dst);
+void RepaddingYV12(int width, int height, int srcStride, int dstStride,int alignheight, void *src, void *dst,int dstAlignTo16 = 1);
+int copyBufWithStride(void *dst, void *src, int width, int height, int srcstride,int dststride,int alignheight,int srcFormat);
+void copyYUYV_withStride(int stride, int width, int height, void *src, void *dst);
+
+void YUYVToNV21(int width, int height, void *src, void *dst);
+void YUYVToNV12(int width, int height, void *src, void *dst);
+void YUYVToNV12_withStride(int width, int height, void *src, void *dst);
+void YUYVToRGB8888(int width, int height, void *src, void *dst);
+void YUYVToRGB565(int width, int height, void *src, void *dst);
+void NV12ToRGB565(int width, int height, void *src, void *dst);
+void NV12ToRGB565withStride(int width, int height, int stride, int alignheight, void *src, void *dst);
+void NV12ToP411(int width, int height, void *src, void *dst);
+void YV12ToNV12(int width, int height, void *src, void *dst);
+void YU16ToYUYV(int width, int height, void *src, void *dst);
+void YU16ToYV12(int width, int height, void *src, void *dst);
+void YU16ToNV12(int width, int height, void *src, void *dst);
+void YU16ToNV21(int width, int height, void *src, void *dst);
+
+}; // namespace reference
+}; // namespace android
+
+#endif // HOST_COLORCONVERT_REFERENCE_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+Host check of the EXIF template of JpegEncoder, see the Makefile next to
+this file.
+
+makeExif() builds its template from the first shot, and only patches the
+fields of the shot into it for the next ones. Every EXIF made from a
+template patched for another shot must be the very EXIF a new JpegEncoder,
+which builds the template from that shot, makes: with GPS on and off, with
+and without the exposure tags, with and without a thumbnail, and with the
+thumbnail of the template's shot different. A field outside the shot has
+to rebuild the template.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "JpegEncoder.h"
+
+namespace android {
+
+static const unsigned int EXIF_BYTES = 64 * 1024;
+static const unsigned int THUMB_BYTES = 3000;
+
+struct Variant {
+    bool gps;
+    bool exposure;      // the exposure time and shutter speed tags
+    bool thumbnail;
+};
+
+static void setString(unsigned char *field, size_t size, const char *value)
+{
+    size_t len = strlen(value);
+    if (len > size - 1)
+        len = size - 1;
+    memset(field, 0, size);
+    memcpy(field, value, len);
+    field[len] = 0;
+}
+
+static void setRational(rational_t *r, uint32_t num, uint32_t den)
+{
+    r->num = num;
+    r->den = den;
+}
+
+// the fields that are the same for every shot of a session
+static void fillSession(const Variant &v, exif_attribute_t *exif)
+{
+    memset(exif, 0, sizeof(*exif));
+    exif->enableGps = v.gps;
+    exif->enableThumb = v.thumbnail;
+    setString(exif->image_description, sizeof(exif->image_description), "Jaguar");
+    memcpy(exif->flashpix_version, "0100", 4);
+    exif->components_configuration[0] = 1;
+    exif->components_configuration[1] = 2;
+    exif->components_configuration[2] = 3;
+    setString(exif->maker, sizeof(exif->maker), "Intel");
+    setString(exif->model, sizeof(exif->model), "USB camera");
+    setString(exif->software, sizeof(exif->software), "libcamera host check");
+    memcpy(exif->exif_version, "0220", 4);
+    setString(exif->user_comment, sizeof(exif->user_comment), "a comment");
+    exif->width = 2592;
+    exif->height = 1944;
+    exif->widthThumb = 320;
+    exif->heightThumb = 240;
+    exif->ycbcr_positioning = 1;
+    exif->exposure_program = 2;
+    exif->metering_mode = 2;
+    exif->flash = 0;
+    exif->color_space = 1;
+    exif->exposure_mode = 0;
+    exif->white_balance = 0;
+    exif->scene_capture_type = 0;
+    exif->light_source = 0;
+    exif->gain_control = 0;
+    exif->sharpness = 0;
+    setRational(&exif->fnumber, 28, 10);
+    setRational(&exif->max_aperture, 297, 100);
+    setRational(&exif->focal_length, 350, 100);
+    setRational(&exif->subject_distance, 0, 1);
+    // exposure tags are left out when their denominators are 0
+    exif->exposure_time.den = v.exposure ? 1 : 0;
+    exif->shutter_speed.den = v.exposure ? 1 : 0;
+    exif->gps_version_id[0] = 2;
+    exif->gps_version_id[1] = 2;
+    setString(exif->gps_processing_method, sizeof(exif->gps_processing_method), "GPS");
+    setRational(&exif->x_resolution, 72, 1);
+    setRational(&exif->y_resolution, 72, 1);
+    exif->resolution_unit = 2;
+    exif->compression_scheme = 6;
+}
+
+// the fields of shot 'n', all different from those of another shot
+static void fillShot(int n, exif_attribute_t *exif)
+{
+    char date[20];
+    snprintf(date, sizeof(date), "2012:0%d:1%d 1%d:2%d:3%d", n % 9 + 1, n % 10, n % 10, n % 10, n % 10);
+    setString(exif->date_time, sizeof(exif->date_time), date);
+    exif->orientation = (n % 2) ? 6 : 1;
+    exif->iso_speed_rating = 100 + 50 * n;
+    if (exif->exposure_time.den)
+        setRational(&exif->exposure_time, 1, 30 + n);
+    if (exif->shutter_speed.den) {
+        exif->shutter_speed.num = 490 + n;
+        exif->shutter_speed.den = 100;
+    }
+    setRational(&exif->aperture, 297 + n, 100);
+    exif->brightness.num = -120 - n;
+    exif->brightness.den = 100;
+    exif->exposure_bias.num = n - 2;
+    exif->exposure_bias.den = 3;
+    setString(exif->gps_latitude_ref, sizeof(exif->gps_latitude_ref), (n % 2) ? "S" : "N");
+    setString(exif->gps_longitude_ref, sizeof(exif->gps_longitude_ref), (n % 2) ? "W" : "E");
+    exif->gps_altitude_ref = n % 2;
+    for (int i = 0; i < 3; i++) {
+        setRational(&exif->gps_latitude[i], 31 + n + i, 1);
+        setRational(&exif->gps_longitude[i], 121 + n + i, 1);
+        setRational(&exif->gps_timestamp[i], 10 + n + i, 1);
+    }
+    setRational(&exif->gps_altitude, 1500 + n, 100);
+    snprintf((char *) exif->gps_datestamp, sizeof(exif->gps_datestamp), "2012:0%d:2%d", n % 9 + 1, n % 10);
+}
+
+// the EXIF of 'exif', with a thumbnail of 'thumb' if it has one
+static unsigned int makeExif(JpegEncoder &encoder, exif_attribute_t *exif, const unsigned char *thumb,
+                             unsigned char *out)
+{
+    unsigned int size = 0;
+    memset(out, 0, EXIF_BYTES);
+    encoder.setThumbData(exif->enableThumb ? thumb : NULL, exif->enableThumb ? THUMB_BYTES : 0);
+    if (encoder.makeExif(out, exif, &size) != JPG_SUCCESS)
+        return 0;
+    return size;
+}
+
+// the EXIF of 'exif' from the template of 'first', against one from its own template
+static bool checkPatched(const char *what, const Variant &v, exif_attribute_t *first, exif_attribute_t *exif,
+                         const unsigned char *thumb)
+{
+    JpegEncoder reused;
+    JpegEncoder fresh;
+    unsigned char *patched = new unsigned char[EXIF_BYTES];
+    unsigned char *built = new unsigned char[EXIF_BYTES];
+
+    const unsigned int firstSize = makeExif(reused, first, thumb, patched);
+    const unsigned int patchedSize = makeExif(reused, exif, thumb, patched);
+    const unsigned int builtSize = makeExif(fresh, exif, thumb, built);
+    unsigned int diff = 0;
+    while (diff < builtSize && diff < patchedSize && patched[diff] == built[diff])
+        diff++;
+    const bool ok = firstSize > 0 && builtSize > 0 && patchedSize == builtSize && diff == builtSize;
+
+    printf("%-4s GPS %-3s exposure %-3s thumbnail %-3s %-28s %4u bytes", ok ? "ok" : "FAIL",
+           v.gps ? "on" : "off", v.exposure ? "on" : "off", v.thumbnail ? "on" : "off", what, builtSize);
+    if (patchedSize != builtSize)
+        printf(", %u from the template", patchedSize);
+    else if (diff != builtSize)
+        printf(", differs at byte %u", diff);
+    printf("\n");
+
+    delete [] patched;
+    delete [] built;
+    return ok;
+}
+
+static int check()
+{
+    unsigned char thumb[THUMB_BYTES];
+    int failures = 0;
+
+    // a JPEG of sorts, so that a misplaced thumbnail shows
+    for (unsigned int i = 0; i < THUMB_BYTES; i++)
+        thumb[i] = (unsigned char) (i * 7 + 3);
+    thumb[0] = 0xFF;
+    thumb[1] = 0xD8;
+
+    for (int i = 0; i < 8; i++) {
+        const Variant v = { (i & 1) != 0, (i & 2) != 0, (i & 4) != 0 };
+        exif_attribute_t first, exif;
+
+        fillSession(v, &first);
+        fillShot(1, &first);
+        fillSession(v, &exif);
+        fillShot(2, &exif);
+        if (!checkPatched("another shot", v, &first, &exif, thumb))
+            failures++;
+
+        // the thumbnail isn't part of the template
+        first.enableThumb = !v.thumbnail;
+        if (!checkPatched("another shot and thumbnail", v, &first, &exif, thumb))
+            failures++;
+
+        // a field outside the shot rebuilds it
+        fillSession(v, &first);
+        fillShot(1, &first);
+        setString(first.model, sizeof(first.model), "another camera");
+        if (!checkPatched("another model", v, &first, &exif, thumb))
+            failures++;
+    }
+    printf("%s\n", failures ? "check FAILED" : "check passed");
+    return failures ? 1 : 0;
+}
+
+}; // namespace android
+
+int main(int argc, char **argv)
+{
+    return android::check();
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+Host benchmark of the per image setup of SWJpegEncoder, see the Makefile
+next to this file.
+
+Setup is everything from a new image to the first row it can take:
+creating the libjpeg compressor, its parameters and quantization tables,
+the destination manager and jpeg_start_compress(). It is timed for the
+persistent SWJpegEncoder, and for a compressor created and destroyed around
+every image with all the parameters set from scratch, which is how images
+were set up before. Both run with one quality, and with the thumbnail and
+picture qualities in turn, like a capture. A whole QVGA encode is timed
+too, to put the setup in proportion.
+
+Before timing, a run of images with changing qualities and speed profiles,
+flat and noisy, is encoded on one persistent encoder, and every JPEG must be byte-identical
+to the one a fresh encoder gives with the same settings.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SWJpegEncoder.h"
+
+namespace android {
+
+static const int SETUP_WIDTH = 2592;
+static const int SETUP_HEIGHT = 1944;
+static const int OUT_BYTES = 1024 * 1024;
+static const int CHECK_WIDTH = 320;
+static const int CHECK_HEIGHT = 240;
+
+static long long nowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// destination manager that only counts, for the scratch setup
+static void initDestination(j_compress_ptr cInfo) {}
+static boolean emptyOutputBuffer(j_compress_ptr cInfo) { return TRUE; }
+static void termDestination(j_compress_ptr cInfo) {}
+
+// one image set up from scratch, the way configEncoding() used to
+static void scratchSetup(int quality, unsigned char *out)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_destination_mgr *dest;
+
+    memset(&cinfo, 0, sizeof(cinfo));
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    cinfo.image_width = SETUP_WIDTH;
+    cinfo.image_height = SETUP_HEIGHT;
+    dest = (struct jpeg_destination_mgr *)
+           (*cinfo.mem->alloc_small)((j_common_ptr) &cinfo, JPOOL_PERMANENT, sizeof(*dest));
+    dest->init_destination = initDestination;
+    dest->empty_output_buffer = emptyOutputBuffer;
+    dest->term_destination = termDestination;
+    dest->next_output_byte = out;
+    dest->free_in_buffer = OUT_BYTES;
+    cinfo.dest = dest;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.raw_data_in = TRUE;
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    cinfo.comp_info[1].h_samp_factor = 1;
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;
+    cinfo.comp_info[2].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_abort_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+}
+
+static void persistentSetup(SWJpegEncoder *encoder, int quality, unsigned char *out)
+{
+    encoder->init();
+    encoder->setJpegQuality(quality);
+    encoder->configEncoding(SETUP_WIDTH, SETUP_HEIGHT, out, OUT_BYTES);
+    encoder->deInit();
+}
+
+// microseconds per image of 'loops' setups, 'alternate' switching between qualities 50 and 80
+static double timeSetup(SWJpegEncoder *encoder, bool alternate, int loops, unsigned char *out)
+{
+    const long long start = nowNs();
+    for (int i = 0; i < loops; i++) {
+        const int quality = (alternate && (i & 1)) ? 50 : 80;
+        if (encoder != NULL)
+            persistentSetup(encoder, quality, out);
+        else
+            scratchSetup(quality, out);
+    }
+    return (nowNs() - start) / 1e3 / loops;
+}
+
+static double timeEncode(SWJpegEncoder *encoder, int loops, unsigned char *out)
+{
+    static const int width = 320;
+    static const int height = 240;
+    unsigned char *yv12 = new unsigned char[width * height * 3 / 2];
+    for (int i = 0; i < width * height * 3 / 2; i++)
+        yv12[i] = (unsigned char) (i * 7 + (i >> 8));
+
+    const long long start = nowNs();
+    for (int i = 0; i < loops; i++) {
+        encoder->init();
+        encoder->setJpegQuality(50);
+        encoder->configEncoding(width, height, out, OUT_BYTES);
+        encoder->doJpegEncoding(SWJpegEncoder::yv12Planes(yv12, width, height, false));
+        encoder->deInit();
+    }
+    delete [] yv12;
+    return (nowNs() - start) / 1e3 / loops;
+}
+
+// a smooth picture, or one of noise
+static void makePicture(unsigned char *yv12, bool noisy)
+{
+    unsigned int seed = 1;
+    for (int i = 0; i < CHECK_WIDTH * CHECK_HEIGHT * 3 / 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        yv12[i] = noisy ? (unsigned char) (seed >> 16) : (unsigned char) (64 + (i % CHECK_WIDTH) / 4);
+    }
+}
+
+// settings of one image of the output check
+struct CheckImage {
+    int quality;
+    JpegSpeed speed;
+    bool noisy;
+};
+
+// encodes one image, returns the bytes of the JPEG, -1 if it failed
+static int encodeImage(SWJpegEncoder *encoder, const CheckImage &image, const unsigned char *yv12,
+                       unsigned char *out)
+{
+    int size = -1;
+    encoder->init();
+    encoder->setJpegQuality(image.quality);
+    encoder->setJpegSpeed(image.speed);
+    if (encoder->configEncoding(CHECK_WIDTH, CHECK_HEIGHT, out, OUT_BYTES) == 0 &&
+        encoder->doJpegEncoding(SWJpegEncoder::yv12Planes(yv12, CHECK_WIDTH, CHECK_HEIGHT, false)) == 0)
+        encoder->getJpegSize(&size);
+    encoder->deInit();
+    return size;
+}
+
+// every image encoded on the persistent encoder must be the one of a fresh encoder
+static bool checkOutput()
+{
+    // optimized Huffman tables of a flat image must not code the noisy ones after it
+    static const CheckImage images[] = {
+        { 80, JPEG_SPEED_BALANCED, false }, { 50, JPEG_SPEED_BALANCED, true },
+        { 80, JPEG_SPEED_BALANCED, true }, { 95, JPEG_SPEED_BALANCED, false },
+        { 50, JPEG_SPEED_BALANCED, false }, { 95, JPEG_SPEED_BALANCED, true },
+        { 80, JPEG_SPEED_QUALITY, false }, { 80, JPEG_SPEED_BALANCED, true },
+        { 80, JPEG_SPEED_QUALITY, false }, { 80, JPEG_SPEED_FAST, true },
+        { 50, JPEG_SPEED_QUALITY, true }, { 50, JPEG_SPEED_QUALITY, false },
+        { 95, JPEG_SPEED_FAST, false },
+    };
+    unsigned char *pictures[2];
+    unsigned char *out = new unsigned char[OUT_BYTES];
+    unsigned char *fresh = new unsigned char[OUT_BYTES];
+    SWJpegEncoder persistent;
+    bool ok = true;
+
+    for (int i = 0; i < 2; i++) {
+        pictures[i] = new unsigned char[CHECK_WIDTH * CHECK_HEIGHT * 3 / 2];
+        makePicture(pictures[i], i == 1);
+    }
+    for (unsigned int i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+        const CheckImage &image = images[i];
+        SWJpegEncoder *encoder = new SWJpegEncoder();
+        const int size = encodeImage(&persistent, image, pictures[image.noisy], out);
+        const int freshSize = encodeImage(encoder, image, pictures[image.noisy], fresh);
+        delete encoder;
+        if (size <= 0 || size != freshSize || memcmp(out, fresh, size) != 0) {
+            printf("FAIL image %u, quality %d, %s, %s: %d bytes, %d from a fresh encoder\n",
+                   i, image.quality, SWJpegEncoder::jpegSpeedName(image.speed),
+                   image.noisy ? "noisy" : "flat", size, freshSize);
+            ok = false;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+        delete [] pictures[i];
+    delete [] fresh;
+    delete [] out;
+    printf("%-40s %10s\n\n", "persistent vs fresh output", ok ? "identical" : "DIFFERENT");
+    return ok;
+}
+
+}; // namespace android
+
+using namespace android;
+
+int main(int argc, char **argv)
+{
+    const int loops = (argc > 1) ? atoi(argv[1]) : 2000;
+    if (!checkOutput())
+        return 1;
+
+    unsigned char *out = new unsigned char[OUT_BYTES];
+    SWJpegEncoder encoder;
+
+    // warm up the allocator and the caches
+    timeSetup(NULL, true, loops / 10 + 1, out);
+    timeSetup(&encoder, true, loops / 10 + 1, out);
+
+    printf("%-40s %10s\n", "5MP setup", "us/image");
+    printf("%-40s %10.2f\n", "from scratch, one quality", timeSetup(NULL, false, loops, out));
+    printf("%-40s %10.2f\n", "from scratch, alternating qualities", timeSetup(NULL, true, loops, out));
+    printf("%-40s %10.2f\n", "persistent, one quality", timeSetup(&encoder, false, loops, out));
+    printf("%-40s %10.2f\n", "persistent, alternating qualities", timeSetup(&encoder, true, loops, out));
+    printf("%-40s %10.2f\n", "QVGA encode, persistent", timeEncode(&encoder, loops / 10 + 1, out));
+
+    delete [] out;
+    return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+Host check of the strip encoding of JpegCompressor, see the Makefile next
+to this file.
+
+Every picture is encoded in strips and as a single stream. The single
+stream is transcoded by libjpeg, coefficients as they are, with the
+restart interval of the strips, into the JPEG a single stream encode with
+that interval gives. The joined strips must then have:
+  - the restart interval of a strip, and RST markers numbered 0..7 over
+    and over, one between every two strips;
+  - the very entropy coded data of the transcoded stream;
+  - a libjpeg decode without a warning, to the pixels of the transcoded
+    stream.
+The heights leave a partial last strip, and a partial last MCU row, and
+the strips are enough for the RST numbers to wrap.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "JpegCompressor.h"
+
+extern "C" {
+#include "jpeglib.h"
+#include "jerror.h"
+}
+
+namespace android {
+
+static const int QUALITY = 85;
+
+struct Case {
+    int width;
+    int height;
+    int format;
+    int strips;
+};
+
+static const Case CASES[] = {
+    { 640, 480, V4L2_PIX_FMT_YUV420, 2 },
+    { 2048, 1544, V4L2_PIX_FMT_YUV420, 12 },
+    { 1280, 780, V4L2_PIX_FMT_YUV422P, 12 },
+    { 1000, 1000, V4L2_PIX_FMT_YUV422P, 16 },
+    { 1928, 1452, V4L2_PIX_FMT_YUV420, 16 },
+};
+
+struct Jpeg {
+    unsigned char *data;
+    int size;
+};
+
+// destination manager writing into a growing buffer
+struct GrowDest {
+    struct jpeg_destination_mgr pub;
+    unsigned char *buf;
+    int size;
+};
+
+static void initDestination(j_compress_ptr cInfo)
+{
+    GrowDest *dest = (GrowDest *) cInfo->dest;
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+}
+
+static boolean emptyOutputBuffer(j_compress_ptr cInfo)
+{
+    GrowDest *dest = (GrowDest *) cInfo->dest;
+    unsigned char *buf = (unsigned char *) malloc(dest->size * 2);
+    memcpy(buf, dest->buf, dest->size);
+    free(dest->buf);
+    dest->pub.next_output_byte = buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+    dest->buf = buf;
+    dest->size *= 2;
+    return TRUE;
+}
+
+static void termDestination(j_compress_ptr cInfo) {}
+
+// source manager reading a JPEG in memory
+static void initSource(j_decompress_ptr dInfo) {}
+
+static boolean fillInputBuffer(j_decompress_ptr dInfo)
+{
+    // past the end: an EOI, libjpeg warns about the premature end
+    static const JOCTET eoi[2] = { 0xFF, 0xD9 };
+    WARNMS(dInfo, JWRN_JPEG_EOF);
+    dInfo->src->next_input_byte = eoi;
+    dInfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void skipInputData(j_decompress_ptr dInfo, long bytes)
+{
+    if (bytes > (long) dInfo->src->bytes_in_buffer)
+        bytes = dInfo->src->bytes_in_buffer;
+    dInfo->src->next_input_byte += bytes;
+    dInfo->src->bytes_in_buffer -= bytes;
+}
+
+static void termSource(j_decompress_ptr dInfo) {}
+
+static void memorySource(j_decompress_ptr dInfo, struct jpeg_source_mgr *src, const Jpeg &jpeg)
+{
+    src->init_source = initSource;
+    src->fill_input_buffer = fillInputBuffer;
+    src->skip_input_data = skipInputData;
+    src->resync_to_restart = jpeg_resync_to_restart;
+    src->term_source = termSource;
+    src->next_input_byte = jpeg.data;
+    src->bytes_in_buffer = jpeg.size;
+    dInfo->src = src;
+}
+
+// offset of the 'marker' segment before the scan, -1 if none
+static int findSegment(const Jpeg &jpeg, unsigned char marker)
+{
+    int pos = 2;
+    while (pos + 4 <= jpeg.size && jpeg.data[pos] == 0xFF) {
+        if (jpeg.data[pos + 1] == marker)
+            return pos;
+        if (jpeg.data[pos + 1] == 0xDA)
+            return -1;
+        pos += 2 + ((jpeg.data[pos + 2] << 8) | jpeg.data[pos + 3]);
+    }
+    return -1;
+}
+
+// where the entropy coded data starts, after the SOS segment, -1 if it doesn't
+static int scanStart(const Jpeg &jpeg)
+{
+    const int sos = findSegment(jpeg, 0xDA);
+    if (sos < 0)
+        return -1;
+    return sos + 2 + ((jpeg.data[sos + 2] << 8) | jpeg.data[sos + 3]);
+}
+
+// the restart interval of the DRI segment, 0 if none
+static int restartInterval(const Jpeg &jpeg)
+{
+    const int dri = findSegment(jpeg, 0xDD);
+    if (dri < 0)
+        return 0;
+    return (jpeg.data[dri + 4] << 8) | jpeg.data[dri + 5];
+}
+
+// the RST markers of the scan, -1 if one is out of sequence
+static int countRestarts(const Jpeg &jpeg)
+{
+    int count = 0;
+    for (int pos = scanStart(jpeg); pos + 1 < jpeg.size; pos++) {
+        if (jpeg.data[pos] != 0xFF || jpeg.data[pos + 1] < 0xD0 || jpeg.data[pos + 1] > 0xD7)
+            continue;
+        if (jpeg.data[pos + 1] != 0xD0 + count % 8)
+            return -1;
+        count++;
+    }
+    return count;
+}
+
+// 'jpeg' as a single stream with a restart every 'interval' MCUs, its coefficients as they are
+static Jpeg transcode(const Jpeg &jpeg, int interval)
+{
+    struct jpeg_decompress_struct dInfo;
+    struct jpeg_compress_struct cInfo;
+    struct jpeg_error_mgr dErr, cErr;
+    struct jpeg_source_mgr src;
+    GrowDest dest;
+
+    dInfo.err = jpeg_std_error(&dErr);
+    jpeg_create_decompress(&dInfo);
+    memorySource(&dInfo, &src, jpeg);
+    jpeg_read_header(&dInfo, TRUE);
+    jvirt_barray_ptr *coefs = jpeg_read_coefficients(&dInfo);
+
+    cInfo.err = jpeg_std_error(&cErr);
+    jpeg_create_compress(&cInfo);
+    dest.pub.init_destination = initDestination;
+    dest.pub.empty_output_buffer = emptyOutputBuffer;
+    dest.pub.term_destination = termDestination;
+    dest.size = jpeg.size + 64 * 1024;
+    dest.buf = (unsigned char *) malloc(dest.size);
+    cInfo.dest = &dest.pub;
+    jpeg_copy_critical_parameters(&dInfo, &cInfo);
+    cInfo.optimize_coding = FALSE;
+    cInfo.restart_interval = interval;
+    jpeg_write_coefficients(&cInfo, coefs);
+    jpeg_finish_compress(&cInfo);
+    jpeg_finish_decompress(&dInfo);
+
+    Jpeg out;
+    out.data = dest.buf;
+    out.size = dest.size - dest.pub.free_in_buffer;
+    jpeg_destroy_compress(&cInfo);
+    jpeg_destroy_decompress(&dInfo);
+    return out;
+}
+
+// decodes 'jpeg' to YCbCr pixels, returns their bytes, 0 if libjpeg warned
+static int decode(const Jpeg &jpeg, unsigned char **pixels)
+{
+    struct jpeg_decompress_struct dInfo;
+    struct jpeg_error_mgr jErr;
+    struct jpeg_source_mgr src;
+
+    dInfo.err = jpeg_std_error(&jErr);
+    jpeg_create_decompress(&dInfo);
+    memorySource(&dInfo, &src, jpeg);
+    jpeg_read_header(&dInfo, TRUE);
+    dInfo.out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(&dInfo);
+    const int rowBytes = dInfo.output_width * dInfo.output_components;
+    const int bytes = rowBytes * dInfo.output_height;
+    *pixels = new unsigned char[bytes];
+    while (dInfo.output_scanline < dInfo.output_height) {
+        JSAMPROW row = *pixels + dInfo.output_scanline * rowBytes;
+        jpeg_read_scanlines(&dInfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dInfo);
+    const long warnings = jErr.num_warnings;
+    jpeg_destroy_decompress(&dInfo);
+    return warnings ? 0 : bytes;
+}
+
+// a test pattern, with some noise for the entropy coder, in a buffer with a stride and rows to spare
+static unsigned char *makePicture(const Case &c, JpegCompressor::InputBuffer *in)
+{
+    in->clear();
+    in->width = c.width;
+    in->height = c.height;
+    in->format = c.format;
+    in->stride = c.width + 64;
+    in->alignHeight = (c.height + 31) / 32 * 32;
+    // a 4:2:2 planar buffer has chroma planes as big as the luma plane
+    in->size = in->stride * in->alignHeight * 3;
+    in->buf = new unsigned char[in->size];
+    unsigned int seed = c.width * 31 + c.height;
+    for (int i = 0; i < in->size; i++) {
+        const int x = i % in->stride;
+        const int y = i / in->stride;
+        seed = seed * 1103515245 + 12345;
+        in->buf[i] = (unsigned char) ((x * 3 + y * 2 + (x * y >> 7)) + ((seed >> 16) & 15));
+    }
+    return in->buf;
+}
+
+// encodes 'in' into a new buffer, in 'strips' strips
+static Jpeg encode(JpegCompressor &compressor, const JpegCompressor::InputBuffer &in, int strips)
+{
+    JpegCompressor::OutputBuffer out;
+    out.clear();
+    out.width = in.width;
+    out.height = in.height;
+    out.quality = QUALITY;
+    out.size = in.width * in.height * 2 + 64 * 1024;
+    out.buf = (unsigned char *) malloc(out.size);
+
+    compressor.setStrips(strips);
+    Jpeg jpeg;
+    jpeg.data = out.buf;
+    jpeg.size = compressor.encode(in, out);
+    return jpeg;
+}
+
+static bool checkCase(const Case &c)
+{
+    JpegCompressor compressor;
+    JpegCompressor::InputBuffer in;
+    unsigned char *picture = makePicture(c, &in);
+    const int mcuHeight = (c.format == V4L2_PIX_FMT_YUV420) ? 16 : 8;
+    const int mcusPerRow = (c.width + 15) / 16;
+    const int mcuRows = (c.height + mcuHeight - 1) / mcuHeight;
+    // the compressor doesn't make strips of less than 8 MCU rows
+    const int strips = (c.strips > mcuRows / 8) ? mcuRows / 8 : c.strips;
+    const int stripMcuRows = (mcuRows + strips - 1) / strips;
+    const int numStrips = (mcuRows + stripMcuRows - 1) / stripMcuRows;
+    bool ok = true;
+
+    Jpeg joined = encode(compressor, in, c.strips);
+    Jpeg single = encode(compressor, in, 1);
+    if (joined.size <= 0 || single.size <= 0) {
+        printf("FAIL %4dx%-4d encode failed\n", c.width, c.height);
+        free(joined.data);
+        free(single.data);
+        delete [] picture;
+        return false;
+    }
+
+    const int interval = restartInterval(joined);
+    const int restarts = countRestarts(joined);
+    Jpeg reference = transcode(single, interval);
+
+    // same entropy coded data, from the scan to the EOI
+    const int joinedScan = scanStart(joined);
+    const int referenceScan = scanStart(reference);
+    const bool sameScan = joinedScan > 0 && referenceScan > 0 &&
+                          joined.size - joinedScan == reference.size - referenceScan &&
+                          memcmp(joined.data + joinedScan, reference.data + referenceScan,
+                                 joined.size - joinedScan) == 0;
+
+    unsigned char *joinedPixels = NULL;
+    unsigned char *referencePixels = NULL;
+    const int joinedBytes = decode(joined, &joinedPixels);
+    const int referenceBytes = decode(reference, &referencePixels);
+    const bool samePixels = joinedBytes > 0 && joinedBytes == referenceBytes &&
+                            memcmp(joinedPixels, referencePixels, joinedBytes) == 0;
+
+    if (interval != stripMcuRows * mcusPerRow || restarts != numStrips - 1 || !sameScan || !samePixels)
+        ok = false;
+    printf("%-4s %4dx%-4d %s %2d strips of %2d MCU rows, the last of %d: restart %d MCUs, %d RST%s%s%s\n",
+           ok ? "ok" : "FAIL", c.width, c.height, c.format == V4L2_PIX_FMT_YUV420 ? "4:2:0" : "4:2:2",
+           numStrips, stripMcuRows, mcuRows - (numStrips - 1) * stripMcuRows, interval, restarts,
+           sameScan ? "" : ", scan differs", joinedBytes ? "" : ", decoded with warnings",
+           samePixels || !joinedBytes ? "" : ", pixels differ");
+
+    delete [] joinedPixels;
+    delete [] referencePixels;
+    free(joined.data);
+    free(single.data);
+    free(reference.data);
+    delete [] picture;
+    return ok;
+}
+
+static int check()
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+        if (!checkCase(CASES[i]))
+            failures++;
+    printf("%s\n", failures ? "check FAILED" : "check passed");
+    return failures ? 1 : 0;
+}
+
+}; // namespace android
+
+int main(int argc, char **argv)
+{
+    return android::check();
+}
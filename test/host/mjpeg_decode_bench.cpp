@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+Host check and benchmark of SWJpegDecoder, see the Makefile next to this
+file.
+
+Frames are made like a UVC camera makes them: libjpeg encodes a test
+pattern as 4:2:2 or 4:2:0, with or without restart markers, and its DHT
+segment is taken out. The check decodes every frame in strips, on
+CHECK_THREADS threads however many CPUs there are, and on the calling
+thread alone, into a YUV422H buffer with a stride and rows to spare, and
+compares the two: the
+strips must give the very bytes the single stream does, and leave the
+bytes past the picture alone. The benchmark times both.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SWJpegDecoder.h"
+
+namespace android {
+
+static const int STRIDE_PAD = 64;
+static const int ROWS_PAD = 16;
+static const unsigned char GUARD = 0xA5;
+static const int CHECK_THREADS = 4;
+
+static long long nowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+struct Frame {
+    unsigned char *data;
+    int size;
+};
+
+// destination manager writing into a growing buffer
+struct FrameDest {
+    struct jpeg_destination_mgr pub;
+    unsigned char *buf;
+    int size;
+};
+
+static void initDestination(j_compress_ptr cInfo)
+{
+    FrameDest *dest = (FrameDest *) cInfo->dest;
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+}
+
+static boolean emptyOutputBuffer(j_compress_ptr cInfo)
+{
+    FrameDest *dest = (FrameDest *) cInfo->dest;
+    unsigned char *buf = (unsigned char *) malloc(dest->size * 2);
+    memcpy(buf, dest->buf, dest->size);
+    free(dest->buf);
+    dest->pub.next_output_byte = buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+    dest->buf = buf;
+    dest->size *= 2;
+    return TRUE;
+}
+
+static void termDestination(j_compress_ptr cInfo) {}
+
+// the DHT segments of 'frame' taken out, as MJPEG frames come
+static void stripDht(Frame *frame)
+{
+    int pos = 2;
+    while (pos + 4 <= frame->size && frame->data[pos] == 0xFF && frame->data[pos + 1] != 0xDA) {
+        const int bytes = 2 + ((frame->data[pos + 2] << 8) | frame->data[pos + 3]);
+        if (frame->data[pos + 1] == 0xC4) {
+            memmove(frame->data + pos, frame->data + pos + bytes, frame->size - pos - bytes);
+            frame->size -= bytes;
+        } else {
+            pos += bytes;
+        }
+    }
+}
+
+// a test pattern encoded like a camera would, 'restartRows' MCU rows or 'restartMcus' MCUs per interval
+static Frame encodeFrame(int width, int height, bool yuv420, int restartRows, int restartMcus)
+{
+    struct jpeg_compress_struct cInfo;
+    struct jpeg_error_mgr jErr;
+    FrameDest dest;
+    const int mcuHeight = yuv420 ? 16 : 8;
+    const int chromaWidth = width / 2;
+
+    cInfo.err = jpeg_std_error(&jErr);
+    jpeg_create_compress(&cInfo);
+    dest.pub.init_destination = initDestination;
+    dest.pub.empty_output_buffer = emptyOutputBuffer;
+    dest.pub.term_destination = termDestination;
+    dest.size = 64 * 1024;
+    dest.buf = (unsigned char *) malloc(dest.size);
+    cInfo.dest = &dest.pub;
+    cInfo.image_width = width;
+    cInfo.image_height = height;
+    cInfo.input_components = 3;
+    cInfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cInfo);
+    jpeg_set_quality(&cInfo, 85, TRUE);
+    cInfo.raw_data_in = TRUE;
+    cInfo.comp_info[0].h_samp_factor = 2;
+    cInfo.comp_info[0].v_samp_factor = yuv420 ? 2 : 1;
+    cInfo.comp_info[1].h_samp_factor = cInfo.comp_info[1].v_samp_factor = 1;
+    cInfo.comp_info[2].h_samp_factor = cInfo.comp_info[2].v_samp_factor = 1;
+    cInfo.restart_in_rows = restartRows;
+    cInfo.restart_interval = restartMcus;
+    jpeg_start_compress(&cInfo, TRUE);
+
+    unsigned char *rowBuf = new unsigned char[mcuHeight * width * 2];
+    JSAMPROW rows[3][16];
+    JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+    for (int i = 0; i < mcuHeight; i++)
+        rows[0][i] = rowBuf + i * width;
+    for (int i = 0; i < 8; i++) {
+        rows[1][i] = rowBuf + mcuHeight * width + i * chromaWidth;
+        rows[2][i] = rowBuf + mcuHeight * width + (8 + i) * chromaWidth;
+    }
+    unsigned int seed = width * 31 + height;
+    while (cInfo.next_scanline < cInfo.image_height) {
+        const int y0 = cInfo.next_scanline;
+        for (int i = 0; i < mcuHeight; i++)
+            for (int x = 0; x < width; x++) {
+                seed = seed * 1103515245 + 12345;
+                rows[0][i][x] = (unsigned char) ((x + y0 + i) * 3 + ((seed >> 16) & 15));
+            }
+        for (int i = 0; i < 8; i++)
+            for (int x = 0; x < chromaWidth; x++) {
+                rows[1][i][x] = (unsigned char) (128 + ((x * 5 + y0) & 63) - 32);
+                rows[2][i][x] = (unsigned char) (128 + ((y0 + i * 7 - x) & 63) - 32);
+            }
+        jpeg_write_raw_data(&cInfo, planes, mcuHeight);
+    }
+    jpeg_finish_compress(&cInfo);
+    delete [] rowBuf;
+
+    Frame frame;
+    frame.data = dest.buf;
+    frame.size = dest.size - dest.pub.free_in_buffer;
+    jpeg_destroy_compress(&cInfo);
+    stripDht(&frame);
+    return frame;
+}
+
+struct Case {
+    int width;
+    int height;
+    bool yuv420;
+    int restartRows;
+    int restartMcus;
+};
+
+static const Case CASES[] = {
+    { 640, 480, false, 0, 0 },
+    { 640, 480, false, 1, 0 },
+    { 640, 480, true, 1, 0 },
+    { 1280, 720, false, 1, 0 },
+    { 1280, 720, false, 0, 7 },
+    { 1280, 720, false, 2, 0 },
+    { 1920, 1080, false, 1, 0 },
+    { 1920, 1080, true, 1, 0 },
+    { 1920, 1080, true, 0, 50 },
+    { 2592, 1944, false, 1, 0 },
+};
+
+static unsigned char *allocPlanes(const Case &c, SWJpegDecoder::OutputPlanes *planes)
+{
+    const int stride = c.width + STRIDE_PAD;
+    const int rows = c.height + ROWS_PAD;
+    unsigned char *buf = new unsigned char[stride * rows * 3];
+    memset(buf, GUARD, stride * rows * 3);
+    *planes = SWJpegDecoder::yuv422hPlanes(buf, stride, rows, c.width, c.height);
+    return buf;
+}
+
+// whether the bytes of the planes past the picture, its width and the aligned rows, are untouched
+static bool guardsIntact(const unsigned char *buf, const SWJpegDecoder::OutputPlanes &planes, int mcuHeight)
+{
+    const int paddedRows = (planes.height + mcuHeight - 1) / mcuHeight * mcuHeight;
+    for (int p = 0; p < 3; p++) {
+        const int width = (p == 0) ? planes.width : planes.width / 2;
+        const int paddedWidth = (p == 0) ? (planes.width + 15) / 16 * 16 : (planes.width + 15) / 16 * 8;
+        for (int r = 0; r < planes.rows; r++) {
+            const unsigned char *row = buf + (p * planes.rows + r) * planes.stride;
+            const int from = (r < paddedRows) ? (paddedWidth > width ? paddedWidth : width) : 0;
+            for (int x = from; x < planes.stride; x++)
+                if (row[x] != GUARD)
+                    return false;
+        }
+    }
+    return true;
+}
+
+static int check()
+{
+    SWJpegDecoder parallel;
+    SWJpegDecoder serial;
+    int failures = 0;
+
+    parallel.setThreads(CHECK_THREADS);
+    serial.setThreads(1);
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        const Case &c = CASES[i];
+        Frame frame = encodeFrame(c.width, c.height, c.yuv420, c.restartRows, c.restartMcus);
+        SWJpegDecoder::OutputPlanes outParallel, outSerial;
+        unsigned char *bufParallel = allocPlanes(c, &outParallel);
+        unsigned char *bufSerial = allocPlanes(c, &outSerial);
+        const int size = outSerial.stride * outSerial.rows * 3;
+
+        const int statusParallel = parallel.decode(frame.data, frame.size, outParallel);
+        const int strips = parallel.getStrips();
+        const int statusSerial = serial.decode(frame.data, frame.size, outSerial);
+        const bool same = memcmp(bufParallel, bufSerial, size) == 0;
+        const bool guards = guardsIntact(bufParallel, outParallel, c.yuv420 ? 16 : 8);
+        const bool ok = statusParallel == 0 && statusSerial == 0 && same && guards;
+        printf("%-4s %4dx%-4d %s restart %d rows %2d MCUs: %3d intervals, %d strips%s%s\n",
+               ok ? "ok" : "FAIL", c.width, c.height, c.yuv420 ? "4:2:0" : "4:2:2",
+               c.restartRows, c.restartMcus, parallel.getIntervals(), strips,
+               same ? "" : ", differs", guards ? "" : ", wrote past the picture");
+        if (!ok)
+            failures++;
+
+        // a frame of another size is refused
+        SWJpegDecoder::OutputPlanes smaller = outSerial;
+        smaller.height -= 16;
+        if (parallel.decode(frame.data, frame.size, smaller) == 0) {
+            printf("FAIL %dx%d frame decoded as %dx%d\n", c.width, c.height, smaller.width, smaller.height);
+            failures++;
+        }
+
+        delete [] bufParallel;
+        delete [] bufSerial;
+        free(frame.data);
+    }
+    printf("%s\n", failures ? "check FAILED" : "check passed");
+    return failures ? 1 : 0;
+}
+
+static int bench()
+{
+    SWJpegDecoder parallel;
+    SWJpegDecoder serial;
+    const int frames = 30;
+
+    serial.setThreads(1);
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        const Case &c = CASES[i];
+        Frame frame = encodeFrame(c.width, c.height, c.yuv420, c.restartRows, c.restartMcus);
+        SWJpegDecoder::OutputPlanes out;
+        unsigned char *buf = allocPlanes(c, &out);
+        double ms[2];
+
+        for (int d = 0; d < 2; d++) {
+            SWJpegDecoder &decoder = d ? parallel : serial;
+            decoder.decode(frame.data, frame.size, out);
+            const long long start = nowNs();
+            for (int f = 0; f < frames; f++)
+                decoder.decode(frame.data, frame.size, out);
+            ms[d] = (nowNs() - start) / 1000000.0 / frames;
+        }
+        printf("%4dx%-4d %s restart %d rows %2d MCUs: %6.2fms serial, %6.2fms in %d strips (x%.2f)\n",
+               c.width, c.height, c.yuv420 ? "4:2:0" : "4:2:2", c.restartRows, c.restartMcus,
+               ms[0], ms[1], parallel.getStrips(), ms[0] / ms[1]);
+        delete [] buf;
+        free(frame.data);
+    }
+    return 0;
+}
+
+}; // namespace android
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "-b") == 0)
+        return android::bench();
+    return android::check();
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <camera/CameraParameters.h>, for test/host: the pixel format keys
+
+#ifndef HOST_SHIM_CAMERA_PARAMETERS_H
+#define HOST_SHIM_CAMERA_PARAMETERS_H
+
+namespace android {
+
+class CameraParameters {
+public:
+    static const char PIXEL_FORMAT_YUV422SP[];
+    static const char PIXEL_FORMAT_YUV420SP[];
+    static const char PIXEL_FORMAT_YUV422I[];
+    static const char PIXEL_FORMAT_YUV420P[];
+    static const char PIXEL_FORMAT_RGB565[];
+    static const char PIXEL_FORMAT_JPEG[];
+};
+
+}; // namespace android
+
+#endif // HOST_SHIM_CAMERA_PARAMETERS_H
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <cutils/atomic.h>, for test/host
+
+#ifndef HOST_SHIM_CUTILS_ATOMIC_H
+#define HOST_SHIM_CUTILS_ATOMIC_H
+
+#include <stdint.h>
+
+static inline void android_atomic_write(int32_t value, volatile int32_t *addr)
+{
+    __sync_synchronize();
+    *addr = value;
+    __sync_synchronize();
+}
+
+static inline int32_t android_atomic_inc(volatile int32_t *addr)
+{
+    return __sync_fetch_and_add(addr, 1);
+}
+
+static inline int32_t android_atomic_dec(volatile int32_t *addr)
+{
+    return __sync_fetch_and_sub(addr, 1);
+}
+
+#endif // HOST_SHIM_CUTILS_ATOMIC_H
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <cutils/properties.h>, for test/host: properties read from the
+// environment, with the dots of the key turned into underscores
+
+#ifndef HOST_SHIM_CUTILS_PROPERTIES_H
+#define HOST_SHIM_CUTILS_PROPERTIES_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PROPERTY_KEY_MAX    32
+#define PROPERTY_VALUE_MAX  92
+
+static inline int property_get(const char *key, char *value, const char *defaultValue)
+{
+    char name[PROPERTY_KEY_MAX];
+    strncpy(name, key, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    for (char *p = name; *p; p++) {
+        if (*p == '.')
+            *p = '_';
+    }
+
+    const char *found = getenv(name);
+    if (found == NULL)
+        found = defaultValue ? defaultValue : "";
+    strncpy(value, found, PROPERTY_VALUE_MAX - 1);
+    value[PROPERTY_VALUE_MAX - 1] = '\0';
+    return strlen(value);
+}
+
+#endif // HOST_SHIM_CUTILS_PROPERTIES_H
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <system/graphics.h>, for test/host: the formats the converters use
+
+#ifndef HOST_SHIM_SYSTEM_GRAPHICS_H
+#define HOST_SHIM_SYSTEM_GRAPHICS_H
+
+enum {
+    HAL_PIXEL_FORMAT_RGBA_8888      = 1,
+    HAL_PIXEL_FORMAT_RGB_565        = 4,
+    HAL_PIXEL_FORMAT_YV12           = 0x32315659,
+    HAL_PIXEL_FORMAT_YCbCr_422_SP   = 0x10,
+    HAL_PIXEL_FORMAT_YCrCb_420_SP   = 0x11,
+    HAL_PIXEL_FORMAT_YCbCr_422_I    = 0x14,
+};
+
+#endif // HOST_SHIM_SYSTEM_GRAPHICS_H
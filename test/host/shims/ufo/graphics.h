@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <ufo/graphics.h>, for test/host: the Intel formats the converters use
+
+#ifndef HOST_SHIM_UFO_GRAPHICS_H
+#define HOST_SHIM_UFO_GRAPHICS_H
+
+enum {
+    HAL_PIXEL_FORMAT_NV12_TILED_INTEL   = 0x100,
+    HAL_PIXEL_FORMAT_YCbCr_422_H_INTEL  = 0x102,
+};
+
+#endif // HOST_SHIM_UFO_GRAPHICS_H
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <utils/Log.h>, for test/host: errors go to stderr, the rest is dropped
+
+#ifndef HOST_SHIM_UTILS_LOG_H
+#define HOST_SHIM_UTILS_LOG_H
+
+#include <stdio.h>
+
+#define ALOGE(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#define ALOGW(...) ((void) 0)
+#define ALOGI(...) ((void) 0)
+#define ALOGD(...) ((void) 0)
+#define ALOGV(...) ((void) 0)
+#define ALOGD_IF(cond, ...) ((void) 0)
+
+// the pre-JB names, still used by some of the HAL
+#define LOGE ALOGE
+
+#endif // HOST_SHIM_UTILS_LOG_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <utils/RefBase.h>, for test/host: strong references only
+
+#ifndef HOST_SHIM_UTILS_REFBASE_H
+#define HOST_SHIM_UTILS_REFBASE_H
+
+#include <stddef.h>
+
+namespace android {
+
+class RefBase {
+public:
+    void incStrong(const void *) const { __sync_add_and_fetch(&mRefs, 1); }
+    void decStrong(const void *) const
+    {
+        if (__sync_sub_and_fetch(&mRefs, 1) == 0)
+            delete this;
+    }
+
+protected:
+    RefBase() : mRefs(0) {}
+    virtual ~RefBase() {}
+
+private:
+    mutable int mRefs;
+};
+
+template <typename T>
+class sp {
+public:
+    sp() : mPtr(NULL) {}
+    sp(T *other) : mPtr(other) { if (mPtr) mPtr->incStrong(this); }
+    sp(const sp<T> &other) : mPtr(other.mPtr) { if (mPtr) mPtr->incStrong(this); }
+    ~sp() { if (mPtr) mPtr->decStrong(this); }
+
+    sp &operator=(const sp<T> &other) { return *this = other.mPtr; }
+    sp &operator=(T *other)
+    {
+        if (other)
+            other->incStrong(this);
+        if (mPtr)
+            mPtr->decStrong(this);
+        mPtr = other;
+        return *this;
+    }
+
+    void clear() { *this = (T *) NULL; }
+    T *get() const { return mPtr; }
+    T *operator->() const { return mPtr; }
+    T &operator*() const { return *mPtr; }
+
+private:
+    T *mPtr;
+};
+
+}; // namespace android
+
+#endif // HOST_SHIM_UTILS_REFBASE_H
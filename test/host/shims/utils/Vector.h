@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <utils/Vector.h>, for test/host, over std::vector
+
+#ifndef HOST_SHIM_UTILS_VECTOR_H
+#define HOST_SHIM_UTILS_VECTOR_H
+
+#include <sys/types.h>
+#include <vector>
+
+namespace android {
+
+template <typename T>
+class Vector {
+public:
+    size_t size() const { return mItems.size(); }
+    bool isEmpty() const { return mItems.empty(); }
+    void clear() { mItems.clear(); }
+
+    ssize_t add(const T &item) { mItems.push_back(item); return mItems.size() - 1; }
+    ssize_t push(const T &item) { return add(item); }
+    ssize_t push_back(const T &item) { return add(item); }
+    ssize_t insertAt(const T &item, size_t index)
+    {
+        mItems.insert(mItems.begin() + index, item);
+        return index;
+    }
+    ssize_t removeAt(size_t index) { mItems.erase(mItems.begin() + index); return index; }
+
+    const T &operator[](size_t index) const { return mItems[index]; }
+    const T &itemAt(size_t index) const { return mItems[index]; }
+    T &editItemAt(size_t index) { return mItems[index]; }
+    const T &top() const { return mItems.back(); }
+    const T *array() const { return mItems.empty() ? NULL : &mItems[0]; }
+
+private:
+    std::vector<T> mItems;
+};
+
+}; // namespace android
+
+#endif // HOST_SHIM_UTILS_VECTOR_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim of <utils/threads.h>, for test/host: the parts the HAL uses, over pthreads
+
+#ifndef HOST_SHIM_UTILS_THREADS_H
+#define HOST_SHIM_UTILS_THREADS_H
+
+#include <pthread.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+class Condition;
+
+class Mutex {
+public:
+    Mutex() { pthread_mutex_init(&mMutex, NULL); }
+    explicit Mutex(const char *) { pthread_mutex_init(&mMutex, NULL); }
+    ~Mutex() { pthread_mutex_destroy(&mMutex); }
+
+    status_t lock() { return -pthread_mutex_lock(&mMutex); }
+    void unlock() { pthread_mutex_unlock(&mMutex); }
+    status_t tryLock() { return -pthread_mutex_trylock(&mMutex); }
+
+    class Autolock {
+    public:
+        explicit Autolock(Mutex &mutex) : mLock(mutex) { mLock.lock(); }
+        ~Autolock() { mLock.unlock(); }
+    private:
+        Mutex &mLock;
+    };
+
+private:
+    friend class Condition;
+    pthread_mutex_t mMutex;
+};
+
+class Condition {
+public:
+    Condition() { pthread_cond_init(&mCond, NULL); }
+    ~Condition() { pthread_cond_destroy(&mCond); }
+
+    status_t wait(Mutex &mutex) { return -pthread_cond_wait(&mCond, &mutex.mMutex); }
+    void signal() { pthread_cond_signal(&mCond); }
+    void broadcast() { pthread_cond_broadcast(&mCond); }
+
+private:
+    pthread_cond_t mCond;
+};
+
+class Thread : virtual public RefBase {
+public:
+    explicit Thread(bool = true) : mExitPending(false), mRunning(false) {}
+    virtual ~Thread() {}
+
+    virtual status_t run(const char * = NULL, int = 0, size_t = 0)
+    {
+        mExitPending = false;
+        mRunning = true;
+        return -pthread_create(&mThread, NULL, entry, this);
+    }
+    void requestExit() { mExitPending = true; }
+    status_t requestExitAndWait()
+    {
+        mExitPending = true;
+        if (mRunning) {
+            pthread_join(mThread, NULL);
+            mRunning = false;
+        }
+        return NO_ERROR;
+    }
+    bool exitPending() const { return mExitPending; }
+
+protected:
+    virtual status_t readyToRun() { return NO_ERROR; }
+
+private:
+    virtual bool threadLoop() = 0;
+
+    static void *entry(void *arg)
+    {
+        Thread *thread = (Thread *) arg;
+        if (thread->readyToRun() == NO_ERROR) {
+            while (!thread->mExitPending && thread->threadLoop())
+                ;
+        }
+        return NULL;
+    }
+
+    volatile bool mExitPending;
+    bool mRunning;
+    pthread_t mThread;
+};
+
+}; // namespace android
+
+#endif // HOST_SHIM_UTILS_THREADS_H